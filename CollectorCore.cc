@@ -0,0 +1,560 @@
+/**
+ *@file CollectorCore.cc
+ *@brief
+ */
+#include <assert.h>
+#include <iostream>
+#include <stdexcept>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "FrameRing.h"
+#include "OptoAcquirer.h"
+#include "StroberDevice.h"
+#include "FrameStage.h"
+#include "CollectorCore.h"
+
+namespace VML {
+
+    CollectorCore::CollectorCore(OptoDevice *d)
+        :device(d),
+        acquirer(0),
+        num_elements(0),
+        total_num_markers(0),
+        packer(0),
+        unported(false),
+        nonblocking(false),
+        scheduled(true),
+        set_up(false),
+        frame_number(-1),
+        nelements(0),
+        flags(0),
+        host_time(0),
+        last_processed(-1),
+        last_solved(-1),
+        last_held(-1),
+        startup_begin(0),
+        active(false),
+        num_valid(0),
+        hold_frames(0)
+    {
+        startup_times.initialize = 0;
+        startup_times.setup = 0;
+        startup_times.activate = 0;
+        startup_times.first_frame = 0;
+    }
+
+    CollectorCore::~CollectorCore()
+    {
+        delete acquirer;
+        delete packer;
+    }
+
+    int CollectorCore::add_markers(int n, int port, int sockets)
+    {
+        if(set_up) {
+            throw std::logic_error("Markers must be added before setup_collection.");
+        }
+        if(port > 0 ? unported : !strobers.empty()) {
+            throw std::logic_error("Markers on a port can't be mixed with markers added without one.");
+        }
+        int first = total_num_markers;
+        if(port > 0)
+            strobers.add(port, n, sockets);
+        else
+            unported = true;
+        num_elements += n;
+        total_num_markers += n;
+        return first+1;
+    }
+
+    int CollectorCore::add_rigid_body(const double *model, int n, int first_marker)
+    {
+        if(set_up) {
+            throw std::logic_error("Rigid bodies must be added before setup_collection.");
+        }
+        int first = first_marker > 0 ? first_marker-1 : total_num_markers;
+        if(first+n > total_num_markers && !strobers.empty()) {
+            throw std::logic_error("Add the rigid body's markers with add_markers() on their port first.");
+        }
+        int body = bodies.add_body(model, n, first);
+        num_elements += 1;
+        if(first+n > total_num_markers) {
+            total_num_markers = first+n;
+            unported = true;
+        }
+        return body;
+    }
+
+    void CollectorCore::initialize_device()
+    {
+        long long start = host_time_ns();
+        if(!startup_begin)
+            startup_begin = start;
+        if(device->initialize()) {
+            throw std::runtime_error("Optotrak initialization returns error.");
+        }
+        startup_times.initialize = host_time_ns()-start;
+    }
+
+    void CollectorCore::setup_collection()
+    {
+        if(set_up) {
+            throw std::logic_error("Setup_collection can be called only once.");
+        }
+        long long start = host_time_ns();
+        if(!startup_begin)
+            startup_begin = start;
+
+        apply_setup();
+        startup_times.setup = host_time_ns()-start;
+    }
+
+    void CollectorCore::apply_setup()
+    {
+        // The stages have been set up too, and keep what they've made.
+        const bool again = set_up;
+        if(!strobers.empty() && !packer) {
+            packer = new StroberDevice(device, strobers);
+            device = packer;
+        }
+
+        // Only grows; a smaller frame reuses what's there.
+        marker_data.resize(total_num_markers);
+        buffer_block.resize(BUFFER_BLOCK*total_num_markers);
+        valid_bits.resize(mask_words(total_num_markers));
+        num_valid = 0;
+        hold.setup(hold_frames ? total_num_markers : 0, hold_frames);
+        bodies.setup(total_num_markers);
+
+        params.num_markers = total_num_markers;
+        if(device->setup_collection(params)) {
+            throw std::runtime_error("OptotrakSetupCollection returns error.");
+        }
+        set_up = true;
+        applied = params;
+        scheduler.reset(1./params.frame_frequency, (params.flags & OPTOTRAK_GET_NEXT_FRAME_FLAG) != 0);
+        frame_number = -1;
+        last_processed = -1;
+        last_solved = -1;
+        last_held = -1;
+
+        for(size_t i=0; i<stages.size(); ++i) {
+            if(again)
+                stages[i]->reconfigure(params);
+            else
+                stages[i]->setup(params);
+        }
+    }
+
+    void CollectorCore::set_hold_over(int max_frames)
+    {
+        hold_frames = max_frames;
+        if(set_up)
+            hold.setup(hold_frames ? total_num_markers : 0, hold_frames);
+        last_held = -1;
+    }
+
+    void CollectorCore::validate(const CollectionParams &p) const
+    {
+        int n = p.num_markers ? p.num_markers : total_num_markers;
+        if(n <= 0) {
+            throw std::invalid_argument("A collection needs at least one marker.");
+        }
+        if(!strobers.empty() && n != total_num_markers) {
+            throw std::invalid_argument("With strobers on ports, the frame size comes from the strober table.");
+        }
+        if(n < bodies.get_min_frame_size() || num_elements+n-total_num_markers < bodies.get_num_bodies()) {
+            throw std::invalid_argument("The frame is too small for the rigid bodies.");
+        }
+        if(!(p.frame_frequency > 0.f) || !(p.marker_frequency > 0.f)) {
+            throw std::invalid_argument("Frame and marker frequencies must be positive.");
+        }
+        // Each marker, plus one slot, gets its turn within a frame.
+        if(p.frame_frequency*(n+1) > p.marker_frequency) {
+            throw std::invalid_argument("Marker frequency too low for the frame frequency and marker count.");
+        }
+        if(!(p.cycle > 0.f && p.cycle <= 1.f)) {
+            throw std::invalid_argument("Duty cycle must be in (0,1].");
+        }
+        if(!(p.voltage > 0.f) || p.threshold < 0 || p.gain < 0) {
+            throw std::invalid_argument("Voltage must be positive, threshold and gain not negative.");
+        }
+        if(!(p.collect_time >= 0.f) || !(p.trigger_time >= 0.f)) {
+            throw std::invalid_argument("Collection and pre-trigger times can't be negative.");
+        }
+    }
+
+    int CollectorCore::add_profile(const CollectionParams &p)
+    {
+        validate(p);
+        profiles.push_back(p);
+        if(!p.num_markers)
+            profiles.back().num_markers = total_num_markers;
+        return (int)profiles.size()-1;
+    }
+
+    void CollectorCore::reconfigure(int n)
+    {
+        if(n < 0 || n >= (int)profiles.size()) {
+            throw std::invalid_argument("No such profile.");
+        }
+        switch_to(profiles[n]);
+    }
+
+    void CollectorCore::reconfigure(const CollectionParams &p)
+    {
+        validate(p);
+        switch_to(p);
+    }
+
+    static bool same_params(const CollectionParams &a, const CollectionParams &b)
+    {
+        return a.num_markers == b.num_markers
+            && a.frame_frequency == b.frame_frequency
+            && a.marker_frequency == b.marker_frequency
+            && a.threshold == b.threshold
+            && a.gain == b.gain
+            && a.stream_mode == b.stream_mode
+            && a.cycle == b.cycle
+            && a.voltage == b.voltage
+            && a.collect_time == b.collect_time
+            && a.trigger_time == b.trigger_time
+            && a.flags == b.flags;
+    }
+
+    void CollectorCore::switch_to(const CollectionParams &p)
+    {
+        CollectionParams q = p;
+        if(!q.num_markers)
+            q.num_markers = total_num_markers;
+        if(set_up && active && same_params(q, applied))
+            return;
+
+        bool acquiring = is_acquiring();
+        int capacity = acquiring ? acquirer->get_ring().get_capacity() : 0;
+        stop_acquisition();
+        if(active) {
+            device->deactivate_markers();
+            active = false;
+        }
+
+        num_elements += q.num_markers-total_num_markers;
+        total_num_markers = q.num_markers;
+        params = q;
+        apply_setup();
+        activate();
+
+        if(acquiring)
+            start_acquisition(capacity);
+    }
+
+    void CollectorCore::add_stage(FrameStage *s)
+    {
+        if(is_acquiring()) {
+            throw std::logic_error("Can't add a stage while acquiring.");
+        }
+        // Set up first, so a stage that throws isn't left attached.
+        if(set_up)
+            s->setup(params);
+        stages.push_back(s);
+    }
+
+    void CollectorCore::remove_stage(FrameStage *s)
+    {
+        if(is_acquiring()) {
+            throw std::logic_error("Can't remove a stage while acquiring.");
+        }
+        stages.erase(std::remove(stages.begin(), stages.end(), s), stages.end());
+    }
+
+    void CollectorCore::activate()
+    {
+        long long start = host_time_ns();
+        if(device->activate_markers()) {
+            throw std::runtime_error("Can't activate markers.");
+        }
+        active = true;
+        if(!startup_times.activate)
+            startup_times.activate = host_time_ns()-start;
+    }
+
+    void CollectorCore::startup(bool initialize)
+    {
+        if(initialize)
+            initialize_device();
+        setup_collection();
+        activate();
+    }
+
+    void CollectorCore::deactivate()
+    {
+        stop_acquisition();
+        if(scheduler.is_in_flight())
+            scheduler.finish(device, &marker_data[0]);
+        device->deactivate_markers();
+        active = false;
+    }
+
+    int CollectorCore::update_frame()
+    {
+        if(is_acquiring()) {
+            FrameInfo info;
+            if(!acquirer->latest_frame(info, &marker_data[0])) {
+                stats.record_failure(true);
+                return -1;
+            }
+            // The acquisition thread has already run the stages.
+            last_processed = info.frame_number;
+            return accept_frame(info.frame_number, info.num_markers, info.flags, info.host_time);
+        }
+
+        if(nonblocking)
+            return update_frame_nonblocking();
+        return update_frame_blocking();
+    }
+
+    int CollectorCore::update_frame_blocking()
+    {
+        scheduler.finish(device, &marker_data[0]);
+
+        unsigned int fn, ne, f;
+        long long before = host_time_ns();
+        int error = device->get_latest_3d(&fn, &ne, &f, &marker_data[0]);
+        long long after = host_time_ns();
+        stats.record_call(before, after);
+        if(error) {
+            stats.record_failure();
+            return -1;
+        }
+        stats.record_frame(fn, after);
+        return accept_frame(fn, ne, f, after);
+    }
+
+    int CollectorCore::update_frame_nonblocking()
+    {
+        assert(num_elements > 0);
+        if(scheduled) {
+            FrameInfo info;
+            long long before = host_time_ns();
+            int r = scheduler.poll(device, info, &marker_data[0]);
+            if(r == RequestScheduler::PENDING) {
+                stats.record_failure(true);
+                return -1;
+            }
+            if(r == RequestScheduler::FAILED) {
+                stats.record_failure();
+                return -1;
+            }
+            stats.record_call(before, info.host_time);
+            stats.record_frame(info.frame_number, info.host_time);
+            int fn = accept_frame(info.frame_number, info.num_markers, info.flags, info.host_time);
+            // Not before: the stages may call other devices.
+            scheduler.request_next(device);
+            return fn;
+        }
+
+        if(device->request_latest_3d()) {
+            stats.record_failure();
+            return -1;
+        }
+
+        if(!device->data_is_ready()){
+            stats.record_failure(true);
+            return -1;
+        }
+
+        unsigned int fn, ne, f;
+        long long before = host_time_ns();
+        int error = device->receive_latest_3d(&fn, &ne, &f, &marker_data[0]);
+        long long after = host_time_ns();
+        stats.record_call(before, after);
+        if(error) {
+            stats.record_failure();
+            return -1;
+        }
+        stats.record_frame(fn, after);
+        return accept_frame(fn, ne, f, after);
+    }
+
+    int CollectorCore::accept_frame(unsigned int fn, unsigned int ne, unsigned int f, long long t)
+    {
+        frame_number = fn;
+        nelements = ne;
+        flags = f;
+        host_time = t;
+
+        if(nelements != total_num_markers) {
+            std::cerr << "Shouldn't happen: missing marker elements.\n";
+            stats.record_failure();
+            return -1;
+        }
+        if(!startup_times.first_frame && startup_begin)
+            startup_times.first_frame = t-startup_begin;
+
+        num_valid = scan_valid(&marker_data[0], total_num_markers, &valid_bits[0]);
+
+        bool solve = frame_number != last_solved && bodies.get_num_bodies() > 0;
+        bool process = frame_number != last_processed && !stages.empty();
+        long long start = solve || process ? host_time_ns() : 0;
+
+        if(solve) {
+            bodies.solve(&marker_data[0], &valid_bits[0]);
+            last_solved = frame_number;
+        }
+
+        if(process) {
+            FrameInfo info;
+            info.frame_number = fn;
+            info.num_markers = ne;
+            info.flags = f;
+            info.host_time = t;
+            for(size_t i=0; i<stages.size(); ++i)
+                stages[i]->process(info, &marker_data[0]);
+        }
+        last_processed = frame_number;
+
+        if(solve || process)
+            stats.record_processing(host_time_ns()-start);
+
+        // After the stages, which record what was measured.  Not
+        // last_processed: while acquiring, the thread has run the stages
+        // and update_frame() has moved it on already.
+        if(hold.is_enabled()) {
+            hold.apply(&marker_data[0], &valid_bits[0], frame_number != last_held);
+            last_held = frame_number;
+        }
+
+        return frame_number;
+    }
+
+    void CollectorCore::start_acquisition(int capacity)
+    {
+        if(!set_up) {
+            throw std::logic_error("start_acquisition called before setup_collection.");
+        }
+        if(is_acquiring())
+            return;
+
+        scheduler.finish(device, &marker_data[0]);
+        delete acquirer;
+        acquirer = new OptoAcquirer(device, total_num_markers, capacity, stages, &stats);
+        bool next_frame = (params.flags & OPTOTRAK_GET_NEXT_FRAME_FLAG) != 0;
+        if(nonblocking || !next_frame)
+            acquirer->set_polling(1./params.frame_frequency, next_frame);
+        acquirer->start();
+    }
+
+    void CollectorCore::stop_acquisition()
+    {
+        if(acquirer)
+            acquirer->stop();
+    }
+
+    bool CollectorCore::is_acquiring() const
+    {
+        return acquirer != 0 && acquirer->is_running();
+    }
+
+    bool CollectorCore::latest_frame(FrameInfo &info, Position3d *markers) const
+    {
+        return acquirer != 0 && acquirer->latest_frame(info, markers);
+    }
+
+    bool CollectorCore::add_frame_waiter(FrameWaiter *w)
+    {
+        return acquirer != 0 && acquirer->add_waiter(w);
+    }
+
+    bool CollectorCore::remove_frame_waiter(FrameWaiter *w)
+    {
+        return acquirer != 0 && acquirer->remove_waiter(w);
+    }
+
+    unsigned long long CollectorCore::get_num_acquired() const
+    {
+        return acquirer ? acquirer->get_num_acquired() : 0;
+    }
+
+    int CollectorCore::frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const
+    {
+        if(!acquirer)
+            return 0;
+        return acquirer->frames_since(n, infos, markers, max_frames);
+    }
+
+    int CollectorCore::get_num_buffered_frames() const
+    {
+        return (int)ceil(params.collect_time*params.frame_frequency);
+    }
+
+    int CollectorCore::collect_buffered(BufferSink &sink)
+    {
+        return run_buffered(&sink, 0, 0);
+    }
+
+    int CollectorCore::collect_buffered(Position3d *dest, int max_frames)
+    {
+        return run_buffered(0, dest, max_frames);
+    }
+
+    int CollectorCore::run_buffered(BufferSink *sink, Position3d *dest, int max_frames)
+    {
+        if(!set_up) {
+            throw std::logic_error("collect_buffered called before setup_collection.");
+        }
+        if(is_acquiring()) {
+            throw std::logic_error("Can't collect buffered data while acquiring.");
+        }
+
+        scheduler.finish(device, &marker_data[0]);
+        int nm = total_num_markers;
+        if(device->buffer_start(get_num_buffered_frames())) {
+            throw std::runtime_error("Can't start buffered collection.");
+        }
+        long long start = host_time_ns();
+        double period = 1e9/params.frame_frequency;
+        std::chrono::nanoseconds poll((long long)(period*BUFFER_BLOCK/2));
+        if(poll < std::chrono::milliseconds(1))
+            poll = std::chrono::milliseconds(1);
+
+        int count = 0;
+        bool complete = false;
+        while(!complete) {
+            Position3d *block = dest ? dest+count*nm : &buffer_block[0];
+            int room = dest ? max_frames-count : BUFFER_BLOCK;
+            if(room <= 0)
+                break;
+
+            int n;
+            if(device->buffer_read(block, room, &n, &complete)) {
+                device->buffer_stop();
+                throw std::runtime_error("Buffered collection failed.");
+            }
+            // Unless we're behind, let half a block pile up before the
+            // next read.
+            if(n < room && !complete)
+                std::this_thread::sleep_for(poll);
+            if(n == 0)
+                continue;
+
+            for(int i=0; i<n && !stages.empty(); ++i) {
+                FrameInfo info;
+                info.frame_number = count+i+1;
+                info.num_markers = nm;
+                info.flags = 0;
+                info.host_time = start+(long long)((count+i)*period);
+                for(size_t k=0; k<stages.size(); ++k)
+                    stages[k]->process(info, block+i*nm);
+            }
+            if(sink)
+                sink->consume(count, block, n);
+            count += n;
+        }
+
+        device->buffer_stop();
+        return count;
+    }
+
+} // end of namespace
@@ -0,0 +1,434 @@
+#ifndef _COLLECTORCORE_H_
+#define _COLLECTORCORE_H_
+
+/**
+ *@file CollectorCore.h
+ *@brief The native half of OptoCollector.
+ *
+ * Plain C++, safe to include from /clr code.  Errors are reported with
+ * std::runtime_error (the managed wrapper turns them into
+ * System::Exception); the per-frame calls return -1 instead, as before.
+ */
+#include <vector>
+#include "OptoDevice.h"
+#include "FrameStats.h"
+#include "MarkerMask.h"
+#include "OptoFrame.h"
+#include "RequestScheduler.h"
+#include "RigidBodySolver.h"
+#include "StroberTable.h"
+
+namespace VML {
+
+    class OptoAcquirer;
+    class FrameStage;
+    class StroberDevice;
+
+    /**
+     * Receives the frames of a buffered collection, a block at a time.
+     */
+    class BufferSink {
+        public:
+            virtual ~BufferSink() {}
+
+            /**
+             * @param first Index of the first frame of the block in the trial.
+             * @param markers num_frames frames, get_total_num_markers() each.
+             * Only valid during the call.
+             */
+            virtual void consume(int first, const Position3d *markers, int num_frames) = 0;
+    };
+
+    /**
+     * How long getting to the first frame took, in ns.  Phases that
+     * haven't happened (or that weren't done through the collector) are
+     * 0.
+     */
+    struct StartupTimes {
+        long long initialize;  //< OptoDevice::initialize().
+        long long setup;       //< setup_collection().
+        long long activate;    //< activate().
+        long long first_frame; //< From the start of the first of these to the first frame received.
+    };
+
+    /**
+     * Everything OptoCollector does, without CLR types, against any
+     * OptoDevice.  See OptoCollector for how markers, strobers and
+     * collection sizes relate.
+     *
+     * All memory is allocated in setup_collection() and
+     * start_acquisition(); update_frame() and the read-out calls don't
+     * allocate.
+     */
+    class CollectorCore {
+        public:
+            /**
+             * @param device Not owned.  Must outlive the collector.
+             */
+            CollectorCore(OptoDevice *device);
+            ~CollectorCore();
+
+            /**
+             * Add n markers on port number p.
+             *
+             * With p from 1 to 4, they're a strober (with sockets sockets,
+             * 0 for 6) chained on that port, and the collector lays the
+             * collection out itself: it sets the strober port table, uses
+             * the smallest collection that reaches every marker, and
+             * packs each frame so the markers come in the order they were
+             * added, without the empty sockets (see StroberTable).
+             * With p 0, the markers are simply appended and the layout is
+             * up to the caller, as in the cases described in
+             * OptoCollector.  The two can't be mixed.
+             * @return Index of the first of them in the frame, counted
+             * from 1, e.g. for add_rigid_body().
+             */
+            int add_markers(int n, int port=0, int sockets=0);
+
+            /**
+             * Add a rigid body of num_markers markers, whose coordinates
+             * in the body's frame are model (x,y,z each).  Its markers are
+             * part of the frame: they start at first_marker (counted from
+             * 1, as in the cases described in OptoCollector), or right
+             * after the markers added so far if first_marker is 0.  The
+             * frame grows to hold them if needed; with strobers on ports,
+             * they must have been added with add_markers() instead.
+             * @return The body's index.
+             */
+            int add_rigid_body(const double *model, int num_markers, int first_marker=0);
+
+            /**
+             * Initialize the device (OptoDevice::initialize()), for when
+             * the collector should own the whole startup.
+             */
+            void initialize_device();
+
+            /**
+             * Prepare for the collection with the values in params.
+             */
+            void setup_collection();
+
+            void activate();
+            void deactivate();
+
+            /**
+             * initialize_device() if asked, setup_collection() and
+             * activate(), in one call.  See start_async() in
+             * CollectorStartup.h to do it on another thread.
+             */
+            void startup(bool initialize=true);
+
+            const StartupTimes &get_startup_times() const { return startup_times; }
+
+            /**
+             * The strobers added with add_markers() on a port; empty if
+             * none were.
+             */
+            const StroberTable &get_strober_table() const { return strobers; }
+
+            /**
+             * Check p for use with reconfigure() and keep it.  Its
+             * num_markers is the new frame size, or 0 for the current
+             * one; the markers added or dropped are at the end of the
+             * frame.  Throws std::invalid_argument saying what's wrong,
+             * so mistakes show up when the profile is made rather than
+             * mid-session.
+             * @return The profile's index.
+             */
+            int add_profile(const CollectionParams &p);
+            int get_num_profiles() const { return (int)profiles.size(); }
+            const CollectionParams &get_profile(int n) const { return profiles[n]; }
+
+            /**
+             * Throws std::invalid_argument if the device can't be set up
+             * with p, given the current markers and rigid bodies.
+             */
+            void validate(const CollectionParams &p) const;
+
+            /**
+             * @brief Switch a live session to profile n.
+             *
+             * Deactivates, sets the collection up again, reactivates and,
+             * if it was running, restarts the acquisition thread.  No
+             * initialization, no fixed waits, and no reallocation unless
+             * the frame grows.  Nothing to do if the device already runs
+             * with the profile.  Frame numbers start over, and the
+             * stages' FrameStage::reconfigure() is called: a recording or
+             * an export carries on in a new file, and readers of a
+             * stage's frames on other threads are safe.  Can also be
+             * called instead of setup_collection() and activate().
+             */
+            void reconfigure(int n);
+
+            /**
+             * Same with parameters that haven't been added as a profile;
+             * they're validated first.
+             */
+            void reconfigure(const CollectionParams &p);
+
+            int get_num_elements() const {
+                return num_elements;
+            }
+
+            /**
+             * @brief Ask the device for a new frame of data.
+             * @return frame number. -1 if anything's wrong or data unavailable (non-blocking update).
+             */
+            int update_frame();
+            int update_frame_blocking();
+
+            /**
+             * Returns at once.  A RequestScheduler keeps one request in
+             * flight and only asks the driver whether it's ready when the
+             * frame is due, so calling this in a loop costs next to no
+             * driver calls and delivers each frame soon after it's in.
+             */
+            int update_frame_nonblocking();
+
+            void set_nonblocking() { nonblocking = true; }
+            void set_blocking() { nonblocking = false; }
+            bool is_nonblocking() const { return nonblocking; }
+
+            /**
+             * Off: update_frame_nonblocking() requests and checks on
+             * every call, as it used to.  On by default; off is there to
+             * measure the difference.
+             */
+            void set_request_scheduling(bool on) { scheduled = on; }
+
+            const RequestScheduler &get_scheduler() const { return scheduler; }
+
+            /**
+             * Without this flag, optotrak doesn't really do a
+             * blocking retrieval with GetLatestData().
+             */
+            void enforce_blocking() {
+                params.flags |= OPTOTRAK_GET_NEXT_FRAME_FLAG;
+            }
+
+            /**
+             * The current frame, no copy.
+             */
+            FrameView get_frame_view() const {
+                FrameView v;
+                v.markers = marker_data.empty() ? 0 : &marker_data[0];
+                v.num_markers = (int)marker_data.size();
+                v.frame_number = frame_number;
+                v.flags = flags;
+                v.valid_mask = valid_bits.empty() ? 0 : &valid_bits[0];
+                return v;
+            }
+
+            const Position3d &get_position(int n) const {
+                return marker_data[n];
+            }
+
+            /**
+             * Markers seen in the current frame, bit n%64 of word n/64 for
+             * marker n; mask_words(get_total_num_markers()) words.
+             * Scanned once per frame, before any hold-over fills the gaps.
+             */
+            const uint64_t *get_valid_mask() const {
+                return valid_bits.empty() ? 0 : &valid_bits[0];
+            }
+
+            int get_num_valid() const { return num_valid; }
+
+            bool is_valid_marker(int n) const {
+                return test_bit(&valid_bits[0], n);
+            }
+
+            /**
+             * Call f(n) for every marker n seen in the current frame.
+             */
+            template <class F>
+            void for_each_valid_marker(F f) const {
+                if(!valid_bits.empty())
+                    for_each_valid(&valid_bits[0], total_num_markers, f);
+            }
+
+            /**
+             * Hand out a missing marker where it was last seen, for up to
+             * max_frames frames (forever if negative, never if 0, the
+             * default).  Only what's read from the collector is filled
+             * in: the valid mask, the rigid bodies and the stages still
+             * see the marker missing.  Forgets what's been seen.
+             */
+            void set_hold_over(int max_frames);
+
+            /**
+             * Frames since marker n was last seen, with hold-over on.
+             */
+            int get_marker_age(int n) const { return hold.get_age(n); }
+
+            int get_frame_number() const { return frame_number; }
+
+            int get_num_rigid_bodies() const { return bodies.get_num_bodies(); }
+
+            /**
+             * Pose of rigid body n in the current frame, solved when the
+             * frame arrived.  Check its valid flag.  Not updated by
+             * collect_buffered(); give a RigidBodySolver the frames from
+             * a BufferSink there.
+             */
+            const BodyPose &get_rigid_body(int n) const {
+                return bodies.get_pose(n);
+            }
+
+            /**
+             * Same, into a BVL::Pose or BVL::FixedPose.
+             * @return false if the body wasn't solved in this frame.
+             */
+            template <class P>
+            bool get_rigid_body(int n, P &pose) const {
+                return bodies.get_pose(n, pose);
+            }
+
+            /**
+             * The rigid body definitions, e.g. for
+             * FrameResampler::set_rigid_bodies().
+             */
+            const RigidBodySolver &get_rigid_bodies() const { return bodies; }
+
+            /**
+             * Host time the current frame was received, in ns.
+             */
+            long long get_host_time() const { return host_time; }
+
+            /**
+             * Run s on every new frame, after the stages added before it.
+             * Not owned.  Stages can't be added or removed while
+             * acquiring.
+             */
+            void add_stage(FrameStage *s);
+            void remove_stage(FrameStage *s);
+
+            /**
+             * See OptoCollector::start_acquisition().  If the device won't
+             * block (set_nonblocking(), or no enforce_blocking()), the
+             * thread keeps a request in flight and naps between checks
+             * instead of spinning.
+             */
+            void start_acquisition(int capacity=256);
+            void stop_acquisition();
+            bool is_acquiring() const;
+
+            bool latest_frame(FrameInfo &info, Position3d *markers) const;
+            int frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const;
+
+            /**
+             * While acquiring, have w notified, on the acquisition thread,
+             * once the next frame is in the ring and through the stages.
+             * The one thread serves every waiter.  See FrameAwaiter.h.
+             * @return false if not acquiring; w won't be notified.
+             */
+            bool add_frame_waiter(FrameWaiter *w);
+            bool remove_frame_waiter(FrameWaiter *w);
+
+            /**
+             * Frames the acquisition thread has pushed to its ring.
+             */
+            unsigned long long get_num_acquired() const;
+
+            /**
+             * @brief Buffered collection of a whole trial.
+             *
+             * The system spools collect_time seconds of frames by itself
+             * and we drain them in blocks of up to BUFFER_BLOCK frames, so
+             * there's no call to the device per frame and nothing is
+             * dropped however late we are.  Blocks until the trial is
+             * complete.  The stages see every frame, stamped with its
+             * nominal time.
+             * @return Number of frames collected.
+             */
+            int collect_buffered(BufferSink &sink);
+
+            /**
+             * Same, straight into dest, which has room for max_frames
+             * frames.  Stops early if dest is full.
+             */
+            int collect_buffered(Position3d *dest, int max_frames);
+
+            /**
+             * Frames in a buffered trial: collect_time*frame_frequency.
+             */
+            int get_num_buffered_frames() const;
+
+            enum {
+                BUFFER_BLOCK=256
+            };
+
+            /**
+             * Size of a frame as the collector holds it.  With strobers
+             * on ports, only the real markers; otherwise as collected,
+             * which may include unused strober sockets.
+             */
+            int get_total_num_markers() const { return total_num_markers; }
+
+            OptoDevice *get_device() const { return device; }
+
+            /**
+             * Timing of every device read, frame number gaps and failures,
+             * in every mode but buffered collection.  Can be read from any
+             * thread while running.
+             */
+            const FrameStats &get_stats() const { return stats; }
+            void reset_stats() { stats.reset(); }
+
+            /**
+             * Collection parameters.  Change them before setup_collection().
+             */
+            CollectionParams params;
+
+        private:
+            int run_buffered(BufferSink *sink, Position3d *dest, int max_frames);
+
+            // Size everything for total_num_markers and set the device up,
+            // then the stages, with reconfigure() if they've been set up.
+            void apply_setup();
+            void switch_to(const CollectionParams &p);
+
+            // Validate what the device returned and make it current.
+            int accept_frame(unsigned int fn, unsigned int ne, unsigned int f, long long t);
+
+            OptoDevice *device;
+            OptoAcquirer *acquirer;
+
+            int num_elements;
+            int total_num_markers;
+
+            StroberTable strobers;
+            StroberDevice *packer; //< Stands in for the device when strobers isn't empty.
+            bool unported; //< Markers were added without a port.
+            bool nonblocking;
+            bool scheduled; //< update_frame_nonblocking() uses scheduler.
+            RequestScheduler scheduler;
+            bool set_up;
+            int frame_number, nelements, flags;
+            long long host_time;
+            int last_processed; //< Last frame the stages have seen.
+            int last_solved; //< Last frame the rigid bodies were solved for.
+            int last_held; //< Last frame the hold-over aged the markers for.
+            long long startup_begin; //< Host time startup began, 0 before.
+            StartupTimes startup_times;
+            bool active; //< Markers activated.
+            std::vector<CollectionParams> profiles;
+            CollectionParams applied; //< What the device was last set up with.
+
+            std::vector<Position3d> marker_data;
+            std::vector<Position3d> buffer_block; //< BUFFER_BLOCK frames, for sinks.
+            std::vector<uint64_t> valid_bits; //< marker_data's, before hold-over.
+            int num_valid;
+            int hold_frames;
+            HoldOver hold;
+            std::vector<FrameStage *> stages;
+            RigidBodySolver bodies;
+            FrameStats stats;
+
+            CollectorCore(const CollectorCore &);
+            CollectorCore &operator=(const CollectorCore &);
+    };
+
+} // end of namespace
+
+#endif/*_COLLECTORCORE_H_*/
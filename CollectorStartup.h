@@ -0,0 +1,29 @@
+#ifndef _COLLECTORSTARTUP_H_
+#define _COLLECTORSTARTUP_H_
+
+/**
+ *@file CollectorStartup.h
+ *@brief CollectorCore::startup() on its own thread.
+ *
+ * Native code only: <future> can't be included from /clr code, where
+ * OptoCollector::start_async() does the same with a Task.
+ */
+#include <future>
+#include "CollectorCore.h"
+
+namespace VML {
+
+    /**
+     * Initialize (if asked), set up and activate c on another thread, so
+     * the caller can get on with its own loading.  get() on the result
+     * waits for it and rethrows what startup() threw.  c mustn't be
+     * touched until then.
+     */
+    inline std::future<void> start_async(CollectorCore &c, bool initialize=true)
+    {
+        return std::async(std::launch::async, [&c, initialize] { c.startup(initialize); });
+    }
+
+} // end of namespace
+
+#endif/*_COLLECTORSTARTUP_H_*/
@@ -0,0 +1,163 @@
+/**
+ *@file CompressedReader.cc
+ *@brief
+ */
+#include <string.h>
+#include <stdexcept>
+#include <thread>
+#include "FrameCodec.h"
+#include "CompressedReader.h"
+
+namespace VML {
+
+    CompressedReader::CompressedReader(const std::string &p)
+        :path(p),
+        num_frames(0),
+        resolution(0.)
+    {
+        file.open(path);
+        if(file.size() < sizeof(RecordingHeader)
+                || memcmp(get_header().magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC))) {
+            throw std::runtime_error(path+" isn't a compressed recording.");
+        }
+        const RecordingHeader &h = get_header();
+        if(h.version != RecordingHeader::VERSION || h.header_size < sizeof(RecordingHeader)) {
+            throw std::runtime_error(path+" has an unknown recording version.");
+        }
+
+        size_t end = h.header_size+(size_t)h.data_size;
+        if(end > file.size())
+            end = file.size();
+        for(size_t at=h.header_size; at<end; ) {
+            size_t size = FrameDecoder::peek(file.data()+at, end-at);
+            if(size == 0)
+                break;
+            CodecBlockHeader b;
+            memcpy(&b, file.data()+at, sizeof(b));
+            if(b.num_markers != h.num_markers)
+                break;
+            Block k;
+            k.offset = at;
+            k.size = size;
+            k.first = num_frames;
+            k.first_time = b.first_time;
+            blocks.push_back(k);
+            num_frames += b.num_frames;
+            resolution = b.resolution;
+            at += size;
+        }
+    }
+
+    size_t CompressedReader::find_block(size_t i) const
+    {
+        size_t lo = 0, hi = blocks.size();
+        while(hi-lo > 1) {
+            size_t mid = (lo+hi)/2;
+            if(blocks[mid].first <= i)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    void CompressedReader::decode(FrameDecoder &d, size_t b, FrameInfo *infos, Position3d *markers) const
+    {
+        const Block &k = blocks[b];
+        if(d.decode(file.data()+k.offset, k.size, infos, markers) < 0)
+            throw std::runtime_error(path+" is damaged.");
+    }
+
+    size_t CompressedReader::read(size_t first, size_t count, FrameInfo *infos, Position3d *markers) const
+    {
+        if(first >= num_frames)
+            return 0;
+        if(count > num_frames-first)
+            count = num_frames-first;
+
+        const int nm = get_num_markers();
+        FrameDecoder d;
+        std::vector<FrameInfo> scratch_infos;
+        std::vector<Position3d> scratch_markers;
+        size_t done = 0;
+        for(size_t b=find_block(first); done<count; ++b) {
+            const Block &k = blocks[b];
+            size_t n = (b+1 < blocks.size() ? blocks[b+1].first : num_frames)-k.first;
+            size_t skip = first+done-k.first;
+            size_t take = n-skip < count-done ? n-skip : count-done;
+            if(skip == 0 && take == n) {
+                decode(d, b, infos+done, markers+done*nm);
+            }else{
+                // Only part of the block is wanted.
+                scratch_infos.resize(n);
+                scratch_markers.resize(n*nm);
+                decode(d, b, &scratch_infos[0], &scratch_markers[0]);
+                memcpy(infos+done, &scratch_infos[skip], take*sizeof(FrameInfo));
+                memcpy(markers+done*nm, &scratch_markers[skip*nm], take*nm*sizeof(Position3d));
+            }
+            done += take;
+        }
+        return count;
+    }
+
+    size_t CompressedReader::read_all(FrameInfo *infos, Position3d *markers, int num_threads) const
+    {
+        if(num_threads <= 0)
+            num_threads = (int)std::thread::hardware_concurrency();
+        if(num_threads > (int)blocks.size())
+            num_threads = (int)blocks.size();
+        if(num_threads < 1)
+            num_threads = 1;
+
+        // Interleaved, so threads finish together however blocks vary.
+        const int nm = get_num_markers();
+        std::vector<std::string> errors(num_threads);
+        auto work = [&](int t) {
+            try {
+                FrameDecoder d;
+                for(size_t b=t; b<blocks.size(); b+=num_threads)
+                    decode(d, b, infos+blocks[b].first, markers+blocks[b].first*nm);
+            }catch(const std::exception &e) {
+                errors[t] = e.what();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for(int t=1; t<num_threads; ++t)
+            threads.push_back(std::thread(work, t));
+        work(0);
+        for(size_t t=0; t<threads.size(); ++t)
+            threads[t].join();
+        for(int t=0; t<num_threads; ++t) {
+            if(!errors[t].empty())
+                throw std::runtime_error(errors[t]);
+        }
+        return num_frames;
+    }
+
+    size_t CompressedReader::lower_bound_time(long long t) const
+    {
+        if(blocks.empty() || t <= blocks[0].first_time)
+            return 0;
+        // The last block starting before t, then inside it.
+        size_t lo = 0, hi = blocks.size();
+        while(hi-lo > 1) {
+            size_t mid = (lo+hi)/2;
+            if(blocks[mid].first_time < t)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        const Block &k = blocks[lo];
+        size_t n = (lo+1 < blocks.size() ? blocks[lo+1].first : num_frames)-k.first;
+        std::vector<FrameInfo> infos(n);
+        std::vector<Position3d> markers(n*get_num_markers());
+        FrameDecoder d;
+        decode(d, lo, &infos[0], markers.empty() ? 0 : &markers[0]);
+        size_t i = 0;
+        while(i < n && infos[i].host_time < t)
+            ++i;
+        return k.first+i;
+    }
+
+} // end of namespace
@@ -0,0 +1,82 @@
+#ifndef _COMPRESSEDREADER_H_
+#define _COMPRESSEDREADER_H_
+
+/**
+ *@file CompressedReader.h
+ *@brief Decoding of compressed recordings (see Recording.h and FrameCodec.h).
+ */
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "OptoFrame.h"
+#include "Recording.h"
+
+namespace VML {
+
+    class FrameDecoder;
+
+    /**
+     * Maps a compressed recording read-only and decodes frames from it.
+     *
+     * Opening walks the block headers (a few bytes per block) into an
+     * index of where each block is and which frames it holds; reads
+     * decode only the blocks they cover.  Blocks are independent, so
+     * read_all() hands them out to several threads.
+     *
+     * A recording still being written, or cut short, reads up to its
+     * last whole block.  Errors throw std::runtime_error.
+     */
+    class CompressedReader {
+        public:
+            CompressedReader(const std::string &path);
+
+            const RecordingHeader &get_header() const {
+                return *(const RecordingHeader *)file.data();
+            }
+
+            int get_num_markers() const { return get_header().num_markers; }
+            double get_resolution() const { return resolution; }
+            size_t get_num_frames() const { return num_frames; }
+            size_t get_num_blocks() const { return blocks.size(); }
+
+            /**
+             * Frames [first, first+count), clipped to the file, into
+             * infos and markers (num_markers each).
+             * @return Frames read.
+             */
+            size_t read(size_t first, size_t count, FrameInfo *infos, Position3d *markers) const;
+
+            /**
+             * Every frame, on num_threads threads (one per core if 0).
+             * @param infos,markers Room for get_num_frames() frames.
+             */
+            size_t read_all(FrameInfo *infos, Position3d *markers, int num_threads=0) const;
+
+            /**
+             * First frame with host time >= t, ns.
+             */
+            size_t lower_bound_time(long long t) const;
+
+        private:
+            struct Block {
+                size_t offset;       //< In the file.
+                size_t size;
+                size_t first;        //< Index of its first frame.
+                long long first_time;
+            };
+
+            // The block holding frame i.
+            size_t find_block(size_t i) const;
+            void decode(FrameDecoder &d, size_t b, FrameInfo *infos, Position3d *markers) const;
+
+            std::string path;
+            MappedFile file;
+            std::vector<Block> blocks;
+            size_t num_frames;
+            double resolution;
+    };
+
+} // end of namespace
+
+#endif/*_COMPRESSEDREADER_H_*/
@@ -0,0 +1,634 @@
+/**
+ *@file DerivedGraph.cc
+ *@brief
+ */
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+#include "DerivedGraph.h"
+#include "MarkerMask.h"
+#include "StageState.h"
+
+namespace VML {
+
+    namespace {
+
+        bool is_point(DerivedGraph::Kind k)
+        {
+            return k == DerivedGraph::MARKER || k == DerivedGraph::LANDMARK || k == DerivedGraph::MIDPOINT;
+        }
+
+        // Nodes still being visited and done, for the topological sort.
+        enum {
+            UNSEEN=0,
+            VISITING=1,
+            DONE=2
+        };
+
+    }
+
+    /*
+     * The compiled plan and its storage.  Steps are in topological order,
+     * sources first; a step reads its inputs' values at their offsets and
+     * writes its own.  Dirty bits, one per step, say which steps have an
+     * input that changed in this frame.
+     */
+    struct DerivedGraph::State {
+        struct Step {
+            Kind kind;
+            int node;
+            int index;         //< Marker or body.
+            int out;           //< Offset of the values.
+            int size;
+            int num_inputs;
+            int src[3];        //< Input nodes.
+            int in[3];         //< Their offsets.
+            double x[3];
+            int history;       //< Velocity: offset in previous; body: in seen.
+            int first_consumer, num_consumers; //< In consumers.
+        };
+
+        // Flag the steps using st's node.
+        void mark(const Step &st) {
+            for(int k=0; k<st.num_consumers; ++k) {
+                int c = consumers[st.first_consumer+k];
+                dirty[c >> 6] |= 1ULL << (c & 63);
+            }
+        }
+
+        std::vector<Step> plan;
+        int num_sources;                   //< The first steps.
+        std::vector<int> consumers;
+        std::vector<uint64_t> dirty;       //< This frame's.
+        std::vector<uint64_t> pending;     //< The next frame's, for velocities.
+
+        std::vector<int> offset, size;     //< Per node.
+        std::vector<double> values;
+        std::vector<unsigned char> valid;  //< Per node.
+
+        // Velocities: the input as of the previous frame.
+        std::vector<double> previous;
+        std::vector<unsigned char> previous_valid;
+
+        // Bodies: their markers as last solved.
+        std::vector<Position3d> seen;
+
+        double frame_frequency;
+        unsigned int last_frame;
+
+        // Odd while a frame is evaluated.
+        std::atomic<unsigned long long> sequence;
+        long long frame_number; //< Evaluated, -1 before the first.
+
+        std::atomic<unsigned long long> num_frames, num_evaluations, total_ns;
+    };
+
+    DerivedGraph::DerivedGraph()
+        :state(new StageState<State>)
+    {
+    }
+
+    DerivedGraph::~DerivedGraph()
+    {
+        delete state;
+    }
+
+    void DerivedGraph::set_rigid_bodies(const RigidBodySolver &b)
+    {
+        bodies = b;
+    }
+
+    int DerivedGraph::add(const Node &n)
+    {
+        if(n.name.empty())
+            throw std::invalid_argument("A derived quantity needs a name.");
+        if(find(n.name) >= 0)
+            throw std::invalid_argument("Derived quantity "+n.name+" is already defined.");
+        nodes.push_back(n);
+        return (int)nodes.size()-1;
+    }
+
+    int DerivedGraph::marker(const std::string &name, int i)
+    {
+        Node n;
+        n.name = name;
+        n.kind = MARKER;
+        n.index = i;
+        return add(n);
+    }
+
+    int DerivedGraph::body(const std::string &name, int b)
+    {
+        Node n;
+        n.name = name;
+        n.kind = BODY;
+        n.index = b;
+        return add(n);
+    }
+
+    int DerivedGraph::landmark(const std::string &name, const std::string &body, const double *x)
+    {
+        Node n;
+        n.name = name;
+        n.kind = LANDMARK;
+        n.index = 0;
+        n.inputs[0] = body;
+        memcpy(n.x, x, sizeof(n.x));
+        return add(n);
+    }
+
+    int DerivedGraph::midpoint(const std::string &name, const std::string &a, const std::string &b)
+    {
+        Node n;
+        n.name = name;
+        n.kind = MIDPOINT;
+        n.index = 0;
+        n.inputs[0] = a;
+        n.inputs[1] = b;
+        return add(n);
+    }
+
+    int DerivedGraph::distance(const std::string &name, const std::string &a, const std::string &b)
+    {
+        Node n;
+        n.name = name;
+        n.kind = DISTANCE;
+        n.index = 0;
+        n.inputs[0] = a;
+        n.inputs[1] = b;
+        return add(n);
+    }
+
+    int DerivedGraph::angle(const std::string &name, const std::string &a, const std::string &vertex, const std::string &b)
+    {
+        Node n;
+        n.name = name;
+        n.kind = ANGLE;
+        n.index = 0;
+        n.inputs[0] = a;
+        n.inputs[1] = vertex;
+        n.inputs[2] = b;
+        return add(n);
+    }
+
+    int DerivedGraph::joint(const std::string &name, const std::string &parent, const std::string &child)
+    {
+        Node n;
+        n.name = name;
+        n.kind = JOINT;
+        n.index = 0;
+        n.inputs[0] = parent;
+        n.inputs[1] = child;
+        return add(n);
+    }
+
+    int DerivedGraph::velocity(const std::string &name, const std::string &input)
+    {
+        Node n;
+        n.name = name;
+        n.kind = VELOCITY;
+        n.index = 0;
+        n.inputs[0] = input;
+        return add(n);
+    }
+
+    int DerivedGraph::define(const std::string &definition)
+    {
+        std::istringstream in(definition);
+        std::string name, equals, kind;
+        in >> name >> equals >> kind;
+        std::vector<std::string> a;
+        for(std::string w; in >> w; )
+            a.push_back(w);
+
+        const std::string bad = "Bad derived quantity: "+definition;
+        if(!in.eof() || equals != "=")
+            throw std::invalid_argument(bad);
+        try {
+            if(kind == "marker" && a.size() == 1)
+                return marker(name, std::stoi(a[0]));
+            if(kind == "body" && a.size() == 1)
+                return body(name, std::stoi(a[0]));
+            if(kind == "landmark" && a.size() == 4) {
+                double x[3] = { std::stod(a[1]), std::stod(a[2]), std::stod(a[3]) };
+                return landmark(name, a[0], x);
+            }
+            if(kind == "midpoint" && a.size() == 2)
+                return midpoint(name, a[0], a[1]);
+            if(kind == "distance" && a.size() == 2)
+                return distance(name, a[0], a[1]);
+            if(kind == "angle" && a.size() == 3)
+                return angle(name, a[0], a[1], a[2]);
+            if(kind == "joint" && a.size() == 2)
+                return joint(name, a[0], a[1]);
+            if(kind == "velocity" && a.size() == 1)
+                return velocity(name, a[0]);
+        }catch(const std::invalid_argument &e) {
+            // Ours, or a number std::stoi() or std::stod() couldn't read.
+            throw std::invalid_argument(bad+" ("+e.what()+")");
+        }catch(const std::out_of_range &) {
+            throw std::invalid_argument(bad);
+        }
+        throw std::invalid_argument(bad);
+    }
+
+    int DerivedGraph::extend(const std::string &definition, const RigidBodySolver &b)
+    {
+        const size_t num_nodes = nodes.size();
+        RigidBodySolver old = bodies;
+        try {
+            bodies = b;
+            int n = define(definition);
+            // setup() only replaces the plan once the new one compiles.
+            if(state->get())
+                setup(applied);
+            return n;
+        }catch(...) {
+            nodes.resize(num_nodes);
+            bodies = old;
+            throw;
+        }
+    }
+
+    int DerivedGraph::find(const std::string &name) const
+    {
+        for(size_t i=0; i<nodes.size(); ++i) {
+            if(nodes[i].name == name)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    int DerivedGraph::get_size(int node) const
+    {
+        const State *s = state->get();
+        return s && node >= 0 && node < (int)s->size.size() ? s->size[node] : 0;
+    }
+
+    void DerivedGraph::setup(const CollectionParams &p)
+    {
+        const int n = (int)nodes.size();
+        State *s = new State;
+        try {
+            // Inputs by index, and every node's inputs before it.
+            std::vector<int> src(3*n, -1), num_inputs(n, 0);
+            for(int i=0; i<n; ++i) {
+                for(int k=0; k<3 && !nodes[i].inputs[k].empty(); ++k) {
+                    src[3*i+k] = find(nodes[i].inputs[k]);
+                    if(src[3*i+k] < 0)
+                        throw std::invalid_argument(nodes[i].name+": no derived quantity "+nodes[i].inputs[k]+".");
+                    ++num_inputs[i];
+                }
+            }
+
+            std::vector<int> order, mark(n, UNSEEN), stack;
+            order.reserve(n);
+            for(int r=0; r<n; ++r) {
+                if(mark[r] != UNSEEN)
+                    continue;
+                // Depth first; a node is placed after all its inputs.
+                stack.push_back(r);
+                while(!stack.empty()) {
+                    int i = stack.back();
+                    if(mark[i] == UNSEEN) {
+                        mark[i] = VISITING;
+                        for(int k=0; k<num_inputs[i]; ++k) {
+                            int j = src[3*i+k];
+                            if(mark[j] == VISITING)
+                                throw std::invalid_argument(nodes[i].name+" is on a cycle: it depends on itself.");
+                            if(mark[j] == UNSEEN)
+                                stack.push_back(j);
+                        }
+                    }else {
+                        stack.pop_back();
+                        if(mark[i] == VISITING) {
+                            mark[i] = DONE;
+                            order.push_back(i);
+                        }
+                    }
+                }
+            }
+
+            // Then by depth, and kind within a depth: still an order in
+            // which inputs come first, sources (depth 0) before the rest,
+            // with runs of the same kind of step.
+            std::vector<int> depth(n, 0);
+            for(int o=0; o<n; ++o) {
+                const int i = order[o];
+                for(int k=0; k<num_inputs[i]; ++k)
+                    depth[i] = std::max(depth[i], depth[src[3*i+k]]+1);
+            }
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return depth[a] != depth[b] ? depth[a] < depth[b] : nodes[a].kind < nodes[b].kind;
+            });
+
+            s->offset.assign(n, 0);
+            s->size.assign(n, 0);
+            int total = 0, history = 0, seen = 0;
+            for(int o=0; o<n; ++o) {
+                const int i = order[o];
+                const Node &d = nodes[i];
+                State::Step st;
+                memset(&st, 0, sizeof(st));
+                st.kind = d.kind;
+                st.node = i;
+                st.index = d.index;
+                st.num_inputs = num_inputs[i];
+                memcpy(st.x, d.x, sizeof(st.x));
+                for(int k=0; k<st.num_inputs; ++k) {
+                    st.src[k] = src[3*i+k];
+                    st.in[k] = s->offset[st.src[k]];
+                }
+
+                const Kind k0 = st.num_inputs > 0 ? nodes[st.src[0]].kind : d.kind;
+                bool ok = true;
+                switch(d.kind) {
+                    case MARKER:
+                        ok = d.index >= 0 && d.index < p.num_markers;
+                        st.size = 3;
+                        break;
+                    case BODY:
+                        ok = d.index >= 0 && d.index < bodies.get_num_bodies();
+                        st.size = 12;
+                        if(ok) {
+                            st.history = seen;
+                            seen += bodies.get_num_markers(d.index);
+                        }
+                        break;
+                    case LANDMARK:
+                        ok = k0 == BODY;
+                        st.size = 3;
+                        break;
+                    case MIDPOINT:
+                    case DISTANCE:
+                    case ANGLE:
+                        for(int k=0; k<st.num_inputs; ++k)
+                            ok = ok && is_point(nodes[st.src[k]].kind);
+                        st.size = d.kind == MIDPOINT ? 3 : 1;
+                        break;
+                    case JOINT:
+                        ok = k0 == BODY && nodes[st.src[1]].kind == BODY;
+                        st.size = 3;
+                        break;
+                    case VELOCITY:
+                        ok = k0 != BODY;
+                        st.size = s->size[st.src[0]];
+                        st.history = history;
+                        history += st.size;
+                        break;
+                }
+                if(!ok)
+                    throw std::invalid_argument(d.name+": wrong inputs, or no such marker or body.");
+                st.out = s->offset[i] = total;
+                s->size[i] = st.size;
+                total += st.size;
+                s->plan.push_back(st);
+            }
+
+            // Consumers of each step, by position.
+            std::vector<int> position(n);
+            for(int o=0; o<n; ++o)
+                position[s->plan[o].node] = o;
+            std::vector<int> count(n+1, 0);
+            for(int o=0; o<n; ++o) {
+                for(int k=0; k<s->plan[o].num_inputs; ++k)
+                    ++count[position[s->plan[o].src[k]]+1];
+            }
+            for(int o=0; o<n; ++o) {
+                count[o+1] += count[o];
+                s->plan[o].first_consumer = count[o];
+                s->plan[o].num_consumers = 0;
+            }
+            s->consumers.assign(count[n], 0);
+            s->num_sources = 0;
+            for(int o=0; o<n; ++o) {
+                State::Step &st = s->plan[o];
+                if(!st.num_inputs)
+                    s->num_sources = o+1;
+                for(int k=0; k<st.num_inputs; ++k) {
+                    State::Step &from = s->plan[position[st.src[k]]];
+                    s->consumers[from.first_consumer+from.num_consumers++] = o;
+                }
+            }
+            s->dirty.assign(mask_words(n), 0);
+            s->pending.assign(mask_words(n), 0);
+
+            if(seen)
+                bodies.setup(p.num_markers);
+            // Nothing seen yet: every marker differs from these.
+            Position3d never;
+            memset(&never, 0xff, sizeof(never));
+            s->seen.assign(seen+1, never);
+            s->values.assign(total, 0.);
+            s->valid.assign(n, 0);
+            s->previous.assign(history, 0.);
+            s->previous_valid.assign(n, 0);
+            s->frame_frequency = p.frame_frequency;
+            s->last_frame = 0;
+            s->sequence.store(0, std::memory_order_relaxed);
+            s->frame_number = -1;
+            s->num_frames.store(0, std::memory_order_relaxed);
+            s->num_evaluations.store(0, std::memory_order_relaxed);
+            s->total_ns.store(0, std::memory_order_relaxed);
+        }catch(...) {
+            delete s;
+            throw;
+        }
+        state->replace(s);
+        applied = p;
+    }
+
+    void DerivedGraph::process(const FrameInfo &info, const Position3d *markers)
+    {
+        State &s = *state->get();
+        const long long t0 = host_time_ns();
+        double *v = &s.values[0];
+        unsigned long long evaluated = 0;
+
+        unsigned long long seq = s.sequence.load(std::memory_order_relaxed);
+        s.sequence.store(seq+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(size_t w=0; w<s.dirty.size(); ++w) {
+            s.dirty[w] = s.pending[w];
+            s.pending[w] = 0;
+        }
+
+        // Sources, every frame: changed only if their values did.
+        for(int p=0; p<s.num_sources; ++p) {
+            const State::Step &st = s.plan[p];
+            const int node = st.node;
+            double *out = v+st.out;
+            double x[12];
+            bool ok;
+            if(st.kind == MARKER) {
+                const Position3d &m = markers[st.index];
+                ok = is_valid(m);
+                x[0] = m.x;
+                x[1] = m.y;
+                x[2] = m.z;
+            }else {
+                // Solved again only if its markers moved.
+                const int first = bodies.get_first_marker(st.index);
+                const size_t bytes = sizeof(Position3d)*bodies.get_num_markers(st.index);
+                Position3d *seen = &s.seen[st.history];
+                if(!memcmp(seen, markers+first, bytes))
+                    continue;
+                memcpy(seen, markers+first, bytes);
+                bodies.solve_body(st.index, markers);
+                const BodyPose &b = bodies.get_pose(st.index);
+                ok = b.valid;
+                memcpy(x, b.rotation, sizeof(b.rotation));
+                memcpy(x+9, b.translation, sizeof(b.translation));
+            }
+            ++evaluated;
+            if(ok != (s.valid[node] != 0) || (ok && memcmp(x, out, sizeof(double)*st.size))) {
+                if(ok)
+                    memcpy(out, x, sizeof(double)*st.size);
+                s.valid[node] = ok;
+                s.mark(st);
+            }
+        }
+
+        // Then only the steps marked, in order.  A step's consumers come
+        // after it, so the bits it sets are still ahead of us.
+        for(size_t w=0; w<s.dirty.size(); ++w) {
+            while(uint64_t bits = s.dirty[w]) {
+                s.dirty[w] = bits & (bits-1);
+                const State::Step &st = s.plan[64*w+lowest_bit(bits)];
+                const int node = st.node;
+                double *out = v+st.out;
+
+                bool ok = true;
+                for(int k=0; k<st.num_inputs; ++k)
+                    ok = ok && s.valid[st.src[k]];
+                if(!ok) {
+                    if(st.kind == VELOCITY)
+                        s.previous_valid[node] = 0;
+                    if(s.valid[node]) {
+                        s.valid[node] = 0;
+                        s.mark(st);
+                    }
+                    continue;
+                }
+
+                const double *a = v+st.in[0], *b = v+st.in[1];
+                if(st.kind == VELOCITY) {
+                    // The input as of the previous frame is what it was
+                    // when last seen here: it hasn't changed since.  Seen
+                    // again next frame while it's moving, to come down to
+                    // 0 when the input stops.
+                    double *prev = &s.previous[st.history];
+                    const int p = (int)(&st-&s.plan[0]);
+                    const bool first = !s.previous_valid[node];
+                    bool moving = first;
+                    if(!first) {
+                        ++evaluated;
+                        unsigned int frames = info.frame_number-s.last_frame;
+                        double rate = frames ? s.frame_frequency/frames : 0.;
+                        for(int k=0; k<st.size; ++k) {
+                            out[k] = (a[k]-prev[k])*rate;
+                            moving = moving || out[k] != 0.;
+                        }
+                    }
+                    memcpy(prev, a, sizeof(double)*st.size);
+                    s.previous_valid[node] = 1;
+                    if(moving)
+                        s.pending[p >> 6] |= 1ULL << (p & 63);
+                    if(first)
+                        continue; // Needs two frames.
+                    s.valid[node] = 1;
+                    s.mark(st);
+                    continue;
+                }
+
+                ++evaluated;
+                switch(st.kind) {
+                    case LANDMARK: {
+                        // a is a body: rotation, then translation.
+                        for(int r=0; r<3; ++r)
+                            out[r] = a[3*r]*st.x[0]+a[3*r+1]*st.x[1]+a[3*r+2]*st.x[2]+a[9+r];
+                        break;
+                    }
+                    case MIDPOINT:
+                        for(int r=0; r<3; ++r)
+                            out[r] = 0.5*(a[r]+b[r]);
+                        break;
+                    case DISTANCE: {
+                        double dx = b[0]-a[0], dy = b[1]-a[1], dz = b[2]-a[2];
+                        out[0] = sqrt(dx*dx+dy*dy+dz*dz);
+                        break;
+                    }
+                    case ANGLE: {
+                        // b is the vertex.
+                        const double *c = v+st.in[2];
+                        double u[3] = { a[0]-b[0], a[1]-b[1], a[2]-b[2] };
+                        double w[3] = { c[0]-b[0], c[1]-b[1], c[2]-b[2] };
+                        double cx = u[1]*w[2]-u[2]*w[1], cy = u[2]*w[0]-u[0]*w[2], cz = u[0]*w[1]-u[1]*w[0];
+                        out[0] = atan2(sqrt(cx*cx+cy*cy+cz*cz), u[0]*w[0]+u[1]*w[1]+u[2]*w[2]);
+                        break;
+                    }
+                    case JOINT: {
+                        // The child's rotation in the parent's: a^T*b.
+                        double r[9];
+                        for(int i=0; i<3; ++i)
+                            for(int j=0; j<3; ++j)
+                                r[3*i+j] = a[i]*b[j]+a[3+i]*b[3+j]+a[6+i]*b[6+j];
+                        double sb = r[2] > 1. ? 1. : r[2] < -1. ? -1. : r[2];
+                        out[0] = atan2(-r[5], r[8]);
+                        out[1] = asin(sb);
+                        out[2] = atan2(-r[1], r[0]);
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                s.valid[node] = 1;
+                s.mark(st);
+            }
+        }
+
+        s.last_frame = info.frame_number;
+        s.frame_number = info.frame_number;
+        s.sequence.store(seq+2, std::memory_order_release);
+
+        s.num_frames.fetch_add(1, std::memory_order_relaxed);
+        s.num_evaluations.fetch_add(evaluated, std::memory_order_relaxed);
+        s.total_ns.fetch_add(host_time_ns()-t0, std::memory_order_relaxed);
+    }
+
+    long long DerivedGraph::get(int node, double *values) const
+    {
+        const State *s = state->get();
+        if(!s || node < 0 || node >= (int)s->size.size())
+            return -1;
+        for(;;) {
+            unsigned long long seq = s->sequence.load(std::memory_order_acquire);
+            if(seq & 1)
+                continue; // A frame is being evaluated; a few microseconds.
+            long long fn = s->valid[node] ? s->frame_number : -1;
+            memcpy(values, &s->values[s->offset[node]], sizeof(double)*s->size[node]);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(s->sequence.load(std::memory_order_relaxed) == seq)
+                return fn;
+        }
+    }
+
+    double DerivedGraph::get_evaluations_per_frame() const
+    {
+        const State *s = state->get();
+        unsigned long long n = s ? s->num_frames.load(std::memory_order_relaxed) : 0;
+        return n ? (double)s->num_evaluations.load(std::memory_order_relaxed)/n : 0.;
+    }
+
+    double DerivedGraph::get_ns_per_frame() const
+    {
+        const State *s = state->get();
+        unsigned long long n = s ? s->num_frames.load(std::memory_order_relaxed) : 0;
+        return n ? (double)s->total_ns.load(std::memory_order_relaxed)/n : 0.;
+    }
+
+} // end of namespace
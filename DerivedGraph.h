@@ -0,0 +1,169 @@
+#ifndef _DERIVEDGRAPH_H_
+#define _DERIVEDGRAPH_H_
+
+/**
+ *@file DerivedGraph.h
+ *@brief Quantities derived from every frame, declared once and evaluated
+ * incrementally as a FrameStage.
+ */
+#include <string>
+#include <vector>
+#include "FrameStage.h"
+#include "RigidBodySolver.h"
+
+namespace VML {
+
+    template <class T> class StageState;
+
+    /**
+     * A graph of named quantities computed from the markers and rigid
+     * bodies of each frame: virtual landmarks, segment lengths, angles,
+     * joint angles between bodies, and velocities of all but bodies.
+     *
+     * Nodes are declared by name, their inputs by the names of other
+     * nodes, in any order before setup(); extend() a graph that's set up
+     * with inputs first.  setup() checks and compiles them into a flat
+     * plan in topological order, with every value in one preallocated
+     * array and each node's consumers listed.  process() looks at the
+     * sources (markers and bodies) and evaluates, in plan order, only the
+     * nodes downstream of those whose values changed, found with a dirty
+     * bit per node; it doesn't allocate.  A marker that's held or stays
+     * missing costs nothing downstream, and a body is fitted again only
+     * if its markers moved.  A node with an invalid input (a missing
+     * marker, a body that wasn't solved) is invalid without being
+     * evaluated.
+     *
+     * Values, in mm and radians:
+     *   marker, landmark, midpoint  x, y, z
+     *   body            rotation (row-major, 9), then translation (3)
+     *   distance        length
+     *   angle           at the middle of three points, 0 to pi
+     *   joint           X-Y-Z Cardan angles of the child body in the
+     *                   parent's frame: R = Rx(a)*Ry(b)*Rz(c)
+     *   velocity        d/dt of its input's values, per second, from the
+     *                   frame numbers and frame frequency; valid from the
+     *                   second frame its input is
+     *
+     * Declaring, and setup(), throw std::invalid_argument for a bad
+     * definition: an unknown or duplicate name, a cycle, an input of the
+     * wrong kind.  Reads (get()) are safe from any thread while frames
+     * come in; declare nodes while not acquiring.
+     */
+    class DerivedGraph : public FrameStage {
+        public:
+            enum Kind {
+                MARKER,
+                BODY,
+                LANDMARK,
+                MIDPOINT,
+                DISTANCE,
+                ANGLE,
+                JOINT,
+                VELOCITY
+            };
+
+            DerivedGraph();
+            ~DerivedGraph();
+
+            /**
+             * Use these rigid bodies (a copy is taken), e.g.
+             * CollectorCore::get_rigid_bodies().  Call before setup().
+             * They're fitted again here, when their markers move.
+             */
+            void set_rigid_bodies(const RigidBodySolver &b);
+
+            /**
+             * Declare a node.  Each returns the node's index, for get().
+             * @param i Marker index in the frame, from 0.
+             * @param b Rigid body index.
+             * @param x Point in body coordinates, 3 values.
+             */
+            int marker(const std::string &name, int i);
+            int body(const std::string &name, int b);
+            int landmark(const std::string &name, const std::string &body, const double *x);
+            int midpoint(const std::string &name, const std::string &a, const std::string &b);
+            int distance(const std::string &name, const std::string &a, const std::string &b);
+            int angle(const std::string &name, const std::string &a, const std::string &vertex, const std::string &b);
+            int joint(const std::string &name, const std::string &parent, const std::string &child);
+            int velocity(const std::string &name, const std::string &input);
+
+            /**
+             * Declare a node from one line of text, for scripts:
+             *
+             *   knee = landmark thigh 0 -12.5 -410
+             *   thigh_length = distance hip knee
+             *   knee_angle = joint thigh shank
+             *
+             * i.e. name = kind, then what the matching call takes.
+             */
+            int define(const std::string &definition);
+
+            /**
+             * define() a node with these rigid bodies, and if the graph is
+             * set up, compile it again with the parameters it was set up
+             * with, so its inputs must be declared already.  A bad
+             * definition throws and changes nothing: the graph keeps its
+             * nodes, bodies and plan.  Not while frames come in.
+             */
+            int extend(const std::string &definition, const RigidBodySolver &b);
+
+            /**
+             * Index of the node called name, -1 if there's none.
+             */
+            int find(const std::string &name) const;
+
+            int get_num_nodes() const { return (int)nodes.size(); }
+
+            /**
+             * Values per node: 3, 12 for a body, 1 for a distance or
+             * angle, its input's for a velocity.  Known after setup().
+             */
+            int get_size(int node) const;
+
+            const std::string &get_name(int node) const { return nodes[node].name; }
+
+            /**
+             * Node's values in the newest frame.  Waits if the frame is
+             * being evaluated, a few microseconds.
+             * @param values Room for get_size(node).
+             * @return The frame number, -1 if the node was invalid then or
+             * no frame has been evaluated.
+             */
+            long long get(int node, double *values) const;
+
+            /**
+             * Nodes evaluated per frame on average, and the time it took
+             * in ns, since setup().  Evaluations over nodes shows what the
+             * skipping saves.
+             */
+            double get_evaluations_per_frame() const;
+            double get_ns_per_frame() const;
+
+            void setup(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+        private:
+            struct Node {
+                std::string name;
+                Kind kind;
+                int index;                //< Marker or body.
+                double x[3];              //< Landmark.
+                std::string inputs[3];
+            };
+
+            struct State;
+
+            int add(const Node &n);
+
+            std::vector<Node> nodes;
+            RigidBodySolver bodies;
+            CollectionParams applied;     //< As of the last setup().
+            StageState<State> *state;
+
+            DerivedGraph(const DerivedGraph &);
+            DerivedGraph &operator=(const DerivedGraph &);
+    };
+
+} // end of namespace
+
+#endif/*_DERIVEDGRAPH_H_*/
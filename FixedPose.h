@@ -0,0 +1,381 @@
+#ifndef _FIXEDPOSE_H_
+#define _FIXEDPOSE_H_
+
+/**
+ *@file FixedPose.h
+ *@brief A Pose that never touches the heap.
+ *
+ * Same interface and the same lazy conversions as Pose/RotationRep, but
+ * the translation, Euler angles, quaternion and matrix are plain arrays
+ * inside the object.  A FixedPose is trivially copyable, so arrays of them
+ * can be memcpy'ed, and costs no allocation to build or copy.
+ *
+ * Conventions: the quaternion is (q0,q1,q2,q3) with q0 the scalar part,
+ * as in RotationRep.  Euler angles (rx,ry,rz) are rotations about the
+ * fixed x, y and z axes, applied in that order, i.e. R = Rz*Ry*Rx.
+ * Matrices are 3x3 row-major (4x4 for the homogeneous one).  Converting
+ * from and to a Pose goes through the rotation matrix.
+ */
+#include <math.h>
+#include <string.h>
+#include <type_traits>
+#include "Pose.h"
+
+namespace BVL {
+
+    /**
+     * The conversions, on raw arrays.  The batch kernels
+     * (RotationKernels.h) have their own, vectorized, with the same
+     * conventions; rotation_bench checks both against RotationRep.
+     */
+    inline void fixed_euler2matrix(const double e[3], double r[9]) {
+        double cx = cos(e[0]), sx = sin(e[0]);
+        double cy = cos(e[1]), sy = sin(e[1]);
+        double cz = cos(e[2]), sz = sin(e[2]);
+        r[0] = cz*cy; r[1] = cz*sy*sx-sz*cx; r[2] = cz*sy*cx+sz*sx;
+        r[3] = sz*cy; r[4] = sz*sy*sx+cz*cx; r[5] = sz*sy*cx-cz*sx;
+        r[6] = -sy;   r[7] = cy*sx;          r[8] = cy*cx;
+    }
+
+    inline void fixed_matrix2euler(const double r[9], double e[3]) {
+        e[0] = atan2(r[7], r[8]);
+        e[1] = atan2(-r[6], sqrt(r[0]*r[0]+r[3]*r[3]));
+        e[2] = atan2(r[3], r[0]);
+    }
+
+    inline void fixed_quaternion2matrix(const double q[4], double r[9]) {
+        double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+        r[0] = 1.-2.*(q2*q2+q3*q3); r[1] = 2.*(q1*q2-q0*q3);    r[2] = 2.*(q1*q3+q0*q2);
+        r[3] = 2.*(q1*q2+q0*q3);    r[4] = 1.-2.*(q1*q1+q3*q3); r[5] = 2.*(q2*q3-q0*q1);
+        r[6] = 2.*(q1*q3-q0*q2);    r[7] = 2.*(q2*q3+q0*q1);    r[8] = 1.-2.*(q1*q1+q2*q2);
+    }
+
+    /**
+     * Shepperd's method: divide by the largest of the four candidates.
+     * q0 comes out non-negative.
+     */
+    inline void fixed_matrix2quaternion(const double r[9], double q[4]) {
+        double t = r[0]+r[4]+r[8];
+        if(t >= r[0] && t >= r[4] && t >= r[8]) {
+            double s = 2.*sqrt(1.+t);
+            q[0] = 0.25*s;
+            q[1] = (r[7]-r[5])/s;
+            q[2] = (r[2]-r[6])/s;
+            q[3] = (r[3]-r[1])/s;
+        }else if(r[0] >= r[4] && r[0] >= r[8]) {
+            double s = 2.*sqrt(1.+r[0]-r[4]-r[8]);
+            q[0] = (r[7]-r[5])/s;
+            q[1] = 0.25*s;
+            q[2] = (r[1]+r[3])/s;
+            q[3] = (r[2]+r[6])/s;
+        }else if(r[4] >= r[8]) {
+            double s = 2.*sqrt(1.-r[0]+r[4]-r[8]);
+            q[0] = (r[2]-r[6])/s;
+            q[1] = (r[1]+r[3])/s;
+            q[2] = 0.25*s;
+            q[3] = (r[5]+r[7])/s;
+        }else {
+            double s = 2.*sqrt(1.-r[0]-r[4]+r[8]);
+            q[0] = (r[3]-r[1])/s;
+            q[1] = (r[2]+r[6])/s;
+            q[2] = (r[5]+r[7])/s;
+            q[3] = 0.25*s;
+        }
+        if(q[0] < 0.) {
+            q[0] = -q[0]; q[1] = -q[1]; q[2] = -q[2]; q[3] = -q[3];
+        }
+    }
+
+    struct FixedRotationRep {
+        enum {
+            EULER_SET=0x1,
+            QUATERNION_SET=0x2,
+            MATRIX_SET=0x4
+        };
+
+        // The identity, valid in all three formats.
+        constexpr FixedRotationRep()
+            :format_cache(EULER_SET|QUATERNION_SET|MATRIX_SET),
+            euler{0.,0.,0.},
+            quaternion{1.,0.,0.,0.},
+            matrix{1.,0.,0., 0.,1.,0., 0.,0.,1.}
+        {}
+
+        // When A_to_B is called, A is guarantted to be valid
+        void euler_to_matrix() {
+            fixed_euler2matrix(euler, matrix);
+            format_cache |= MATRIX_SET;
+        }
+
+        void euler_to_quaternion() {
+            if(!(format_cache & MATRIX_SET))
+                euler_to_matrix();
+            matrix_to_quaternion();
+        }
+
+        void matrix_to_euler() {
+            fixed_matrix2euler(matrix, euler);
+            format_cache |= EULER_SET;
+        }
+
+        void matrix_to_quaternion() {
+            fixed_matrix2quaternion(matrix, quaternion);
+            format_cache |= QUATERNION_SET;
+        }
+
+        void quaternion_to_euler() {
+            quaternion_to_matrix();
+            matrix_to_euler();
+        }
+
+        void quaternion_to_matrix() {
+            fixed_quaternion2matrix(quaternion, matrix);
+            format_cache |= MATRIX_SET;
+        }
+
+        constexpr bool euler_set() const {
+            return (format_cache & EULER_SET) != 0;
+        }
+
+        constexpr bool quaternion_set() const {
+            return (format_cache & QUATERNION_SET) != 0;
+        }
+
+        constexpr bool matrix_set() const {
+            return (format_cache & MATRIX_SET) != 0;
+        }
+
+        void get_euler() {
+            if(!euler_set()) {
+                if(matrix_set())
+                    matrix_to_euler();
+                else
+                    quaternion_to_euler();
+            }
+        }
+
+        void get_quaternion() {
+            if(!quaternion_set()) {
+                if(matrix_set())
+                    matrix_to_quaternion();
+                else
+                    euler_to_quaternion();
+            }
+        }
+
+        void get_matrix() {
+            if(!matrix_set()) {
+                if(euler_set())
+                    euler_to_matrix();
+                else
+                    quaternion_to_matrix();
+            }
+        }
+
+        void set_euler(double rx, double ry, double rz) {
+            euler[0] = rx;
+            euler[1] = ry;
+            euler[2] = rz;
+            // not |=, because we need to invalidate the cache
+            format_cache = EULER_SET;
+        }
+
+        void set_quaternion(double q0, double q1, double q2, double q3) {
+            quaternion[0] = q0;
+            quaternion[1] = q1;
+            quaternion[2] = q2;
+            quaternion[3] = q3;
+            format_cache = QUATERNION_SET;
+        }
+
+        void set_matrix(const double r[9]) {
+            memcpy(matrix, r, sizeof(matrix));
+            format_cache = MATRIX_SET;
+        }
+
+        unsigned int format_cache;
+        double euler[3];
+        double quaternion[4];
+        double matrix[9];
+    };
+
+    class FixedPose {
+        public:
+            constexpr FixedPose()
+                :translation{0.,0.,0.}
+            {}
+
+            constexpr FixedPose(double x, double y, double z)
+                :translation{x,y,z}
+            {}
+
+            /**
+             * Same as the Pose constructors.
+             */
+            FixedPose(const Vector<double> &r, const Vector<double> &t) {
+                if(r.dim() == 3)
+                    rotation.set_euler(r(1),r(2),r(3));
+                else if(r.dim() == 4)
+                    rotation.set_quaternion(r(1),r(2),r(3),r(4));
+                else
+                    throw std::logic_error("Using wrong-sized vector to initialize pose.");
+                set_translation(t);
+            }
+
+            FixedPose(const Matrix<double> &r, const Vector<double> &t) {
+                set_rotation(r);
+                set_translation(t);
+            }
+
+            explicit FixedPose(const Pose &p) {
+                set_rotation(p.get_rotation_matrix());
+                p.get_translation(translation[0], translation[1], translation[2]);
+            }
+
+            Pose to_pose() const {
+                return Pose(get_rotation_matrix(), get_translation());
+            }
+
+            void set_translation(double x, double y, double z) {
+                translation[0] = x;
+                translation[1] = y;
+                translation[2] = z;
+            }
+
+            void set_translation(const Vector<double> &t) {
+                assert(t.dim() == 3);
+                set_translation(t[0], t[1], t[2]);
+            }
+
+            Vector<double> get_translation() const {
+                Vector<double> t(3);
+                t[0] = translation[0];
+                t[1] = translation[1];
+                t[2] = translation[2];
+                return t;
+            }
+
+            void get_translation(double &x, double &y, double &z) const {
+                x = translation[0];
+                y = translation[1];
+                z = translation[2];
+            }
+
+            constexpr const double *translation_data() const {
+                return translation;
+            }
+
+            /**
+             * r: 3x3, row-major.
+             */
+            void get_rotation_matrix(double r[9]) const {
+                rotation.get_matrix();
+                memcpy(r, rotation.matrix, sizeof(rotation.matrix));
+            }
+
+            Matrix<double> get_rotation_matrix() const {
+                rotation.get_matrix();
+                Matrix<double> r(3,3);
+                for(int i=0; i<3; ++i)
+                    for(int j=0; j<3; ++j)
+                        r(i+1,j+1) = rotation.matrix[3*i+j];
+                return r;
+            }
+
+            void get_rotation_matrix(Matrix<double> &r) const {
+                r = get_rotation_matrix();
+            }
+
+            /**
+             * h: 4x4, row-major.
+             */
+            void get_homogeneous_matrix(double h[16]) const {
+                rotation.get_matrix();
+                const double *r = rotation.matrix;
+                h[0] = r[0]; h[1] = r[1]; h[2] = r[2];  h[3] = translation[0];
+                h[4] = r[3]; h[5] = r[4]; h[6] = r[5];  h[7] = translation[1];
+                h[8] = r[6]; h[9] = r[7]; h[10] = r[8]; h[11] = translation[2];
+                h[12] = 0.;  h[13] = 0.;  h[14] = 0.;   h[15] = 1.;
+            }
+
+            Matrix<double> get_homogeneous_matrix() const {
+                double a[16];
+                get_homogeneous_matrix(a);
+                Matrix<double> h(4,4);
+                for(int i=0; i<4; ++i)
+                    for(int j=0; j<4; ++j)
+                        h(i+1,j+1) = a[4*i+j];
+                return h;
+            }
+
+            Vector<double> get_euler_angles() const {
+                rotation.get_euler();
+                Vector<double> e(3);
+                e(1) = rotation.euler[0];
+                e(2) = rotation.euler[1];
+                e(3) = rotation.euler[2];
+                return e;
+            }
+
+            void get_euler_angles(double &rx, double &ry, double &rz) const {
+                rotation.get_euler();
+                rx = rotation.euler[0];
+                ry = rotation.euler[1];
+                rz = rotation.euler[2];
+            }
+
+            Vector<double> get_quaternion() const {
+                rotation.get_quaternion();
+                Vector<double> q(4);
+                for(int i=0; i<4; ++i)
+                    q(i+1) = rotation.quaternion[i];
+                return q;
+            }
+
+            void get_quaternion(double &q0, double &q1, double &q2, double &q3) const {
+                rotation.get_quaternion();
+                q0 = rotation.quaternion[0];
+                q1 = rotation.quaternion[1];
+                q2 = rotation.quaternion[2];
+                q3 = rotation.quaternion[3];
+            }
+
+            void set_rotation(double rx, double ry, double rz) {
+                rotation.set_euler(rx,ry,rz);
+            }
+
+            void set_rotation(double q0, double q1, double q2, double q3) {
+                rotation.set_quaternion(q0,q1,q2,q3);
+            }
+
+            void set_rotation(const double r[9]) {
+                rotation.set_matrix(r);
+            }
+
+            void set_rotation(const Matrix<double> &r) {
+                if(r.dim1() != 3 || r.dim2() != 3)
+                    throw std::logic_error("Using wrong-sized matrix to initialize pose.");
+                double a[9];
+                for(int i=0; i<3; ++i)
+                    for(int j=0; j<3; ++j)
+                        a[3*i+j] = r(i+1,j+1);
+                rotation.set_matrix(a);
+            }
+
+            const FixedRotationRep &get_rotation_rep() const {
+                return rotation;
+            }
+
+        protected:
+            double translation[3];
+            // Conversions are cached by const getters, as in Pose.
+            mutable FixedRotationRep rotation;
+    };
+
+    static_assert(std::is_trivially_copyable<FixedPose>::value, "FixedPose must stay trivially copyable.");
+
+    std::ostream &operator<<(std::ostream &os, const FixedPose &);
+
+}
+
+#endif/*_FIXEDPOSE_H_*/
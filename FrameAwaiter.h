@@ -0,0 +1,69 @@
+#ifndef _FRAMEAWAITER_H_
+#define _FRAMEAWAITER_H_
+
+/**
+ *@file FrameAwaiter.h
+ *@brief co_await the next frame instead of polling update_frame().
+ *
+ * C++20 native code only (/std:c++20, -std=c++20); OptoCollector has
+ * next_frame_async() for .NET.  Empty otherwise.
+ */
+#include "CollectorCore.h"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+
+namespace VML {
+
+    /**
+     * Suspends the coroutine until the acquisition thread has the next
+     * frame, then gives its number, or -1 if acquisition isn't running or
+     * stops first.  The coroutine resumes on the acquisition thread, so
+     * read the frame with latest_frame() and keep the work short, or hand
+     * it to another thread; don't stop acquisition from there.
+     *
+     *     for(;;) {
+     *         int fn = co_await next_frame(core);
+     *         if(fn < 0)
+     *             break;
+     *         core.latest_frame(info, markers);
+     *         ...
+     *     }
+     */
+    class NextFrame : private FrameWaiter {
+        public:
+            explicit NextFrame(CollectorCore &c):core(c), frame_number(-1) {
+                notify = &NextFrame::resume;
+            }
+
+            bool await_ready() const { return false; }
+
+            bool await_suspend(std::coroutine_handle<> h) {
+                handle = h;
+                return core.add_frame_waiter(this);
+            }
+
+            int await_resume() const { return frame_number; }
+
+        private:
+            static void resume(FrameWaiter *w, int fn) {
+                NextFrame *n = static_cast<NextFrame *>(w);
+                n->frame_number = fn;
+                n->handle.resume();
+            }
+
+            CollectorCore &core;
+            std::coroutine_handle<> handle;
+            int frame_number;
+    };
+
+    inline NextFrame next_frame(CollectorCore &c)
+    {
+        return NextFrame(c);
+    }
+
+} // end of namespace
+
+#endif
+
+#endif/*_FRAMEAWAITER_H_*/
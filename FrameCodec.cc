@@ -0,0 +1,439 @@
+/**
+ *@file FrameCodec.cc
+ *@brief
+ */
+#include <math.h>
+#include <string.h>
+#include <stdexcept>
+#include "FrameCodec.h"
+
+namespace VML {
+
+    namespace {
+
+        inline uint32_t zigzag(uint32_t r)
+        {
+            return (r << 1) ^ (uint32_t)((int32_t)r >> 31);
+        }
+
+        inline uint32_t unzigzag(uint32_t z)
+        {
+            return (z >> 1) ^ (0u-(z & 1));
+        }
+
+        inline int bit_width(uint32_t x)
+        {
+            int w = 0;
+            while(x) {
+                ++w;
+                x >>= 1;
+            }
+            return w;
+        }
+
+        inline size_t packed_bytes(size_t n, int width)
+        {
+            return (n*width+7)/8;
+        }
+
+        // Bytes a lane of n values can take at most.
+        inline size_t max_lane_bytes(size_t n)
+        {
+            return sizeof(CodecLaneHeader)+packed_bytes(n, 32)+8;
+        }
+
+        /*
+         * Write n values as a lane at p, with whichever predictor packs
+         * them smallest.  Writes whole 8-byte words, so up to 7 bytes past
+         * the lane may be scribbled on.
+         * @return The end of the lane.
+         */
+        char *put_lane(char *p, const uint32_t *v, int n)
+        {
+            uint32_t any[3] = { 0, 0, 0 };
+            for(int i=0; i<n; ++i)
+                any[0] |= zigzag(v[i]);
+            for(int i=1; i<n; ++i)
+                any[1] |= zigzag(v[i]-v[i-1]);
+            for(int i=2; i<n; ++i)
+                any[2] |= zigzag(v[i]-2*v[i-1]+v[i-2]);
+
+            int order = 0;
+            size_t best = (size_t)n*bit_width(any[0]);
+            for(int k=1; k<=2 && k<=n; ++k) {
+                size_t bits = (size_t)(n-k)*bit_width(any[k]);
+                if(bits < best) {
+                    best = bits;
+                    order = k;
+                }
+            }
+
+            CodecLaneHeader h;
+            h.order = (uint8_t)order;
+            h.width = (uint8_t)bit_width(any[order]);
+            h.reserved = 0;
+            h.base[0] = order >= 1 ? v[0] : 0;
+            h.base[1] = order >= 2 ? v[1]-v[0] : 0;
+            memcpy(p, &h, sizeof(h));
+            p += sizeof(h);
+
+            const int w = h.width;
+            if(w == 0)
+                return p;
+            uint64_t acc = 0;
+            int bits = 0;
+            char *out = p;
+            for(int i=order; i<n; ++i) {
+                uint32_t r = order == 0 ? v[i] : order == 1 ? v[i]-v[i-1] : v[i]-2*v[i-1]+v[i-2];
+                uint64_t z = zigzag(r);
+                acc |= z << bits;
+                bits += w;
+                if(bits >= 64) {
+                    memcpy(out, &acc, 8);
+                    out += 8;
+                    bits -= 64;
+                    acc = bits ? z >> (w-bits) : 0;
+                }
+            }
+            if(bits)
+                memcpy(out, &acc, 8);
+            return p+packed_bytes(n-order, w);
+        }
+
+        inline uint32_t unpack_one(const char *p, int i, int width, uint64_t mask)
+        {
+            uint64_t word;
+            memcpy(&word, p+(i*width >> 3), 8);
+            return (uint32_t)((word >> (i*width & 7)) & mask);
+        }
+
+        /*
+         * Undo the predictor over n residuals of W bits at p, carrying on
+         * from value x and delta d.  Eight residuals are W bytes, so
+         * within a group of eight every offset and shift is a constant
+         * and the loop is a handful of instructions per value.
+         */
+        template <int W, int ORDER>
+        void unpack(const char *p, int n, uint32_t *v, uint32_t x, uint32_t d)
+        {
+            const uint64_t mask = W == 32 ? 0xffffffffu : (1u << W)-1;
+            int i = 0;
+            for(; i+8<=n; i+=8, p+=W) {
+#if defined(__GNUC__)
+#pragma GCC unroll 8
+#endif
+                for(int j=0; j<8; ++j) {
+                    uint64_t word;
+                    memcpy(&word, p+j*W/8, 8);
+                    uint32_t r = unzigzag((uint32_t)((word >> (j*W%8)) & mask));
+                    if(ORDER == 0)
+                        v[i+j] = r;
+                    else if(ORDER == 1)
+                        v[i+j] = x += r;
+                    else {
+                        d += r;
+                        v[i+j] = x += d;
+                    }
+                }
+            }
+            for(int j=0; i<n; ++i, ++j) {
+                uint32_t r = unzigzag(unpack_one(p, j, W, mask));
+                if(ORDER == 0)
+                    v[i] = r;
+                else if(ORDER == 1)
+                    v[i] = x += r;
+                else {
+                    d += r;
+                    v[i] = x += d;
+                }
+            }
+        }
+
+        typedef void (*Unpacker)(const char *, int, uint32_t *, uint32_t, uint32_t);
+
+        template <int... W>
+        struct Unpackers {
+            static const Unpacker table[3][sizeof...(W)];
+        };
+
+        template <int... W>
+        const Unpacker Unpackers<W...>::table[3][sizeof...(W)] = {
+            { &unpack<W, 0>... },
+            { &unpack<W, 1>... },
+            { &unpack<W, 2>... }
+        };
+
+        // Indexed by order, then width.
+        typedef Unpackers<0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,
+                17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32> UnpackTable;
+
+        /*
+         * Read a lane of n values into v.  The block is padded so reading
+         * 8 bytes from anywhere inside the lane stays in it.
+         * @return The end of the lane, 0 if it doesn't fit before end.
+         */
+        const char *get_lane(const char *p, const char *end, uint32_t *v, int n)
+        {
+            if(end-p < (ptrdiff_t)sizeof(CodecLaneHeader))
+                return 0;
+            CodecLaneHeader h;
+            memcpy(&h, p, sizeof(h));
+            p += sizeof(h);
+            const int order = h.order, w = h.width;
+            if(order > 2 || order > n || w > 32)
+                return 0;
+            size_t bytes = packed_bytes(n-order, w);
+            if((size_t)(end-p) < bytes)
+                return 0;
+
+            uint32_t x = h.base[0], d = h.base[1];
+            if(order >= 1)
+                v[0] = x;
+            if(order >= 2)
+                v[1] = x += d;
+            UnpackTable::table[order][w](p, n-order, v+order, x, d);
+            return p+bytes;
+        }
+
+        const int64_t MAX_TIME_SPAN = 0xffffffffLL;
+
+    }
+
+    FrameEncoder::FrameEncoder(int nm, double res, int bf)
+        :num_markers(nm),
+        resolution(res),
+        block_frames(bf),
+        num_frames(0),
+        block_size(0),
+        ready(false)
+    {
+        if(!(res > 0.) || nm < 0 || bf <= 0)
+            throw std::logic_error("FrameEncoder needs a resolution and a block size.");
+        mask_words = (bf+63)/64;
+        infos.resize(bf);
+        coords.resize((size_t)3*nm*bf);
+        present.resize((size_t)nm*mask_words);
+        lane.resize(bf);
+
+        size_t most = sizeof(CodecBlockHeader)+3*max_lane_bytes(bf)
+            +nm*(sizeof(CodecMarkerHeader)+mask_words*sizeof(uint64_t)+3*max_lane_bytes(bf))+16;
+        block.resize(most);
+    }
+
+    bool FrameEncoder::fits(const FrameInfo &info) const
+    {
+        if(num_frames == 0)
+            return true;
+        int64_t dt = info.host_time-infos[0].host_time;
+        return num_frames < block_frames && dt >= 0 && dt <= MAX_TIME_SPAN;
+    }
+
+    bool FrameEncoder::add(const FrameInfo &info, const Position3d *markers)
+    {
+        ready = false;
+        if(!fits(info))
+            encode();
+        if(num_frames == 0)
+            memset(&present[0], 0, present.size()*sizeof(uint64_t));
+
+        const int f = num_frames++;
+        infos[f] = info;
+        const double scale = 1./resolution;
+        for(int m=0; m<num_markers; ++m) {
+            const Position3d &p = markers[m];
+            if(!is_valid(p))
+                continue;
+            present[(size_t)m*mask_words+f/64] |= 1ull << (f%64);
+            const float c[3] = { p.x, p.y, p.z };
+            for(int a=0; a<3; ++a) {
+                double q = c[a]*scale;
+                q = q < -2147483647. ? -2147483647. : q > 2147483647. ? 2147483647. : q;
+                coords[(size_t)(3*m+a)*block_frames+f] = (uint32_t)(int32_t)lrint(q);
+            }
+        }
+
+        if(num_frames == block_frames)
+            encode();
+        return ready;
+    }
+
+    bool FrameEncoder::flush()
+    {
+        ready = false;
+        if(num_frames > 0)
+            encode();
+        return ready;
+    }
+
+    void FrameEncoder::encode()
+    {
+        const int n = num_frames;
+        char *p = &block[0];
+        char *start = p;
+        p += sizeof(CodecBlockHeader);
+
+        for(int f=0; f<n; ++f)
+            lane[f] = infos[f].frame_number;
+        p = put_lane(p, &lane[0], n);
+        for(int f=0; f<n; ++f)
+            lane[f] = infos[f].flags;
+        p = put_lane(p, &lane[0], n);
+        for(int f=0; f<n; ++f)
+            lane[f] = (uint32_t)(infos[f].host_time-infos[0].host_time);
+        p = put_lane(p, &lane[0], n);
+
+        for(int m=0; m<num_markers; ++m) {
+            const uint64_t *bits = &present[(size_t)m*mask_words];
+            int count = 0;
+            for(int k=0; k<(n+63)/64; ++k) {
+                for(uint64_t b=bits[k]; b; b&=b-1)
+                    ++count;
+            }
+            CodecMarkerHeader mh;
+            mh.presence = count == n ? CodecMarkerHeader::ALL : count == 0 ? CodecMarkerHeader::NONE : CodecMarkerHeader::SOME;
+            mh.count = (uint32_t)count;
+            memcpy(p, &mh, sizeof(mh));
+            p += sizeof(mh);
+            if(mh.presence == CodecMarkerHeader::NONE)
+                continue;
+            if(mh.presence == CodecMarkerHeader::SOME) {
+                memcpy(p, bits, (n+63)/64*sizeof(uint64_t));
+                p += (n+63)/64*sizeof(uint64_t);
+            }
+
+            for(int a=0; a<3; ++a) {
+                const uint32_t *c = &coords[(size_t)(3*m+a)*block_frames];
+                const uint32_t *v = c;
+                if(count < n) {
+                    int k = 0;
+                    for(int f=0; f<n; ++f) {
+                        if(bits[f/64] >> (f%64) & 1)
+                            lane[k++] = c[f];
+                    }
+                    v = &lane[0];
+                }
+                p = put_lane(p, v, count);
+            }
+        }
+
+        // At least 8 bytes of padding, for the decoder's word reads.
+        size_t size = ((size_t)(p-start)+8+7) & ~(size_t)7;
+        memset(p, 0, start+size-p);
+
+        CodecBlockHeader h;
+        h.magic = CODEC_BLOCK_MAGIC;
+        h.size = (uint32_t)size;
+        h.num_frames = (uint32_t)n;
+        h.num_markers = num_markers;
+        h.resolution = resolution;
+        h.first_time = infos[0].host_time;
+        memcpy(start, &h, sizeof(h));
+
+        block_size = size;
+        num_frames = 0;
+        ready = true;
+    }
+
+    FrameDecoder::FrameDecoder()
+    {
+    }
+
+    size_t FrameDecoder::peek(const char *data, size_t available)
+    {
+        if(available < sizeof(CodecBlockHeader))
+            return 0;
+        CodecBlockHeader h;
+        memcpy(&h, data, sizeof(h));
+        if(h.magic != CODEC_BLOCK_MAGIC || h.size < sizeof(h)+8 || h.size > available || h.num_markers < 0)
+            return 0;
+        return h.size;
+    }
+
+    int FrameDecoder::decode(const char *data, size_t size, FrameInfo *infos, Position3d *markers)
+    {
+        if(peek(data, size) == 0)
+            return -1;
+        CodecBlockHeader h;
+        memcpy(&h, data, sizeof(h));
+        const int n = (int)h.num_frames, nm = h.num_markers;
+        // The padding is off limits to lanes: it's what word reads run into.
+        const char *end = data+h.size-8;
+        const char *p = data+sizeof(h);
+
+        if(values.size() < (size_t)3*n)
+            values.resize((size_t)3*n);
+        uint32_t *v = &values[0];
+
+        if(!(p = get_lane(p, end, v, n)))
+            return -1;
+        for(int f=0; f<n; ++f) {
+            infos[f].frame_number = v[f];
+            infos[f].num_markers = (unsigned int)nm;
+        }
+        if(!(p = get_lane(p, end, v, n)))
+            return -1;
+        for(int f=0; f<n; ++f)
+            infos[f].flags = v[f];
+        if(!(p = get_lane(p, end, v, n)))
+            return -1;
+        for(int f=0; f<n; ++f)
+            infos[f].host_time = h.first_time+v[f];
+
+        const double res = h.resolution;
+        const int words = (n+63)/64;
+        for(int m=0; m<nm; ++m) {
+            CodecMarkerHeader mh;
+            if(end-p < (ptrdiff_t)sizeof(mh))
+                return -1;
+            memcpy(&mh, p, sizeof(mh));
+            p += sizeof(mh);
+            Position3d *out = markers+m;
+
+            if(mh.presence == CodecMarkerHeader::NONE) {
+                for(int f=0; f<n; ++f, out+=nm)
+                    out->x = out->y = out->z = BAD_FLOAT;
+                continue;
+            }
+            const char *bits = 0;
+            if(mh.presence == CodecMarkerHeader::SOME) {
+                bits = p;
+                p += words*sizeof(uint64_t);
+                if(p > end)
+                    return -1;
+            }else if(mh.presence != CodecMarkerHeader::ALL || mh.count != (uint32_t)n) {
+                return -1;
+            }
+            const int c = (int)mh.count;
+            if(c > n)
+                return -1;
+            uint32_t *x = v, *y = v+c, *z = v+2*c;
+            if(!(p = get_lane(p, end, x, c)) || !(p = get_lane(p, end, y, c)) || !(p = get_lane(p, end, z, c)))
+                return -1;
+
+            if(!bits) {
+                for(int f=0; f<n; ++f, out+=nm) {
+                    out->x = (float)((int32_t)x[f]*res);
+                    out->y = (float)((int32_t)y[f]*res);
+                    out->z = (float)((int32_t)z[f]*res);
+                }
+                continue;
+            }
+            int k = 0;
+            for(int f=0; f<n; ++f, out+=nm) {
+                uint64_t word;
+                memcpy(&word, bits+f/64*sizeof(uint64_t), sizeof(word));
+                if((word >> (f%64) & 1) && k < c) {
+                    out->x = (float)((int32_t)x[k]*res);
+                    out->y = (float)((int32_t)y[k]*res);
+                    out->z = (float)((int32_t)z[k]*res);
+                    ++k;
+                }else
+                    out->x = out->y = out->z = BAD_FLOAT;
+            }
+            if(k != c)
+                return -1;
+        }
+        return n;
+    }
+
+} // end of namespace
@@ -0,0 +1,153 @@
+#ifndef _FRAMECODEC_H_
+#define _FRAMECODEC_H_
+
+/**
+ *@file FrameCodec.h
+ *@brief Lossy, compact encoding of frames in independent blocks.
+ *
+ * A block holds up to a few hundred consecutive frames:
+ *
+ *   CodecBlockHeader
+ *   lanes: frame numbers, flags, host times (ns after first_time)
+ *   per marker: CodecMarkerHeader, presence bits if some are missing,
+ *               then lanes x, y, z of the frames it's in
+ *   padding to a multiple of 8, at least 8 bytes
+ *
+ * Coordinates are quantized to multiples of the block's resolution.  A
+ * lane is a run of 32-bit values stored as residuals from a predictor,
+ * zigzagged and bit-packed at the width of the largest:
+ *
+ *   CodecLaneHeader, then ceil(n*width/8) bytes
+ *
+ * The predictor is chosen per lane as the one giving the narrowest
+ * residuals: none (order 0), the previous value (1, deltas), or the
+ * previous value plus the previous delta (2, constant velocity).  All
+ * arithmetic is modulo 2^32, so decoding is exact.
+ *
+ * Missing markers aren't coded at all: they're the clear bits of the
+ * marker's presence mask, and decode to BAD_FLOAT.
+ *
+ * Everything is little-endian.  Blocks decode independently, so a file
+ * of them can be seeked and decoded on several threads.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "OptoFrame.h"
+
+namespace VML {
+
+    struct CodecBlockHeader {
+        uint32_t magic;       //< CODEC_BLOCK_MAGIC
+        uint32_t size;        //< Bytes in the block, this header and padding included.
+        uint32_t num_frames;
+        int32_t num_markers;
+        double resolution;    //< mm per quantization step.
+        int64_t first_time;   //< Host time of the first frame, ns.
+    };
+
+    struct CodecLaneHeader {
+        uint8_t order;        //< Predictor: 0, 1 or 2.
+        uint8_t width;        //< Bits per residual, 0 to 32.
+        uint16_t reserved;
+        uint32_t base[2];     //< The first value, and the first delta with order 2.
+    };
+
+    struct CodecMarkerHeader {
+        enum {
+            ALL=0,            //< In every frame; no presence bits.
+            NONE=1,           //< In none; no lanes.
+            SOME=2            //< ceil(num_frames/64) uint64_t of presence bits follow.
+        };
+        uint32_t presence;
+        uint32_t count;       //< Frames it's in, the length of its lanes.
+    };
+
+    static const uint32_t CODEC_BLOCK_MAGIC = 0x4b4c424fu; // "OBLK"
+
+    /**
+     * Buffers frames and encodes them a block at a time.  Quantizing is
+     * O(markers) per frame, and a block is encoded in a couple of passes
+     * over what's buffered; all memory is allocated by the constructor.
+     */
+    class FrameEncoder {
+        public:
+            /**
+             * @param resolution mm per step, e.g. 0.01.  Coordinates round
+             * to the nearest step, so they're off by at most half of it.
+             * @param block_frames Frames per block.
+             */
+            FrameEncoder(int num_markers, double resolution, int block_frames=256);
+
+            /**
+             * Buffer a frame.
+             * @return true if a block is ready in get_block(), to be
+             * taken before the next add().  A block ends when it's full,
+             * or early if this frame's time or number can't be coded in
+             * it (4 s or more after its first frame, or going backwards).
+             */
+            bool add(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Encode what's buffered as a short block.
+             * @return false if nothing was.
+             */
+            bool flush();
+
+            const char *get_block() const { return &block[0]; }
+            size_t get_block_size() const { return block_size; }
+
+            int get_num_markers() const { return num_markers; }
+            double get_resolution() const { return resolution; }
+
+        private:
+            void encode();
+            bool fits(const FrameInfo &info) const;
+
+            int num_markers;
+            double resolution;
+            int block_frames;
+            int num_frames;       //< Buffered.
+
+            std::vector<FrameInfo> infos;
+            std::vector<uint32_t> coords; //< Marker m axis a of frame f at (3*m+a)*block_frames+f.
+            std::vector<uint64_t> present; //< Marker m's bits at m*mask_words.
+            int mask_words;
+            std::vector<uint32_t> lane;   //< One lane's values, gathered.
+
+            std::vector<char> block;
+            size_t block_size;
+            bool ready;
+    };
+
+    /**
+     * Decodes blocks.  decode() reads only its own buffer and writes only
+     * the caller's, so a decoder per thread can decode a file's blocks in
+     * parallel.
+     */
+    class FrameDecoder {
+        public:
+            FrameDecoder();
+
+            /**
+             * Check the block header at data.
+             * @param available Bytes at data.
+             * @return The block's size, 0 if it isn't a block or it's cut
+             * short.
+             */
+            static size_t peek(const char *data, size_t available);
+
+            /**
+             * @param infos,markers Room for the block's num_frames frames
+             * of num_markers markers.
+             * @return Frames decoded, -1 if the block is damaged.
+             */
+            int decode(const char *data, size_t size, FrameInfo *infos, Position3d *markers);
+
+        private:
+            std::vector<uint32_t> values;
+    };
+
+} // end of namespace
+
+#endif/*_FRAMECODEC_H_*/
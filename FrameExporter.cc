@@ -0,0 +1,592 @@
+/**
+ *@file FrameExporter.cc
+ *@brief
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "FrameExporter.h"
+
+namespace VML {
+
+    namespace {
+
+        enum {
+            C3D_BLOCK=512,
+            C3D_INTEL=84,
+            POINT=1,
+            ANALOG=2,
+            TRIAL=3
+        };
+
+        const long long BATCH_AGE = 500000000; //< ns before a batch goes out unfilled.
+
+        /*
+         * The parameter section: groups and parameters, each pointing to
+         * the next, in blocks.
+         */
+        class C3DParameters {
+            public:
+                C3DParameters()
+                    :last(0)
+                {
+                    // Block count goes in byte 2, filled in by get().
+                    const char header[4] = { 1, 0x50, 0, C3D_INTEL };
+                    bytes.assign(header, header+4);
+                }
+
+                void group(int id, const char *name) {
+                    start(name, -id);
+                    put_u8(0); // No description.
+                }
+
+                void int16s(int g, const char *name, const int *v, int n, bool array) {
+                    start(name, g);
+                    put_u8(2);
+                    dims(array ? 1 : 0, n);
+                    for(int i=0; i<n; ++i) {
+                        short s = (short)v[i];
+                        put(&s, 2);
+                    }
+                    put_u8(0);
+                }
+
+                void int16(int g, const char *name, int v) {
+                    int16s(g, name, &v, 1, false);
+                }
+
+                void real(int g, const char *name, float v) {
+                    start(name, g);
+                    put_u8(4);
+                    dims(0, 0);
+                    put(&v, 4);
+                    put_u8(0);
+                }
+
+                // Strings padded to a common width: a 2-D char array.
+                void strings(int g, const char *name, const std::vector<std::string> &s, int width) {
+                    start(name, g);
+                    put_u8(0xff);
+                    put_u8(2);
+                    put_u8(width);
+                    put_u8((int)s.size());
+                    for(size_t i=0; i<s.size(); ++i) {
+                        std::string p = s[i];
+                        p.resize(width, ' ');
+                        put(p.data(), width);
+                    }
+                    put_u8(0);
+                }
+
+                void string(int g, const char *name, const std::string &s) {
+                    start(name, g);
+                    put_u8(0xff);
+                    put_u8(1);
+                    put_u8((int)s.size());
+                    put(s.data(), s.size());
+                    put_u8(0);
+                }
+
+                /*
+                 * The section, padded to whole blocks.  The last record
+                 * still has offset 0: that's what ends the list.
+                 */
+                std::vector<char> get() const {
+                    std::vector<char> b(bytes);
+                    size_t blocks = (b.size()+C3D_BLOCK-1)/C3D_BLOCK;
+                    b.resize(blocks*C3D_BLOCK, 0);
+                    b[2] = (char)blocks;
+                    return b;
+                }
+
+            private:
+                void put(const void *p, size_t n) {
+                    bytes.insert(bytes.end(), (const char *)p, (const char *)p+n);
+                }
+
+                void put_u8(int v) {
+                    bytes.push_back((char)v);
+                }
+
+                void dims(int n, int d) {
+                    put_u8(n);
+                    if(n)
+                        put_u8(d);
+                }
+
+                void start(const char *name, int id) {
+                    // The previous record's offset points here.
+                    if(last) {
+                        short next = (short)(bytes.size()-last);
+                        memcpy(&bytes[last], &next, 2);
+                    }
+                    short zero = 0;
+                    put_u8((int)strlen(name));
+                    put_u8(id);
+                    put(name, strlen(name));
+                    last = bytes.size();
+                    put(&zero, 2);
+                }
+
+                std::vector<char> bytes;
+                size_t last;    //< Offset field of the latest record.
+        };
+
+        /*
+         * v with decimals digits after the point, rounded, at p.  The
+         * caller skips values that don't fit 64 bits.
+         */
+        char *put_fixed(char *p, double v, int decimals, unsigned long long scale)
+        {
+            unsigned long long q = (unsigned long long)((v < 0. ? -v : v)*scale+0.5);
+            if(v < 0. && q)
+                *p++ = '-';
+            unsigned long long whole = q/scale, frac = q%scale;
+            char digits[24];
+            int n = 0;
+            do {
+                digits[n++] = (char)('0'+whole%10);
+                whole /= 10;
+            }while(whole);
+            while(n)
+                *p++ = digits[--n];
+            if(decimals > 0) {
+                *p++ = '.';
+                for(int i=decimals-1; i>=0; --i) {
+                    p[i] = (char)('0'+frac%10);
+                    frac /= 10;
+                }
+                p += decimals;
+            }
+            return p;
+        }
+
+        double seconds_since(std::chrono::steady_clock::time_point t)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+        }
+
+    }
+
+    struct FrameExporter::Writer {
+        struct Batch {
+            std::vector<FrameInfo> infos;
+            std::vector<Position3d> markers;
+            int count;
+        };
+
+        Writer(int num_markers, int batch_frames)
+            :num_markers(num_markers),
+            frame_frequency(0.f),
+            decimals(0),
+            fill(0),
+            full(-1),
+            stopping(false),
+            file(0),
+            failed(false),
+            bytes(0),
+            num_written(0),
+            num_dropped(0),
+            busy(0.),
+            frames_in_file(0),
+            next_frame(0),
+            first_time(0)
+        {
+            for(int i=0; i<2; ++i) {
+                batches[i].infos.resize(batch_frames);
+                batches[i].markers.resize((size_t)batch_frames*num_markers);
+                batches[i].count = 0;
+            }
+        }
+
+        ~Writer() {
+            if(file)
+                fclose(file);
+        }
+
+        void run(Format format);
+        void write(const Batch &b, Format format);
+        void write_c3d(const Batch &b);
+        void write_csv(const Batch &b);
+        void write_bytes(const void *p, size_t n) {
+            if(!failed && fwrite(p, 1, n, file) != n)
+                failed = true;
+            bytes += n;
+        }
+
+        // The header and parameter blocks, for frames_in_file frames.
+        std::vector<char> c3d_head() const;
+        std::vector<char> c3d_parameters(int data_start) const;
+        void csv_head();
+
+        int num_markers;
+        float frame_frequency;
+        int decimals;
+        Batch batches[2];
+        int fill;               //< Batch the acquisition is filling.
+        int full;               //< Batch handed to the thread, -1 once it's done.
+        bool stopping;
+        std::mutex lock;
+        std::condition_variable changed;
+        std::thread thread;
+
+        FILE *file;
+        bool failed;
+        unsigned long long bytes; //< Written since the file was opened.
+        std::atomic<unsigned long long> num_written;
+        std::atomic<unsigned long long> num_dropped;
+        std::atomic<double> busy; //< Seconds spent writing.
+
+        // The writer thread's own.
+        unsigned long long frames_in_file; //< Gap frames included.
+        unsigned int next_frame;
+        long long first_time;
+        std::vector<float> points;
+        std::vector<char> text;
+    };
+
+    std::vector<char> FrameExporter::Writer::c3d_parameters(int data_start) const
+    {
+        C3DParameters p;
+        const int nm = num_markers;
+        const int frames = frames_in_file > 65535 ? 65535 : (int)frames_in_file;
+
+        p.group(POINT, "POINT");
+        p.int16(POINT, "USED", nm);
+        p.real(POINT, "SCALE", -1.f);
+        p.real(POINT, "RATE", frame_frequency);
+        p.int16(POINT, "DATA_START", data_start);
+        p.int16(POINT, "FRAMES", frames);
+        p.string(POINT, "UNITS", "mm");
+
+        // M1, M2, ..., at most 255 per parameter: LABELS, LABELS2, ...
+        int width = (int)std::to_string(nm).size()+1;
+        if(width < 4)
+            width = 4;
+        for(int first=0, k=1; first<nm; first+=255, ++k) {
+            std::vector<std::string> labels;
+            for(int i=first; i<nm && i<first+255; ++i)
+                labels.push_back("M"+std::to_string(i+1));
+            std::string name = k == 1 ? "LABELS" : "LABELS"+std::to_string(k);
+            p.strings(POINT, name.c_str(), labels, width);
+        }
+
+        p.group(ANALOG, "ANALOG");
+        p.int16(ANALOG, "USED", 0);
+        p.real(ANALOG, "RATE", frame_frequency);
+
+        // The frame count in full, as two 16-bit words.
+        p.group(TRIAL, "TRIAL");
+        const int start[2] = { 1, 0 };
+        const int end[2] = { (int)(frames_in_file & 0xffff), (int)(frames_in_file >> 16 & 0xffff) };
+        p.int16s(TRIAL, "ACTUAL_START_FIELD", start, 2, true);
+        p.int16s(TRIAL, "ACTUAL_END_FIELD", end, 2, true);
+        p.real(TRIAL, "CAMERA_RATE", frame_frequency);
+        return p.get();
+    }
+
+    std::vector<char> FrameExporter::Writer::c3d_head() const
+    {
+        // The section's size doesn't depend on the values in it.
+        const int data_start = 2+(int)(c3d_parameters(0).size()/C3D_BLOCK);
+        std::vector<char> params = c3d_parameters(data_start);
+
+        short w[C3D_BLOCK/2];
+        memset(w, 0, sizeof(w));
+        w[0] = 0x5002;          // Parameters start at block 2.
+        w[1] = (short)num_markers;
+        w[2] = 0;               // No analog.
+        w[3] = 1;
+        w[4] = (short)(frames_in_file > 65535 ? 65535 : frames_in_file);
+        w[5] = 10;              // Largest gap to interpolate.
+        const float scale = -1.f; // Negative: points are floats.
+        memcpy(&w[6], &scale, 4);
+        w[8] = (short)data_start;
+        w[9] = 0;
+        memcpy(&w[10], &frame_frequency, 4);
+
+        std::vector<char> head(sizeof(w)+params.size());
+        memcpy(&head[0], w, sizeof(w));
+        memcpy(&head[sizeof(w)], &params[0], params.size());
+        return head;
+    }
+
+    void FrameExporter::Writer::csv_head()
+    {
+        std::string s = "frame,time";
+        for(int i=0; i<num_markers; ++i) {
+            std::string m = ",M"+std::to_string(i+1);
+            s += m+"_x"+m+"_y"+m+"_z";
+        }
+        s += "\n";
+        write_bytes(s.data(), s.size());
+    }
+
+    void FrameExporter::Writer::write_c3d(const Batch &b)
+    {
+        const int nm = num_markers;
+        const size_t stride = (size_t)nm*4;
+        points.resize(stride);
+        for(int f=0; f<b.count; ++f) {
+            const FrameInfo &info = b.infos[f];
+
+            // Frames missing in between: all markers missing, as long as
+            // it looks like a gap and not a new collection.
+            unsigned int gap = frames_in_file ? info.frame_number-next_frame : 0;
+            if(gap > 0 && gap <= (unsigned int)(frame_frequency*60.f)) {
+                for(size_t j=0; j<stride; ++j)
+                    points[j] = (j & 3) == 3 ? -1.f : 0.f;
+                for(unsigned int k=0; k<gap; ++k)
+                    write_bytes(&points[0], stride*sizeof(float));
+                frames_in_file += gap;
+            }
+
+            const Position3d *m = &b.markers[(size_t)f*nm];
+            float *out = &points[0];
+            for(int i=0; i<nm; ++i, out+=4) {
+                bool ok = is_valid(m[i]);
+                out[0] = ok ? m[i].x : 0.f;
+                out[1] = ok ? m[i].y : 0.f;
+                out[2] = ok ? m[i].z : 0.f;
+                out[3] = ok ? 0.f : -1.f;
+            }
+            write_bytes(&points[0], stride*sizeof(float));
+            ++frames_in_file;
+            next_frame = info.frame_number+1;
+        }
+    }
+
+    void FrameExporter::Writer::write_csv(const Batch &b)
+    {
+        const int nm = num_markers;
+        // Sign, 20 digits, point, decimals and a comma per number.
+        const size_t longest = 64+(size_t)nm*3*(24+decimals);
+        text.resize(longest*b.count);
+        unsigned long long scale = 1;
+        for(int i=0; i<decimals; ++i)
+            scale *= 10;
+        const double limit = 9e18/scale;
+
+        char *p = &text[0];
+        for(int f=0; f<b.count; ++f) {
+            const FrameInfo &info = b.infos[f];
+            if(frames_in_file == 0)
+                first_time = info.host_time;
+            p = put_fixed(p, info.frame_number, 0, 1);
+            *p++ = ',';
+            p = put_fixed(p, (info.host_time-first_time)*1e-9, 6, 1000000);
+            const Position3d *m = &b.markers[(size_t)f*nm];
+            for(int i=0; i<nm; ++i) {
+                const float c[3] = { m[i].x, m[i].y, m[i].z };
+                bool ok = is_valid(m[i]);
+                for(int a=0; a<3; ++a) {
+                    *p++ = ',';
+                    if(ok && c[a] < limit && c[a] > -limit)
+                        p = put_fixed(p, c[a], decimals, scale);
+                }
+            }
+            *p++ = '\n';
+            ++frames_in_file;
+        }
+        write_bytes(&text[0], p-&text[0]);
+    }
+
+    void FrameExporter::Writer::write(const Batch &b, Format format)
+    {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if(format == C3D)
+            write_c3d(b);
+        else
+            write_csv(b);
+        busy.store(busy.load(std::memory_order_relaxed)+seconds_since(t0), std::memory_order_relaxed);
+        num_written.fetch_add(b.count, std::memory_order_relaxed);
+    }
+
+    void FrameExporter::Writer::run(Format format)
+    {
+        std::unique_lock<std::mutex> l(lock);
+        for(;;) {
+            changed.wait(l, [this]() { return full >= 0 || stopping; });
+            if(full < 0)
+                break;
+            Batch &b = batches[full];
+            l.unlock();
+            write(b, format);
+            l.lock();
+            b.count = 0;
+            full = -1;
+            changed.notify_all();
+        }
+    }
+
+    FrameExporter::FrameExporter(const std::string &p, Format f, const Params &ps)
+        :path(p),
+        segment(0),
+        format(f),
+        params(ps),
+        writer(0)
+    {
+        if(params.batch_frames < 1)
+            params.batch_frames = 1;
+        if(params.decimals < 0)
+            params.decimals = 0;
+        if(params.decimals > 9)
+            params.decimals = 9;
+    }
+
+    FrameExporter::~FrameExporter()
+    {
+        try {
+            close();
+        }catch(const std::exception &) {
+        }
+        delete writer;
+    }
+
+    FrameExporter::Format FrameExporter::format_of(const std::string &p)
+    {
+        if(p.size() < 4)
+            return CSV;
+        std::string ext = p.substr(p.size()-4);
+        for(size_t i=0; i<ext.size(); ++i)
+            ext[i] = (char)tolower((unsigned char)ext[i]);
+        return ext == ".c3d" ? C3D : CSV;
+    }
+
+    void FrameExporter::setup(const CollectionParams &p)
+    {
+        segment = 0;
+        open(path, p);
+    }
+
+    void FrameExporter::reconfigure(const CollectionParams &p)
+    {
+        // Not over what's been exported.
+        open(segment_path(path, ++segment), p);
+    }
+
+    void FrameExporter::open(const std::string &name, const CollectionParams &p)
+    {
+        close();
+        delete writer;
+        writer = 0;
+
+        Writer *w = new Writer(p.num_markers, params.batch_frames);
+        w->frame_frequency = p.frame_frequency;
+        w->decimals = params.decimals;
+        w->file = fopen(name.c_str(), "wb");
+        if(!w->file) {
+            delete w;
+            throw std::runtime_error("Can't create "+name);
+        }
+        file = name;
+        // Rewritten by close(), when the frame count is known.
+        if(format == C3D) {
+            std::vector<char> head = w->c3d_head();
+            w->write_bytes(&head[0], head.size());
+        }else
+            w->csv_head();
+
+        writer = w;
+        Format f = format;
+        w->thread = std::thread([w, f]() { w->run(f); });
+    }
+
+    bool FrameExporter::hand_off()
+    {
+        Writer *w = writer;
+        std::unique_lock<std::mutex> l(w->lock);
+        if(params.wait)
+            w->changed.wait(l, [w]() { return w->full < 0; });
+        if(w->full >= 0)
+            return false;
+        w->full = w->fill;
+        w->fill = 1-w->fill;
+        w->changed.notify_all();
+        return true;
+    }
+
+    void FrameExporter::process(const FrameInfo &info, const Position3d *markers)
+    {
+        if(!writer)
+            return;
+        const int nm = writer->num_markers;
+        Writer::Batch *b = &writer->batches[writer->fill];
+        if(b->count == params.batch_frames) {
+            if(!hand_off()) {
+                writer->num_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            b = &writer->batches[writer->fill];
+        }
+
+        b->infos[b->count] = info;
+        memcpy(&b->markers[(size_t)b->count*nm], markers, sizeof(Position3d)*nm);
+        ++b->count;
+        if(b->count == params.batch_frames || info.host_time-b->infos[0].host_time >= BATCH_AGE)
+            hand_off();
+    }
+
+    void FrameExporter::close()
+    {
+        Writer *w = writer;
+        if(!w || !w->file)
+            return;
+
+        {
+            // The last batch, once the thread is free for it.
+            std::unique_lock<std::mutex> l(w->lock);
+            w->changed.wait(l, [w]() { return w->full < 0; });
+            if(w->batches[w->fill].count > 0) {
+                w->full = w->fill;
+                w->fill = 1-w->fill;
+            }
+            w->stopping = true;
+            w->changed.notify_all();
+        }
+        if(w->thread.joinable())
+            w->thread.join();
+
+        if(format == C3D) {
+            // Whole blocks, then the header again with the frame count.
+            if(w->bytes%C3D_BLOCK) {
+                std::vector<char> pad(C3D_BLOCK-w->bytes%C3D_BLOCK, 0);
+                w->write_bytes(&pad[0], pad.size());
+            }
+            std::vector<char> head = w->c3d_head();
+            if(fseek(w->file, 0, SEEK_SET))
+                w->failed = true;
+            w->write_bytes(&head[0], head.size());
+        }
+        bool ok = fclose(w->file) == 0 && !w->failed;
+        w->file = 0;
+        if(!ok)
+            throw std::runtime_error("Can't write "+file);
+    }
+
+    unsigned long long FrameExporter::get_num_written() const
+    {
+        return writer ? writer->num_written.load(std::memory_order_relaxed) : 0;
+    }
+
+    unsigned long long FrameExporter::get_num_dropped() const
+    {
+        return writer ? writer->num_dropped.load(std::memory_order_relaxed) : 0;
+    }
+
+    double FrameExporter::get_frames_per_second() const
+    {
+        if(!writer)
+            return 0.;
+        double s = writer->busy.load(std::memory_order_relaxed);
+        return s > 0. ? get_num_written()/s : 0.;
+    }
+
+} // end of namespace
@@ -0,0 +1,122 @@
+#ifndef _FRAMEEXPORTER_H_
+#define _FRAMEEXPORTER_H_
+
+/**
+ *@file FrameExporter.h
+ *@brief Write every frame to a C3D or CSV file from a background thread.
+ */
+#include <string>
+#include "FrameStage.h"
+
+namespace VML {
+
+    /**
+     * A FrameStage that exports the session for analysis tools.
+     *
+     * Frames are copied into one of two batches.  When the batch is full
+     * (or half a second old) it's handed to a writer thread and the other
+     * batch takes its place, so the acquisition never waits for the disk.
+     * If the writer is still busy with the other batch, frames are dropped
+     * until it's done; get_num_dropped() says how many.
+     *
+     * C3D: float points, one per marker, labelled M1, M2, ..., in mm, at
+     * POINT:RATE = frame_frequency.  Missing markers have residual -1 and
+     * coordinates 0, the others residual 0 (the Optotrak doesn't report
+     * one).  Frames the file didn't get, dropped here or by the device,
+     * are written as all missing so the frame rate still holds.  The
+     * frame count is filled in by close().
+     *
+     * CSV: frame number, seconds since the first frame, then x, y, z of
+     * each marker with a fixed number of decimals; missing markers are
+     * empty fields.  Numbers are formatted by hand, so the locale doesn't
+     * matter.
+     *
+     * After a reconfigure() the export carries on in a new file, since
+     * the frame rate or size may have changed: trial.c3d, trial.1.c3d,
+     * trial.2.c3d, each complete in itself.
+     *
+     * Errors throw std::runtime_error: from setup() or reconfigure() if
+     * the file can't be created, from close() if it couldn't be written.
+     */
+    class FrameExporter : public FrameStage {
+        public:
+            enum Format {
+                C3D,
+                CSV
+            };
+
+            struct Params {
+                Params()
+                    :batch_frames(256),
+                    decimals(3),
+                    wait(false)
+                {}
+
+                int batch_frames;   //< Frames per batch.
+                int decimals;       //< CSV digits after the point.
+                bool wait;          //< Wait for the writer instead of dropping, for offline conversion only.
+            };
+
+            /**
+             * @param path The file is created (or truncated) in setup().
+             */
+            FrameExporter(const std::string &path, Format format, const Params &p=Params());
+            ~FrameExporter();
+
+            /**
+             * C3D for paths ending in .c3d (any case), CSV otherwise.
+             */
+            static Format format_of(const std::string &path);
+
+            void setup(const CollectionParams &p);
+            void reconfigure(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Write out what's left and finalize the file.  Detach the
+             * exporter from the collector (or stop acquiring) first.
+             */
+            void close();
+
+            /**
+             * In the current file.
+             */
+            unsigned long long get_num_written() const;
+            unsigned long long get_num_dropped() const;
+
+            /**
+             * Frames written per second the writer spent writing: how fast
+             * it could go, whatever the frame rate.
+             */
+            double get_frames_per_second() const;
+
+            const std::string &get_path() const { return path; }
+
+            /**
+             * The file being written: get_path(), or the segment since
+             * the last reconfigure().
+             */
+            const std::string &get_file() const { return file; }
+
+        private:
+            struct Writer;
+
+            // Close the current file, if any, and start exporting to name.
+            void open(const std::string &name, const CollectionParams &p);
+            // Give the writer the batch being filled, if it's free.
+            bool hand_off();
+
+            std::string path;
+            std::string file;
+            int segment;
+            Format format;
+            Params params;
+            Writer *writer;
+
+            FrameExporter(const FrameExporter &);
+            FrameExporter &operator=(const FrameExporter &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMEEXPORTER_H_*/
@@ -0,0 +1,38 @@
+/**
+ *@file FramePublisher.cc
+ *@brief
+ */
+#include "SharedFrames.h"
+#include "FramePublisher.h"
+
+namespace VML {
+
+    FramePublisher::FramePublisher(const std::string &n, int s)
+        :name(n),
+        num_slots(s),
+        frames(new SharedFrames)
+    {
+    }
+
+    FramePublisher::~FramePublisher()
+    {
+        delete frames;
+    }
+
+    void FramePublisher::setup(const CollectionParams &p)
+    {
+        frames->create(name, p.num_markers, num_slots, p.frame_frequency);
+    }
+
+    void FramePublisher::process(const FrameInfo &info, const Position3d *markers)
+    {
+        if(frames->is_open())
+            frames->publish(info, markers);
+    }
+
+    void FramePublisher::close()
+    {
+        frames->close();
+    }
+
+} // end of namespace
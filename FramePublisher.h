@@ -0,0 +1,57 @@
+#ifndef _FRAMEPUBLISHER_H_
+#define _FRAMEPUBLISHER_H_
+
+/**
+ *@file FramePublisher.h
+ *@brief Publish every frame in shared memory for other processes (see
+ * SharedFrames.h and FrameSubscriber.h).
+ */
+#include <string>
+#include "FrameStage.h"
+
+namespace VML {
+
+    class SharedFrames;
+
+    /**
+     * A FrameStage that copies each frame into a named shared-memory
+     * segment, where any number of FrameSubscribers, in any process, read
+     * it.  process() is one copy into the segment and, only if a reader is
+     * asleep waiting, one wake-up call; it never waits for the readers.
+     *
+     * The segment is created in setup(), so setting the collection up
+     * again with another frame size makes a new one; readers of the old
+     * one see it closed and open it again.
+     */
+    class FramePublisher : public FrameStage {
+        public:
+            /**
+             * @param name POSIX shm name, e.g. "/optotrak".
+             * @param num_slots Frames kept, so slow readers still get a
+             * consistent frame without retrying.
+             */
+            FramePublisher(const std::string &name, int num_slots=8);
+            ~FramePublisher();
+
+            void setup(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Take the segment down; readers see it closed.
+             */
+            void close();
+
+            const std::string &get_name() const { return name; }
+
+        private:
+            std::string name;
+            int num_slots;
+            SharedFrames *frames;
+
+            FramePublisher(const FramePublisher &);
+            FramePublisher &operator=(const FramePublisher &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMEPUBLISHER_H_*/
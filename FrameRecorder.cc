@@ -0,0 +1,239 @@
+/**
+ *@file FrameRecorder.cc
+ *@brief
+ */
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "FrameCodec.h"
+#include "FrameRing.h"
+#include "MappedFile.h"
+#include "Recording.h"
+#include "FrameRecorder.h"
+
+namespace VML {
+
+    struct FrameRecorder::Writer {
+        Writer(int num_markers, int buffer_frames)
+            :ring(num_markers, buffer_frames),
+            running(false),
+            num_written(0),
+            num_dropped(0),
+            next(0),
+            end(0),
+            capacity(0),
+            growth(0),
+            encoder(0),
+            infos(BATCH),
+            markers(BATCH*num_markers)
+        {}
+
+        ~Writer() {
+            delete encoder;
+        }
+
+        // Copy everything in the ring to the file.  False if there was nothing.
+        bool drain();
+        // Make room for n more bytes.
+        void reserve(unsigned long long n);
+        // Append the encoder's block.
+        void write_block();
+
+        RecordingHeader *header() {
+            return (RecordingHeader *)file.data();
+        }
+
+        enum { BATCH=64 };
+
+        FrameRing ring;
+        MappedFile file;
+        std::thread thread;
+        std::atomic<bool> running;
+        std::atomic<unsigned long long> num_written;
+        std::atomic<unsigned long long> num_dropped;
+
+        unsigned long long next;     //< Ring position to read next.
+        unsigned long long end;      //< Bytes written after the header.
+        unsigned long long capacity; //< Bytes the file has room for after the header.
+        unsigned long long growth;   //< Bytes added each time it's full.
+        uint32_t rsize;
+        FrameEncoder *encoder;       //< Compressing, if set.
+
+        std::vector<FrameInfo> infos;
+        std::vector<Position3d> markers;
+    };
+
+    void FrameRecorder::Writer::reserve(unsigned long long n)
+    {
+        if(end+n <= capacity)
+            return;
+        while(capacity < end+n)
+            capacity += growth;
+        file.resize(sizeof(RecordingHeader)+capacity);
+    }
+
+    void FrameRecorder::Writer::write_block()
+    {
+        size_t size = encoder->get_block_size();
+        reserve(size);
+        memcpy(file.data()+sizeof(RecordingHeader)+end, encoder->get_block(), size);
+        end += size;
+
+        CodecBlockHeader b;
+        memcpy(&b, encoder->get_block(), sizeof(b));
+        unsigned long long written = num_written.load(std::memory_order_relaxed)+b.num_frames;
+        std::atomic_thread_fence(std::memory_order_release);
+        header()->data_size = end;
+        header()->num_records = written;
+        num_written.store(written, std::memory_order_relaxed);
+    }
+
+    bool FrameRecorder::Writer::drain()
+    {
+        int nm = ring.get_num_markers();
+        unsigned long long before = next;
+        int n = ring.read_from(next, &infos[0], &markers[0], BATCH);
+        if(n == 0)
+            return false;
+        if(next-before > (unsigned long long)n)
+            num_dropped.fetch_add(next-before-n, std::memory_order_relaxed);
+
+        if(encoder) {
+            for(int i=0; i<n; ++i) {
+                if(encoder->add(infos[i], &markers[i*nm]))
+                    write_block();
+            }
+            return true;
+        }
+
+        reserve((unsigned long long)n*rsize);
+        unsigned long long written = num_written.load(std::memory_order_relaxed);
+        char *r = file.data()+sizeof(RecordingHeader)+end;
+        for(int i=0; i<n; ++i, r+=rsize) {
+            RecordHeader *h = (RecordHeader *)r;
+            h->frame_number = infos[i].frame_number;
+            h->flags = infos[i].flags;
+            h->host_time = infos[i].host_time;
+            memcpy(r+sizeof(RecordHeader), &markers[i*nm], sizeof(Position3d)*nm);
+        }
+
+        // Publish the records only after they've been written.
+        std::atomic_thread_fence(std::memory_order_release);
+        header()->num_records = written+n;
+        num_written.store(written+n, std::memory_order_relaxed);
+        end += (unsigned long long)n*rsize;
+        return true;
+    }
+
+    FrameRecorder::FrameRecorder(const std::string &p, int n, double res)
+        :path(p),
+        segment(0),
+        buffer_frames(n),
+        resolution(res),
+        writer(0)
+    {
+    }
+
+    FrameRecorder::~FrameRecorder()
+    {
+        close();
+        delete writer;
+    }
+
+    void FrameRecorder::setup(const CollectionParams &p)
+    {
+        segment = 0;
+        open(path, p);
+    }
+
+    void FrameRecorder::reconfigure(const CollectionParams &p)
+    {
+        // Not over what's been recorded.
+        open(segment_path(path, ++segment), p);
+    }
+
+    void FrameRecorder::open(const std::string &name, const CollectionParams &p)
+    {
+        close();
+        delete writer;
+        writer = new Writer(p.num_markers, buffer_frames);
+
+        // Room for a minute to begin with, and another minute whenever
+        // it's full, so remapping is rare.  Compressed, it's five minutes
+        // or more.
+        writer->rsize = record_size(p.num_markers);
+        unsigned long long frames = (unsigned long long)(p.frame_frequency*60.f);
+        if(frames < 1024)
+            frames = 1024;
+        writer->growth = frames*writer->rsize;
+        if(resolution > 0.)
+            writer->encoder = new FrameEncoder(p.num_markers, resolution);
+        writer->capacity = writer->growth;
+        writer->file.create(name, sizeof(RecordingHeader)+writer->capacity);
+        file = name;
+
+        RecordingHeader *h = writer->header();
+        memset(h, 0, sizeof(RecordingHeader));
+        memcpy(h->magic, writer->encoder ? COMPRESSED_MAGIC : RECORDING_MAGIC, sizeof(h->magic));
+        h->version = RecordingHeader::VERSION;
+        h->header_size = sizeof(RecordingHeader);
+        h->record_size = writer->encoder ? 0 : writer->rsize;
+        h->num_markers = p.num_markers;
+        h->frame_frequency = p.frame_frequency;
+        h->marker_frequency = p.marker_frequency;
+        h->threshold = p.threshold;
+        h->gain = p.gain;
+        h->stream_mode = p.stream_mode;
+        h->cycle = p.cycle;
+        h->voltage = p.voltage;
+        h->collect_time = p.collect_time;
+        h->trigger_time = p.trigger_time;
+        h->flags = p.flags;
+        h->start_time = host_time_ns();
+        h->num_records = 0;
+
+        Writer *w = writer;
+        w->running.store(true);
+        w->thread = std::thread([w]() {
+            while(w->running.load(std::memory_order_relaxed)) {
+                if(!w->drain())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+    }
+
+    void FrameRecorder::process(const FrameInfo &info, const Position3d *markers)
+    {
+        if(writer)
+            writer->ring.push(info, markers);
+    }
+
+    void FrameRecorder::close()
+    {
+        if(!writer || !writer->file.is_open())
+            return;
+
+        writer->running.store(false);
+        if(writer->thread.joinable())
+            writer->thread.join();
+        while(writer->drain())
+            ;
+        if(writer->encoder && writer->encoder->flush())
+            writer->write_block();
+
+        writer->file.close(sizeof(RecordingHeader)+writer->end);
+    }
+
+    unsigned long long FrameRecorder::get_num_written() const
+    {
+        return writer ? writer->num_written.load(std::memory_order_relaxed) : 0;
+    }
+
+    unsigned long long FrameRecorder::get_num_dropped() const
+    {
+        return writer ? writer->num_dropped.load(std::memory_order_relaxed) : 0;
+    }
+
+} // end of namespace
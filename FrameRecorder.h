@@ -0,0 +1,85 @@
+#ifndef _FRAMERECORDER_H_
+#define _FRAMERECORDER_H_
+
+/**
+ *@file FrameRecorder.h
+ *@brief Record every frame to a memory-mapped file (see Recording.h).
+ */
+#include <string>
+#include "FrameStage.h"
+
+namespace VML {
+
+    /**
+     * A FrameStage that logs the session.  process() only copies the frame
+     * into a ring; a writer thread drains the ring into the mapped file,
+     * growing it in large steps, and keeps the header's num_records
+     * current so a reader can follow a live recording.
+     *
+     * If the writer falls more than a ring's worth behind, frames are
+     * dropped rather than the acquisition held up; get_num_dropped() says
+     * how many.
+     *
+     * With a resolution, the writer thread encodes the frames with
+     * FrameEncoder instead and the file is a compressed recording; a
+     * reader sees frames a block at a time.  Read it with
+     * CompressedReader.
+     *
+     * After a reconfigure() the recording carries on in a new file, one
+     * per segment: trial.rec, trial.1.rec, trial.2.rec, each with its
+     * own header.
+     */
+    class FrameRecorder : public FrameStage {
+        public:
+            /**
+             * @param path The file is created (or truncated) in setup().
+             * @param buffer_frames Frames the ring holds.
+             * @param resolution mm per step to compress to, 0 not to.
+             */
+            FrameRecorder(const std::string &path, int buffer_frames=4096, double resolution=0.);
+            ~FrameRecorder();
+
+            void setup(const CollectionParams &p);
+            void reconfigure(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Write out what's left and finalize the file.  Detach the
+             * recorder from the collector (or stop acquiring) first.
+             */
+            void close();
+
+            /**
+             * In the current file.
+             */
+            unsigned long long get_num_written() const;
+            unsigned long long get_num_dropped() const;
+
+            const std::string &get_path() const { return path; }
+
+            /**
+             * The file being written: get_path(), or the segment since
+             * the last reconfigure().
+             */
+            const std::string &get_file() const { return file; }
+
+        private:
+            struct Writer;
+
+            // Close the current file, if any, and start recording to name.
+            void open(const std::string &name, const CollectionParams &p);
+
+            std::string path;
+            std::string file;
+            int segment;
+            int buffer_frames;
+            double resolution;
+            Writer *writer;
+
+            FrameRecorder(const FrameRecorder &);
+            FrameRecorder &operator=(const FrameRecorder &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMERECORDER_H_*/
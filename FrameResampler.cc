@@ -0,0 +1,412 @@
+/**
+ *@file FrameResampler.cc
+ *@brief
+ */
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include "StageState.h"
+#include "FrameResampler.h"
+
+namespace VML {
+
+    namespace {
+
+        enum {
+            SLOTS=8,  //< Frames kept, so the writer stays clear of the ones a query reads.
+            WINDOW=4  //< Frames a query reads.
+        };
+
+    }
+
+    struct FrameResampler::State {
+        State(int num_markers, int num_bodies)
+            :n(num_markers),
+            b(num_bodies),
+            markers(SLOTS*num_markers),
+            poses(SLOTS*num_bodies),
+            head(0),
+            offset(0.),
+            started(false),
+            last_frame(0)
+        {
+            for(int i=0; i<SLOTS; ++i)
+                sequence[i].store(0, std::memory_order_relaxed);
+        }
+
+        int n, b;
+
+        // Slot i&(SLOTS-1) holds frame i; sequence 2i+1 while it's written.
+        std::atomic<unsigned long long> sequence[SLOTS];
+        long long time[SLOTS];
+        std::vector<Position3d> markers;
+        std::vector<BodyPose> poses;
+        std::atomic<unsigned long long> head;
+
+        // Timeline, producer only.
+        double period_ns;
+        long long latency_ns;
+        double offset; //< Arrival time of frame 0, ns.
+        bool started;
+        unsigned int last_frame;
+    };
+
+    /**
+     * Weights over the window giving an estimate at the query time.  Only
+     * usable for a marker seen in all of frames lo to hi.
+     */
+    struct FrameResampleStencil {
+        int lo, hi;
+        double w[WINDOW];
+    };
+
+    struct FrameResampler::Query {
+        const State *s;
+        unsigned long long head;
+        int m; //< Frames in the window, oldest first.
+        long long time[WINDOW];
+        // Best first; the next ones need fewer frames.
+        FrameResampleStencil stencils[3];
+        int num_stencils;
+        // Rotations: SLERP from frame a to frame b by u.
+        int a, b;
+        double u;
+        int result;
+
+        size_t slot(int k) const { return (size_t)((head-m+k) & (SLOTS-1)); }
+    };
+
+    namespace {
+
+        void clear(FrameResampleStencil &st, int lo, int hi)
+        {
+            st.lo = lo;
+            st.hi = hi;
+            for(int k=0; k<WINDOW; ++k)
+                st.w[k] = 0.;
+        }
+
+        void quaternion_to_matrix(const double *q, double *r)
+        {
+            double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+            r[0] = 1.-2.*(q2*q2+q3*q3); r[1] = 2.*(q1*q2-q0*q3);    r[2] = 2.*(q1*q3+q0*q2);
+            r[3] = 2.*(q1*q2+q0*q3);    r[4] = 1.-2.*(q1*q1+q3*q3); r[5] = 2.*(q2*q3-q0*q1);
+            r[6] = 2.*(q1*q3-q0*q2);    r[7] = 2.*(q2*q3+q0*q1);    r[8] = 1.-2.*(q1*q1+q2*q2);
+        }
+
+        /*
+         * Along the shortest arc from q0 (u=0) to q1 (u=1); u > 1
+         * carries on at the same angular velocity.  The result is unit
+         * length with q[0] >= 0.
+         */
+        void slerp(const double *q0, const double *q1, double u, double *q)
+        {
+            double d = q0[0]*q1[0]+q0[1]*q1[1]+q0[2]*q1[2]+q0[3]*q1[3];
+            double sign = d < 0. ? -1. : 1.;
+            d = fabs(d);
+            double w0, w1;
+            if(d > 0.9999999) {
+                w0 = 1.-u;
+                w1 = u;
+            }else {
+                double theta = acos(d);
+                double st = sin(theta);
+                w0 = sin((1.-u)*theta)/st;
+                w1 = sin(u*theta)/st;
+            }
+            double norm = 0.;
+            for(int k=0; k<4; ++k) {
+                q[k] = w0*q0[k]+sign*w1*q1[k];
+                norm += q[k]*q[k];
+            }
+            norm = (q[0] < 0. ? -1. : 1.)/sqrt(norm);
+            for(int k=0; k<4; ++k)
+                q[k] *= norm;
+        }
+
+    }
+
+    FrameResampler::FrameResampler(const Params &p)
+        :params(p),
+        state(new StageState<State>)
+    {
+    }
+
+    FrameResampler::~FrameResampler()
+    {
+        delete state;
+    }
+
+    void FrameResampler::set_rigid_bodies(const RigidBodySolver &b)
+    {
+        bodies = b;
+    }
+
+    void FrameResampler::setup(const CollectionParams &p)
+    {
+        if(!(p.frame_frequency > 0.f))
+            throw std::logic_error("Resampling needs the frame frequency.");
+        if(bodies.get_num_bodies())
+            bodies.setup(p.num_markers);
+
+        State *s = new State(p.num_markers, bodies.get_num_bodies());
+        s->period_ns = 1e9/p.frame_frequency;
+        s->latency_ns = (long long)(params.latency*1e9);
+        state->replace(s);
+    }
+
+    void FrameResampler::process(const FrameInfo &info, const Position3d *markers)
+    {
+        State &s = *state->get();
+
+        // The earliest arrivals are the least delayed: jump down to them,
+        // creep up slowly in case the device's clock runs slow of ours.
+        double x = info.host_time-info.frame_number*s.period_ns;
+        if(!s.started || info.frame_number <= s.last_frame || x < s.offset)
+            s.offset = x;
+        else
+            s.offset += (x-s.offset)*(1./64.);
+        s.started = true;
+        s.last_frame = info.frame_number;
+
+        if(s.b)
+            bodies.solve(markers);
+
+        unsigned long long i = s.head.load(std::memory_order_relaxed);
+        size_t k = (size_t)(i & (SLOTS-1));
+
+        // odd: being written
+        s.sequence[k].store(2*i+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s.time[k] = (long long)(s.offset+info.frame_number*s.period_ns)-s.latency_ns;
+        memcpy(&s.markers[k*s.n], markers, sizeof(Position3d)*s.n);
+        for(int j=0; j<s.b; ++j)
+            s.poses[k*s.b+j] = bodies.get_pose(j);
+
+        s.sequence[k].store(2*i+2, std::memory_order_release);
+        s.head.store(i+1, std::memory_order_release);
+    }
+
+    bool FrameResampler::locate(long long t, Query &q) const
+    {
+        const State *s = state->get();
+        q.s = s;
+        if(!s)
+            return false;
+        for(;;) {
+            q.head = s->head.load(std::memory_order_acquire);
+            if(q.head == 0)
+                return false;
+            q.m = q.head < WINDOW ? (int)q.head : WINDOW;
+            bool ok = true;
+            for(int k=0; k<q.m && ok; ++k) {
+                unsigned long long i = q.head-q.m+k;
+                ok = s->sequence[q.slot(k)].load(std::memory_order_acquire) == 2*i+2;
+                q.time[k] = s->time[q.slot(k)];
+            }
+            if(ok)
+                break;
+            // Lapped while reading the times; start again from the new head.
+        }
+
+        const int m = q.m, last = m-1;
+        const long long *tk = q.time;
+        q.num_stencils = 0;
+
+        if(t < tk[0]) {
+            // Older than the window: the oldest frame.
+            FrameResampleStencil &st = q.stencils[q.num_stencils++];
+            clear(st, 0, 0);
+            st.w[0] = 1.;
+            q.a = q.b = 0;
+            q.u = 0.;
+            q.result = INTERPOLATED;
+            return true;
+        }
+
+        if(m == 1 || t >= tk[last]) {
+            double dt = (double)(t-tk[last]);
+            double max_dt = params.max_extrapolation*1e9;
+            if(dt > max_dt)
+                dt = max_dt;
+            q.result = t > tk[last] ? EXTRAPOLATED : INTERPOLATED;
+            q.a = q.b = last;
+            q.u = 0.;
+
+            if(m >= 2) {
+                double h = (double)(tk[last]-tk[last-1]);
+                // Velocity from the derivative of the parabola through
+                // the last 3 frames: second order, where 2 frames are
+                // first order.
+                if(params.method == CUBIC && m >= 3) {
+                    double h1 = (double)(tk[last-1]-tk[last-2]), h2 = h;
+                    FrameResampleStencil &st = q.stencils[q.num_stencils++];
+                    clear(st, last-2, last);
+                    st.w[last-2] = dt*h2/(h1*(h1+h2));
+                    st.w[last-1] = -dt*(h1+h2)/(h1*h2);
+                    st.w[last] = 1.+dt*(2.*h2+h1)/(h2*(h1+h2));
+                }
+                FrameResampleStencil &st = q.stencils[q.num_stencils++];
+                clear(st, last-1, last);
+                st.w[last-1] = -dt/h;
+                st.w[last] = 1.+dt/h;
+                q.a = last-1;
+                q.u = 1.+dt/h;
+            }
+            FrameResampleStencil &st = q.stencils[q.num_stencils++];
+            clear(st, last, last);
+            st.w[last] = 1.;
+            return true;
+        }
+
+        int a = 0;
+        while(t >= tk[a+1])
+            ++a;
+        int b = a+1;
+        double h = (double)(tk[b]-tk[a]);
+        double u = (t-tk[a])/h;
+        q.a = a;
+        q.b = b;
+        q.u = u;
+        q.result = INTERPOLATED;
+
+        if(params.method == CUBIC) {
+            // Hermite on a..b, tangents by central differences where
+            // there's a frame on the other side, one-sided otherwise.
+            double u2 = u*u, u3 = u2*u;
+            double h00 = 2.*u3-3.*u2+1., h10 = u3-2.*u2+u;
+            double h01 = -2.*u3+3.*u2, h11 = u3-u2;
+            FrameResampleStencil &st = q.stencils[q.num_stencils++];
+            clear(st, a > 0 ? a-1 : a, b < last ? b+1 : b);
+            st.w[a] += h00;
+            st.w[b] += h01;
+            if(a > 0) {
+                double c = h10*h/(tk[b]-tk[a-1]);
+                st.w[b] += c;
+                st.w[a-1] -= c;
+            }else {
+                st.w[b] += h10;
+                st.w[a] -= h10;
+            }
+            if(b < last) {
+                double c = h11*h/(tk[b+1]-tk[a]);
+                st.w[b+1] += c;
+                st.w[a] -= c;
+            }else {
+                st.w[b] += h11;
+                st.w[a] -= h11;
+            }
+        }
+        FrameResampleStencil &st = q.stencils[q.num_stencils++];
+        clear(st, a, b);
+        st.w[a] = 1.-u;
+        st.w[b] = u;
+        return true;
+    }
+
+    bool FrameResampler::unchanged(const Query &q) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        for(int k=0; k<q.m; ++k) {
+            unsigned long long i = q.head-q.m+k;
+            if(q.s->sequence[q.slot(k)].load(std::memory_order_relaxed) != 2*i+2)
+                return false;
+        }
+        return true;
+    }
+
+    int FrameResampler::sample(long long t, Position3d *out) const
+    {
+        Query q;
+        do {
+            if(!locate(t, q))
+                return NO_FRAMES;
+            const State &s = *q.s;
+            const Position3d *frame[WINDOW];
+            for(int k=0; k<q.m; ++k)
+                frame[k] = &s.markers[q.slot(k)*s.n];
+
+            for(int i=0; i<s.n; ++i) {
+                const FrameResampleStencil *st = q.stencils, *end = q.stencils+q.num_stencils;
+                for(; st<end; ++st) {
+                    int k = st->lo;
+                    while(k <= st->hi && is_valid(frame[k][i]))
+                        ++k;
+                    if(k > st->hi)
+                        break;
+                }
+                if(st == end) {
+                    out[i].x = out[i].y = out[i].z = BAD_FLOAT;
+                    continue;
+                }
+                double x = 0., y = 0., z = 0.;
+                for(int k=st->lo; k<=st->hi; ++k) {
+                    const Position3d &p = frame[k][i];
+                    x += st->w[k]*p.x;
+                    y += st->w[k]*p.y;
+                    z += st->w[k]*p.z;
+                }
+                out[i].x = (float)x;
+                out[i].y = (float)y;
+                out[i].z = (float)z;
+            }
+        }while(!unchanged(q));
+        return q.result;
+    }
+
+    int FrameResampler::sample_pose(long long t, int i, BodyPose &pose) const
+    {
+        Query q;
+        do {
+            if(!locate(t, q))
+                return NO_FRAMES;
+            const State &s = *q.s;
+            const BodyPose *frame[WINDOW];
+            for(int k=0; k<q.m; ++k)
+                frame[k] = &s.poses[q.slot(k)*s.b+i];
+
+            const FrameResampleStencil *st = q.stencils, *end = q.stencils+q.num_stencils;
+            for(; st<end; ++st) {
+                int k = st->lo;
+                while(k <= st->hi && frame[k]->valid)
+                    ++k;
+                if(k > st->hi)
+                    break;
+            }
+            const BodyPose &newest = *frame[q.b];
+            pose.rms = newest.rms;
+            pose.num_markers = newest.num_markers;
+            pose.valid = st != end;
+            if(!pose.valid)
+                continue;
+
+            for(int j=0; j<3; ++j) {
+                double v = 0.;
+                for(int k=st->lo; k<=st->hi; ++k)
+                    v += st->w[k]*frame[k]->translation[j];
+                pose.translation[j] = v;
+            }
+            // Extrapolating from the newest frame alone: hold its rotation.
+            if(frame[q.a]->valid)
+                slerp(frame[q.a]->quaternion, newest.quaternion, q.u, pose.quaternion);
+            else
+                memcpy(pose.quaternion, newest.quaternion, sizeof(pose.quaternion));
+            quaternion_to_matrix(pose.quaternion, pose.rotation);
+        }while(!unchanged(q));
+        return q.result;
+    }
+
+    long long FrameResampler::get_latest_time() const
+    {
+        Query q;
+        do {
+            if(!locate(0, q))
+                return -1;
+        }while(!unchanged(q));
+        return q.time[q.m-1];
+    }
+
+} // end of namespace
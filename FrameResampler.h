@@ -0,0 +1,135 @@
+#ifndef _FRAMERESAMPLER_H_
+#define _FRAMERESAMPLER_H_
+
+/**
+ *@file FrameResampler.h
+ *@brief Markers and rigid body poses at any host time, as a FrameStage.
+ */
+#include "FrameStage.h"
+#include "RigidBodySolver.h"
+
+namespace VML {
+
+    template <class T> class StageState;
+
+    /**
+     * Keeps the last few frames on a timeline of host times, so they can
+     * be sampled at the time something else runs at, e.g. a display
+     * refreshing at 90 Hz from a tracker at 500: interpolated between
+     * frames, or extrapolated a little past the newest one to where
+     * things will be when the picture lights up.
+     *
+     * Arrival times jitter with the driver and the scheduler, so frames
+     * aren't placed at their host_time but at offset+frame_number*period,
+     * the offset following the earliest arrivals.  The times are then
+     * those of the cameras' clock, less latency.
+     *
+     * Positions are interpolated linearly, or by cubic Hermite with
+     * finite-difference tangents, and extrapolated at constant velocity.
+     * Rotations are interpolated and extrapolated by SLERP.  A query looks
+     * at the newest 4 frames only, so it takes constant time, and doesn't
+     * allocate or lock: like FrameRing, it reads and then checks the
+     * frames weren't overwritten meanwhile.  Call from any thread, also
+     * while the stage is set up again (CollectorCore::reconfigure()):
+     * the timeline starts over, and a query in progress finishes on the
+     * old one.
+     *
+     * A marker missing from a frame the query needs comes out missing,
+     * unless a lower-order estimate can do without that frame.
+     */
+    class FrameResampler : public FrameStage {
+        public:
+            enum Method {
+                LINEAR,
+                CUBIC
+            };
+
+            enum Result {
+                NO_FRAMES=-1,
+                INTERPOLATED=0, //< At or before the newest frame.
+                EXTRAPOLATED=1  //< Past it.
+            };
+
+            struct Params {
+                Params()
+                    :method(CUBIC),
+                    max_extrapolation(0.05),
+                    latency(0.)
+                {}
+
+                Method method;
+                double max_extrapolation; //< s past the newest frame; later queries get this far.
+                double latency; //< s from the cameras taking a frame to the host getting it.
+            };
+
+            FrameResampler(const Params &p);
+            ~FrameResampler();
+
+            /**
+             * Sample these rigid bodies as well (a copy is taken).  Call
+             * before setup(), e.g. with CollectorCore::get_rigid_bodies().
+             * They're solved again here for every frame.
+             */
+            void set_rigid_bodies(const RigidBodySolver &b);
+
+            void setup(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Every marker at host time t (ns, host_time_ns()).
+             * @param markers Room for num_markers.  Missing ones get
+             * BAD_FLOAT.
+             * @return A Result.
+             */
+            int sample(long long t, Position3d *markers) const;
+
+            /**
+             * Pose of rigid body i at host time t.  pose.valid is false if
+             * the body wasn't solved in the frames needed.
+             * @return A Result.
+             */
+            int sample_pose(long long t, int i, BodyPose &pose) const;
+
+            /**
+             * Same, into a BVL::Pose or BVL::FixedPose.
+             * @return NO_FRAMES if the pose isn't valid; p is untouched.
+             */
+            template <class P>
+            int sample_pose(long long t, int i, P &p) const {
+                BodyPose b;
+                int r = sample_pose(t, i, b);
+                if(r == NO_FRAMES || !b.valid)
+                    return NO_FRAMES;
+                p.set_rotation(b.quaternion[0], b.quaternion[1], b.quaternion[2], b.quaternion[3]);
+                p.set_translation(b.translation[0], b.translation[1], b.translation[2]);
+                return r;
+            }
+
+            /**
+             * Timeline time of the newest frame, ns, or -1 if none.
+             */
+            long long get_latest_time() const;
+
+            int get_num_bodies() const { return bodies.get_num_bodies(); }
+            const Params &get_params() const { return params; }
+
+        private:
+            struct State;
+            struct Query;
+
+            // Find the frames around t and their weights; false if none yet.
+            bool locate(long long t, Query &q) const;
+            // The frames q used weren't overwritten while it ran.
+            bool unchanged(const Query &q) const;
+
+            Params params;
+            RigidBodySolver bodies;
+            StageState<State> *state;
+
+            FrameResampler(const FrameResampler &);
+            FrameResampler &operator=(const FrameResampler &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMERESAMPLER_H_*/
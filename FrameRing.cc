@@ -0,0 +1,124 @@
+/**
+ *@file FrameRing.cc
+ *@brief
+ */
+#include <string.h>
+#include <chrono>
+#include "FrameRing.h"
+
+namespace VML {
+
+    long long host_time_ns()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    FrameRing::FrameRing(int n, int capacity)
+        :num_markers(n),
+        head(0)
+    {
+        unsigned long long c = 1;
+        while(c < (unsigned long long)capacity)
+            c <<= 1;
+        mask = c-1;
+
+        slots = std::vector<Slot>(c);
+        for(unsigned long long i=0; i<c; ++i)
+            slots[i].sequence.store(0, std::memory_order_relaxed);
+        marker_data.resize(c*num_markers);
+    }
+
+    void FrameRing::push(const FrameInfo &info, const Position3d *markers)
+    {
+        unsigned long long i = head.load(std::memory_order_relaxed);
+        Slot &s = slots[i & mask];
+
+        // odd: being written
+        s.sequence.store(2*i+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s.info = info;
+        memcpy(&marker_data[(i & mask)*num_markers], markers, sizeof(Position3d)*num_markers);
+
+        s.sequence.store(2*i+2, std::memory_order_release);
+        head.store(i+1, std::memory_order_release);
+    }
+
+    bool FrameRing::read_slot(unsigned long long i, FrameInfo &info, Position3d *markers) const
+    {
+        const Slot &s = slots[i & mask];
+        unsigned long long seq = s.sequence.load(std::memory_order_acquire);
+        if(seq != 2*i+2)
+            return false;
+
+        info = s.info;
+        if(markers)
+            memcpy(markers, &marker_data[(i & mask)*num_markers], sizeof(Position3d)*num_markers);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return s.sequence.load(std::memory_order_relaxed) == seq;
+    }
+
+    bool FrameRing::latest(FrameInfo &info, Position3d *markers) const
+    {
+        for(;;) {
+            unsigned long long h = head.load(std::memory_order_acquire);
+            if(h == 0)
+                return false;
+            if(read_slot(h-1, info, markers))
+                return true;
+            // The producer lapped us while we were copying.  Try the new head.
+        }
+    }
+
+    int FrameRing::frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const
+    {
+        if(max_frames <= 0)
+            return 0;
+
+        unsigned long long h = head.load(std::memory_order_acquire);
+        unsigned long long oldest = h > mask+1 ? h-(mask+1) : 0;
+
+        // Walk back from the newest frame, filling the output from its end.
+        int k = max_frames;
+        for(unsigned long long i=h; i>oldest && k>0; --i) {
+            Position3d *m = markers ? markers+(k-1)*num_markers : 0;
+            if(!read_slot(i-1, infos[k-1], m))
+                break; // overwritten; everything older is gone too
+            if(infos[k-1].frame_number <= n)
+                break;
+            --k;
+        }
+
+        int count = max_frames-k;
+        if(k > 0 && count > 0) {
+            memmove(infos, infos+k, sizeof(FrameInfo)*count);
+            if(markers)
+                memmove(markers, markers+k*num_markers, sizeof(Position3d)*count*num_markers);
+        }
+        return count;
+    }
+
+    int FrameRing::read_from(unsigned long long &next, FrameInfo *infos, Position3d *markers, int max_frames) const
+    {
+        unsigned long long h = head.load(std::memory_order_acquire);
+        int count = 0;
+        while(next < h && count < max_frames) {
+            unsigned long long oldest = h > mask+1 ? h-(mask+1) : 0;
+            if(next < oldest)
+                next = oldest;
+
+            Position3d *m = markers ? markers+count*num_markers : 0;
+            if(read_slot(next, infos[count], m)) {
+                ++next;
+                ++count;
+            }else {
+                // Overwritten while we read it; the head has moved on.
+                h = head.load(std::memory_order_acquire);
+            }
+        }
+        return count;
+    }
+
+} // end of namespace
@@ -0,0 +1,99 @@
+#ifndef _FRAMERING_H_
+#define _FRAMERING_H_
+
+/**
+ *@file FrameRing.h
+ *@brief Preallocated single-producer/multi-consumer ring of frames.
+ *
+ * Native only: <atomic> can't be included in /clr translation units.
+ */
+#include <atomic>
+#include <vector>
+#include "OptoFrame.h"
+
+namespace VML {
+
+    /**
+     * A ring of the last N frames, all markers included.
+     *
+     * One thread (the acquisition thread) pushes; any number of threads
+     * read.  Every slot carries its own sequence counter, odd while the
+     * producer is writing it, so a reader copies a slot and then checks
+     * the counter didn't move (a seqlock per slot).  The producer never
+     * waits for readers.  A reader only retries if the producer wrapped
+     * around the whole ring while it was copying, i.e. it was descheduled
+     * for N frame periods, so in practice reads are wait-free.
+     *
+     * All memory is allocated in the constructor.
+     */
+    class FrameRing {
+        public:
+            /**
+             * @param num_markers Markers per frame.
+             * @param capacity Number of frames kept; rounded up to a power of 2.
+             */
+            FrameRing(int num_markers, int capacity);
+
+            /**
+             * Producer only.  Publish a frame.
+             */
+            void push(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Copy the most recent frame.
+             * @param markers Room for get_num_markers() entries.
+             * @return false if nothing's been pushed yet.
+             */
+            bool latest(FrameInfo &info, Position3d *markers) const;
+
+            /**
+             * Copy, oldest first, the frames still in the ring whose frame
+             * number is larger than n.
+             * @param infos,markers Room for max_frames frames.
+             * @return Number of frames copied.  If more than max_frames are
+             * newer than n, the newest max_frames are returned.
+             */
+            int frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const;
+
+            /**
+             * Copy, oldest first, frames from stream position next on (the
+             * n-th frame ever pushed has position n-1) and advance next
+             * past them.  Meant for a consumer that has to see every frame.
+             * @return Number of frames copied.  If the producer has
+             * overwritten some frames before they were read, next jumps
+             * over them; the caller can tell by how far it moved.
+             */
+            int read_from(unsigned long long &next, FrameInfo *infos, Position3d *markers, int max_frames) const;
+
+            /**
+             * Total number of frames pushed since construction.
+             */
+            unsigned long long get_num_pushed() const {
+                return head.load(std::memory_order_acquire);
+            }
+
+            int get_num_markers() const { return num_markers; }
+            int get_capacity() const { return (int)(mask+1); }
+
+        private:
+            struct Slot {
+                std::atomic<unsigned long long> sequence;
+                FrameInfo info;
+            };
+
+            // Copy the frame with stream index i.  False if it's been overwritten.
+            bool read_slot(unsigned long long i, FrameInfo &info, Position3d *markers) const;
+
+            int num_markers;
+            unsigned long long mask;
+            std::vector<Slot> slots;
+            std::vector<Position3d> marker_data;
+            std::atomic<unsigned long long> head; //< Stream index of the next frame to write.
+
+            FrameRing(const FrameRing &);
+            FrameRing &operator=(const FrameRing &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMERING_H_*/
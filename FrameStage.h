@@ -0,0 +1,65 @@
+#ifndef _FRAMESTAGE_H_
+#define _FRAMESTAGE_H_
+
+/**
+ *@file FrameStage.h
+ *@brief Per-frame processing attached to a CollectorCore.
+ */
+#include <string>
+#include "OptoDevice.h"
+#include "OptoFrame.h"
+
+namespace VML {
+
+    /**
+     * Something that wants to see every new frame: a recorder, a filter,
+     * a publisher, etc.
+     *
+     * process() runs on the thread that gets frames from the device, i.e.
+     * the acquisition thread if there's one, otherwise whoever calls
+     * update_frame().  It's called once per frame number, so repeated
+     * reads of the same frame aren't seen twice.  It must not block and
+     * shouldn't allocate; hand anything slow to another thread.
+     */
+    class FrameStage {
+        public:
+            virtual ~FrameStage() {}
+
+            /**
+             * Called by setup_collection(), or when the stage is added to a
+             * collector that's already set up.  Allocate here.
+             * @param p The collection parameters, num_markers included.
+             */
+            virtual void setup(const CollectionParams &p) = 0;
+
+            /**
+             * Called by CollectorCore::reconfigure() instead of setup() on
+             * a stage that's been set up already, while no frames come
+             * in.  Frame numbers start over and the frame size may have
+             * changed.  What the stage has produced must survive: a
+             * stage writing a file carries on in a new one (see
+             * segment_path()), and state other threads read from isn't
+             * freed under them.  By default it's set up again.
+             */
+            virtual void reconfigure(const CollectionParams &p) { setup(p); }
+
+            virtual void process(const FrameInfo &info, const Position3d *markers) = 0;
+    };
+
+    /**
+     * The file for segment n of an output at path, n counted from 1 for
+     * the first reconfigure(): "trial.c3d" gives "trial.1.c3d", "trial"
+     * gives "trial.1".
+     */
+    inline std::string segment_path(const std::string &path, int n)
+    {
+        std::string::size_type dot = path.rfind('.');
+        std::string::size_type slash = path.find_last_of("/\\");
+        if(dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == 0 || dot == slash+1)
+            dot = path.size();
+        return path.substr(0, dot)+"."+std::to_string(n)+path.substr(dot);
+    }
+
+} // end of namespace
+
+#endif/*_FRAMESTAGE_H_*/
@@ -0,0 +1,216 @@
+/**
+ *@file FrameStats.cc
+ *@brief
+ */
+#include <atomic>
+#include <iostream>
+#include "FrameStats.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace VML {
+
+    namespace {
+
+        typedef std::atomic<unsigned long long> Counter;
+
+        inline void bump(Counter &a, unsigned long long n=1)
+        {
+            a.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        inline int floor_log2(unsigned long long v)
+        {
+#ifdef _MSC_VER
+            unsigned long i;
+            _BitScanReverse64(&i, v);
+            return (int)i;
+#else
+            return 63-__builtin_clzll(v);
+#endif
+        }
+
+        struct AtomicHistogram {
+            void add(long long ns) {
+                bump(counts[LatencyHistogram::bucket_of(ns < 0 ? 0 : ns)]);
+            }
+
+            void copy(LatencyHistogram &h) const {
+                for(int i=0; i<LatencyHistogram::NUM_BUCKETS; ++i)
+                    h.counts[i] = counts[i].load(std::memory_order_relaxed);
+            }
+
+            void reset() {
+                for(int i=0; i<LatencyHistogram::NUM_BUCKETS; ++i)
+                    counts[i].store(0, std::memory_order_relaxed);
+            }
+
+            Counter counts[LatencyHistogram::NUM_BUCKETS];
+        };
+
+        void print(std::ostream &os, const char *name, const LatencyHistogram &h)
+        {
+            os << name << ": n " << h.total()
+                << " p50 " << h.quantile(0.5)*1e-3
+                << " p99 " << h.quantile(0.99)*1e-3
+                << " p99.9 " << h.quantile(0.999)*1e-3 << " us\n";
+        }
+
+    }
+
+    int LatencyHistogram::bucket_of(unsigned long long v)
+    {
+        if(v < 4)
+            return (int)v;
+        int e = floor_log2(v);
+        return 4*(e-1)+(int)((v >> (e-2)) & 3);
+    }
+
+    unsigned long long LatencyHistogram::lower_edge(int b)
+    {
+        if(b < 4)
+            return b;
+        return (unsigned long long)(4+b%4) << (b/4-1);
+    }
+
+    unsigned long long LatencyHistogram::total() const
+    {
+        unsigned long long n = 0;
+        for(int i=0; i<NUM_BUCKETS; ++i)
+            n += counts[i];
+        return n;
+    }
+
+    double LatencyHistogram::quantile(double p) const
+    {
+        unsigned long long n = total();
+        if(n == 0)
+            return 0.;
+
+        unsigned long long rank = (unsigned long long)(p*(n-1))+1;
+        unsigned long long sum = 0;
+        for(int i=0; i<NUM_BUCKETS; ++i) {
+            sum += counts[i];
+            if(sum >= rank) {
+                double lo = (double)lower_edge(i);
+                double hi = i+1 < NUM_BUCKETS ? (double)lower_edge(i+1) : lo;
+                return 0.5*(lo+hi);
+            }
+        }
+        return (double)lower_edge(NUM_BUCKETS-1);
+    }
+
+    struct FrameStats::Counters {
+        Counter num_calls, num_frames, num_duplicates, num_dropped;
+        Counter num_backwards, num_failures, num_not_ready;
+        std::atomic<long long> max_call_ns;
+        AtomicHistogram call, interval, process;
+
+        // The writer's own.
+        bool have_last;
+        unsigned int last_frame;
+        long long last_time;
+    };
+
+    FrameStats::FrameStats()
+        :c(new Counters)
+    {
+        reset();
+    }
+
+    FrameStats::~FrameStats()
+    {
+        delete c;
+    }
+
+    void FrameStats::reset()
+    {
+        c->num_calls.store(0);
+        c->num_frames.store(0);
+        c->num_duplicates.store(0);
+        c->num_dropped.store(0);
+        c->num_backwards.store(0);
+        c->num_failures.store(0);
+        c->num_not_ready.store(0);
+        c->max_call_ns.store(0);
+        c->call.reset();
+        c->interval.reset();
+        c->process.reset();
+        c->have_last = false;
+        c->last_frame = 0;
+        c->last_time = 0;
+    }
+
+    void FrameStats::record_call(long long before, long long after)
+    {
+        long long d = after-before;
+        bump(c->num_calls);
+        c->call.add(d);
+        if(d > c->max_call_ns.load(std::memory_order_relaxed))
+            c->max_call_ns.store(d, std::memory_order_relaxed);
+    }
+
+    void FrameStats::record_frame(unsigned int fn, long long t)
+    {
+        if(c->have_last) {
+            if(fn == c->last_frame) {
+                bump(c->num_duplicates);
+                return;
+            }
+            if(fn < c->last_frame)
+                bump(c->num_backwards);
+            else {
+                bump(c->num_dropped, fn-c->last_frame-1);
+                c->interval.add(t-c->last_time);
+            }
+        }
+        bump(c->num_frames);
+        c->have_last = true;
+        c->last_frame = fn;
+        c->last_time = t;
+    }
+
+    void FrameStats::record_failure(bool not_ready)
+    {
+        bump(c->num_failures);
+        if(not_ready)
+            bump(c->num_not_ready);
+    }
+
+    void FrameStats::record_processing(long long ns)
+    {
+        c->process.add(ns);
+    }
+
+    void FrameStats::snapshot(FrameStatsSnapshot &s) const
+    {
+        s.num_calls = c->num_calls.load(std::memory_order_relaxed);
+        s.num_frames = c->num_frames.load(std::memory_order_relaxed);
+        s.num_duplicates = c->num_duplicates.load(std::memory_order_relaxed);
+        s.num_dropped = c->num_dropped.load(std::memory_order_relaxed);
+        s.num_backwards = c->num_backwards.load(std::memory_order_relaxed);
+        s.num_failures = c->num_failures.load(std::memory_order_relaxed);
+        s.num_not_ready = c->num_not_ready.load(std::memory_order_relaxed);
+        s.max_call_ns = c->max_call_ns.load(std::memory_order_relaxed);
+        c->call.copy(s.call);
+        c->interval.copy(s.interval);
+        c->process.copy(s.process);
+    }
+
+    void FrameStats::dump(std::ostream &os) const
+    {
+        FrameStatsSnapshot s;
+        snapshot(s);
+        os << "calls " << s.num_calls << " frames " << s.num_frames
+            << " duplicates " << s.num_duplicates << " dropped " << s.num_dropped
+            << " backwards " << s.num_backwards << " failures " << s.num_failures
+            << " (not ready " << s.num_not_ready << ")"
+            << " longest call " << s.max_call_ns*1e-3 << " us\n";
+        print(os, "device call", s.call);
+        print(os, "frame interval", s.interval);
+        print(os, "processing", s.process);
+    }
+
+} // end of namespace
@@ -0,0 +1,112 @@
+#ifndef _FRAMESTATS_H_
+#define _FRAMESTATS_H_
+
+/**
+ *@file FrameStats.h
+ *@brief Counters and latency histograms for the device calls.
+ *
+ * Safe to include from /clr code: the atomics are kept out of the header.
+ */
+#include <iosfwd>
+
+namespace VML {
+
+    /**
+     * Counts of durations in log-spaced buckets: each power of two of
+     * nanoseconds is split into 4, so a bucket is at most 25% wide, from
+     * 1 ns to centuries.
+     */
+    struct LatencyHistogram {
+        enum {
+            NUM_BUCKETS=256
+        };
+
+        static int bucket_of(unsigned long long ns);
+        // Smallest value in bucket b.
+        static unsigned long long lower_edge(int b);
+
+        unsigned long long total() const;
+
+        /**
+         * Estimated p-th quantile (p in [0,1]) in ns: the middle of the
+         * bucket it falls in.  0 if empty.
+         */
+        double quantile(double p) const;
+
+        unsigned long long counts[NUM_BUCKETS];
+    };
+
+    /**
+     * A consistent-enough copy of FrameStats, taken while running.
+     */
+    struct FrameStatsSnapshot {
+        unsigned long long num_calls;      //< Device reads (get/receive latest 3D).
+        unsigned long long num_frames;     //< New frames among them.
+        unsigned long long num_duplicates; //< Same frame number as the previous read.
+        unsigned long long num_dropped;    //< Frame numbers skipped over.
+        unsigned long long num_backwards;  //< Frame number went down (device restarted).
+        unsigned long long num_failures;   //< update_frame() or device calls returning an error.
+        unsigned long long num_not_ready;  //< Nonblocking reads with no data yet (also failures).
+        long long max_call_ns;
+
+        LatencyHistogram call;     //< Host time across the device read.
+        LatencyHistogram interval; //< Host time between new frames.
+        LatencyHistogram process;  //< Our own time per frame: rigid bodies and stages.
+    };
+
+    /**
+     * Instrumentation of the collector's reads.  The record_*() calls are
+     * a handful of relaxed atomic adds each, no locks, so any thread can
+     * take a snapshot() or dump() while frames keep coming.
+     *
+     * record_call() and record_frame() must come from one thread at a
+     * time (whoever is calling the device); the others from any.
+     */
+    class FrameStats {
+        public:
+            FrameStats();
+            ~FrameStats();
+
+            /**
+             * A device read started at host time before and returned at
+             * after (both host_time_ns()).
+             */
+            void record_call(long long before, long long after);
+
+            /**
+             * The frame number the read returned, and when.
+             */
+            void record_frame(unsigned int frame_number, long long host_time);
+
+            /**
+             * A call that failed (-1).  not_ready: only because the data
+             * weren't there yet.
+             */
+            void record_failure(bool not_ready=false);
+
+            void record_processing(long long ns);
+
+            void snapshot(FrameStatsSnapshot &s) const;
+
+            /**
+             * Zero everything.  Only while no frames are being read.
+             */
+            void reset();
+
+            /**
+             * The counters, then p50/p99/p99.9 of each histogram, a line
+             * each.
+             */
+            void dump(std::ostream &os) const;
+
+        private:
+            struct Counters;
+            Counters *c;
+
+            FrameStats(const FrameStats &);
+            FrameStats &operator=(const FrameStats &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMESTATS_H_*/
@@ -0,0 +1,104 @@
+/**
+ *@file FrameSubscriber.cc
+ *@brief
+ */
+#include "SharedFrames.h"
+#include "FrameSubscriber.h"
+
+namespace VML {
+
+    FrameSubscriber::FrameSubscriber()
+        :frames(new SharedFrames),
+        seen(0),
+        num_skipped(0)
+    {
+    }
+
+    FrameSubscriber::~FrameSubscriber()
+    {
+        delete frames;
+    }
+
+    void FrameSubscriber::open(const std::string &name)
+    {
+        frames->open(name);
+        // next() waits for a frame published from now on.
+        seen = frames->get_head();
+    }
+
+    void FrameSubscriber::close()
+    {
+        frames->close();
+    }
+
+    bool FrameSubscriber::is_open() const
+    {
+        return frames->is_open();
+    }
+
+    bool FrameSubscriber::is_closed() const
+    {
+        return !frames->is_open() || frames->is_closed();
+    }
+
+    int FrameSubscriber::get_num_markers() const
+    {
+        return frames->get_num_markers();
+    }
+
+    float FrameSubscriber::get_frame_frequency() const
+    {
+        return frames->is_open() ? frames->get_frame_frequency() : 0.f;
+    }
+
+    bool FrameSubscriber::read_latest(FrameInfo &info, Position3d *markers)
+    {
+        for(;;) {
+            if(is_closed())
+                return false;
+            unsigned long long h = frames->get_head();
+            if(h < seen)
+                seen = 0; // the publisher started over in place
+            if(h == 0)
+                return false;
+            if(frames->read(h-1, info, markers)) {
+                if(h-1 > seen)
+                    num_skipped += h-1-seen;
+                seen = h;
+                return true;
+            }
+            // The publisher lapped us while we were copying.  Try the new head.
+        }
+    }
+
+    bool FrameSubscriber::latest(FrameInfo &info, Position3d *markers)
+    {
+        return is_open() && read_latest(info, markers);
+    }
+
+    bool FrameSubscriber::next(FrameInfo &info, Position3d *markers, double timeout)
+    {
+        if(!is_open())
+            return false;
+
+        long long end = timeout < 0. ? 0 : host_time_ns()+(long long)(timeout*1e9);
+        for(;;) {
+            if(is_closed())
+                return false;
+            unsigned long long h = frames->get_head();
+            if(h < seen)
+                seen = 0; // the publisher started over in place
+            if(h > seen)
+                return read_latest(info, markers);
+
+            long long left = -1;
+            if(timeout >= 0.) {
+                left = end-host_time_ns();
+                if(left <= 0)
+                    return false;
+            }
+            frames->wait(seen, left);
+        }
+    }
+
+} // end of namespace
@@ -0,0 +1,83 @@
+#ifndef _FRAMESUBSCRIBER_H_
+#define _FRAMESUBSCRIBER_H_
+
+/**
+ *@file FrameSubscriber.h
+ *@brief Read the frames a FramePublisher puts in shared memory, from
+ * another process.
+ *
+ * Safe to include from /clr code.  Needs only OptoCore.lib (or
+ * liboptosim.a), not the Optotrak libraries.
+ */
+#include <string>
+#include "OptoFrame.h"
+
+namespace VML {
+
+    class SharedFrames;
+
+    /**
+     * One reader of a published segment.  Reads copy the frame straight
+     * out of shared memory into the caller's buffer, and never hold up
+     * the publisher.  Errors throw std::runtime_error.
+     *
+     * If the publisher goes away or changes the frame size, the reads
+     * return false and is_closed() says so; open() again to follow the
+     * new segment.
+     */
+    class FrameSubscriber {
+        public:
+            FrameSubscriber();
+            ~FrameSubscriber();
+
+            /**
+             * Map the segment published under name.
+             */
+            void open(const std::string &name);
+            void close();
+            bool is_open() const;
+            bool is_closed() const;
+
+            /**
+             * Markers per frame, i.e. the room the markers arguments
+             * need.
+             */
+            int get_num_markers() const;
+            float get_frame_frequency() const;
+
+            /**
+             * Copy the newest frame.
+             * @return false if nothing's been published yet, or the
+             * segment is closed.
+             */
+            bool latest(FrameInfo &info, Position3d *markers);
+
+            /**
+             * Wait for a frame newer than the last one read here, and copy
+             * the newest.  Sleeps in the kernel (futex or event) rather
+             * than polling.
+             * @param timeout In seconds; negative to wait for as long as it
+             * takes.
+             * @return false on timeout or if the segment is closed.
+             */
+            bool next(FrameInfo &info, Position3d *markers, double timeout=-1.);
+
+            /**
+             * Frames published since open() that were never read here.
+             */
+            unsigned long long get_num_skipped() const { return num_skipped; }
+
+        private:
+            bool read_latest(FrameInfo &info, Position3d *markers);
+
+            SharedFrames *frames;
+            unsigned long long seen; //< Publisher's frame count at our last read.
+            unsigned long long num_skipped;
+
+            FrameSubscriber(const FrameSubscriber &);
+            FrameSubscriber &operator=(const FrameSubscriber &);
+    };
+
+} // end of namespace
+
+#endif/*_FRAMESUBSCRIBER_H_*/
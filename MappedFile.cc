@@ -0,0 +1,199 @@
+/**
+ *@file MappedFile.cc
+ *@brief
+ */
+#include <stdexcept>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VML {
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile()
+        :base(0), length(0), writable(false), file(INVALID_HANDLE_VALUE), mapping(0)
+    {
+    }
+
+    void MappedFile::create(const std::string &path, size_t size)
+    {
+        close();
+        file = CreateFileA(path.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, 0,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if(file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Can't create "+path);
+        writable = true;
+        resize(size);
+    }
+
+    void MappedFile::open(const std::string &path)
+    {
+        close();
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, 0,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if(file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Can't open "+path);
+
+        LARGE_INTEGER s;
+        GetFileSizeEx(file, &s);
+        length = (size_t)s.QuadPart;
+        writable = false;
+        map(false);
+    }
+
+    void MappedFile::resize(size_t size)
+    {
+        unmap();
+        LARGE_INTEGER s;
+        s.QuadPart = size;
+        if(!SetFilePointerEx(file, s, 0, FILE_BEGIN) || !SetEndOfFile(file))
+            throw std::runtime_error("Can't resize mapped file.");
+        length = size;
+        map(true);
+    }
+
+    void MappedFile::map(bool w)
+    {
+        if(length == 0)
+            return;
+        mapping = CreateFileMappingA(file, 0, w ? PAGE_READWRITE : PAGE_READONLY, 0, 0, 0);
+        if(!mapping)
+            throw std::runtime_error("CreateFileMapping failed.");
+        base = (char *)MapViewOfFile(mapping, w ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if(!base)
+            throw std::runtime_error("MapViewOfFile failed.");
+    }
+
+    void MappedFile::unmap()
+    {
+        if(base)
+            UnmapViewOfFile(base);
+        if(mapping)
+            CloseHandle(mapping);
+        base = 0;
+        mapping = 0;
+    }
+
+    void MappedFile::flush(size_t offset, size_t n)
+    {
+        if(base)
+            FlushViewOfFile(base+offset, n);
+    }
+
+    void MappedFile::close(size_t final_size)
+    {
+        if(file == INVALID_HANDLE_VALUE)
+            return;
+        unmap();
+        if(writable) {
+            LARGE_INTEGER s;
+            s.QuadPart = final_size;
+            SetFilePointerEx(file, s, 0, FILE_BEGIN);
+            SetEndOfFile(file);
+        }
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        length = 0;
+    }
+
+#else
+
+    MappedFile::MappedFile()
+        :base(0), length(0), writable(false), fd(-1)
+    {
+    }
+
+    void MappedFile::create(const std::string &path, size_t size)
+    {
+        close();
+        fd = ::open(path.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+        if(fd < 0)
+            throw std::runtime_error("Can't create "+path);
+        writable = true;
+        resize(size);
+    }
+
+    void MappedFile::open(const std::string &path)
+    {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("Can't open "+path);
+
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+        writable = false;
+        map(false);
+    }
+
+    void MappedFile::resize(size_t size)
+    {
+        unmap();
+        if(ftruncate(fd, size))
+            throw std::runtime_error("Can't resize mapped file.");
+        length = size;
+        map(true);
+    }
+
+    void MappedFile::map(bool w)
+    {
+        if(length == 0)
+            return;
+        void *p = mmap(0, length, w ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED)
+            throw std::runtime_error("mmap failed.");
+        base = (char *)p;
+    }
+
+    void MappedFile::unmap()
+    {
+        if(base)
+            munmap(base, length);
+        base = 0;
+    }
+
+    void MappedFile::flush(size_t offset, size_t n)
+    {
+        if(!base)
+            return;
+        // msync wants a page-aligned start.
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = offset/page*page;
+        msync(base+start, n+offset-start, MS_ASYNC);
+    }
+
+    void MappedFile::close(size_t final_size)
+    {
+        if(fd < 0)
+            return;
+        unmap();
+        if(writable && ftruncate(fd, final_size)) {
+            // Leave the file as long as it was; a reader only trusts the header.
+        }
+        ::close(fd);
+        fd = -1;
+        length = 0;
+    }
+
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    void MappedFile::close()
+    {
+        close(length);
+    }
+
+} // end of namespace
@@ -0,0 +1,75 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+/**
+ *@file MappedFile.h
+ *@brief A file mapped into memory, on Windows or POSIX.
+ */
+#include <stddef.h>
+#include <string>
+
+namespace VML {
+
+    /**
+     * Errors throw std::runtime_error.
+     */
+    class MappedFile {
+        public:
+            MappedFile();
+            ~MappedFile();
+
+            /**
+             * Create (or truncate) path, size bytes long, mapped read-write.
+             */
+            void create(const std::string &path, size_t size);
+
+            /**
+             * Map an existing file read-only.
+             */
+            void open(const std::string &path);
+
+            /**
+             * Change the length of a file opened with create() and map it
+             * again.  Pointers from data() are invalidated.
+             */
+            void resize(size_t size);
+
+            /**
+             * Unmap and close.  If the file was created, it's cut to
+             * final_size bytes first.
+             */
+            void close(size_t final_size);
+            void close();
+
+            /**
+             * Ask the OS to write back the range [offset, offset+length)
+             * without waiting for it.
+             */
+            void flush(size_t offset, size_t length);
+
+            char *data() { return base; }
+            const char *data() const { return base; }
+            size_t size() const { return length; }
+            bool is_open() const { return base != 0; }
+
+        private:
+            void map(bool writable);
+            void unmap();
+
+            char *base;
+            size_t length;
+            bool writable;
+#ifdef _WIN32
+            void *file;
+            void *mapping;
+#else
+            int fd;
+#endif
+
+            MappedFile(const MappedFile &);
+            MappedFile &operator=(const MappedFile &);
+    };
+
+} // end of namespace
+
+#endif/*_MAPPEDFILE_H_*/
@@ -0,0 +1,236 @@
+/**
+ *@file MarkerFilter.cc
+ *@brief
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdexcept>
+#include <vector>
+#include "FrameRing.h"
+#include "StageState.h"
+#include "MarkerFilter.h"
+
+namespace VML {
+
+    /**
+     * One lane per coordinate: lane a*n+i is axis a of marker i.  The
+     * filter state arrays s0..s4 mean different things per filter type.
+     */
+    struct MarkerFilter::State {
+        State(int num_markers, int capacity)
+            :n(num_markers),
+            lanes(3*num_markers),
+            ring(num_markers, capacity),
+            in(lanes), out(lanes), seen(lanes), fresh(lanes, 1.),
+            s0(lanes), s1(lanes), s2(lanes), s3(lanes), s4(lanes),
+            frame(num_markers),
+            was_seen(num_markers, false),
+            last_frame(0),
+            started(false)
+        {}
+
+        int n, lanes;
+        FrameRing ring;
+
+        std::vector<double> in, out;
+        std::vector<double> seen;  //< 1 if the marker is in this frame.
+        std::vector<double> fresh; //< 1 if it's back after being missing.
+        std::vector<double> s0, s1, s2, s3, s4;
+        std::vector<Position3d> frame;
+        std::vector<bool> was_seen;
+
+        double period;
+        double b0, b1, b2, a1, a2; //< Biquad coefficients.
+        unsigned int last_frame;
+        bool started;
+    };
+
+    /*
+     * The kernels.  x is the input, y the output; ok and f are 1 or 0 per
+     * lane, for seen and fresh.  Selections are written as a+m*(b-a) rather
+     * than with ?:, which keeps the loops free of branches under strict
+     * floating point, and the pointers are __restrict so there are no
+     * aliasing checks.  Missing lanes have x = 0, so everything stays
+     * finite.
+     */
+    namespace {
+
+        // s0 = last output, s1 = smoothed speed.
+        void one_euro(int m, double dt, double ad, double wmin, double wbeta,
+                const double *__restrict x, const double *__restrict ok, const double *__restrict f,
+                double *__restrict y, double *__restrict prev, double *__restrict dprev)
+        {
+            for(int i=0; i<m; ++i) {
+                double dx = (x[i]-prev[i])/dt;
+                double edx = dprev[i]+ad*(dx-dprev[i]);
+                double w = wmin+wbeta*fabs(edx);
+                double v = prev[i]+w/(w+1.)*(x[i]-prev[i]);
+                v += f[i]*(x[i]-v);
+                edx -= f[i]*edx;
+                y[i] = v;
+                prev[i] += ok[i]*(v-prev[i]);
+                dprev[i] += ok[i]*(edx-dprev[i]);
+            }
+        }
+
+        // s0 = position, s1 = velocity, s2..s4 = covariance p00, p01, p11.
+        void kalman(int m, double dt, double q, double r,
+                const double *__restrict x, const double *__restrict ok, const double *__restrict f,
+                double *__restrict y, double *__restrict pos, double *__restrict vel,
+                double *__restrict c00, double *__restrict c01, double *__restrict c11)
+        {
+            double q00 = q*dt*dt*dt/3., q01 = q*dt*dt/2., q11 = q*dt;
+            for(int i=0; i<m; ++i) {
+                // Predict.
+                double pp = pos[i]+vel[i]*dt;
+                double p00 = c00[i]+dt*(2.*c01[i]+dt*c11[i])+q00;
+                double p01 = c01[i]+dt*c11[i]+q01;
+                double p11 = c11[i]+q11;
+
+                // Update.
+                double k0 = p00/(p00+r), k1 = p01/(p00+r);
+                double e = x[i]-pp;
+                double np = pp+k0*e;
+                double nv = vel[i]+k1*e;
+                double n00 = (1.-k0)*p00;
+                double n01 = (1.-k0)*p01;
+                double n11 = p11-k1*p01;
+
+                // Restart: at the measurement, speed unknown.
+                np += f[i]*(x[i]-np);
+                nv -= f[i]*nv;
+                n00 += f[i]*(r-n00);
+                n01 -= f[i]*n01;
+                n11 += f[i]*(1e6-n11);
+
+                y[i] = np;
+                pos[i] += ok[i]*(np-pos[i]);
+                vel[i] += ok[i]*(nv-vel[i]);
+                c00[i] += ok[i]*(n00-c00[i]);
+                c01[i] += ok[i]*(n01-c01[i]);
+                c11[i] += ok[i]*(n11-c11[i]);
+            }
+        }
+
+        // Transposed direct form II; z1, z2 = the two delays.
+        void biquad(int m, double b0, double b1, double b2, double a1, double a2,
+                const double *__restrict x, const double *__restrict ok, const double *__restrict f,
+                double *__restrict y, double *__restrict z1, double *__restrict z2)
+        {
+            for(int i=0; i<m; ++i) {
+                double v = b0*x[i]+z1[i];
+                double n1 = b1*x[i]-a1*v+z2[i];
+                double n2 = b2*x[i]-a2*v;
+                // Restart in the steady state for x, which passes unchanged.
+                v += f[i]*(x[i]-v);
+                n1 += f[i]*((1.-b0)*x[i]-n1);
+                n2 += f[i]*((b2-a2)*x[i]-n2);
+                y[i] = v;
+                z1[i] += ok[i]*(n1-z1[i]);
+                z2[i] += ok[i]*(n2-z2[i]);
+            }
+        }
+
+    }
+
+    MarkerFilter::MarkerFilter(const Params &p)
+        :params(p),
+        state(new StageState<State>)
+    {
+    }
+
+    MarkerFilter::~MarkerFilter()
+    {
+        delete state;
+    }
+
+    void MarkerFilter::setup(const CollectionParams &p)
+    {
+        if(params.type == BUTTERWORTH && !(params.cutoff > 0. && 2.*params.cutoff < p.frame_frequency)) {
+            throw std::logic_error("Butterworth cutoff must be below half the frame frequency.");
+        }
+
+        State *s = new State(p.num_markers, params.capacity);
+        s->period = 1./p.frame_frequency;
+
+        double k = tan(M_PI*params.cutoff/p.frame_frequency);
+        double norm = 1./(1.+M_SQRT2*k+k*k);
+        s->b0 = k*k*norm;
+        s->b1 = 2.*s->b0;
+        s->b2 = s->b0;
+        s->a1 = 2.*(k*k-1.)*norm;
+        s->a2 = (1.-M_SQRT2*k+k*k)*norm;
+        state->replace(s);
+    }
+
+    void MarkerFilter::process(const FrameInfo &info, const Position3d *markers)
+    {
+        State &s = *state->get();
+        int n = s.n;
+        for(int i=0; i<n; ++i) {
+            bool ok = is_valid(markers[i]);
+            double seen = ok ? 1. : 0.;
+            double fresh = ok && !s.was_seen[i] ? 1. : 0.;
+            s.was_seen[i] = ok;
+            s.in[i] = ok ? markers[i].x : 0.;
+            s.in[n+i] = ok ? markers[i].y : 0.;
+            s.in[2*n+i] = ok ? markers[i].z : 0.;
+            for(int a=0; a<3; ++a) {
+                s.seen[a*n+i] = seen;
+                s.fresh[a*n+i] = fresh;
+            }
+        }
+
+        // Dropped frames lengthen the step for the filters that model time.
+        double dt = s.period;
+        if(s.started && info.frame_number > s.last_frame)
+            dt *= info.frame_number-s.last_frame;
+        s.last_frame = info.frame_number;
+        s.started = true;
+
+        const Params &p = params;
+        const double *x = &s.in[0], *ok = &s.seen[0], *f = &s.fresh[0];
+        double *y = &s.out[0];
+        switch(p.type) {
+            case ONE_EURO:
+                one_euro(s.lanes, dt, 1./(1.+1./(2.*M_PI*p.d_cutoff*dt)),
+                        2.*M_PI*p.min_cutoff*dt, 2.*M_PI*p.beta*dt,
+                        x, ok, f, y, &s.s0[0], &s.s1[0]);
+                break;
+            case KALMAN:
+                kalman(s.lanes, dt, p.process_noise, p.measurement_noise,
+                        x, ok, f, y, &s.s0[0], &s.s1[0], &s.s2[0], &s.s3[0], &s.s4[0]);
+                break;
+            case BUTTERWORTH:
+                biquad(s.lanes, s.b0, s.b1, s.b2, s.a1, s.a2,
+                        x, ok, f, y, &s.s0[0], &s.s1[0]);
+                break;
+        }
+
+        for(int i=0; i<n; ++i) {
+            Position3d &p = s.frame[i];
+            if(s.seen[i] != 0.) {
+                p.x = (float)s.out[i];
+                p.y = (float)s.out[n+i];
+                p.z = (float)s.out[2*n+i];
+            }else
+                p = markers[i];
+        }
+        s.ring.push(info, &s.frame[0]);
+    }
+
+    bool MarkerFilter::latest_frame(FrameInfo &info, Position3d *markers) const
+    {
+        const State *s = state->get();
+        return s != 0 && s->ring.latest(info, markers);
+    }
+
+    int MarkerFilter::frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const
+    {
+        const State *s = state->get();
+        if(!s)
+            return 0;
+        return s->ring.frames_since(n, infos, markers, max_frames);
+    }
+
+} // end of namespace
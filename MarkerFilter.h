@@ -0,0 +1,105 @@
+#ifndef _MARKERFILTER_H_
+#define _MARKERFILTER_H_
+
+/**
+ *@file MarkerFilter.h
+ *@brief Real-time smoothing of every marker, as a FrameStage.
+ */
+#include "FrameStage.h"
+
+namespace VML {
+
+    template <class T> class StageState;
+
+    /**
+     * Filters each coordinate of each marker on the fly, O(1) per frame.
+     * The filtered frames go into a ring of their own and are read with
+     * latest_frame() and frames_since(), like the raw ones from a
+     * CollectorCore, and from any thread.
+     *
+     * Internally the coordinates are kept as structure-of-arrays (all x,
+     * then all y, then all z) and every filter is a branch-free loop over
+     * them, so the compiler vectorizes it.  All state is allocated in
+     * setup(); setting up again (CollectorCore::reconfigure()) starts a
+     * new filter and ring, and readers switch over to them.
+     *
+     * A missing marker comes out missing and its filter is frozen; when
+     * it's seen again the filter restarts from the new position.
+     */
+    class MarkerFilter : public FrameStage {
+        public:
+            enum Type {
+                /**
+                 * One Euro (Casiez et al. 2012): a first-order low-pass
+                 * whose cutoff rises with speed, min_cutoff+beta*|v|.
+                 * Smooth at rest, little lag when moving.
+                 */
+                ONE_EURO,
+                /**
+                 * Constant-velocity Kalman filter per coordinate, with
+                 * white-noise acceleration.
+                 */
+                KALMAN,
+                /**
+                 * Second-order Butterworth low-pass (one biquad).  Assumes
+                 * evenly spaced frames; group delay is about
+                 * 0.2/cutoff seconds.
+                 */
+                BUTTERWORTH
+            };
+
+            struct Params {
+                Params()
+                    :type(ONE_EURO),
+                    min_cutoff(1.),
+                    beta(0.05),
+                    d_cutoff(1.),
+                    process_noise(1e5),
+                    measurement_noise(0.01),
+                    cutoff(10.),
+                    capacity(256)
+                {}
+
+                Type type;
+                double min_cutoff; //< One Euro: cutoff at rest, Hz.
+                double beta; //< One Euro: cutoff increase per mm/s.
+                double d_cutoff; //< One Euro: cutoff for the speed estimate, Hz.
+                double process_noise; //< Kalman: acceleration noise density, mm^2/s^3.
+                double measurement_noise; //< Kalman: position variance, mm^2.
+                double cutoff; //< Butterworth: cutoff, Hz.  Below half the frame frequency.
+                int capacity; //< Filtered frames kept.
+            };
+
+            MarkerFilter(const Params &p);
+            ~MarkerFilter();
+
+            void setup(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Copy the newest filtered frame.
+             * @return false if nothing's been filtered yet.
+             */
+            bool latest_frame(FrameInfo &info, Position3d *markers) const;
+
+            /**
+             * Filtered frames with a frame number larger than n, oldest
+             * first.  Same as FrameRing::frames_since().
+             */
+            int frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const;
+
+            const Params &get_params() const { return params; }
+
+        private:
+            struct State;
+
+            Params params;
+            StageState<State> *state;
+
+            MarkerFilter(const MarkerFilter &);
+            MarkerFilter &operator=(const MarkerFilter &);
+    };
+
+} // end of namespace
+
+#endif/*_MARKERFILTER_H_*/
@@ -0,0 +1,84 @@
+/**
+ *@file MarkerMask.cc
+ *@brief
+ */
+#include <limits.h>
+#include "MarkerMask.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MARKER_MASK_SSE2
+#endif
+
+namespace VML {
+
+    namespace {
+
+        inline int popcount(uint64_t w)
+        {
+#ifdef _MSC_VER
+            return (int)__popcnt64(w);
+#else
+            return __builtin_popcountll(w);
+#endif
+        }
+
+    }
+
+    int scan_valid(const Position3d *markers, int n, uint64_t *bits)
+    {
+        int count = 0;
+        for(int k=0; k<mask_words(n); ++k) {
+            const Position3d *m = markers+64*k;
+            int end = n-64*k < 64 ? n-64*k : 64;
+            uint64_t w = 0;
+            int i = 0;
+#ifdef MARKER_MASK_SSE2
+            // 4 markers are 12 floats: x0 y0 z0 x1 ... in three loads.
+            const __m128 limit = _mm_set1_ps(MAX_NEGATIVE);
+            for(; i+4<=end; i+=4) {
+                const float *f = &m[i].x;
+                unsigned v = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(f), limit))
+                    | _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(f+4), limit)) << 4
+                    | _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(f+8), limit)) << 8;
+                // bit 3j: all of marker j's coordinates
+                v &= (v >> 1) & (v >> 2);
+                uint64_t four = (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4) | ((v >> 6) & 8);
+                w |= four << i;
+            }
+#endif
+            for(; i<end; ++i)
+                w |= (uint64_t)is_valid(m[i]) << i;
+            bits[k] = w;
+            count += popcount(w);
+        }
+        return count;
+    }
+
+    void HoldOver::setup(int n, int max)
+    {
+        max_frames = max;
+        Position3d missing;
+        missing.x = missing.y = missing.z = BAD_FLOAT;
+        last.assign(n, missing);
+        age.assign(n, INT_MAX);
+    }
+
+    void HoldOver::apply(Position3d *markers, const uint64_t *bits, bool new_frame)
+    {
+        int n = (int)last.size();
+        int limit = max_frames < 0 ? INT_MAX-1 : max_frames;
+        for(int i=0; i<n; ++i) {
+            if(test_bit(bits, i)) {
+                last[i] = markers[i];
+                age[i] = 0;
+                continue;
+            }
+            if(new_frame && age[i] < INT_MAX)
+                ++age[i];
+            if(age[i] <= limit)
+                markers[i] = last[i];
+        }
+    }
+
+} // end of namespace
@@ -0,0 +1,106 @@
+#ifndef _MARKERMASK_H_
+#define _MARKERMASK_H_
+
+/**
+ *@file MarkerMask.h
+ *@brief One validity bit per marker, and holding missing markers at
+ * their last position.
+ */
+#include <stdint.h>
+#include <vector>
+#include "OptoFrame.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace VML {
+
+    /**
+     * 64-bit words needed for n markers.
+     */
+    inline int mask_words(int n) {
+        return (n+63)/64;
+    }
+
+    /**
+     * Set bit i (bit i%64 of bits[i/64]) if markers[i] was seen, i.e.
+     * passes is_valid(); clear it otherwise, and clear the unused bits of
+     * the last word.  Compares all the coordinates of 4 markers at once
+     * with SSE2 (and is scalar elsewhere), so no branches per float.
+     * @param bits mask_words(n) words.
+     * @return Number of markers seen.
+     */
+    int scan_valid(const Position3d *markers, int n, uint64_t *bits);
+
+    inline bool test_bit(const uint64_t *bits, int i) {
+        return ((bits[i >> 6] >> (i & 63)) & 1) != 0;
+    }
+
+    /**
+     * Index of the lowest set bit of w, which isn't 0.
+     */
+    inline int lowest_bit(uint64_t w) {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward64(&i, w);
+        return (int)i;
+#else
+        return __builtin_ctzll(w);
+#endif
+    }
+
+    /**
+     * Call f(i) for every marker i whose bit is set, in order: a ctz per
+     * marker seen, nothing per marker missing.
+     */
+    template <class F>
+    void for_each_valid(const uint64_t *bits, int n, F f) {
+        for(int k=0; k<mask_words(n); ++k) {
+            for(uint64_t w=bits[k]; w; w&=w-1)
+                f(64*k+lowest_bit(w));
+        }
+    }
+
+    /**
+     * Replaces missing markers with where they were last seen, for up to
+     * max_frames frames in a row (forever if negative, never if 0), so
+     * short occlusions don't reach the consumers as sentinels.  A marker
+     * never seen, or missing for longer, keeps the sentinel.
+     */
+    class HoldOver {
+        public:
+            HoldOver():max_frames(0) {}
+
+            /**
+             * Allocate for num_markers markers and forget what was seen.
+             */
+            void setup(int num_markers, int max_frames);
+
+            bool is_enabled() const { return max_frames != 0; }
+            int get_max_frames() const { return max_frames; }
+
+            /**
+             * Fill in markers from what's been seen, and remember what's
+             * seen now.
+             * @param bits This frame's scan_valid().
+             * @param new_frame False if it's the same frame again, so the
+             * ages don't move.
+             */
+            void apply(Position3d *markers, const uint64_t *bits, bool new_frame);
+
+            /**
+             * Frames since marker i was last seen: 0 if it's in this
+             * frame.  Meaningless if never seen.
+             */
+            int get_age(int i) const { return age[i]; }
+
+        private:
+            int max_frames;
+            std::vector<Position3d> last;
+            std::vector<int> age;
+    };
+
+} // end of namespace
+
+#endif/*_MARKERMASK_H_*/
@@ -0,0 +1,72 @@
+/**
+ *@file ODAUCollector.cc
+ *@brief 
+ */
+#include <stdexcept>
+#include "ODAUCollector.h"
+
+using namespace System;
+
+namespace VML {
+
+    ODAUCollector::ODAUCollector(OptoCollector ^o, int history)
+        :optical(o)
+    {
+        init(history);
+    }
+
+    ODAUCollector::ODAUCollector(OptoCollector ^o)
+        :optical(o)
+    {
+        init(1024);
+    }
+
+    void ODAUCollector::init(int history)
+    {
+        device = new OapiOdauDevice;
+        core = new OdauCore(device, history);
+        frame = new MergedFrame;
+        try {
+            optical->get_core()->add_stage(core);
+        }catch(const std::exception &e) {
+            this->!ODAUCollector();
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
+
+    ODAUCollector::~ODAUCollector()
+    {
+        if(core)
+            optical->get_core()->remove_stage(core);
+        this->!ODAUCollector();
+    }
+
+    ODAUCollector::!ODAUCollector()
+    {
+        delete core;
+        delete device;
+        delete frame;
+        core = 0;
+        device = 0;
+        frame = 0;
+    }
+
+    int ODAUCollector::get_latest_frame()
+    {
+        return (int)core->get_latest_frame();
+    }
+
+    int ODAUCollector::get_frame(int fn, OptoFrame ^f, array<float> ^analog)
+    {
+        if(fn < 0 || !core->read((unsigned int)fn, *frame))
+            return -1;
+        const int n = (int)frame->analog.size();
+        if(f->valid->Length != (int)frame->markers.size() || analog->Length < n)
+            throw gcnew System::Exception("Frame or analog array of the wrong size.");
+        f->assign(frame->info, frame->markers.empty() ? 0 : &frame->markers[0]);
+        if(n)
+            System::Runtime::InteropServices::Marshal::Copy(IntPtr(&frame->analog[0]), analog, 0, n);
+        return frame->num_scans;
+    }
+
+} // end of namespace
@@ -0,0 +1,93 @@
+#ifndef _ODAUCOLLECTOR_H_
+#define _ODAUCOLLECTOR_H_
+
+/**
+ *@file ODAUCollector.h
+ *@brief 
+ */
+#include "OptoCollector.h"
+#include "OdauCore.h"
+
+namespace VML {
+
+    /**
+     * The ODAU's analog channels, collected with an OptoCollector's
+     * frames and merged with them by frame number.
+     *
+     * The ODAU is clocked by the Optotrak: it takes samples_per_frame
+     * scans of its channels per optical frame.  Each time the collector
+     * gets a frame (update_frame() or the acquisition thread), the ODAU's
+     * latest frame is read right after it, and get_frame() gives both
+     * halves of a frame together.  The work is done by an OdauCore
+     * attached to the collector; this class only converts types and
+     * exceptions.
+     *
+     * Create it and set the properties before the collector's
+     * setup_collection(), which sets the ODAU up too.
+     */
+    public ref class ODAUCollector {
+        public:
+            /**
+             * @param history Frames kept for get_frame().
+             */
+            ODAUCollector(OptoCollector ^optical, int history);
+            ODAUCollector(OptoCollector ^optical);
+
+            /**
+             * Detaches from the collector.  Dispose of it before the
+             * collector.
+             */
+            ~ODAUCollector();
+            !ODAUCollector();
+
+            /**
+             * The newest frame with both halves in, -1 if none yet.
+             */
+            int get_latest_frame();
+
+            /**
+             * Frame fn's markers into f and its analog data into analog,
+             * in volts: num_channels runs of samples_per_frame samples.
+             * @return The number of scans the ODAU sent (the rest are 0),
+             * or -1 if the frame isn't complete or no longer kept.
+             */
+            int get_frame(int fn, OptoFrame ^f, array<float> ^analog);
+
+            /**
+             * Frames merged, and ODAU reads that failed.
+             */
+            unsigned long long get_num_merged() { return core->get_num_merged(); }
+            unsigned long long get_num_failures() { return core->get_num_failures(); }
+
+            property int odau { //< 0 for ODAU1, 1 for ODAU2, ...
+                int get() { return core->params.odau; }
+                void set(int v) { core->params.odau = v; }
+            }
+            property int num_channels { //< Analog channels to sample, 1 to 16 (8).
+                int get() { return core->params.num_channels; }
+                void set(int v) { core->params.num_channels = v; }
+            }
+            property int gain { //< Analog gain (1).
+                int get() { return core->params.gain; }
+                void set(int v) { core->params.gain = v; }
+            }
+            property int samples_per_frame { //< Scans per optical frame (1).
+                int get() { return core->params.samples_per_frame; }
+                void set(int v) { core->params.samples_per_frame = v; }
+            }
+            property float scan_frequency { //< Once set up.
+                float get() { return core->get_scan_frequency(); }
+            }
+
+        private:
+            OptoCollector ^optical;
+            OdauDevice *device;
+            OdauCore *core;
+            MergedFrame *frame; //< Scratch for get_frame().
+
+            void init(int history);
+    };
+
+} // end of namespace
+
+#endif/*_ODAUCOLLECTOR_H_*/
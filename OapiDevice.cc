@@ -0,0 +1,233 @@
+/**
+ *@file OapiDevice.cc
+ *@brief
+ */
+#include <chrono>
+#include <thread>
+#include "OptoDevice.h"
+#include "OptoFrame.h"
+#include "Triangulator.h"
+
+namespace VML {
+
+    /**
+     * Call f until it returns 0 or timeout seconds have passed, waiting
+     * 1 ms between tries at first, doubling up to 50 ms.
+     * @return f's last result.
+     */
+    template <class F>
+    static int poll(F f, double timeout)
+    {
+        long long end = host_time_ns()+(long long)(timeout*1e9);
+        std::chrono::milliseconds wait(1);
+        int err;
+        while( (err = f()) && host_time_ns() < end ) {
+            std::this_thread::sleep_for(wait);
+            if(wait < std::chrono::milliseconds(50))
+                wait *= 2;
+        }
+        return err;
+    }
+
+    OapiDevice &OapiDevice::instance()
+    {
+        static OapiDevice device;
+        return device;
+    }
+
+    int OapiDevice::query_status(int *sensors, int *markers)
+    {
+        int nodaus, nbodies, threshold, gain, stream, flags;
+        float ff, mf, cycle, voltage, ct, tt;
+        return OptotrakGetStatus(sensors, &nodaus, &nbodies, markers, &ff, &mf,
+                &threshold, &gain, &stream, &cycle, &voltage, &ct, &tt, &flags);
+    }
+
+    int OapiDevice::initialize()
+    {
+        int err;
+        if( (err = TransputerLoadSystem( "system" )) != OPTO_NO_ERROR_CODE )
+            return err;
+
+        // Initialization fails until the loaded system has booted, and
+        // the system doesn't answer status requests until it's up.
+        if( (err = poll([]{
+                        return TransputerInitializeSystem(OPTO_LOG_ERRORS_FLAG|OPTO_LOG_MESSAGES_FLAG);
+                        }, ready_timeout)) )
+            return err;
+        if( (err = poll([this]{
+                        int nm;
+                        int e = query_status(&num_sensors, &nm);
+                        return e ? e : num_sensors > 0 ? 0 : -1;
+                        }, ready_timeout)) )
+            return err;
+
+        // on-host conversions have to be enabled for rigid body processing
+        if( (err = OptotrakSetProcessingFlags( OPTO_LIB_POLL_REAL_DATA |
+                        OPTO_CONVERT_ON_HOST |
+                        OPTO_RIGID_ON_HOST )) )
+            return err;
+
+        return OptotrakLoadCameraParameters( "standard" );
+    }
+
+    int OapiDevice::shutdown()
+    {
+        OptotrakDeActivateMarkers();
+        // Make sure the deactivation went through before going down.
+        poll([this]{
+                int ns, nm;
+                return query_status(&ns, &nm);
+                }, ready_timeout);
+
+        return TransputerShutdownSystem();
+    }
+
+    int OapiDevice::set_strober_table(int port1, int port2, int port3, int port4)
+    {
+        return OptotrakSetStroberPortTable(port1, port2, port3, port4);
+    }
+
+    int OapiDevice::setup_collection(const CollectionParams &p)
+    {
+        num_markers = p.num_markers;
+        int err = OptotrakSetupCollection(
+                p.num_markers,
+                p.frame_frequency,
+                p.marker_frequency,
+                p.threshold,
+                p.gain,
+                p.stream_mode,
+                p.cycle,
+                p.voltage,
+                p.collect_time,
+                p.trigger_time,
+                p.flags);
+        if(err)
+            return err;
+
+        probe.resize(num_markers > 0 ? num_markers : 1);
+
+        // Ready once the system reports the new collection.
+        return poll([this]{
+                int ns, nm;
+                int e = query_status(&ns, &nm);
+                return e ? e : nm == num_markers ? 0 : -1;
+                }, ready_timeout);
+    }
+
+    int OapiDevice::activate_markers()
+    {
+        int err = OptotrakActivateMarkers();
+        if(err)
+            return err;
+
+        // Ready once a frame comes through.  The request stays
+        // outstanding until then, so it's made once.
+        if( (err = RequestLatest3D()) )
+            return err;
+        if( (err = poll([]{ return DataIsReady() ? 0 : -1; }, ready_timeout)) )
+            return err;
+        unsigned int fn, ne, f;
+        return DataReceiveLatest3D(&fn, &ne, &f, &probe[0]);
+    }
+
+    int OapiDevice::deactivate_markers()
+    {
+        return OptotrakDeActivateMarkers();
+    }
+
+    int OapiDevice::get_latest_3d(unsigned int *fn, unsigned int *ne, unsigned int *f, Position3d *p)
+    {
+        return DataGetLatest3D(fn, ne, f, p);
+    }
+
+    int OapiDevice::request_latest_3d()
+    {
+        return RequestLatest3D();
+    }
+
+    bool OapiDevice::data_is_ready()
+    {
+        return DataIsReady() != 0;
+    }
+
+    int OapiDevice::receive_latest_3d(unsigned int *fn, unsigned int *ne, unsigned int *f, Position3d *p)
+    {
+        return DataReceiveLatest3D(fn, ne, f, p);
+    }
+
+    int OapiDevice::buffer_start(int num_frames)
+    {
+        if(num_frames <= 0)
+            return 1;
+        int err;
+        int nmarkers;
+        if( (err = query_status(&num_sensors, &nmarkers)) )
+            return err;
+
+        // With OPTOTRAK_BUFFER_RAW_FLAG the spool holds raw frames back to
+        // back, one centroid per sensor per marker.
+        buffer_stop();
+        spool.resize((size_t)num_sensors*num_markers*num_frames);
+        num_spooled = 0;
+        num_converted = 0;
+        spool_complete = false;
+
+        // A buffer that didn't start isn't stopped by the next buffer_stop().
+        if( (err = DataBufferInitializeMem(OPTOTRAK, &spool[0])) || (err = DataBufferStart()) )
+            spool.clear();
+        return err;
+    }
+
+    int OapiDevice::buffer_read(Position3d *markers, int max_frames, int *num_frames, bool *complete)
+    {
+        if(spool.empty())
+            return 1;
+        int err;
+        if(!spool_complete) {
+            unsigned int realtime, complete_flag, spool_status;
+            if( (err = DataBufferWriteData(&realtime, &complete_flag, &spool_status, &num_spooled)) )
+                return err;
+            if(spool_status)
+                return (int)spool_status;
+            spool_complete = complete_flag != 0;
+        }
+
+        int n = 0;
+        if(triangulator) {
+            if(triangulator->get_num_sensors() != num_sensors)
+                return -1;
+            unsigned long ready = num_spooled-num_converted;
+            n = ready < (unsigned long)max_frames ? (int)ready : max_frames;
+            if(n > 0)
+                triangulator->triangulate_frames(&spool[num_converted*num_sensors*num_markers],
+                        n, num_markers, markers, triangulator_threads);
+            num_converted += n;
+        }else {
+            while(num_converted < num_spooled && n < max_frames) {
+                unsigned int ne;
+                if( (err = OptotrakConvertRawTo3D(&ne,
+                                &spool[num_converted*num_sensors*num_markers], markers+n*num_markers)) )
+                    return err;
+                ++num_converted;
+                ++n;
+            }
+        }
+
+        *num_frames = n;
+        *complete = spool_complete && num_converted == num_spooled;
+        return 0;
+    }
+
+    int OapiDevice::buffer_stop()
+    {
+        int err = 0;
+        if(!spool.empty()) {
+            err = DataBufferStop();
+            spool.clear();
+        }
+        return err;
+    }
+
+} // end of namespace
@@ -0,0 +1,30 @@
+/**
+ *@file OapiOdauDevice.cc
+ *@brief
+ */
+#include "OdauDevice.h"
+
+namespace VML {
+
+    int OapiOdauDevice::setup_collection(const OdauParams &p, const CollectionParams &optical)
+    {
+        odau_id = ODAU1+p.odau;
+        return OdauSetupCollection(
+                odau_id,
+                p.num_channels,
+                p.gain,
+                ODAU_DIGITAL_PORT_OFF,
+                optical.frame_frequency,
+                optical.frame_frequency*p.samples_per_frame,
+                optical.stream_mode,
+                optical.collect_time,
+                optical.trigger_time,
+                0);
+    }
+
+    int OapiOdauDevice::get_latest(unsigned int *fn, unsigned int *ne, unsigned int *f, int *data)
+    {
+        return DataGetLatestOdauRaw(odau_id, fn, ne, f, data);
+    }
+
+} // end of namespace
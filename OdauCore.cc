@@ -0,0 +1,222 @@
+/**
+ *@file OdauCore.cc
+ *@brief
+ */
+#include <string.h>
+#include <atomic>
+#include <stdexcept>
+#include "StageState.h"
+#include "OdauCore.h"
+
+namespace VML {
+
+    /*
+     * A slot per frame number modulo history, tagged with the frame it
+     * holds.  Each slot has its own seqlock, as FrameRing's.
+     */
+    struct OdauCore::Store {
+        struct Slot {
+            std::atomic<unsigned int> sequence; //< Odd while written.
+            unsigned int frame_number;
+            bool has_optical;
+            bool has_analog;
+            FrameInfo info;
+            unsigned int analog_flags;
+            int num_scans;
+        };
+
+        Store(int history, int num_markers, int num_channels, int samples_per_frame)
+            :slots(history),
+            num_markers(num_markers),
+            num_channels(num_channels),
+            samples_per_frame(samples_per_frame),
+            num_samples(num_channels*samples_per_frame),
+            markers((size_t)history*num_markers+1),
+            analog((size_t)history*num_channels*samples_per_frame),
+            latest(-1),
+            num_merged(0),
+            num_analog(0),
+            num_failures(0)
+        {
+            for(size_t i=0; i<slots.size(); ++i) {
+                slots[i].sequence.store(0, std::memory_order_relaxed);
+                slots[i].frame_number = 0;
+                slots[i].has_optical = slots[i].has_analog = false;
+            }
+        }
+
+        /*
+         * Producer only.  Start writing frame fn's slot, cleared if it held
+         * an older frame; 0 if it holds a newer one (fn is too old).
+         */
+        Slot *open(unsigned int fn) {
+            Slot &s = slots[fn % slots.size()];
+            if(s.has_optical || s.has_analog) {
+                if((int)(fn-s.frame_number) < 0)
+                    return 0;
+            }
+            s.sequence.store(s.sequence.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            if(s.frame_number != fn || !(s.has_optical || s.has_analog)) {
+                s.frame_number = fn;
+                s.has_optical = s.has_analog = false;
+            }
+            return &s;
+        }
+
+        void close(Slot *s) {
+            bool complete = s->has_optical && s->has_analog;
+            s->sequence.store(s->sequence.load(std::memory_order_relaxed)+1, std::memory_order_release);
+            if(complete) {
+                num_merged.fetch_add(1, std::memory_order_relaxed);
+                if((long long)s->frame_number > latest.load(std::memory_order_relaxed))
+                    latest.store(s->frame_number, std::memory_order_release);
+            }
+        }
+
+        size_t index(const Slot *s) const { return s-&slots[0]; }
+
+        std::vector<Slot> slots;
+        int num_markers;
+        int num_channels;
+        int samples_per_frame;
+        int num_samples;                //< Per frame, all channels.
+        std::vector<Position3d> markers;
+        std::vector<float> analog;
+        std::atomic<long long> latest;
+        std::atomic<unsigned long long> num_merged;
+        std::atomic<unsigned long long> num_analog;
+        std::atomic<unsigned long long> num_failures;
+    };
+
+    OdauCore::OdauCore(OdauDevice *d, int h)
+        :device(d),
+        history(h > 0 ? h : 1),
+        frame_frequency(0.f),
+        store(new StageState<Store>)
+    {
+    }
+
+    OdauCore::~OdauCore()
+    {
+        delete store;
+    }
+
+    void OdauCore::setup(const CollectionParams &p)
+    {
+        if(params.num_channels < 1 || params.num_channels > 16)
+            throw std::invalid_argument("The ODAU has 1 to 16 analog channels");
+        if(params.samples_per_frame < 1 || params.gain < 1 || !(params.volts_per_count > 0.))
+            throw std::invalid_argument("Bad ODAU samples per frame, gain or scale");
+        if(device->setup_collection(params, p))
+            throw std::runtime_error("Can't set up the ODAU collection");
+
+        Store *s = new Store(history, p.num_markers, params.num_channels, params.samples_per_frame);
+        raw.assign(s->num_samples, 0);
+        applied = params;
+        frame_frequency = p.frame_frequency;
+        store->replace(s);
+    }
+
+    void OdauCore::process(const FrameInfo &info, const Position3d *markers)
+    {
+        Store *st = store->get();
+        if(!st)
+            return;
+
+        if(Store::Slot *s = st->open(info.frame_number)) {
+            s->info = info;
+            s->has_optical = true;
+            memcpy(&st->markers[st->index(s)*st->num_markers], markers,
+                    sizeof(Position3d)*st->num_markers);
+            st->close(s);
+        }
+
+        // Nothing of the Optotrak's is outstanding here: the next request
+        // goes out after the stages have run (RequestScheduler::request_next()).
+        unsigned int fn, ne, flags;
+        if(device->get_latest(&fn, &ne, &flags, &raw[0])) {
+            st->num_failures.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const int nc = st->num_channels, spf = st->samples_per_frame;
+        const Store::Slot &old = st->slots[fn % st->slots.size()];
+        if(old.has_analog && old.frame_number == fn)
+            return; // Seen it already.
+        Store::Slot *s = st->open(fn);
+        if(!s)
+            return;
+
+        int scans = (int)(ne/nc);
+        if(scans > spf)
+            scans = spf;
+        const float scale = (float)(applied.volts_per_count/applied.gain);
+        float *a = &st->analog[st->index(s)*st->num_samples];
+        for(int c=0; c<nc; ++c) {
+            for(int k=0; k<scans; ++k)
+                a[c*spf+k] = (short)(raw[k*nc+c] & 0xffff)*scale;
+            for(int k=scans; k<spf; ++k)
+                a[c*spf+k] = 0.f;
+        }
+        s->analog_flags = flags;
+        s->num_scans = scans;
+        s->has_analog = true;
+        st->num_analog.fetch_add(1, std::memory_order_relaxed);
+        st->close(s);
+    }
+
+    bool OdauCore::read(unsigned int fn, MergedFrame &f) const
+    {
+        const Store *st = store->get();
+        if(!st)
+            return false;
+        const Store::Slot &s = st->slots[fn % st->slots.size()];
+        const size_t i = st->index(&s);
+        const int nm = st->num_markers, ns = st->num_samples;
+        f.markers.resize(nm);
+        f.analog.resize(ns);
+
+        unsigned int seq = s.sequence.load(std::memory_order_acquire);
+        if(seq & 1 || s.frame_number != fn || !s.has_optical || !s.has_analog)
+            return false;
+        f.info = s.info;
+        f.analog_flags = s.analog_flags;
+        f.num_scans = s.num_scans;
+        if(nm)
+            memcpy(&f.markers[0], &st->markers[i*nm], sizeof(Position3d)*nm);
+        memcpy(&f.analog[0], &st->analog[i*ns], sizeof(float)*ns);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(s.sequence.load(std::memory_order_relaxed) != seq)
+            return false; // Overwritten while copied: it's gone.
+
+        f.num_channels = st->num_channels;
+        f.samples_per_frame = st->samples_per_frame;
+        return true;
+    }
+
+    long long OdauCore::get_latest_frame() const
+    {
+        const Store *st = store->get();
+        return st ? st->latest.load(std::memory_order_acquire) : -1;
+    }
+
+    unsigned long long OdauCore::get_num_merged() const
+    {
+        const Store *st = store->get();
+        return st ? st->num_merged.load(std::memory_order_relaxed) : 0;
+    }
+
+    unsigned long long OdauCore::get_num_analog() const
+    {
+        const Store *st = store->get();
+        return st ? st->num_analog.load(std::memory_order_relaxed) : 0;
+    }
+
+    unsigned long long OdauCore::get_num_failures() const
+    {
+        const Store *st = store->get();
+        return st ? st->num_failures.load(std::memory_order_relaxed) : 0;
+    }
+
+} // end of namespace
@@ -0,0 +1,112 @@
+#ifndef _ODAUCORE_H_
+#define _ODAUCORE_H_
+
+/**
+ *@file OdauCore.h
+ *@brief The native half of ODAUCollector: analog data merged with the
+ * optical frames, by frame number.
+ */
+#include <vector>
+#include "FrameStage.h"
+#include "OdauDevice.h"
+
+namespace VML {
+
+    template <class T> class StageState;
+
+    /**
+     * A caller-owned copy of one merged frame, filled by OdauCore::read().
+     * Reuse it; it's only allocated the first time.
+     */
+    struct MergedFrame {
+        FrameInfo info;              //< The optical frame's.
+        unsigned int analog_flags;
+        int num_channels;
+        int samples_per_frame;
+        int num_scans;               //< Scans that came, up to samples_per_frame; the rest are 0.
+        std::vector<Position3d> markers;
+        std::vector<float> analog;   //< Volts, channel c's samples from c*samples_per_frame.
+
+        const float *channel(int c) const {
+            return &analog[(size_t)c*samples_per_frame];
+        }
+    };
+
+    /**
+     * A FrameStage that gets the ODAU's data for each optical frame, in
+     * the same acquisition step: process() asks the ODAU for its latest
+     * frame right after the Optotrak's has come in.  Both go into a ring
+     * of history frames, in the slot of their own frame number, so a
+     * frame is complete once both halves have arrived, in either order.
+     * The ODAU's call waits for its data (a transfer, not a frame), which
+     * is the one exception to stages not blocking.  No request of either
+     * device is outstanding meanwhile, as OAPI requires: whichever way
+     * frames are read, the Optotrak's next request is only sent once the
+     * stages have run.
+     *
+     * Analog samples are converted to volts and stored channel by
+     * channel.  The ODAU is set up with the optical collection: attach
+     * the stage (CollectorCore::add_stage()) before setup_collection(),
+     * with params filled in.
+     *
+     * Reads are safe from any thread while frames come in, and while the
+     * stage is set up again: a new ring takes over and frames from
+     * before are no longer read.
+     */
+    class OdauCore : public FrameStage {
+        public:
+            /**
+             * @param device Not owned.  Must outlive the stage.
+             * @param history Frames kept for read().
+             */
+            OdauCore(OdauDevice *device, int history=1024);
+            ~OdauCore();
+
+            /**
+             * Sets the ODAU up.  Throws std::invalid_argument for
+             * unusable params, std::runtime_error if the device fails.
+             */
+            void setup(const CollectionParams &p);
+            void process(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Frame fn, if both halves are in and it's still kept.
+             */
+            bool read(unsigned int fn, MergedFrame &f) const;
+
+            /**
+             * The newest complete frame's number, -1 if none yet.
+             */
+            long long get_latest_frame() const;
+
+            int get_num_channels() const { return applied.num_channels; }
+            int get_samples_per_frame() const { return applied.samples_per_frame; }
+            float get_scan_frequency() const { return applied.samples_per_frame*frame_frequency; }
+
+            unsigned long long get_num_merged() const;   //< Frames completed.
+            unsigned long long get_num_analog() const;   //< ODAU frames received.
+            unsigned long long get_num_failures() const; //< ODAU calls that failed.
+
+            /**
+             * Used by the next setup(); applied ones are
+             * get_num_channels() etc.
+             */
+            OdauParams params;
+
+        private:
+            struct Store;
+
+            OdauDevice *device;
+            int history;
+            OdauParams applied;
+            float frame_frequency;
+            std::vector<int> raw;    //< One get_latest()'s values.
+            StageState<Store> *store;
+
+            OdauCore(const OdauCore &);
+            OdauCore &operator=(const OdauCore &);
+    };
+
+} // end of namespace
+
+#endif/*_ODAUCORE_H_*/
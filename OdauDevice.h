@@ -0,0 +1,77 @@
+#ifndef _ODAUDEVICE_H_
+#define _ODAUDEVICE_H_
+
+/**
+ *@file OdauDevice.h
+ *@brief The ODAU (analog/digital data acquisition unit) of an Optotrak
+ * system.
+ */
+#include "OptoDevice.h"
+
+namespace VML {
+
+    /**
+     * What to sample.  The ODAU runs on the Optotrak's frame clock:
+     * samples_per_frame scans of every channel per optical frame.
+     */
+    struct OdauParams {
+        OdauParams()
+            :odau(0),
+            num_channels(8),
+            gain(1),
+            samples_per_frame(1),
+            volts_per_count(10./32768.)
+        {}
+
+        int odau;               //< Which ODAU, 0 for the first (ODAU1).
+        int num_channels;       //< Analog channels, 1 to 16.
+        int gain;               //< Amplification, 1, 2, 5, 10, ...
+        int samples_per_frame;  //< Scan frequency over frame frequency.
+        double volts_per_count; //< At gain 1, of the low 16 bits of a raw value.
+    };
+
+    /**
+     * One ODAU.  Return values follow OAPI: 0 means success.
+     */
+    class OdauDevice {
+        public:
+            virtual ~OdauDevice() {}
+
+            /**
+             * After the Optotrak's own setup_collection(), with its
+             * parameters, so both run on the same frames.
+             */
+            virtual int setup_collection(const OdauParams &p, const CollectionParams &optical) = 0;
+
+            /**
+             * Same as DataGetLatestOdauRaw: the newest frame's scans,
+             * num_channels raw values each, one scan after the other.
+             * @param data Room for num_channels*samples_per_frame values.
+             * @param num_elements Values received.
+             */
+            virtual int get_latest(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, int *data) = 0;
+    };
+
+    /**
+     * Straight pass-through to NDI's library.  No request is left
+     * outstanding, so it can share the system with an OapiDevice as long
+     * as the two take turns, as OdauCore does.
+     */
+    class OapiOdauDevice : public OdauDevice {
+        public:
+            OapiOdauDevice()
+                :odau_id(0)
+            {}
+
+            int setup_collection(const OdauParams &p, const CollectionParams &optical);
+            int get_latest(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, int *data);
+
+        private:
+            int odau_id; //< OAPI's, ODAU1 and up.
+    };
+
+} // end of namespace
+
+#endif/*_ODAUDEVICE_H_*/
@@ -1,18 +1,19 @@
 using System;
 using System.Diagnostics;
+using System.Threading.Tasks;
 using VML;
 
 class Opto {
     public static void Main() {
-        Optotrak.initialize();
-
         OptoCollector oc = new OptoCollector();
 
         oc.add_markers(3);
         oc.frame_frequency = 500;
         oc.enforce_blocking();
-        oc.setup_collection();
-        oc.activate();
+        // Initialize, set up and activate in the background; anything
+        // else the program needs to load can go here.
+        Task startup = oc.start_async(true);
+        startup.Wait();
         double[] x = new double[3];
         double[] y;
 
@@ -30,7 +31,9 @@ class Opto {
             y = oc.get_position(0);
             Console.WriteLine(" y:" + y[0] + " " + y[1] + " " + y[2] + " ");
         }
+        Console.WriteLine("first frame after " + oc.get_time_to_first_frame() + " ms");
 
+        Console.Write(oc.dump_stats());
         Console.WriteLine("Stop");
         Optotrak.shutdown();
     }
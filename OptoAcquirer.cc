@@ -0,0 +1,223 @@
+/**
+ *@file OptoAcquirer.cc
+ *@brief
+ */
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "FrameRing.h"
+#include "OptoDevice.h"
+#include "FrameStage.h"
+#include "FrameStats.h"
+#include "OptoAcquirer.h"
+
+namespace VML {
+
+    struct OptoAcquirer::Worker {
+        Worker():running(false), num_failures(0), waiters(0), has_waiters(false) {}
+
+        std::thread thread;
+        std::atomic<bool> running;
+        std::atomic<unsigned long long> num_failures;
+
+        std::mutex lock; //< For waiters.
+        FrameWaiter *waiters; //< Newest first.
+        std::atomic<bool> has_waiters; //< So the thread only locks when there are.
+    };
+
+    OptoAcquirer::OptoAcquirer(OptoDevice *d, int num_markers, int capacity,
+            const std::vector<FrameStage *> &s, FrameStats *st)
+        :device(d),
+        ring(new FrameRing(num_markers, capacity)),
+        worker(new Worker),
+        scratch(num_markers),
+        stages(s),
+        stats(st),
+        polling(false)
+    {
+    }
+
+    OptoAcquirer::~OptoAcquirer()
+    {
+        stop();
+        delete worker;
+        delete ring;
+    }
+
+    void OptoAcquirer::set_polling(double frame_period, bool next_frame)
+    {
+        polling = true;
+        scheduler.reset(frame_period, next_frame);
+    }
+
+    void OptoAcquirer::start()
+    {
+        if(worker->running.load())
+            return;
+        worker->running.store(true);
+        worker->thread = std::thread(&OptoAcquirer::run, this);
+    }
+
+    void OptoAcquirer::stop()
+    {
+        worker->running.store(false);
+        if(worker->thread.joinable())
+            worker->thread.join();
+        notify_waiters(-1);
+    }
+
+    bool OptoAcquirer::is_running() const
+    {
+        return worker->running.load();
+    }
+
+    bool OptoAcquirer::add_waiter(FrameWaiter *w)
+    {
+        std::lock_guard<std::mutex> l(worker->lock);
+        if(!worker->running.load())
+            return false;
+        // Either the thread sees has_waiters after its push, or we see
+        // the push and wait for the one after.
+        worker->has_waiters.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        w->after = ring->get_num_pushed();
+        w->next = worker->waiters;
+        worker->waiters = w;
+        return true;
+    }
+
+    bool OptoAcquirer::remove_waiter(FrameWaiter *w)
+    {
+        std::lock_guard<std::mutex> l(worker->lock);
+        for(FrameWaiter **p=&worker->waiters; *p; p=&(*p)->next) {
+            if(*p == w) {
+                *p = w->next;
+                w->next = 0;
+                worker->has_waiters.store(worker->waiters != 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned long long OptoAcquirer::get_num_acquired() const
+    {
+        return ring->get_num_pushed();
+    }
+
+    void OptoAcquirer::notify_waiters(int frame_number)
+    {
+        FrameWaiter *ready = 0;
+        {
+            std::lock_guard<std::mutex> l(worker->lock);
+            unsigned long long count = ring->get_num_pushed();
+            FrameWaiter **p = &worker->waiters;
+            while(*p) {
+                FrameWaiter *w = *p;
+                if(frame_number < 0 || w->after < count) {
+                    *p = w->next;
+                    w->after = count;
+                    w->next = ready;
+                    ready = w;
+                }else {
+                    p = &w->next;
+                }
+            }
+            worker->has_waiters.store(worker->waiters != 0);
+        }
+        // Oldest first, unlocked so they can wait again.
+        while(ready) {
+            FrameWaiter *w = ready;
+            ready = w->next;
+            w->next = 0;
+            w->notify(w, frame_number);
+        }
+    }
+
+    unsigned long long OptoAcquirer::get_num_failures() const
+    {
+        return worker->num_failures.load(std::memory_order_relaxed);
+    }
+
+    bool OptoAcquirer::latest_frame(FrameInfo &info, Position3d *markers) const
+    {
+        return ring->latest(info, markers);
+    }
+
+    int OptoAcquirer::frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const
+    {
+        return ring->frames_since(n, infos, markers, max_frames);
+    }
+
+    int OptoAcquirer::poll_frame(FrameInfo &info)
+    {
+        for(;;) {
+            int r = scheduler.poll(device, info, &scratch[0]);
+            if(r != RequestScheduler::PENDING)
+                return r == RequestScheduler::READY ? 0 : 1;
+            if(!worker->running.load(std::memory_order_relaxed))
+                return 1;
+            // Checked now and then, so stop() isn't held up long.
+            long long wait = scheduler.get_due()-host_time_ns();
+            if(wait > 10000000)
+                wait = 10000000;
+            if(wait > 0)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        }
+    }
+
+    void OptoAcquirer::run()
+    {
+        unsigned int num_markers = (unsigned int)scratch.size();
+        unsigned int last_frame = 0;
+        bool first = true;
+
+        while(worker->running.load(std::memory_order_relaxed)) {
+            FrameInfo info;
+            long long before = stats ? host_time_ns() : 0;
+            int error = polling ? poll_frame(info)
+                : device->get_latest_3d(&info.frame_number, &info.num_markers, &info.flags, &scratch[0]);
+            info.host_time = host_time_ns();
+            if(error && !worker->running.load(std::memory_order_relaxed))
+                break;
+            if(stats)
+                stats->record_call(before, info.host_time);
+            if(error || info.num_markers != num_markers) {
+                worker->num_failures.fetch_add(1, std::memory_order_relaxed);
+                if(stats)
+                    stats->record_failure();
+                std::this_thread::yield();
+                continue;
+            }
+            if(stats)
+                stats->record_frame(info.frame_number, info.host_time);
+
+            if(!first && info.frame_number == last_frame) {
+                // The scheduler knows when to ask again.
+                if(!polling)
+                    std::this_thread::yield();
+                continue;
+            }
+            first = false;
+            last_frame = info.frame_number;
+
+            ring->push(info, &scratch[0]);
+            for(size_t i=0; i<stages.size(); ++i)
+                stages[i]->process(info, &scratch[0]);
+            if(stats && !stages.empty())
+                stats->record_processing(host_time_ns()-info.host_time);
+            // Not before: the stages may call other devices.
+            if(polling)
+                scheduler.request_next(device);
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(worker->has_waiters.load(std::memory_order_relaxed))
+                notify_waiters((int)info.frame_number);
+        }
+
+        // Don't leave a request for whoever calls the device next.
+        scheduler.finish(device, &scratch[0]);
+    }
+
+} // end of namespace
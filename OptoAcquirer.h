@@ -0,0 +1,126 @@
+#ifndef _OPTOACQUIRER_H_
+#define _OPTOACQUIRER_H_
+
+/**
+ *@file OptoAcquirer.h
+ *@brief A thread that owns the device calls and fills a FrameRing.
+ *
+ * Safe to include from /clr code: the thread and the ring are kept out of
+ * the header.
+ */
+#include <vector>
+#include "OptoFrame.h"
+#include "RequestScheduler.h"
+
+namespace VML {
+
+    class OptoDevice;
+    class FrameRing;
+    class FrameStage;
+    class FrameStats;
+
+    /**
+     * Once started, a dedicated thread loops on get_latest_3d() and pushes
+     * every new frame, timestamped on arrival, into the ring.  Nothing
+     * else may call the device while the thread runs.
+     *
+     * The loop relies on the device blocking until the next frame
+     * (OPTOTRAK_GET_NEXT_FRAME_FLAG, see OptoCollector::enforce_blocking());
+     * without it the thread keeps seeing the same frame and just yields,
+     * unless set_polling() is called.
+     *
+     * Any number of threads can wait for the thread's next frame with a
+     * FrameWaiter, so there's one poller however many are waiting.
+     */
+    class OptoAcquirer {
+        public:
+            /**
+             * @param device Not owned.
+             * @param num_markers Markers per frame, as given to the device's setup.
+             * @param capacity Frames kept in the ring.
+             * @param stages Run on the thread for every frame, after it's
+             * been pushed to the ring.
+             * @param stats If given, every device call is recorded there.
+             * Not owned.
+             */
+            OptoAcquirer(OptoDevice *device, int num_markers, int capacity,
+                    const std::vector<FrameStage *> &stages=std::vector<FrameStage *>(),
+                    FrameStats *stats=0);
+            ~OptoAcquirer();
+
+            /**
+             * Before start(), for a device that doesn't block: poll with
+             * a RequestScheduler, sleeping until each driver call is due,
+             * rather than spin on get_latest_3d().
+             * @param next_frame The collection has OPTOTRAK_GET_NEXT_FRAME_FLAG.
+             */
+            void set_polling(double frame_period, bool next_frame);
+
+            void start();
+
+            /**
+             * Join the thread, then notify every waiter left with -1.
+             * Not from a waiter's notify().
+             */
+            void stop();
+            bool is_running() const;
+
+            /**
+             * Have w notified when a frame newer than the ones acquired so
+             * far has been pushed and been through the stages.
+             * @return false if the thread isn't running; w isn't added.
+             */
+            bool add_waiter(FrameWaiter *w);
+
+            /**
+             * @return false if w had already been notified.
+             */
+            bool remove_waiter(FrameWaiter *w);
+
+            /**
+             * Frames pushed to the ring so far.
+             */
+            unsigned long long get_num_acquired() const;
+
+            /**
+             * Wait-free read of the newest frame.  See FrameRing::latest().
+             */
+            bool latest_frame(FrameInfo &info, Position3d *markers) const;
+
+            /**
+             * See FrameRing::frames_since().
+             */
+            int frames_since(unsigned int n, FrameInfo *infos, Position3d *markers, int max_frames) const;
+
+            const FrameRing &get_ring() const { return *ring; }
+
+            /**
+             * Number of device calls that returned an error.
+             */
+            unsigned long long get_num_failures() const;
+
+        private:
+            void run();
+            // Poll for the next frame with the scheduler.
+            int poll_frame(FrameInfo &info);
+            // Notify the waiters the frame just pushed is for, or all with -1.
+            void notify_waiters(int frame_number);
+
+            struct Worker;
+
+            OptoDevice *device;
+            FrameRing *ring;
+            Worker *worker;
+            std::vector<Position3d> scratch;
+            std::vector<FrameStage *> stages;
+            FrameStats *stats;
+            bool polling; //< The device doesn't block.
+            RequestScheduler scheduler;
+
+            OptoAcquirer(const OptoAcquirer &);
+            OptoAcquirer &operator=(const OptoAcquirer &);
+    };
+
+} // end of namespace
+
+#endif/*_OPTOACQUIRER_H_*/
@@ -3,184 +3,688 @@
  *@brief 
  */
 #include <assert.h>
-#include "Optotrak.h"
+#include <sstream>
+#include <stdexcept>
+#include <msclr/marshal_cppstd.h>
+#include <vcclr.h>
+#include "OptoDevice.h"
 #include "OptoCollector.h"
 
 using namespace System;
+using namespace System::Collections::Generic;
+using namespace System::Threading;
 
 namespace VML {
 
-    OptoCollector::OptoCollector()
-        :num_elements(0),
-        total_num_markers(0),
-        marker_data(0)
+    OptoFrame::OptoFrame(int num_markers)
+    {
+        xyz = gcnew array<double>(3*num_markers);
+        valid = gcnew array<bool>(num_markers);
+        markers = new Position3d[num_markers];
+    }
+
+    OptoFrame::~OptoFrame()
+    {
+        this->!OptoFrame();
+    }
+
+    OptoFrame::!OptoFrame()
+    {
+        delete [] markers;
+        markers = 0;
+    }
+
+    void OptoFrame::assign(const FrameInfo &info, const Position3d *m, const uint64_t *mask)
+    {
+        frame_number = info.frame_number;
+        flags = info.flags;
+        host_time = info.host_time;
+
+        int n = valid->Length;
+        pin_ptr<double> p = &xyz[0];
+        pin_ptr<bool> v = &valid[0];
+        for(int i=0; i<n; ++i) {
+            p[3*i] = m[i].x;
+            p[3*i+1] = m[i].y;
+            p[3*i+2] = m[i].z;
+            v[i] = mask ? test_bit(mask, i) : is_valid(m[i]);
+        }
+    }
+
+    OptoSubscriber::OptoSubscriber(String ^name)
+        :sub(new FrameSubscriber)
     {
-        frame_frequency = 120.f;
-        marker_frequency = 2500.f;
-        threshold = 30; 
-        gain = 160;
-        stream_mode = 0;
-        cycle = 0.4f;
-        voltage = 7.0f;
-        collect_time = 1.f;
-        trigger_time = 0.f;
+        try {
+            sub->open(msclr::interop::marshal_as<std::string>(name));
+        }catch(const std::exception &e) {
+            delete sub;
+            sub = 0;
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
 
-        nonblocking = false;
-        collect_flags = OPTOTRAK_NO_FIRE_MARKERS_FLAG | OPTOTRAK_BUFFER_RAW_FLAG ;
+    OptoSubscriber::~OptoSubscriber()
+    {
+        this->!OptoSubscriber();
+    }
+
+    OptoSubscriber::!OptoSubscriber()
+    {
+        delete sub;
+        sub = 0;
+    }
+
+    bool OptoSubscriber::latest_frame(OptoFrame ^f)
+    {
+        FrameInfo info;
+        if(!sub->latest(info, f->markers))
+            return false;
+        f->assign(info, f->markers);
+        return true;
+    }
+
+    bool OptoSubscriber::next_frame(OptoFrame ^f, int timeout_ms)
+    {
+        FrameInfo info;
+        if(!sub->next(info, f->markers, timeout_ms < 0 ? -1. : timeout_ms*1e-3))
+            return false;
+        f->assign(info, f->markers);
+        return true;
+    }
+
+    struct ManagedFrameWaiter : FrameWaiter {
+        gcroot<OptoCollector ^> owner;
+
+        static void arrived(FrameWaiter *w, int frame_number)
+        {
+            static_cast<ManagedFrameWaiter *>(w)->owner->frame_arrived(frame_number, w->after);
+        }
+    };
+
+    OptoCollector::OptoCollector()
+        :core(new CollectorCore(&OapiDevice::instance())),
+        recorder(0),
+        exporter(0),
+        publisher(0),
+        filter(0),
+        resampler(0),
+        derived(0),
+        waiter(new ManagedFrameWaiter),
+        armed(false),
+        waiting(gcnew List<Tasks::TaskCompletionSource<int> ^>),
+        waiting_after(gcnew List<unsigned long long>)
+    {
+        waiter->owner = this;
+        waiter->notify = &ManagedFrameWaiter::arrived;
     }
 
     OptoCollector::~OptoCollector()
     {
-        // The first 2 if's are necessary because of the collector
-        // can be either pure marker or pure rigid body.
-        if(marker_data)
-            free(marker_data);
+        core->remove_frame_waiter(waiter);
+        delete core;
+        delete waiter;
+        delete recorder;
+        delete exporter;
+        delete publisher;
+        delete filter;
+        delete resampler;
+        delete derived;
     }
 
-    void OptoCollector::add_markers(int n, int port)
+    int OptoCollector::add_markers(int n, int port, int sockets)
     {
-        assert(port < NUM_PORTS);
-        num_elements += n;
-        total_num_markers += n;
+        try {
+            return core->add_markers(n, port, sockets);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
+
+    int OptoCollector::add_rigid_body(array<double> ^model, int first_marker)
+    {
+        if(model->Length == 0)
+            throw gcnew System::Exception("Empty rigid body.");
+        pin_ptr<double> m = &model[0];
+        try {
+            return core->add_rigid_body(m, model->Length/3, first_marker);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
     }
 
+    int OptoCollector::get_rigid_body(int n, array<double> ^t, array<double> ^q)
+    {
+        assert(n < core->get_num_rigid_bodies());
+        const BodyPose &p = core->get_rigid_body(n);
+        if(!p.valid)
+            return -1;
+        for(int i=0; i<3; ++i)
+            t[i] = p.translation[i];
+        for(int i=0; i<4; ++i)
+            q[i] = p.quaternion[i];
+        return core->get_frame_number();
+    }
 
     void OptoCollector::setup_collection()
     {
-        if(marker_data) {
-            throw gcnew System::Exception("Setup_collection can be called only once.");
-        }
-
-        /////////////////////////////////////////////////
-        //
-        // allocate space
-        // 
-        /////////////////////////////////////////////////
-
-        // allocate space for markers
-        marker_data = (Position3d*)malloc(sizeof(Position3d)*total_num_markers);
-        if(marker_data == 0)
-            throw gcnew System::Exception("Can't alloc marker data");
-
-        /////////////////////////////////////////////////
-        //
-        // Set up collection
-        // 
-        /////////////////////////////////////////////////
-	if(OptotrakSetupCollection(
-	    total_num_markers,    // Number of markers in the collection. 
-	    frame_frequency,// Frequency to collect rigid_data frames at. 
-	    marker_frequency, // Marker frequency for marker maximum on-time. 
-	    threshold,        // Dynamic or Static Threshold value to use. 
-	    gain,             // Minimum gain code amplification to use. 
-	    stream_mode,      // Stream mode for the rigid_data buffers. 
-	    cycle,            // Marker Duty Cycle to use. 
-	    voltage,          // Voltage to use when turning on markers. 
-	    collect_time,     // Number of seconds of rigid_data to collect. 
-	    trigger_time,     // Seconds to pre-trigger rigid_data by. 
-            collect_flags) ) {
-
-	    throw gcnew System::Exception("OptotrakSetupCollection returns error.");
-	}
-
-	Optotrak::sleep(1);
+        try {
+            core->setup_collection();
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
     }
 
     void OptoCollector::activate()
     {
-	if( OptotrakActivateMarkers() ) {
-	    throw gcnew System::Exception("Can't activate markers.");
-	} 
-
-	Optotrak::sleep(1);
+        try {
+            core->activate();
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
     }
 
     void OptoCollector::deactivate()
     {
-	OptotrakDeActivateMarkers();
+        core->deactivate();
     }
 
+    void OptoCollector::run_startup(Object ^initialize_system)
+    {
+        try {
+            core->startup(safe_cast<bool>(initialize_system));
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
 
-    int OptoCollector::update_frame()
+    Threading::Tasks::Task ^OptoCollector::start_async(bool initialize_system)
     {
-        int fnumber;
-	if(nonblocking) {
-	    fnumber = update_frame_nonblocking();
-	}else  {
-	    fnumber = update_frame_blocking();
-	}
+        return Threading::Tasks::Task::Factory->StartNew(
+                gcnew Action<Object ^>(this, &OptoCollector::run_startup), initialize_system);
+    }
 
-        return fnumber;
+    int OptoCollector::add_profile(int num_markers)
+    {
+        CollectionParams p = core->params;
+        p.num_markers = num_markers;
+        try {
+            return core->add_profile(p);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
     }
 
-    int OptoCollector::update_frame_blocking()
+    void OptoCollector::reconfigure(int profile)
     {
-        //assert(num_elements > 0);
-        // do the markers
-        unsigned int fn, ne, f;
-        if(DataGetLatest3D(&fn, &ne, &f, marker_data)) {
-            return -1;
+        try {
+            core->reconfigure(profile);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
         }
-        frame_number = fn;
-        nelements = ne;
-        flags = f;
+    }
 
-        if(nelements != total_num_markers) {
-            Console::WriteLine("Shouldn't happen: missing marker elements.");
-            return -1;
+    void OptoCollector::reconfigure()
+    {
+        CollectionParams p = core->params;
+        p.num_markers = 0;
+        try {
+            core->reconfigure(p);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
         }
+    }
 
+    double OptoCollector::get_time_to_first_frame()
+    {
+        long long t = core->get_startup_times().first_frame;
+        return t ? t*1e-6 : -1.;
+    }
+
+    void OptoCollector::start_acquisition(int capacity)
+    {
+        try {
+            core->start_acquisition(capacity);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
 
-	return frame_number;
+    int OptoCollector::collect_buffered(array<float> ^xyz)
+    {
+        int nm = core->get_total_num_markers();
+        if(nm == 0 || xyz->Length < 3*nm)
+            return 0;
+
+        // Position3d is three floats, so the device can write into xyz.
+        pin_ptr<float> p = &xyz[0];
+        try {
+            return core->collect_buffered((Position3d *)p, xyz->Length/(3*nm));
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
     }
 
-    int OptoCollector::update_frame_nonblocking()
+    void OptoCollector::start_recording(String ^path)
     {
-        assert(num_elements > 0);
-        if(RequestLatest3D()) {
-            return -1;
+        start_recording(path, 0.);
+    }
+
+    void OptoCollector::start_recording(String ^path, double resolution)
+    {
+        try {
+            stop_recording();
+            recorder = new FrameRecorder(msclr::interop::marshal_as<std::string>(path), 4096, resolution);
+            core->add_stage(recorder);
+        }catch(const std::exception &e) {
+            delete recorder;
+            recorder = 0;
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
+
+    void OptoCollector::stop_recording()
+    {
+        if(!recorder)
+            return;
+        try {
+            core->remove_stage(recorder);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+        delete recorder;
+        recorder = 0;
+    }
+
+    void OptoCollector::start_export(String ^path)
+    {
+        try {
+            stop_export();
+            std::string p = msclr::interop::marshal_as<std::string>(path);
+            exporter = new FrameExporter(p, FrameExporter::format_of(p));
+            core->add_stage(exporter);
+        }catch(const std::exception &e) {
+            delete exporter;
+            exporter = 0;
+            throw gcnew System::Exception(gcnew String(e.what()));
         }
+    }
+
+    void OptoCollector::stop_export()
+    {
+        if(!exporter)
+            return;
+        try {
+            core->remove_stage(exporter);
+        }catch(const std::exception &x) {
+            throw gcnew System::Exception(gcnew String(x.what()));
+        }
+        FrameExporter *e = exporter;
+        exporter = 0;
+        try {
+            e->close();
+        }catch(const std::exception &x) {
+            delete e;
+            throw gcnew System::Exception(gcnew String(x.what()));
+        }
+        delete e;
+    }
+
+    void OptoCollector::start_publishing(String ^name)
+    {
+        try {
+            stop_publishing();
+            publisher = new FramePublisher(msclr::interop::marshal_as<std::string>(name));
+            core->add_stage(publisher);
+        }catch(const std::exception &e) {
+            delete publisher;
+            publisher = 0;
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
 
-        if(!DataIsReady()){
+    void OptoCollector::stop_publishing()
+    {
+        if(!publisher)
+            return;
+        try {
+            core->remove_stage(publisher);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+        delete publisher;
+        publisher = 0;
+    }
+
+    String ^OptoCollector::dump_stats()
+    {
+        std::ostringstream os;
+        const StartupTimes &t = core->get_startup_times();
+        os << "startup: initialize " << t.initialize*1e-6 << " setup " << t.setup*1e-6
+            << " activate " << t.activate*1e-6 << " first frame " << t.first_frame*1e-6 << " ms\n";
+        core->get_stats().dump(os);
+        return gcnew String(os.str().c_str());
+    }
+
+    long long OptoCollector::get_num_dropped_frames()
+    {
+        FrameStatsSnapshot s;
+        core->get_stats().snapshot(s);
+        return s.num_dropped;
+    }
+
+    double OptoCollector::get_call_latency(double q)
+    {
+        FrameStatsSnapshot s;
+        core->get_stats().snapshot(s);
+        return s.call.quantile(q)*1e-3;
+    }
+
+    void OptoCollector::set_filter(const MarkerFilter::Params &p)
+    {
+        try {
+            remove_filter();
+            filter = new MarkerFilter(p);
+            core->add_stage(filter);
+        }catch(const std::exception &e) {
+            delete filter;
+            filter = 0;
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+    }
+
+    void OptoCollector::set_one_euro_filter(double min_cutoff, double beta)
+    {
+        MarkerFilter::Params p;
+        p.type = MarkerFilter::ONE_EURO;
+        p.min_cutoff = min_cutoff;
+        p.beta = beta;
+        set_filter(p);
+    }
+
+    void OptoCollector::set_kalman_filter(double process_noise, double measurement_noise)
+    {
+        MarkerFilter::Params p;
+        p.type = MarkerFilter::KALMAN;
+        p.process_noise = process_noise;
+        p.measurement_noise = measurement_noise;
+        set_filter(p);
+    }
+
+    void OptoCollector::set_butterworth_filter(double cutoff)
+    {
+        MarkerFilter::Params p;
+        p.type = MarkerFilter::BUTTERWORTH;
+        p.cutoff = cutoff;
+        set_filter(p);
+    }
+
+    void OptoCollector::remove_filter()
+    {
+        if(!filter)
+            return;
+        try {
+            core->remove_stage(filter);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+        delete filter;
+        filter = 0;
+    }
+
+    bool OptoCollector::latest_filtered_frame(OptoFrame ^f)
+    {
+        FrameInfo info;
+        if(!filter || !filter->latest_frame(info, f->markers))
+            return false;
+        f->assign(info, f->markers);
+        return true;
+    }
+
+    int OptoCollector::get_filtered_position(array<double> ^p, int n)
+    {
+        int m = core->get_total_num_markers();
+        if(filtered == nullptr || filtered->valid->Length != m)
+            filtered = gcnew OptoFrame(m);
+        if(!latest_filtered_frame(filtered))
             return -1;
+        p[0] = filtered->xyz[3*n];
+        p[1] = filtered->xyz[3*n+1];
+        p[2] = filtered->xyz[3*n+2];
+        return filtered->frame_number;
+    }
+
+    void OptoCollector::set_resampling(bool cubic, double max_extrapolation, double latency)
+    {
+        FrameResampler::Params p;
+        p.method = cubic ? FrameResampler::CUBIC : FrameResampler::LINEAR;
+        p.max_extrapolation = max_extrapolation;
+        p.latency = latency;
+        try {
+            remove_resampling();
+            resampler = new FrameResampler(p);
+            resampler->set_rigid_bodies(core->get_rigid_bodies());
+            core->add_stage(resampler);
+        }catch(const std::exception &e) {
+            delete resampler;
+            resampler = 0;
+            throw gcnew System::Exception(gcnew String(e.what()));
         }
+    }
+
+    void OptoCollector::remove_resampling()
+    {
+        if(!resampler)
+            return;
+        try {
+            core->remove_stage(resampler);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+        delete resampler;
+        resampler = 0;
+    }
 
-        unsigned int fn, ne, f;
-        if(DataReceiveLatest3D(&fn, &ne, &f, marker_data)) {
+    int OptoCollector::sample_frame(OptoFrame ^f, long long t)
+    {
+        if(!resampler)
+            return -1;
+        int r = resampler->sample(t, f->markers);
+        if(r < 0)
+            return -1;
+        FrameInfo info;
+        info.frame_number = 0;
+        info.num_markers = f->valid->Length;
+        info.flags = 0;
+        info.host_time = t;
+        f->assign(info, f->markers);
+        return r;
+    }
+
+    int OptoCollector::sample_rigid_body(int n, long long t, array<double> ^tr, array<double> ^q)
+    {
+        if(!resampler || n >= resampler->get_num_bodies())
             return -1;
+        BodyPose p;
+        int r = resampler->sample_pose(t, n, p);
+        if(r < 0 || !p.valid)
+            return -1;
+        for(int i=0; i<3; ++i)
+            tr[i] = p.translation[i];
+        for(int i=0; i<4; ++i)
+            q[i] = p.quaternion[i];
+        return r;
+    }
+
+    int OptoCollector::add_derived(String ^definition)
+    {
+        const bool fresh = !derived;
+        try {
+            if(core->is_acquiring())
+                throw std::logic_error("Can't add a derived quantity while acquiring.");
+            if(fresh)
+                derived = new DerivedGraph;
+            // Compiled again at once if the collector's set up.
+            int n = derived->extend(msclr::interop::marshal_as<std::string>(definition), core->get_rigid_bodies());
+            if(fresh)
+                core->add_stage(derived);
+            return n;
+        }catch(const std::exception &e) {
+            if(fresh) {
+                delete derived;
+                derived = 0;
+            }
+            throw gcnew System::Exception(gcnew String(e.what()));
         }
-        frame_number = fn;
-        nelements = ne;
-        flags = f;
+    }
 
-        if(nelements != total_num_markers) {
-            Console::WriteLine("Shouldn't happen: missing marker elements.");
+    void OptoCollector::remove_derived()
+    {
+        if(!derived)
+            return;
+        try {
+            core->remove_stage(derived);
+        }catch(const std::exception &e) {
+            throw gcnew System::Exception(gcnew String(e.what()));
+        }
+        delete derived;
+        derived = 0;
+    }
+
+    int OptoCollector::find_derived(String ^name)
+    {
+        return derived ? derived->find(msclr::interop::marshal_as<std::string>(name)) : -1;
+    }
+
+    int OptoCollector::get_derived(int n, array<double> ^values)
+    {
+        if(!derived || n < 0 || n >= derived->get_num_nodes())
             return -1;
+        double v[12];
+        long long fn = derived->get(n, v);
+        if(fn < 0)
+            return -1;
+        int size = derived->get_size(n);
+        if(values->Length < size)
+            throw gcnew System::Exception("Array too small for the derived quantity.");
+        for(int i=0; i<size; ++i)
+            values[i] = v[i];
+        return (int)fn;
+    }
+
+    bool OptoCollector::latest_frame(OptoFrame ^f)
+    {
+        FrameInfo info;
+        if(!core->latest_frame(info, f->markers))
+            return false;
+        f->assign(info, f->markers);
+        return true;
+    }
+
+    Tasks::Task<int> ^OptoCollector::next_frame_async()
+    {
+        Tasks::TaskCompletionSource<int> ^t =
+            gcnew Tasks::TaskCompletionSource<int>(Tasks::TaskCreationOptions::RunContinuationsAsynchronously);
+        unsigned long long after = core->get_num_acquired();
+        bool stopped = false;
+        Monitor::Enter(waiting);
+        try {
+            waiting->Add(t);
+            waiting_after->Add(after);
+            if(!armed)
+                stopped = !(armed = core->add_frame_waiter(waiter));
+        }finally {
+            Monitor::Exit(waiting);
         }
+        if(stopped)
+            frame_arrived(-1, 0);
+        return t->Task;
+    }
 
-	return frame_number;
+    void OptoCollector::frame_arrived(int frame_number, unsigned long long count)
+    {
+        List<Tasks::TaskCompletionSource<int> ^> ^done = gcnew List<Tasks::TaskCompletionSource<int> ^>;
+        bool stopped = false;
+        Monitor::Enter(waiting);
+        try {
+            // Those asked for after this frame came in wait for the next.
+            armed = false;
+            for(int i=0; i<waiting->Count; ) {
+                if(frame_number < 0 || waiting_after[i] < count) {
+                    done->Add(waiting[i]);
+                    waiting->RemoveAt(i);
+                    waiting_after->RemoveAt(i);
+                }else {
+                    ++i;
+                }
+            }
+            if(waiting->Count)
+                stopped = !(armed = core->add_frame_waiter(waiter));
+        }finally {
+            Monitor::Exit(waiting);
+        }
+        for each(Tasks::TaskCompletionSource<int> ^t in done)
+            t->TrySetResult(frame_number);
+        // Acquisition stopped while we were at it.
+        if(stopped)
+            frame_arrived(-1, 0);
+    }
+
+    int OptoCollector::frames_since(int n, array<OptoFrame ^> ^frames)
+    {
+        if(frames->Length == 0)
+            return 0;
+
+        int m = core->get_total_num_markers();
+        std::vector<FrameInfo> infos(frames->Length);
+        std::vector<Position3d> markers(frames->Length*m);
+        int count = core->frames_since(n, &infos[0], &markers[0], frames->Length);
+        for(int i=0; i<count; ++i)
+            frames[i]->assign(infos[i], &markers[i*m]);
+        return count;
+    }
+
+    int OptoCollector::get_frame(OptoFrame ^f)
+    {
+        FrameView v = core->get_frame_view();
+        assert(f->valid->Length == v.num_markers);
+        FrameInfo info;
+        info.frame_number = v.frame_number;
+        info.num_markers = v.num_markers;
+        info.flags = v.flags;
+        info.host_time = 0;
+        f->assign(info, v.markers, v.valid_mask);
+        return v.frame_number;
     }
 
     int OptoCollector::get_position(array<double> ^p, int n) 
     {
-        assert( n < num_elements);
-        p[0] = marker_data[n].x;
-        p[1] = marker_data[n].y;
-        p[2] = marker_data[n].z;
-        return frame_number;
+        assert( n < core->get_num_elements());
+        const Position3d &m = core->get_position(n);
+        p[0] = m.x;
+        p[1] = m.y;
+        p[2] = m.z;
+        return core->get_frame_number();
+    }
+
+    int OptoCollector::get_valid_markers(array<int> ^indices)
+    {
+        // No for_each_valid(): a native lambda can't capture indices.
+        const uint64_t *mask = core->get_valid_mask();
+        int n = 0, size = indices->Length;
+        for(int k=0; mask && k<mask_words(core->get_total_num_markers()); ++k) {
+            for(uint64_t w=mask[k]; w; w&=w-1, ++n) {
+                if(n < size)
+                    indices[n] = 64*k+lowest_bit(w);
+            }
+        }
+        return n;
     }
 
     array<double> ^OptoCollector::get_position(int n)
     {
-        assert( n < num_elements);
         array<double> ^p=gcnew array<double>(3);
-        p[0] = marker_data[n].x;
-        p[1] = marker_data[n].y;
-        p[2] = marker_data[n].z;
+        get_position(p, n);
         return p;
     }
 
 } // end of namespace
-
-
-
@@ -9,6 +9,14 @@
 #include "ndtypes.h"
 #include "ndpack.h"
 #include "ndopto.h"
+#include "CollectorCore.h"
+#include "DerivedGraph.h"
+#include "FrameExporter.h"
+#include "FramePublisher.h"
+#include "FrameRecorder.h"
+#include "FrameResampler.h"
+#include "FrameSubscriber.h"
+#include "MarkerFilter.h"
 
 namespace VML {
     enum RotationFormat {
@@ -18,6 +26,80 @@ namespace VML {
         MATRIX
     };
 
+    /**
+     * A caller-owned copy of one frame, filled by OptoCollector::get_frame(),
+     * OptoCollector::latest_frame() and OptoCollector::frames_since().
+     * Reuse it; nothing is allocated after construction.
+     */
+    public ref class OptoFrame {
+        public:
+            OptoFrame(int num_markers);
+            ~OptoFrame();
+            !OptoFrame();
+
+            property int frame_number;
+            property int flags;
+            property long long host_time; //< Arrival time, ns on the host's steady clock.
+
+            /**
+             * x,y,z of marker 0, then of marker 1, etc.
+             */
+            initonly array<double> ^xyz;
+
+            /**
+             * Whether marker i was seen.  If not, its xyz hold the
+             * Optotrak's missing-marker sentinel, or where it was last
+             * seen with OptoCollector::set_hold_over().
+             */
+            initonly array<bool> ^valid;
+
+        internal:
+            // Fill from a native frame, and its valid mask if there's one.
+            void assign(const FrameInfo &info, const Position3d *m, const uint64_t *mask);
+            void assign(const FrameInfo &info, const Position3d *m) { assign(info, m, 0); }
+
+            Position3d *markers; //< Native scratch the ring copies into.
+    };
+
+    /**
+     * Reads, in another process, the frames an OptoCollector publishes
+     * with start_publishing().  Doesn't need the Optotrak.
+     */
+    public ref class OptoSubscriber {
+        public:
+            /**
+             * Open the frames published under name.  Throws if there
+             * aren't any.
+             */
+            OptoSubscriber(System::String ^name);
+            ~OptoSubscriber();
+            !OptoSubscriber();
+
+            int get_num_markers() { return sub->get_num_markers(); }
+
+            /**
+             * Copy the newest frame into f (made for get_num_markers()).
+             * @return false if there's none yet or the publisher's gone.
+             */
+            bool latest_frame(OptoFrame ^f);
+
+            /**
+             * Wait up to timeout_ms (forever if negative) for a frame newer
+             * than the last one read, and copy it into f.
+             * @return false on timeout or if the publisher's gone.
+             */
+            bool next_frame(OptoFrame ^f, int timeout_ms);
+
+            /**
+             * The publisher has stopped or changed the frame size; make a
+             * new subscriber.
+             */
+            bool is_closed() { return sub->is_closed(); }
+
+        private:
+            FrameSubscriber *sub;
+    };
+
 
     /**
      * Optotrak collector container.  Possible combinations include
@@ -79,8 +161,20 @@ namespace VML {
      * markers (cuby1), then we need to set the 1st marker of laser1 to 7 and
      * use 12 markers to call SetupCollection.  The same reason in case 2.
      *
+     * All of the above is worked out by the collector if every strober is
+     * added with add_markers(n, port), in chain order: it sets the strober
+     * table, collects just enough, and hands out frames with only the
+     * real markers, in the order added.  Case 2 becomes
+     *   add_markers(1, 1); first = add_markers(6, 1);
+     *   add_rigid_body(laser1, first);
+     * and the frame has 7 markers, not 12.
+     *
+     * The work is done by a CollectorCore on the OAPI device; this class
+     * only converts types and exceptions for managed callers.
      */
 
+    struct ManagedFrameWaiter;
+
     public ref class OptoCollector {
 
         public:
@@ -95,13 +189,46 @@ namespace VML {
 	    virtual ~OptoCollector();
 
             /**
-             * Add n markers on port number p;
+             * Add n markers on port number p (1 to 4), as a strober with
+             * sockets sockets (6 if left out), or with p 0 the old way
+             * (see the cases above).
+             * @return Where the first of them is in the frame, from 1;
+             * give it to add_rigid_body() if they're a body's.
+             */
+            int add_markers(int n, int p, int sockets);
+            int add_markers(int n, int p) {
+                return add_markers(n, p, 0);
+            }
+            int add_markers(int n) {
+                return add_markers(n, 0, 0);
+            }
+
+            /**
+             * Add a rigid body.  model holds the x,y,z of each of its
+             * markers in the body's own frame; the body's markers start
+             * at first_marker (from 1; see the cases above), or follow the
+             * markers added so far if it's left out.  Its pose is solved
+             * on the host every frame.
+             * @return The body's index, for get_rigid_body().
              */
-            void add_markers(int n, int p);
-            void add_markers(int n) {
-                add_markers(n, 0);
+            int add_rigid_body(array<double> ^model, int first_marker);
+            int add_rigid_body(array<double> ^model) {
+                return add_rigid_body(model, 0);
             }
 
+            int get_num_rigid_bodies() {
+                return core->get_num_rigid_bodies();
+            }
+
+            /**
+             * @brief Pose of rigid body n in the current frame.
+             * @param translation x,y,z.
+             * @param quaternion q0 (scalar),q1,q2,q3.
+             * @return frame number, or -1 if too few of the body's markers
+             * were seen to solve it.
+             */
+            int get_rigid_body(int n, array<double> ^translation, array<double> ^quaternion);
+
 
             /**
              * Prepare for the collection.
@@ -118,13 +245,79 @@ namespace VML {
 	    void activate();
 	    void deactivate();
 
+            /**
+             * @brief Optotrak::initialize() (if initialize_system),
+             * setup_collection() and activate() on a worker thread.
+             *
+             * Each step returns as soon as the system is ready rather than
+             * after fixed waits.  Meanwhile the caller can load whatever
+             * else it needs; Wait() on the task rethrows any error.  Leave
+             * the collector alone until the task is done.
+             */
+            System::Threading::Tasks::Task ^start_async(bool initialize_system);
+
+            /**
+             * @brief Keep the current parameters (the properties below)
+             * as a profile to switch to later with reconfigure().
+             *
+             * They're checked now, so a bad one throws here rather than
+             * mid-session.  E.g. one profile for a 100 Hz calibration and
+             * one for the 500 Hz trials.
+             * @param num_markers Frame size for the profile, or 0 for the
+             * current one.  Markers added or dropped are at the end.
+             * @return The profile's index.
+             */
+            int add_profile(int num_markers);
+
+            /**
+             * @brief Switch the session to a profile without starting
+             * over: deactivate, set up again, reactivate and resume the
+             * acquisition thread if it was running.  Frame numbers start
+             * over.  Much faster than a new collector.  A recording or
+             * export carries on in a new file: trial.rec, then
+             * trial.1.rec, etc.
+             */
+            void reconfigure(int profile);
+
+            /**
+             * Same, with the properties as they are now.
+             */
+            void reconfigure();
+
+            /**
+             * Milliseconds from the start of the startup (initialization,
+             * or setup_collection() if the system was initialized
+             * elsewhere) to the first frame received.  -1 before that.
+             */
+            double get_time_to_first_frame();
+
 	    /**
 	     * Get the number of elements (markers or ridig bodies) in this collector.
 	     */
 	    int get_num_elements()  {
-		return num_elements;
+		return core->get_num_elements();
 	    }
 
+            /**
+             * @brief Copy the whole current frame into f in one call.
+             * @return frame number.
+             */
+            int get_frame(OptoFrame ^f);
+
+            /**
+             * @brief The current frame without copying (C++ callers only).
+             */
+            FrameView get_frame_view() {
+                return core->get_frame_view();
+            }
+
+            /**
+             * @brief The native collector (C++ callers only).
+             */
+            CollectorCore *get_core() {
+                return core;
+            }
+
 	    /**
 	     * @brief Retrieve the 3-D position of the n-th element.
 	     * @param n Which element(marker or rigid body) to read from. Default is the 1st one.
@@ -138,50 +331,340 @@ namespace VML {
 
             array<double> ^get_position(int n);
 
+            /**
+             * @brief Whether marker n was seen in the current frame.
+             */
+            bool is_valid(int n) { return core->is_valid_marker(n); }
+
+            /**
+             * @brief Number of markers seen in the current frame.
+             */
+            int get_num_valid() { return core->get_num_valid(); }
+
+            /**
+             * @brief Indices of the markers seen in the current frame, in
+             * order, as many as fit.
+             * @return how many were seen.
+             */
+            int get_valid_markers(array<int> ^indices);
+
+            /**
+             * @brief Report a missing marker where it was last seen, for
+             * up to max_frames frames (forever if negative, never if 0).
+             * is_valid() still tells it's missing; the rigid bodies and
+             * the recorders don't see the held positions.
+             */
+            void set_hold_over(int max_frames) { core->set_hold_over(max_frames); }
+
+            /**
+             * @brief Frames since marker n was last seen, with hold-over on.
+             */
+            int get_marker_age(int n) { return core->get_marker_age(n); }
+
             /**
              * @brief Ask the optotrak system for a new frame of data.
              * @return frame number. -1 if anything's wrong or data unavailable (non-blocking update).
              */
-	    int update_frame();
-	    int update_frame_blocking();
-	    int update_frame_nonblocking();
+	    int update_frame() { return core->update_frame(); }
+	    int update_frame_blocking() { return core->update_frame_blocking(); }
+	    int update_frame_nonblocking() { return core->update_frame_nonblocking(); }
 
 
-	    void set_nonblocking() { nonblocking = true; }
-	    void set_blocking() { nonblocking = false; }
-	    bool is_nonblocking()  { return nonblocking; }
+	    void set_nonblocking() { core->set_nonblocking(); }
+	    void set_blocking() { core->set_blocking(); }
+	    bool is_nonblocking()  { return core->is_nonblocking(); }
 
             /**
              * Without this flag, optotrak doesn't really do a 
              * blocking retrieval with GetLatestData().
              */
             void enforce_blocking() {
-                collect_flags |=OPTOTRAK_GET_NEXT_FRAME_FLAG;
+                core->enforce_blocking();
             }
 
+            /**
+             * Hand the device over to a background thread which keeps the
+             * last capacity frames in a ring.  Call after
+             * setup_collection(), preferably with enforce_blocking() so
+             * the thread sleeps in the driver until each frame arrives.
+             *
+             * While acquiring, update_frame() no longer calls the driver;
+             * it copies the newest frame from the ring, so get_position()
+             * keeps working.  latest_frame() and frames_since() can be
+             * called from any number of threads.
+             */
+            void start_acquisition(int capacity);
+            void start_acquisition() {
+                start_acquisition(256);
+            }
+            void stop_acquisition() {
+                core->stop_acquisition();
+            }
+            bool is_acquiring() {
+                return core->is_acquiring();
+            }
+
+            /**
+             * Copy the newest frame without touching the driver.
+             * @return false if no frame has arrived yet.
+             */
+            bool latest_frame(OptoFrame ^f);
+
+            /**
+             * Copy, oldest first, the frames still in the ring with a frame
+             * number larger than n.
+             * @return Number of entries of frames filled.
+             */
+            int frames_since(int n, array<OptoFrame ^> ^frames);
+
+            /**
+             * A task completing with the number of the next frame the
+             * acquisition thread gets, or -1 if acquisition isn't running
+             * or stops first.  Await it instead of polling update_frame()
+             * in nonblocking mode: the acquisition thread serves every
+             * waiting task, and their continuations run on the thread
+             * pool, not on it.  Read the frame with latest_frame().
+             */
+            System::Threading::Tasks::Task<int> ^next_frame_async();
+
+            /**
+             * @brief Buffered collection of a whole trial of collect_time
+             * seconds.
+             *
+             * The system spools the trial and the frames are drained in
+             * large blocks straight into xyz (x,y,z of each marker of
+             * frame 0, then frame 1, etc.), which should have room for
+             * get_num_buffered_frames() frames.  Blocks until the trial
+             * is over.
+             * @return Number of frames collected.
+             */
+            int collect_buffered(array<float> ^xyz);
+            int get_num_buffered_frames() {
+                return core->get_num_buffered_frames();
+            }
+
+            /**
+             * Log every frame to path (format in Recording.h) until
+             * stop_recording().  Writing happens on its own thread and
+             * never holds up update_frame() or the acquisition thread.
+             * Both calls must be made while not acquiring.
+             */
+            void start_recording(System::String ^path);
+            void stop_recording();
+
+            /**
+             * Record compressed (see FrameCodec.h): positions rounded to
+             * resolution mm, e.g. 0.01, for a fifth of the size or less.
+             * Read back with CompressedReader or "opto_codec decompress".
+             */
+            void start_recording(System::String ^path, double resolution);
+
+            /**
+             * @brief Export every frame to path, C3D if it ends in .c3d,
+             * CSV otherwise, until stop_export().
+             *
+             * Batches of frames are written on their own thread (see
+             * FrameExporter.h), never holding up the acquisition.  Both
+             * calls must be made while not acquiring.
+             */
+            void start_export(System::String ^path);
+            void stop_export();
+
+            /**
+             * Frames per second the exporter writes, and frames it had
+             * to drop because the disk fell behind.
+             */
+            double get_export_rate() {
+                return exporter ? exporter->get_frames_per_second() : 0.;
+            }
+            unsigned long long get_num_export_dropped() {
+                return exporter ? exporter->get_num_dropped() : 0;
+            }
+
+            /**
+             * @brief Put every frame in shared memory under name (e.g.
+             * "/optotrak") for other processes, until stop_publishing().
+             *
+             * Readers use OptoSubscriber (or FrameSubscriber from C++).
+             * Costs the acquisition one copy per frame.  Both calls must
+             * be made while not acquiring.
+             */
+            void start_publishing(System::String ^name);
+            void stop_publishing();
+
+            /**
+             * @brief What the reads have been doing, as text: how many
+             * device calls, new, duplicate and skipped frames and
+             * failures, and percentiles of the time spent in the driver,
+             * between frames and in our own per-frame processing.  The
+             * first line has the startup times.
+             *
+             * Every update_frame() (or acquisition thread read) is
+             * recorded, at well under a microsecond each.  Can be called
+             * while acquiring.
+             */
+            System::String ^dump_stats();
+            void reset_stats() { core->reset_stats(); }
+
+            /**
+             * Frame numbers skipped between reads so far.
+             */
+            long long get_num_dropped_frames();
+
+            /**
+             * The q-th quantile (0 to 1) of the time spent in the device
+             * read, in microseconds.
+             */
+            double get_call_latency(double q);
+
+            /**
+             * Smooth every marker as frames arrive, with one of
+             * MarkerFilter's filters (see MarkerFilter.h for the
+             * parameters).  The raw data are still there; the filtered
+             * ones are read with get_filtered_position() and
+             * latest_filtered_frame().  Replaces the current filter.
+             * Must be called while not acquiring.
+             */
+            void set_one_euro_filter(double min_cutoff, double beta);
+            void set_kalman_filter(double process_noise, double measurement_noise);
+            void set_butterworth_filter(double cutoff);
+            void remove_filter();
+
+            /**
+             * Same as get_position(), from the newest filtered frame.
+             * @return frame number, -1 if there's no filter or no frame yet.
+             */
+            int get_filtered_position(array<double> ^x, int n);
+
+            /**
+             * Same as latest_frame(), from the filter.
+             */
+            bool latest_filtered_frame(OptoFrame ^f);
+
+            /**
+             * Keep the last few frames on a timeline of host times, so the
+             * markers and rigid bodies can be sampled at any time with
+             * sample_frame() and sample_rigid_body(): interpolated between
+             * frames, or extrapolated up to max_extrapolation seconds past
+             * the newest, e.g. to when the display next lights up (see
+             * FrameResampler.h).  Rigid bodies added afterwards aren't
+             * sampled; call it again.  Must be called while not acquiring.
+             * @param cubic Cubic interpolation of positions, else linear.
+             * @param latency Seconds from the cameras taking a frame to
+             * the host getting it, if known.
+             */
+            void set_resampling(bool cubic, double max_extrapolation, double latency);
+            void remove_resampling();
+
+            /**
+             * Every marker at host time t (ns, as get_host_time()).  f's
+             * frame_number is 0 and its host_time t.
+             * @return 0 if interpolated, 1 if extrapolated, -1 if there's
+             * no resampling or no frame yet.
+             */
+            int sample_frame(OptoFrame ^f, long long t);
+
+            /**
+             * Pose of rigid body n at host time t, as get_rigid_body().
+             * @return Same as sample_frame(), -1 also if the body wasn't
+             * solved in the frames needed.
+             */
+            int sample_rigid_body(int n, long long t, array<double> ^translation, array<double> ^quaternion);
+
+            /**
+             * @brief Declare a quantity derived from every frame, e.g.
+             * "knee = landmark thigh 0 -12.5 -410" or "knee_angle =
+             * joint thigh shank" (see DerivedGraph.h for the kinds).
+             *
+             * All of them are compiled by setup_collection() into one
+             * plan, evaluated as frames arrive, only where the inputs
+             * changed.  Inputs can be declared after the quantities using
+             * them, but if the collector is set up already the graph is
+             * compiled at once, so declare them first then.  One that
+             * throws adds nothing.  Add the rigid bodies first.  Must be
+             * called while not acquiring.
+             * @return The quantity's index, for get_derived().
+             */
+            int add_derived(System::String ^definition);
+            void remove_derived();
+
+            /**
+             * Index of the derived quantity called name, -1 if none.
+             */
+            int find_derived(System::String ^name);
+
+            /**
+             * @brief Values of derived quantity n in the newest frame: 3
+             * for a point, velocity or joint, 1 for a distance or angle,
+             * 12 for a body (rotation row by row, then translation).
+             * @return frame number, -1 if it couldn't be evaluated (e.g.
+             * a marker it needs was missing) or there's no frame yet.
+             */
+            int get_derived(int n, array<double> ^values);
+
+            /**
+             * Now on the clock frames are timed with, in ns.
+             */
+            static long long get_host_time() { return host_time_ns(); }
+
 	private:
-	    int num_marker_elements;//< Number of markers or rigid bodies
-            int num_rigid_body_elements;
-	    int num_elements;
-            int total_num_markers;
-            int collect_flags;
+            CollectorCore *core;
+            FrameRecorder *recorder;
+            FrameExporter *exporter;
+            FramePublisher *publisher;
+            MarkerFilter *filter;
+            OptoFrame ^filtered; //< Scratch for get_filtered_position().
+            FrameResampler *resampler;
+            DerivedGraph *derived;
+            ManagedFrameWaiter *waiter; //< Registered with core while tasks wait.
+            bool armed;
+            System::Collections::Generic::List<System::Threading::Tasks::TaskCompletionSource<int> ^> ^waiting;
+            System::Collections::Generic::List<unsigned long long> ^waiting_after; //< Frames acquired when each was asked for.
 
-            literal int NUM_PORTS=4;
-	    bool nonblocking;
-	    int frame_number, nelements, flags;
+            void set_filter(const MarkerFilter::Params &p);
+            void run_startup(System::Object ^initialize_system);
 
-	    Position3d *marker_data;
+        internal:
+            // From the acquisition thread: frame count-1 is in, or it stopped (-1).
+            void frame_arrived(int frame_number, unsigned long long count);
 
         public:
-            property float frame_frequency; //< Frequency to collect data frames (120).
-            property float marker_frequency;//< Marker frequency for marker maximum on-time (2500).
-            property int threshold; // Dynamic or Static Threshold value to use (30).
-            property int gain; //< Minimum gain code amplification to use (160).
-            property int stream_mode; //< Stream mode for the data buffers (1).
-            property float cycle; // Marker Duty Cycle to use (0.4).
-            property float voltage; //< Voltage to use when turning on markers (7.0).
-            property float collect_time; //< Number of seconds for buffered data collections.
-            property float trigger_time;   //< Number of seconds to pre-trigger data by.
+            property float frame_frequency { //< Frequency to collect data frames (120).
+                float get() { return core->params.frame_frequency; }
+                void set(float v) { core->params.frame_frequency = v; }
+            }
+            property float marker_frequency { //< Marker frequency for marker maximum on-time (2500).
+                float get() { return core->params.marker_frequency; }
+                void set(float v) { core->params.marker_frequency = v; }
+            }
+            property int threshold { // Dynamic or Static Threshold value to use (30).
+                int get() { return core->params.threshold; }
+                void set(int v) { core->params.threshold = v; }
+            }
+            property int gain { //< Minimum gain code amplification to use (160).
+                int get() { return core->params.gain; }
+                void set(int v) { core->params.gain = v; }
+            }
+            property int stream_mode { //< Stream mode for the data buffers (1).
+                int get() { return core->params.stream_mode; }
+                void set(int v) { core->params.stream_mode = v; }
+            }
+            property float cycle { // Marker Duty Cycle to use (0.4).
+                float get() { return core->params.cycle; }
+                void set(float v) { core->params.cycle = v; }
+            }
+            property float voltage { //< Voltage to use when turning on markers (7.0).
+                float get() { return core->params.voltage; }
+                void set(float v) { core->params.voltage = v; }
+            }
+            property float collect_time { //< Number of seconds for buffered data collections.
+                float get() { return core->params.collect_time; }
+                void set(float v) { core->params.collect_time = v; }
+            }
+            property float trigger_time { //< Number of seconds to pre-trigger data by.
+                float get() { return core->params.trigger_time; }
+                void set(float v) { core->params.trigger_time = v; }
+            }
     };
 
 } // end of namespace
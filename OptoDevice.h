@@ -0,0 +1,179 @@
+#ifndef _OPTODEVICE_H_
+#define _OPTODEVICE_H_
+
+/**
+ *@file OptoDevice.h
+ *@brief The device calls the native code makes, so they can be served by
+ * either the real OAPI or a simulation.
+ */
+#include <vector>
+#include "OptoTypes.h"
+
+namespace VML {
+
+    class Triangulator;
+
+    /**
+     * The arguments of OptotrakSetupCollection.
+     */
+    struct CollectionParams {
+        CollectionParams()
+            :num_markers(0),
+            frame_frequency(120.f),
+            marker_frequency(2500.f),
+            threshold(30),
+            gain(160),
+            stream_mode(0),
+            cycle(0.4f),
+            voltage(7.0f),
+            collect_time(1.f),
+            trigger_time(0.f),
+            flags(OPTOTRAK_NO_FIRE_MARKERS_FLAG | OPTOTRAK_BUFFER_RAW_FLAG)
+        {}
+
+        int num_markers;        //< Number of markers in the collection.
+        float frame_frequency;  //< Frequency to collect data frames (120).
+        float marker_frequency; //< Marker frequency for marker maximum on-time (2500).
+        int threshold;          //< Dynamic or Static Threshold value to use (30).
+        int gain;               //< Minimum gain code amplification to use (160).
+        int stream_mode;        //< Stream mode for the data buffers (0).
+        float cycle;            //< Marker Duty Cycle to use (0.4).
+        float voltage;          //< Voltage to use when turning on markers (7.0).
+        float collect_time;     //< Number of seconds for buffered data collections.
+        float trigger_time;     //< Number of seconds to pre-trigger data by.
+        int flags;              //< OPTOTRAK_*_FLAG
+    };
+
+    /**
+     * One Optotrak system.  Return values follow OAPI: 0 means success,
+     * except for data_is_ready().
+     */
+    class OptoDevice {
+        public:
+            virtual ~OptoDevice() {}
+
+            /**
+             * Load and initialize the system, ready for setup_collection().
+             * This and the other setup calls return as soon as the system
+             * is ready for the next one.
+             */
+            virtual int initialize() = 0;
+            virtual int shutdown() = 0;
+
+            /**
+             * OptotrakSetStroberPortTable: markers sent per port.  Before
+             * setup_collection().
+             */
+            virtual int set_strober_table(int port1, int port2, int port3, int port4) = 0;
+
+            virtual int setup_collection(const CollectionParams &p) = 0;
+            virtual int activate_markers() = 0;
+            virtual int deactivate_markers() = 0;
+
+            /**
+             * Same as DataGetLatest3D.
+             */
+            virtual int get_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers) = 0;
+
+            /**
+             * RequestLatest3D, DataIsReady and DataReceiveLatest3D.
+             */
+            virtual int request_latest_3d() = 0;
+            virtual bool data_is_ready() = 0;
+            virtual int receive_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers) = 0;
+
+            /**
+             * Buffered collection: the system spools num_frames frames
+             * (collect_time seconds) on its own and buffer_read() drains
+             * whatever has arrived so far, converted to 3-D, without
+             * waiting.
+             * @param markers Room for max_frames frames.
+             * @param num_frames Frames copied, in order.
+             * @param complete Set once the last frame has been read.
+             */
+            virtual int buffer_start(int num_frames) = 0;
+            virtual int buffer_read(Position3d *markers, int max_frames, int *num_frames, bool *complete) = 0;
+            virtual int buffer_stop() = 0;
+    };
+
+    /**
+     * Straight pass-through to NDI's library.  There's only one system per
+     * host, hence one instance.
+     *
+     * The setup calls don't wait fixed times for the system to settle;
+     * they poll it until it answers as expected (activate_markers() until
+     * a frame comes through), and fail with its last error if that takes
+     * longer than the ready timeout.
+     */
+    class OapiDevice : public OptoDevice {
+        public:
+            static OapiDevice &instance();
+
+            int initialize();
+            int shutdown();
+
+            int set_strober_table(int port1, int port2, int port3, int port4);
+            int setup_collection(const CollectionParams &p);
+            int activate_markers();
+            int deactivate_markers();
+
+            int get_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers);
+
+            int request_latest_3d();
+            bool data_is_ready();
+            int receive_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers);
+
+            int buffer_start(int num_frames);
+            int buffer_read(Position3d *markers, int max_frames, int *num_frames, bool *complete);
+            int buffer_stop();
+
+            /**
+             * Longest wait for the system to get ready, in seconds (5).
+             */
+            void set_ready_timeout(double s) { ready_timeout = s; }
+
+            /**
+             * Convert buffered raw frames with t, on num_threads threads,
+             * instead of one at a time with OptotrakConvertRawTo3D; 0 to
+             * go back.  t must have a model of every sensor of the system
+             * and outlive its use.
+             */
+            void set_triangulator(const Triangulator *t, int num_threads=1) {
+                triangulator = t;
+                triangulator_threads = num_threads;
+            }
+
+        private:
+            OapiDevice()
+                :ready_timeout(5.),
+                num_markers(0), num_sensors(0), num_spooled(0), num_converted(0),
+                spool_complete(false),
+                triangulator(0), triangulator_threads(1)
+            {}
+
+            // OptotrakGetStatus, for the counts.
+            int query_status(int *sensors, int *markers);
+
+            double ready_timeout;
+            std::vector<Position3d> probe; //< A frame, for activate_markers().
+
+            // Spooled raw frames: num_sensors centroids per marker.  Empty
+            // unless a buffer has been started.
+            std::vector<float> spool;
+            int num_markers;
+            int num_sensors;
+            unsigned long num_spooled;
+            unsigned long num_converted;
+            bool spool_complete;
+
+            const Triangulator *triangulator;
+            int triangulator_threads;
+    };
+
+} // end of namespace
+
+#endif/*_OPTODEVICE_H_*/
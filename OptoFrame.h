@@ -0,0 +1,81 @@
+#ifndef _OPTOFRAME_H_
+#define _OPTOFRAME_H_
+
+/**
+ *@file OptoFrame.h
+ *@brief Per-frame bookkeeping shared by the collector, the acquisition
+ * thread and the frame ring.
+ */
+#include <stdint.h>
+#include "OptoTypes.h"
+
+namespace VML {
+
+    /**
+     * Everything about a frame except the marker positions themselves,
+     * which live in a separate Position3d array so they can be handed to
+     * the OAPI calls unchanged.
+     */
+    struct FrameInfo {
+        unsigned int frame_number;
+        unsigned int num_markers;
+        unsigned int flags;
+        long long host_time; //< Host steady clock in ns, taken right after the device returned.
+    };
+
+    /**
+     * The Optotrak reports a missing (occluded) marker with a huge
+     * negative sentinel in all three coordinates.
+     */
+    inline bool is_valid(const Position3d &p) {
+        return p.x > MAX_NEGATIVE && p.y > MAX_NEGATIVE && p.z > MAX_NEGATIVE;
+    }
+
+    /**
+     * Read-only view of the collector's current frame.  No copy: markers
+     * points into the collector's own buffer and stays valid, with new
+     * contents, until the collector is destroyed.  Don't read it while
+     * another thread calls update_frame().
+     */
+    struct FrameView {
+        const Position3d *markers;
+        int num_markers;
+        unsigned int frame_number;
+        unsigned int flags;
+        const uint64_t *valid_mask; //< One bit per marker if not 0; see MarkerMask.h.
+
+        bool valid(int i) const {
+            if(valid_mask)
+                return ((valid_mask[i >> 6] >> (i & 63)) & 1) != 0;
+            return is_valid(markers[i]);
+        }
+    };
+
+    /**
+     * A one-shot request to hear about the next frame the acquisition
+     * thread gets, see CollectorCore::add_frame_waiter().  Intrusive, so
+     * waiting allocates nothing; it must outlive the wait.
+     */
+    struct FrameWaiter {
+        FrameWaiter():notify(0), next(0), after(0) {}
+
+        /**
+         * Called on the acquisition thread with the new frame's number,
+         * or -1 if acquisition stops first (then on the thread stopping
+         * it).  The waiter is no longer registered and may add itself
+         * again from here.
+         */
+        void (*notify)(FrameWaiter *w, int frame_number);
+
+        FrameWaiter *next;
+        unsigned long long after; //< Frames acquired when added; when notified, including the new one.
+    };
+
+    /**
+     * Nanoseconds on the host's monotonic clock.
+     */
+    long long host_time_ns();
+
+} // end of namespace
+
+#endif/*_OPTOFRAME_H_*/
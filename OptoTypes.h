@@ -0,0 +1,31 @@
+#ifndef _OPTOTYPES_H_
+#define _OPTOTYPES_H_
+
+/**
+ *@file OptoTypes.h
+ *@brief The OAPI types shared by the native (non-/clr) code.
+ *
+ * On Windows they come straight from NDI's headers.  Elsewhere only the
+ * simulated device can be built, so we declare layout-compatible stand-ins
+ * for the few types and constants we use.
+ */
+#ifdef _WIN32
+#include "ndtypes.h"
+#include "ndpack.h"
+#include "ndopto.h"
+#else
+
+typedef struct {
+    float x, y, z;
+} Position3d;
+
+#define BAD_FLOAT (float)-3.697314E28
+#define MAX_NEGATIVE (float)-3.0E28
+
+#define OPTOTRAK_BUFFER_RAW_FLAG        0x0020
+#define OPTOTRAK_NO_FIRE_MARKERS_FLAG   0x0040
+#define OPTOTRAK_GET_NEXT_FRAME_FLAG    0x2000
+
+#endif
+
+#endif/*_OPTOTYPES_H_*/
@@ -2,47 +2,28 @@
  *@file Optotrak.cc
  *@brief 
  */
-#include "ndtypes.h"
-#include "ndpack.h"
-#include "ndopto.h"
+#include <stdexcept>
+#include <msclr/marshal_cppstd.h>
+#include "OptoDevice.h"
 #include "Optotrak.h"
+#include "Triangulator.h"
 
 namespace VML {
 
+    namespace {
+        Triangulator *host_triangulator = 0;
+    }
+
     void Optotrak::initialize()
     {
-        using namespace System;
-	if( TransputerLoadSystem( "system" ) != OPTO_NO_ERROR_CODE ){
-	    throw gcnew System::Exception("TransputerLoadSystem returns error");
-	}
-
-	Optotrak::sleep(1);
-
-	if( TransputerInitializeSystem(OPTO_LOG_ERRORS_FLAG|OPTO_LOG_MESSAGES_FLAG)){
-	    throw gcnew System::Exception("TransputerInitializeSystem returns error");
-	}
-	Optotrak::sleep(1);
-
-        // on-host conversions have to be enabled for rigid body processing
-        if( OptotrakSetProcessingFlags( OPTO_LIB_POLL_REAL_DATA |
-                    OPTO_CONVERT_ON_HOST |
-                    OPTO_RIGID_ON_HOST ) ) {
-            throw gcnew System::Exception("OptotrakSetProcessingFlags returns error.");
-        }
-
-	if( OptotrakLoadCameraParameters( "standard" ) ){
-	    throw gcnew System::Exception("OptotrakLoadCameraParameters returns error");
+	if( OapiDevice::instance().initialize() ){
+	    throw gcnew System::Exception("Optotrak initialization returns error");
 	}
-
     }
 
     void Optotrak::shutdown()
     {
-
-	OptotrakDeActivateMarkers();
-	Optotrak::sleep(1);
-
-	if( TransputerShutdownSystem() ){
+	if( OapiDevice::instance().shutdown() ){
 	    throw gcnew System::Exception("TransputerShutdownSystem returns error");
 	}
     }
@@ -53,4 +34,22 @@ namespace VML {
         Thread::Sleep(s*1000);
     }
 
+    void Optotrak::set_host_triangulation(System::String ^sensor_model, int num_threads)
+    {
+        OapiDevice::instance().set_triangulator(0);
+        delete host_triangulator;
+        host_triangulator = 0;
+        if(sensor_model == nullptr)
+            return;
+        try {
+            host_triangulator = new Triangulator;
+            host_triangulator->load(msclr::interop::marshal_as<std::string>(sensor_model));
+        }catch(const std::exception &e) {
+            delete host_triangulator;
+            host_triangulator = 0;
+            throw gcnew System::Exception(gcnew System::String(e.what()));
+        }
+        OapiDevice::instance().set_triangulator(host_triangulator, num_threads);
+    }
+
 } // end of namespace
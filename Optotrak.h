@@ -26,6 +26,15 @@ namespace VML {
 
             static void sleep(int s);
 
+            /**
+             * Convert buffered collections from raw on the host with our
+             * own Triangulator instead of NDI's conversion, on num_threads
+             * threads (one per core if 0).
+             * @param sensor_model A file written by Triangulator::save(),
+             * or nullptr to go back to NDI's conversion.
+             */
+            static void set_host_triangulation(System::String ^sensor_model, int num_threads);
+
     };
 
 } // end of namespace
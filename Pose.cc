@@ -3,6 +3,7 @@
  *@brief 
  */
 #include "Pose.h"
+#include "FixedPose.h"
 #include <iostream>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -25,6 +26,19 @@ namespace BVL {
         os <<*(p.rotation);
         return os;
     }
+
+    ostream &operator<<(ostream &os, const FixedPose &p)
+    {
+        double x, y, z, rx, ry, rz, q0, q1, q2, q3;
+        p.get_translation(x, y, z);
+        p.get_euler_angles(rx, ry, rz);
+        p.get_quaternion(q0, q1, q2, q3);
+        os << "Translation: "<<x<<" "<<y<<" "<<z<<"\n";
+        os << "Euler angles:"<<rx*180./M_PI<<" "<<ry*180./M_PI<<" "<<rz*180./M_PI<<"\n";
+        os << "Quaternion: " <<q0<<" "<<q1<<" "<<q2<<" "<<q3<<"\n";
+        os << "Matrix:\n" <<p.get_rotation_matrix();
+        return os;
+    }
 }
 
 
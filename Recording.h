@@ -0,0 +1,70 @@
+#ifndef _RECORDING_H_
+#define _RECORDING_H_
+
+/**
+ *@file Recording.h
+ *@brief On-disk layout of recorded sessions.
+ *
+ * A recording is a RecordingHeader followed by fixed-size records, one
+ * per frame:
+ *
+ *   RecordHeader, Position3d[num_markers], padding to record_size
+ *
+ * Everything is in the writer's byte order (little-endian on our hosts),
+ * so a reader can map the file and use the records in place.
+ *
+ * A compressed recording (magic "OPTOCMP") has the same header, with
+ * record_size 0, followed by FrameCodec blocks back to back, data_size
+ * bytes of them.  num_records counts the frames in those blocks.
+ */
+#include <stdint.h>
+#include "OptoDevice.h"
+
+namespace VML {
+
+    struct RecordingHeader {
+        enum {
+            VERSION=1
+        };
+
+        char magic[8];           //< "OPTOREC"
+        uint32_t version;
+        uint32_t header_size;    //< Offset of the first record.
+        uint32_t record_size;    //< Bytes per frame, a multiple of 8.
+        int32_t num_markers;
+        float frame_frequency;
+        float marker_frequency;
+        int32_t threshold;
+        int32_t gain;
+        int32_t stream_mode;
+        float cycle;
+        float voltage;
+        float collect_time;
+        float trigger_time;
+        int32_t flags;           //< The collection flags.
+        int64_t start_time;      //< Host time (ns) the recording was opened.
+        uint64_t num_records;    //< Records written so far.  Updated as the recording grows.
+        uint64_t data_size;      //< Bytes of blocks after the header, compressed recordings only.
+        uint8_t reserved[40];  //< Pads the header to 128 bytes.
+    };
+
+    struct RecordHeader {
+        uint32_t frame_number;
+        uint32_t flags;
+        int64_t host_time;       //< ns, on the recording host's steady clock.
+    };
+
+    /**
+     * Size of one record with n markers.
+     */
+    inline uint32_t record_size(int n) {
+        uint32_t s = (uint32_t)(sizeof(RecordHeader)+n*sizeof(Position3d));
+        return (s+7) & ~7u;
+    }
+
+    static const char RECORDING_MAGIC[8] = { 'O','P','T','O','R','E','C','\0' };
+    static const char COMPRESSED_MAGIC[8] = { 'O','P','T','O','C','M','P','\0' };
+
+} // end of namespace
+
+#endif/*_RECORDING_H_*/
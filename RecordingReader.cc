@@ -0,0 +1,260 @@
+/**
+ *@file RecordingReader.cc
+ *@brief
+ */
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdexcept>
+#include "RecordingReader.h"
+
+namespace VML {
+
+    namespace {
+        // Layout of the .idx file: this, the index entries, then the gaps.
+        struct IndexFileHeader {
+            char magic[8];
+            uint64_t num_records;
+            uint64_t step;
+            uint64_t num_entries;
+            uint64_t num_gaps;
+            int64_t start_time; //< Must match the recording's.
+        };
+
+        struct IndexFileGap {
+            uint64_t record;
+            uint32_t first_missing;
+            uint32_t num_missing;
+        };
+
+        const char INDEX_MAGIC[8] = { 'O','P','T','O','I','D','X','\0' };
+    }
+
+    RecordingReader::RecordingReader(const std::string &p, size_t index_step)
+        :path(p),
+        first_record(0),
+        stride(0),
+        num_records(0),
+        step(index_step > 0 ? index_step : 1),
+        num_dropped(0)
+    {
+        file.open(path);
+        if(file.size() < sizeof(RecordingHeader)
+                || memcmp(get_header().magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC))) {
+            throw std::runtime_error(path+" isn't a recording.");
+        }
+        const RecordingHeader &h = get_header();
+        if(h.version != RecordingHeader::VERSION || h.record_size < record_size(h.num_markers)) {
+            throw std::runtime_error(path+" has an unknown recording version.");
+        }
+
+        first_record = file.data()+h.header_size;
+        stride = h.record_size;
+        num_records = (size_t)h.num_records;
+        size_t room = (file.size()-h.header_size)/stride;
+        if(num_records > room)
+            num_records = room;
+
+        if(!load_index())
+            build_index();
+    }
+
+    void RecordingReader::build_index()
+    {
+        index.clear();
+        gaps.clear();
+        num_dropped = 0;
+
+        for(size_t i=0; i<num_records; i+=step) {
+            IndexEntry e;
+            e.frame_number = record(i).frame_number;
+            e.pad = 0;
+            e.host_time = record(i).host_time;
+            index.push_back(e);
+        }
+
+        // Only steps whose frame numbers don't add up contain gaps.
+        for(size_t k=0; k<index.size(); ++k) {
+            size_t lo = k*step;
+            size_t hi = k+1 < index.size() ? lo+step : num_records-1;
+            if(hi > lo && record(hi).frame_number-record(lo).frame_number != hi-lo)
+                find_gaps(lo, hi);
+        }
+    }
+
+    void RecordingReader::find_gaps(size_t lo, size_t hi)
+    {
+        if(hi-lo == 1) {
+            unsigned int a = record(lo).frame_number;
+            unsigned int b = record(hi).frame_number;
+            if(b > a+1) {
+                FrameGap g;
+                g.record = hi;
+                g.first_missing = a+1;
+                g.num_missing = b-a-1;
+                gaps.push_back(g);
+                num_dropped += g.num_missing;
+            }
+            return;
+        }
+
+        size_t mid = lo+(hi-lo)/2;
+        if(record(mid).frame_number-record(lo).frame_number != mid-lo)
+            find_gaps(lo, mid);
+        if(record(hi).frame_number-record(mid).frame_number != hi-mid)
+            find_gaps(mid, hi);
+    }
+
+    bool RecordingReader::load_index()
+    {
+        FILE *f = fopen((path+".idx").c_str(), "rb");
+        if(!f)
+            return false;
+
+        IndexFileHeader h;
+        bool ok = fread(&h, sizeof(h), 1, f) == 1
+            && !memcmp(h.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC))
+            && h.num_records == num_records
+            && h.step == step
+            && h.start_time == get_header().start_time;
+        if(ok) {
+            index.resize((size_t)h.num_entries);
+            ok = index.empty() || fread(&index[0], sizeof(IndexEntry), index.size(), f) == index.size();
+        }
+        if(ok) {
+            std::vector<IndexFileGap> g((size_t)h.num_gaps);
+            ok = g.empty() || fread(&g[0], sizeof(IndexFileGap), g.size(), f) == g.size();
+            gaps.resize(g.size());
+            num_dropped = 0;
+            for(size_t i=0; ok && i<g.size(); ++i) {
+                gaps[i].record = (size_t)g[i].record;
+                gaps[i].first_missing = g[i].first_missing;
+                gaps[i].num_missing = g[i].num_missing;
+                num_dropped += g[i].num_missing;
+            }
+        }
+        fclose(f);
+        return ok;
+    }
+
+    bool RecordingReader::save_index() const
+    {
+        FILE *f = fopen((path+".idx").c_str(), "wb");
+        if(!f)
+            return false;
+
+        IndexFileHeader h;
+        memcpy(h.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        h.num_records = num_records;
+        h.step = step;
+        h.num_entries = index.size();
+        h.num_gaps = gaps.size();
+        h.start_time = get_header().start_time;
+
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+        if(ok && !index.empty())
+            ok = fwrite(&index[0], sizeof(IndexEntry), index.size(), f) == index.size();
+        for(size_t i=0; ok && i<gaps.size(); ++i) {
+            IndexFileGap g;
+            g.record = gaps[i].record;
+            g.first_missing = gaps[i].first_missing;
+            g.num_missing = gaps[i].num_missing;
+            ok = fwrite(&g, sizeof(g), 1, f) == 1;
+        }
+        return fclose(f) == 0 && ok;
+    }
+
+    size_t RecordingReader::lower_bound_frame(unsigned int fn) const
+    {
+        // The first index entry not below fn bounds the step to search.
+        size_t lo = 0, hi = index.size();
+        while(lo < hi) {
+            size_t mid = (lo+hi)/2;
+            if(index[mid].frame_number < fn)
+                lo = mid+1;
+            else
+                hi = mid;
+        }
+
+        size_t first = lo == 0 ? 0 : (lo-1)*step+1;
+        size_t last = lo == index.size() ? num_records : lo*step;
+        while(first < last) {
+            size_t mid = (first+last)/2;
+            if(record(mid).frame_number < fn)
+                first = mid+1;
+            else
+                last = mid;
+        }
+        return first;
+    }
+
+    size_t RecordingReader::lower_bound_time(long long t) const
+    {
+        size_t lo = 0, hi = index.size();
+        while(lo < hi) {
+            size_t mid = (lo+hi)/2;
+            if(index[mid].host_time < t)
+                lo = mid+1;
+            else
+                hi = mid;
+        }
+
+        size_t first = lo == 0 ? 0 : (lo-1)*step+1;
+        size_t last = lo == index.size() ? num_records : lo*step;
+        while(first < last) {
+            size_t mid = (first+last)/2;
+            if(record(mid).host_time < t)
+                first = mid+1;
+            else
+                last = mid;
+        }
+        return first;
+    }
+
+    long long RecordingReader::find_frame(unsigned int fn) const
+    {
+        size_t i = lower_bound_frame(fn);
+        if(i < num_records && record(i).frame_number == fn)
+            return (long long)i;
+        return -1;
+    }
+
+    RecordView RecordingReader::records(size_t first, size_t count) const
+    {
+        if(first > num_records)
+            first = num_records;
+        if(count > num_records-first)
+            count = num_records-first;
+
+        RecordView v;
+        v.base = first_record+first*stride;
+        v.stride = stride;
+        v.count = count;
+        v.first = first;
+        return v;
+    }
+
+    RecordView RecordingReader::frame_range(unsigned int first_frame, unsigned int last_frame) const
+    {
+        size_t first = lower_bound_frame(first_frame);
+        size_t end = last_frame == UINT_MAX ? num_records : lower_bound_frame(last_frame+1);
+        return records(first, end > first ? end-first : 0);
+    }
+
+    RecordView RecordingReader::time_window(long long t0, long long t1) const
+    {
+        size_t first = lower_bound_time(t0);
+        size_t end = lower_bound_time(t1);
+        return records(first, end > first ? end-first : 0);
+    }
+
+    StridedView<Position3d> RecordingReader::marker(int m, const RecordView &r) const
+    {
+        StridedView<Position3d> v;
+        v.base = r.base+sizeof(RecordHeader)+m*sizeof(Position3d);
+        v.stride = r.stride;
+        v.count = r.count;
+        return v;
+    }
+
+} // end of namespace
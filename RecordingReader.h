@@ -0,0 +1,157 @@
+#ifndef _RECORDINGREADER_H_
+#define _RECORDINGREADER_H_
+
+/**
+ *@file RecordingReader.h
+ *@brief Random access to files written by FrameRecorder.
+ */
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "Recording.h"
+
+namespace VML {
+
+    /**
+     * Every stride bytes, a T, count times.  Points into the mapped file.
+     */
+    template <class T>
+    struct StridedView {
+        const char *base;
+        size_t stride;
+        size_t count;
+
+        const T &operator[](size_t i) const {
+            return *(const T *)(base+i*stride);
+        }
+        size_t size() const { return count; }
+    };
+
+    /**
+     * A run of consecutive records.  Points into the mapped file.
+     */
+    struct RecordView {
+        const char *base;
+        size_t stride;
+        size_t count;
+        size_t first;       //< Index of the first record in the file.
+
+        const RecordHeader &header(size_t i) const {
+            return *(const RecordHeader *)(base+i*stride);
+        }
+
+        const Position3d *markers(size_t i) const {
+            return (const Position3d *)(base+i*stride+sizeof(RecordHeader));
+        }
+
+        size_t size() const { return count; }
+    };
+
+    /**
+     * A run of frames the device produced but the recording doesn't have.
+     */
+    struct FrameGap {
+        size_t record;             //< The record right after the gap.
+        unsigned int first_missing;
+        unsigned int num_missing;
+    };
+
+    /**
+     * Maps a recording read-only and answers range queries without reading
+     * it all.
+     *
+     * Records have a fixed size, so the only thing to look up is which
+     * record holds a frame number or a time.  Frame numbers and times only
+     * go up, so a sparse index (every index_step-th record) plus a
+     * binary search inside one step does it.  The same index finds
+     * dropped frames: a step whose frame numbers differ by more than
+     * index_step contains a gap, and only those steps are searched.
+     *
+     * The index is loaded from path+".idx" if that matches the recording,
+     * otherwise built; save_index() writes it for next time.
+     *
+     * Errors throw std::runtime_error.
+     */
+    class RecordingReader {
+        public:
+            RecordingReader(const std::string &path, size_t index_step=1024);
+
+            const RecordingHeader &get_header() const {
+                return *(const RecordingHeader *)file.data();
+            }
+
+            int get_num_markers() const { return get_header().num_markers; }
+            size_t get_num_records() const { return num_records; }
+
+            /**
+             * Records [first, first+count), clipped to the file.
+             */
+            RecordView records(size_t first, size_t count) const;
+
+            /**
+             * Records whose frame numbers are in [first_frame, last_frame].
+             */
+            RecordView frame_range(unsigned int first_frame, unsigned int last_frame) const;
+
+            /**
+             * Records whose host times are in [t0, t1), ns.
+             */
+            RecordView time_window(long long t0, long long t1) const;
+
+            /**
+             * Marker m of every record in r, e.g. marker(5, frame_range(10000, 20000)).
+             */
+            StridedView<Position3d> marker(int m, const RecordView &r) const;
+
+            /**
+             * Index of the record holding frame fn, or -1.
+             */
+            long long find_frame(unsigned int fn) const;
+
+            /**
+             * First record with frame number >= fn, or host time >= t.
+             */
+            size_t lower_bound_frame(unsigned int fn) const;
+            size_t lower_bound_time(long long t) const;
+
+            const std::vector<FrameGap> &get_gaps() const { return gaps; }
+            unsigned long long get_num_dropped() const { return num_dropped; }
+
+            /**
+             * Write the index next to the recording.  False if it can't.
+             */
+            bool save_index() const;
+
+        private:
+            struct IndexEntry {
+                unsigned int frame_number;
+                unsigned int pad;
+                long long host_time;
+            };
+
+            const RecordHeader &record(size_t i) const {
+                return *(const RecordHeader *)(first_record+i*stride);
+            }
+
+            void build_index();
+            bool load_index();
+            // Record gaps between records lo and hi (lo < hi), which are
+            // known to contain at least one.
+            void find_gaps(size_t lo, size_t hi);
+
+            std::string path;
+            MappedFile file;
+            const char *first_record;
+            size_t stride;
+            size_t num_records;
+            size_t step;
+
+            std::vector<IndexEntry> index; //< Record i*step.
+            std::vector<FrameGap> gaps;
+            unsigned long long num_dropped;
+    };
+
+} // end of namespace
+
+#endif/*_RECORDINGREADER_H_*/
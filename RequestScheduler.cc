@@ -0,0 +1,205 @@
+/**
+ *@file RequestScheduler.cc
+ *@brief
+ */
+#include <math.h>
+#include "OptoDevice.h"
+#include "RequestScheduler.h"
+
+namespace VML {
+
+    RequestScheduler::RequestScheduler()
+    {
+        reset(1./120., true);
+    }
+
+    void RequestScheduler::reset(double frame_period, bool nf)
+    {
+        nominal = period = frame_period*1e9;
+        jitter = 0.;
+        latency = 0.;
+        probe = 10000.;
+        next_frame = nf;
+        in_flight = false;
+        seen = false;
+        missed = false;
+        requested = 0;
+        request_at = poll_at = 0;
+        anchor_frame = last_frame = timed_frame = 0;
+        anchor_time = timed_time = 0.;
+        reset_counts();
+    }
+
+    void RequestScheduler::reset_counts()
+    {
+        counts.requests = counts.checks = counts.misses = counts.frames = 0;
+    }
+
+    long long RequestScheduler::predict(unsigned int fn) const
+    {
+        if(!seen)
+            return 0;
+        return (long long)(anchor_time+(double)(int)(fn-anchor_frame)*period);
+    }
+
+    long long RequestScheduler::guard() const
+    {
+        // Arrivals are tracked at their earliest, so a little ahead of
+        // the prediction catches most frames on the first check.
+        double g = jitter/4.;
+        if(g < period/200.)
+            g = period/200.;
+        if(g < 10000.)
+            g = 10000.;
+        return (long long)g;
+    }
+
+    int RequestScheduler::poll(OptoDevice *device, FrameInfo &info, Position3d *markers)
+    {
+        long long now = host_time_ns();
+        if(!in_flight) {
+            if(now < request_at)
+                return PENDING;
+            ++counts.requests;
+            if(device->request_latest_3d())
+                return FAILED;
+            in_flight = true;
+            missed = false;
+            requested = now;
+            long long ready = now+(long long)latency-guard();
+            if(poll_at < ready)
+                poll_at = ready;
+        }
+        if(now < poll_at)
+            return PENDING;
+
+        ++counts.checks;
+        if(!device->data_is_ready()) {
+            ++counts.misses;
+            missed = true;
+            poll_at = now+guard();
+            return PENDING;
+        }
+
+        in_flight = false;
+        int error = device->receive_latest_3d(&info.frame_number, &info.num_markers, &info.flags, markers);
+        info.host_time = host_time_ns();
+        if(error) {
+            request_at = poll_at = 0;
+            return FAILED;
+        }
+        if(next_frame) {
+            observe(info.frame_number, now);
+        }else {
+            // As with arrivals: a first check that finds it ready only
+            // says it took no longer than that.
+            double l = (double)(now-requested);
+            if(missed)
+                latency += (l-guard()/2.-latency)/8.;
+            else
+                latency = (l < latency ? l : latency)-guard()/4.;
+            if(latency < 0.)
+                latency = 0.;
+            observe_latest(info.frame_number, requested);
+        }
+        return READY;
+    }
+
+    void RequestScheduler::request_next(OptoDevice *device)
+    {
+        if(!next_frame || in_flight)
+            return;
+        ++counts.requests;
+        if(device->request_latest_3d())
+            return;
+        in_flight = true;
+        missed = false;
+        requested = host_time_ns();
+    }
+
+    void RequestScheduler::observe(unsigned int fn, long long t)
+    {
+        bool fresh = !seen || (int)(fn-last_frame) > 0;
+        if(!fresh)
+            return;
+        ++counts.frames;
+
+        double expected = anchor_time+(double)(int)(fn-anchor_frame)*period;
+        if(!seen || (missed && fabs(t-expected) > period)) {
+            // First frame, or lost track.
+            anchor_frame = timed_frame = fn;
+            anchor_time = timed_time = (double)t;
+        }else if(missed) {
+            // Ready between the last check and this one: a timing.
+            double a = t-guard()/2.;
+            int n = (int)(fn-timed_frame);
+            double d = (a-timed_time)/n;
+            // A late frame makes the next interval look short; only
+            // plausible intervals teach the period.
+            if(n > 0 && d > nominal*0.8 && d < nominal*1.25)
+                period += (d-period)/(n < 16 ? 16./n : 1.);
+            timed_frame = fn;
+            timed_time = a;
+
+            // Follow the earliest arrivals: delays only add.
+            double err = a-expected;
+            anchor_time = expected+(err < 0. ? err/2. : err/16.);
+            anchor_frame = fn;
+            jitter += (fabs(err)-jitter)/8.;
+            probe = (double)guard();
+        }else {
+            // Ready at the first check, so some time before it (or we
+            // checked late): look earlier, further each time.
+            anchor_time = (t < expected ? t : expected)-probe;
+            anchor_frame = fn;
+            if(probe < period/4.)
+                probe *= 2.;
+        }
+        seen = true;
+        last_frame = fn;
+
+        poll_at = predict(last_frame+1)-guard();
+        request_at = 0;
+    }
+
+    void RequestScheduler::observe_latest(unsigned int fn, long long r)
+    {
+        // Here the anchor is when a frame is taken: the answer is the
+        // newest frame at the request, so fn was taken by r, and if it's
+        // the same as last time, the next one wasn't.
+        bool fresh = !seen || (int)(fn-last_frame) > 0;
+        if(!seen) {
+            anchor_frame = fn;
+            anchor_time = (double)r;
+        }else if(!fresh) {
+            // Too early by up to the last probe.
+            anchor_frame = fn+1;
+            anchor_time = r+(probe > guard() ? probe/2. : (double)guard());
+            probe = (double)guard();
+        }else {
+            double taken = anchor_time+(double)(int)(fn-anchor_frame)*period;
+            // Ask a little earlier each time until it's too early.
+            anchor_time = (taken < r ? taken : (double)r)-probe;
+            anchor_frame = fn;
+            if(probe < period/16.)
+                probe *= 2.;
+        }
+        if(fresh)
+            ++counts.frames;
+        seen = true;
+        last_frame = fn;
+
+        request_at = predict(last_frame+1)+guard()/2;
+    }
+
+    void RequestScheduler::finish(OptoDevice *device, Position3d *markers)
+    {
+        if(in_flight) {
+            unsigned int fn, ne, f;
+            device->receive_latest_3d(&fn, &ne, &f, markers);
+            in_flight = false;
+        }
+        request_at = poll_at = 0;
+    }
+
+} // end of namespace
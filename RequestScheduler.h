@@ -0,0 +1,127 @@
+#ifndef _REQUESTSCHEDULER_H_
+#define _REQUESTSCHEDULER_H_
+
+/**
+ *@file RequestScheduler.h
+ *@brief Keeps one frame request in flight and asks whether it's ready
+ * only when the frame should be.
+ */
+#include "OptoFrame.h"
+
+namespace VML {
+
+    class OptoDevice;
+
+    /**
+     * Drives request_latest_3d(), data_is_ready() and receive_latest_3d()
+     * for a caller that polls.  It learns when frames arrive: the period,
+     * starting from the nominal one and following the frame numbers'
+     * arrival times, and the phase and jitter of arrivals.  Nothing is
+     * asked of the driver until just before the next frame is predicted
+     * to be in, and a request already out is never made again.
+     *
+     * With OPTOTRAK_GET_NEXT_FRAME_FLAG the next request goes out as soon
+     * as the caller is done with a frame (request_next()).  Without it
+     * the system answers with the newest frame at once, so the request
+     * waits until the next frame is due, less the time an answer takes.
+     *
+     * Never sleeps; get_due() tells a caller that can when to call again.
+     * Plain C++, no allocation.
+     */
+    class RequestScheduler {
+        public:
+            enum {
+                FAILED=-1,
+                READY=0,
+                PENDING=1 //< Nothing new yet.
+            };
+
+            /**
+             * Driver calls made, for comparing schedules.
+             */
+            struct Counts {
+                unsigned long long requests;
+                unsigned long long checks; //< data_is_ready()
+                unsigned long long misses; //< data_is_ready() false
+                unsigned long long frames;
+            };
+
+            RequestScheduler();
+
+            /**
+             * Start over for frames every frame_period seconds.  Call
+             * after setup_collection(), with nothing in flight.
+             * @param next_frame The collection has OPTOTRAK_GET_NEXT_FRAME_FLAG.
+             */
+            void reset(double frame_period, bool next_frame);
+
+            /**
+             * Make whichever driver call is due, if any.
+             * @return READY with the frame in info and markers; PENDING
+             * if it isn't there yet (or isn't due); FAILED if the driver
+             * said so.
+             */
+            int poll(OptoDevice *device, FrameInfo &info, Position3d *markers);
+
+            /**
+             * With OPTOTRAK_GET_NEXT_FRAME_FLAG, send the next request
+             * now, once the frame poll() returned has been used: OAPI
+             * allows no other call (e.g. to the ODAU) while a request is
+             * out.  Otherwise, or if it fails, the next poll() sends it.
+             */
+            void request_next(OptoDevice *device);
+
+            /**
+             * Host time (ns) before which poll() won't call the driver.
+             */
+            long long get_due() const {
+                return in_flight ? poll_at : request_at;
+            }
+
+            bool is_in_flight() const { return in_flight; }
+
+            /**
+             * Receive the request in flight, if any, into markers and
+             * drop it, so the device can be used some other way.  Blocks
+             * until it's ready.
+             */
+            void finish(OptoDevice *device, Position3d *markers);
+
+            /**
+             * Learnt frame period, in s.
+             */
+            double get_period() const { return period*1e-9; }
+
+            /**
+             * Host time frame fn is expected to be ready (to be taken,
+             * without next_frame).  0 until a frame has been received.
+             */
+            long long predict(unsigned int fn) const;
+
+            const Counts &get_counts() const { return counts; }
+            void reset_counts();
+
+        private:
+            // Learn from frame fn found ready at t, and plan the next one.
+            void observe(unsigned int fn, long long t);
+            // Same without OPTOTRAK_GET_NEXT_FRAME_FLAG, for the request made at r.
+            void observe_latest(unsigned int fn, long long r);
+            long long guard() const;
+
+            double nominal, period, jitter, latency; //< ns
+            double probe; //< How much earlier to look after a frame was ready at the first check.
+            bool next_frame;
+            bool in_flight;
+            bool seen; //< A frame's been received since reset().
+            bool missed; //< data_is_ready() said no since the request.
+            long long requested; //< When the request in flight went out.
+            long long request_at, poll_at;
+            unsigned int anchor_frame, last_frame, timed_frame;
+            double anchor_time; //< Predicted ready time of anchor_frame, or time taken without next_frame.
+            double timed_time; //< Ready time of timed_frame, the last one timed.
+            Counts counts;
+    };
+
+} // end of namespace
+
+#endif/*_REQUESTSCHEDULER_H_*/
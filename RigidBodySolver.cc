@@ -0,0 +1,218 @@
+/**
+ *@file RigidBodySolver.cc
+ *@brief
+ */
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include "MarkerMask.h"
+#include "RigidBodySolver.h"
+
+namespace VML {
+
+    namespace {
+
+        /**
+         * Eigen-decomposition of the symmetric 4x4 a by cyclic Jacobi
+         * rotations.  a is destroyed; its diagonal ends up holding the
+         * eigenvalues, and column j of v the eigenvector of a[j][j].
+         */
+        void jacobi4(double a[4][4], double v[4][4])
+        {
+            for(int i=0; i<4; ++i)
+                for(int j=0; j<4; ++j)
+                    v[i][j] = i == j ? 1. : 0.;
+
+            for(int sweep=0; sweep<50; ++sweep) {
+                double off = 0., diag = 0.;
+                for(int p=0; p<4; ++p) {
+                    diag += a[p][p]*a[p][p];
+                    for(int q=p+1; q<4; ++q)
+                        off += a[p][q]*a[p][q];
+                }
+                if(off <= 1e-30*diag || off == 0.)
+                    return;
+
+                for(int p=0; p<3; ++p) {
+                    for(int q=p+1; q<4; ++q) {
+                        if(a[p][q] == 0.)
+                            continue;
+                        double theta = (a[q][q]-a[p][p])/(2.*a[p][q]);
+                        double t = (theta >= 0. ? 1. : -1.)/(fabs(theta)+sqrt(theta*theta+1.));
+                        double c = 1./sqrt(t*t+1.), s = t*c;
+
+                        for(int k=0; k<4; ++k) {
+                            double akp = a[k][p], akq = a[k][q];
+                            a[k][p] = c*akp-s*akq;
+                            a[k][q] = s*akp+c*akq;
+                        }
+                        for(int k=0; k<4; ++k) {
+                            double apk = a[p][k], aqk = a[q][k];
+                            a[p][k] = c*apk-s*aqk;
+                            a[q][k] = s*apk+c*aqk;
+                        }
+                        for(int k=0; k<4; ++k) {
+                            double vkp = v[k][p], vkq = v[k][q];
+                            v[k][p] = c*vkp-s*vkq;
+                            v[k][q] = s*vkp+c*vkq;
+                        }
+                    }
+                }
+            }
+        }
+
+    }
+
+    RigidBodySolver::RigidBodySolver()
+        :frame_size(0)
+    {
+    }
+
+    int RigidBodySolver::add_body(const double *m, int num_markers, int first_marker)
+    {
+        if(num_markers < 3 || first_marker < 0) {
+            throw std::logic_error("A rigid body needs at least 3 markers.");
+        }
+
+        Body b;
+        b.first_marker = first_marker;
+        b.num_markers = num_markers;
+        b.model_offset = (int)model.size();
+        model.insert(model.end(), m, m+3*num_markers);
+        bodies.push_back(b);
+
+        BodyPose p = BodyPose();
+        p.valid = false;
+        poses.push_back(p);
+        return (int)bodies.size()-1;
+    }
+
+    void RigidBodySolver::setup(int n)
+    {
+        int largest = 0;
+        for(size_t i=0; i<bodies.size(); ++i) {
+            if(bodies[i].first_marker+bodies[i].num_markers > n) {
+                throw std::logic_error("Rigid body markers beyond the end of the frame.");
+            }
+            if(bodies[i].num_markers > largest)
+                largest = bodies[i].num_markers;
+        }
+
+        frame_size = n;
+        seen_model.assign(3*largest, 0.);
+        seen_data.assign(3*largest, 0.);
+    }
+
+    int RigidBodySolver::get_min_frame_size() const
+    {
+        int n = 0;
+        for(size_t i=0; i<bodies.size(); ++i)
+            n = std::max(n, bodies[i].first_marker+bodies[i].num_markers);
+        return n;
+    }
+
+    void RigidBodySolver::solve(const Position3d *frame, const uint64_t *valid)
+    {
+        for(size_t i=0; i<bodies.size(); ++i)
+            solve(bodies[i], frame, valid, poses[i]);
+    }
+
+    void RigidBodySolver::solve(const Body &b, const Position3d *frame, const uint64_t *valid, BodyPose &pose)
+    {
+        // Gather the markers we've got and their centroids.
+        const double *m = &model[b.model_offset];
+        double *sm = &seen_model[0], *sd = &seen_data[0];
+        double cm[3] = {0., 0., 0.}, cd[3] = {0., 0., 0.};
+        int n = 0;
+        for(int i=0; i<b.num_markers; ++i) {
+            const Position3d &p = frame[b.first_marker+i];
+            if(valid ? !test_bit(valid, b.first_marker+i) : !is_valid(p))
+                continue;
+            sm[3*n] = m[3*i]; sm[3*n+1] = m[3*i+1]; sm[3*n+2] = m[3*i+2];
+            sd[3*n] = p.x; sd[3*n+1] = p.y; sd[3*n+2] = p.z;
+            for(int k=0; k<3; ++k) {
+                cm[k] += sm[3*n+k];
+                cd[k] += sd[3*n+k];
+            }
+            ++n;
+        }
+
+        pose.num_markers = n;
+        pose.valid = false;
+        if(n < 3)
+            return;
+        for(int k=0; k<3; ++k) {
+            cm[k] /= n;
+            cd[k] /= n;
+        }
+
+        // Cross-covariance s[a][b] = sum of model_a*data_b, centred.
+        double s[3][3] = {{0.}};
+        for(int i=0; i<n; ++i) {
+            double mc[3], dc[3];
+            for(int k=0; k<3; ++k) {
+                mc[k] = sm[3*i+k]-cm[k];
+                dc[k] = sd[3*i+k]-cd[k];
+            }
+            for(int r=0; r<3; ++r)
+                for(int c=0; c<3; ++c)
+                    s[r][c] += mc[r]*dc[c];
+        }
+
+        double sxx = s[0][0], sxy = s[0][1], sxz = s[0][2];
+        double syx = s[1][0], syy = s[1][1], syz = s[1][2];
+        double szx = s[2][0], szy = s[2][1], szz = s[2][2];
+        double a[4][4] = {
+            { sxx+syy+szz, syz-szy,      szx-sxz,      sxy-syx },
+            { syz-szy,     sxx-syy-szz,  sxy+syx,      szx+sxz },
+            { szx-sxz,     sxy+syx,     -sxx+syy-szz,  syz+szy },
+            { sxy-syx,     szx+sxz,      syz+szy,     -sxx-syy+szz }
+        };
+        double v[4][4];
+        jacobi4(a, v);
+
+        int best = 0, second = -1;
+        for(int j=1; j<4; ++j)
+            if(a[j][j] > a[best][best])
+                best = j;
+        for(int j=0; j<4; ++j)
+            if(j != best && (second < 0 || a[j][j] > a[second][second]))
+                second = j;
+        // Markers on a line leave the rotation about the line undetermined,
+        // and the largest eigenvalue repeated.
+        double gap = a[best][best]-a[second][second];
+        if(!(gap > 1e-9*fabs(a[best][best])))
+            return;
+
+        double q0 = v[0][best], q1 = v[1][best], q2 = v[2][best], q3 = v[3][best];
+        double norm = sqrt(q0*q0+q1*q1+q2*q2+q3*q3);
+        if(q0 < 0.)
+            norm = -norm;
+        q0 /= norm; q1 /= norm; q2 /= norm; q3 /= norm;
+
+        double *r = pose.rotation;
+        r[0] = 1.-2.*(q2*q2+q3*q3); r[1] = 2.*(q1*q2-q0*q3);    r[2] = 2.*(q1*q3+q0*q2);
+        r[3] = 2.*(q1*q2+q0*q3);    r[4] = 1.-2.*(q1*q1+q3*q3); r[5] = 2.*(q2*q3-q0*q1);
+        r[6] = 2.*(q1*q3-q0*q2);    r[7] = 2.*(q2*q3+q0*q1);    r[8] = 1.-2.*(q1*q1+q2*q2);
+        pose.quaternion[0] = q0;
+        pose.quaternion[1] = q1;
+        pose.quaternion[2] = q2;
+        pose.quaternion[3] = q3;
+
+        double *t = pose.translation;
+        for(int k=0; k<3; ++k)
+            t[k] = cd[k]-(r[3*k]*cm[0]+r[3*k+1]*cm[1]+r[3*k+2]*cm[2]);
+
+        double sum = 0.;
+        for(int i=0; i<n; ++i) {
+            const double *x = sm+3*i, *y = sd+3*i;
+            for(int k=0; k<3; ++k) {
+                double e = r[3*k]*x[0]+r[3*k+1]*x[1]+r[3*k+2]*x[2]+t[k]-y[k];
+                sum += e*e;
+            }
+        }
+        pose.rms = sqrt(sum/n);
+        pose.valid = true;
+    }
+
+} // end of namespace
@@ -0,0 +1,119 @@
+#ifndef _RIGIDBODYSOLVER_H_
+#define _RIGIDBODYSOLVER_H_
+
+/**
+ *@file RigidBodySolver.h
+ *@brief Rigid body poses from marker positions, on the host.
+ */
+#include <vector>
+#include "OptoFrame.h"
+
+namespace VML {
+
+    /**
+     * Where a rigid body is in one frame: a marker at body coordinates b
+     * is measured at rotation*b+translation.  Same conventions as
+     * BVL::FixedPose (row-major matrix, q0 the scalar part and >= 0).
+     */
+    struct BodyPose {
+        double rotation[9];
+        double quaternion[4];
+        double translation[3];
+        double rms; //< RMS distance between the measured and fitted markers, mm.
+        int num_markers; //< Markers seen and used in the fit.
+        bool valid; //< False if fewer than 3 markers were seen, or all on a line.
+    };
+
+    /**
+     * Least-squares fit of each body's definition to the markers seen in a
+     * frame, by Horn's quaternion method: the rotation is the eigenvector
+     * of the largest eigenvalue of a 4x4 matrix built from the
+     * cross-covariance, found with a few Jacobi sweeps.  Missing markers
+     * are left out of the fit; 3 non-collinear ones are enough.
+     *
+     * All storage is allocated by setup(); solve() doesn't allocate.
+     * A 6-marker body takes about a microsecond a frame.
+     */
+    class RigidBodySolver {
+        public:
+            RigidBodySolver();
+
+            /**
+             * @param model Body coordinates of the markers, x,y,z each.
+             * @param num_markers At least 3.
+             * @param first_marker Index in the frame of the body's first
+             * marker (0-based); the rest follow it.
+             * @return The body's index.
+             */
+            int add_body(const double *model, int num_markers, int first_marker);
+
+            /**
+             * Check the bodies against the frame size and allocate.
+             * Throws std::logic_error if a body doesn't fit.
+             */
+            void setup(int frame_size);
+
+            /**
+             * Fit every body to frame, which has frame_size markers.
+             * @param valid If given, the frame's scan_valid() mask, tested
+             * instead of the coordinates.
+             */
+            void solve(const Position3d *frame, const uint64_t *valid=0);
+
+            /**
+             * Fit body i alone, e.g. only when its markers have moved.
+             */
+            void solve_body(int i, const Position3d *frame, const uint64_t *valid=0) {
+                solve(bodies[i], frame, valid, poses[i]);
+            }
+
+            int get_num_bodies() const { return (int)bodies.size(); }
+
+            /**
+             * Where body i's markers are in the frame (0-based), and how
+             * many.
+             */
+            int get_first_marker(int i) const { return bodies[i].first_marker; }
+            int get_num_markers(int i) const { return bodies[i].num_markers; }
+
+            /**
+             * Smallest frame that holds every body's markers.
+             */
+            int get_min_frame_size() const;
+
+            const BodyPose &get_pose(int i) const { return poses[i]; }
+
+            /**
+             * Copy body i's pose into a BVL::Pose or BVL::FixedPose.
+             * @return Whether the pose is valid.  If not, p is untouched.
+             */
+            template <class P>
+            bool get_pose(int i, P &p) const {
+                const BodyPose &b = poses[i];
+                if(!b.valid)
+                    return false;
+                p.set_rotation(b.quaternion[0], b.quaternion[1], b.quaternion[2], b.quaternion[3]);
+                p.set_translation(b.translation[0], b.translation[1], b.translation[2]);
+                return true;
+            }
+
+        private:
+            struct Body {
+                int first_marker;
+                int num_markers;
+                int model_offset; //< Into model, in doubles.
+            };
+
+            void solve(const Body &b, const Position3d *frame, const uint64_t *valid, BodyPose &pose);
+
+            std::vector<Body> bodies;
+            std::vector<double> model;
+            std::vector<BodyPose> poses;
+            // The seen markers of one body, model and measured, 3 doubles each.
+            std::vector<double> seen_model, seen_data;
+            int frame_size;
+    };
+
+} // end of namespace
+
+#endif/*_RIGIDBODYSOLVER_H_*/
@@ -0,0 +1,445 @@
+/**
+ *@file RotationKernels.cc
+ *@brief
+ *
+ * Each conversion is written once, as a template over a small vector
+ * type: Avx (4 doubles), Sse (2 doubles) or Scalar (1).  The widest one
+ * the compiler allows does the bulk of the arrays and Scalar the tail.
+ * sin/cos and atan are the Cephes polynomials, evaluated in all lanes
+ * with selects in place of branches.
+ */
+#include <math.h>
+#include "RotationKernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ROTATION_KERNELS_SSE2
+#endif
+
+namespace BVL {
+
+    namespace {
+
+        struct ScalarMask {
+            bool m;
+        };
+
+        struct Scalar {
+            enum { W=1 };
+            typedef ScalarMask Mask;
+            double v;
+
+            static Scalar load(const double *p) { Scalar r = { *p }; return r; }
+            static Scalar set(double x) { Scalar r = { x }; return r; }
+            void store(double *p) const { *p = v; }
+        };
+
+        inline Scalar operator+(Scalar a, Scalar b) { return Scalar::set(a.v+b.v); }
+        inline Scalar operator-(Scalar a, Scalar b) { return Scalar::set(a.v-b.v); }
+        inline Scalar operator*(Scalar a, Scalar b) { return Scalar::set(a.v*b.v); }
+        inline Scalar operator/(Scalar a, Scalar b) { return Scalar::set(a.v/b.v); }
+        inline Scalar operator-(Scalar a) { return Scalar::set(-a.v); }
+        inline ScalarMask operator<(Scalar a, Scalar b) { ScalarMask m = { a.v < b.v }; return m; }
+        inline ScalarMask operator>(Scalar a, Scalar b) { ScalarMask m = { a.v > b.v }; return m; }
+        inline ScalarMask operator>=(Scalar a, Scalar b) { ScalarMask m = { a.v >= b.v }; return m; }
+        inline ScalarMask operator==(Scalar a, Scalar b) { ScalarMask m = { a.v == b.v }; return m; }
+        inline ScalarMask operator&(ScalarMask a, ScalarMask b) { ScalarMask m = { a.m && b.m }; return m; }
+        inline ScalarMask andnot(ScalarMask a, ScalarMask b) { ScalarMask m = { !a.m && b.m }; return m; }
+        inline Scalar select(ScalarMask m, Scalar a, Scalar b) { return m.m ? a : b; }
+        inline Scalar vsqrt(Scalar a) { return Scalar::set(sqrt(a.v)); }
+        inline Scalar vfloor(Scalar a) { return Scalar::set(floor(a.v)); }
+        inline Scalar vabs(Scalar a) { return Scalar::set(fabs(a.v)); }
+
+#if defined(__AVX2__)
+
+        struct AvxMask {
+            __m256d m;
+        };
+
+        struct Avx {
+            enum { W=4 };
+            typedef AvxMask Mask;
+            __m256d v;
+
+            static Avx load(const double *p) { Avx r = { _mm256_loadu_pd(p) }; return r; }
+            static Avx set(double x) { Avx r = { _mm256_set1_pd(x) }; return r; }
+            void store(double *p) const { _mm256_storeu_pd(p, v); }
+        };
+
+        inline Avx mk(__m256d v) { Avx r = { v }; return r; }
+        inline AvxMask mkm(__m256d m) { AvxMask r = { m }; return r; }
+        inline Avx operator+(Avx a, Avx b) { return mk(_mm256_add_pd(a.v, b.v)); }
+        inline Avx operator-(Avx a, Avx b) { return mk(_mm256_sub_pd(a.v, b.v)); }
+        inline Avx operator*(Avx a, Avx b) { return mk(_mm256_mul_pd(a.v, b.v)); }
+        inline Avx operator/(Avx a, Avx b) { return mk(_mm256_div_pd(a.v, b.v)); }
+        inline Avx operator-(Avx a) { return mk(_mm256_xor_pd(a.v, _mm256_set1_pd(-0.))); }
+        inline AvxMask operator<(Avx a, Avx b) { return mkm(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)); }
+        inline AvxMask operator>(Avx a, Avx b) { return mkm(_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ)); }
+        inline AvxMask operator>=(Avx a, Avx b) { return mkm(_mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ)); }
+        inline AvxMask operator==(Avx a, Avx b) { return mkm(_mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ)); }
+        inline AvxMask operator&(AvxMask a, AvxMask b) { return mkm(_mm256_and_pd(a.m, b.m)); }
+        inline AvxMask andnot(AvxMask a, AvxMask b) { return mkm(_mm256_andnot_pd(a.m, b.m)); }
+        inline Avx select(AvxMask m, Avx a, Avx b) { return mk(_mm256_blendv_pd(b.v, a.v, m.m)); }
+        inline Avx vsqrt(Avx a) { return mk(_mm256_sqrt_pd(a.v)); }
+        inline Avx vfloor(Avx a) { return mk(_mm256_floor_pd(a.v)); }
+        inline Avx vabs(Avx a) { return mk(_mm256_andnot_pd(_mm256_set1_pd(-0.), a.v)); }
+
+        typedef Avx Wide;
+        const char *const ISA = "AVX2";
+
+#elif defined(ROTATION_KERNELS_SSE2)
+
+        struct SseMask {
+            __m128d m;
+        };
+
+        struct Sse {
+            enum { W=2 };
+            typedef SseMask Mask;
+            __m128d v;
+
+            static Sse load(const double *p) { Sse r = { _mm_loadu_pd(p) }; return r; }
+            static Sse set(double x) { Sse r = { _mm_set1_pd(x) }; return r; }
+            void store(double *p) const { _mm_storeu_pd(p, v); }
+        };
+
+        inline Sse mk(__m128d v) { Sse r = { v }; return r; }
+        inline SseMask mkm(__m128d m) { SseMask r = { m }; return r; }
+        inline Sse operator+(Sse a, Sse b) { return mk(_mm_add_pd(a.v, b.v)); }
+        inline Sse operator-(Sse a, Sse b) { return mk(_mm_sub_pd(a.v, b.v)); }
+        inline Sse operator*(Sse a, Sse b) { return mk(_mm_mul_pd(a.v, b.v)); }
+        inline Sse operator/(Sse a, Sse b) { return mk(_mm_div_pd(a.v, b.v)); }
+        inline Sse operator-(Sse a) { return mk(_mm_xor_pd(a.v, _mm_set1_pd(-0.))); }
+        inline SseMask operator<(Sse a, Sse b) { return mkm(_mm_cmplt_pd(a.v, b.v)); }
+        inline SseMask operator>(Sse a, Sse b) { return mkm(_mm_cmpgt_pd(a.v, b.v)); }
+        inline SseMask operator>=(Sse a, Sse b) { return mkm(_mm_cmpge_pd(a.v, b.v)); }
+        inline SseMask operator==(Sse a, Sse b) { return mkm(_mm_cmpeq_pd(a.v, b.v)); }
+        inline SseMask operator&(SseMask a, SseMask b) { return mkm(_mm_and_pd(a.m, b.m)); }
+        inline SseMask andnot(SseMask a, SseMask b) { return mkm(_mm_andnot_pd(a.m, b.m)); }
+        inline Sse select(SseMask m, Sse a, Sse b) {
+            return mk(_mm_or_pd(_mm_and_pd(m.m, a.v), _mm_andnot_pd(m.m, b.v)));
+        }
+        inline Sse vsqrt(Sse a) { return mk(_mm_sqrt_pd(a.v)); }
+        // SSE2 has no floor; truncate and step down for negatives.
+        inline Sse vfloor(Sse a) {
+            __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(a.v));
+            return mk(_mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, a.v), _mm_set1_pd(1.))));
+        }
+        inline Sse vabs(Sse a) { return mk(_mm_andnot_pd(_mm_set1_pd(-0.), a.v)); }
+
+        typedef Sse Wide;
+        const char *const ISA = "SSE2";
+
+#else
+
+        typedef Scalar Wide;
+        const char *const ISA = "scalar";
+
+#endif
+
+        template <class V>
+        inline V c(double x) {
+            return V::set(x);
+        }
+
+        // Horner, coefficients from the highest power down.
+        template <class V>
+        inline V polevl(V x, const double *coef, int n) {
+            V r = c<V>(coef[0]);
+            for(int i=1; i<n; ++i)
+                r = r*x+c<V>(coef[i]);
+            return r;
+        }
+
+        // Same with an implicit leading 1.
+        template <class V>
+        inline V p1evl(V x, const double *coef, int n) {
+            V r = x+c<V>(coef[0]);
+            for(int i=1; i<n; ++i)
+                r = r*x+c<V>(coef[i]);
+            return r;
+        }
+
+        const double PIO4 = 7.85398163397448309616E-1;
+        const double PIO2 = 1.57079632679489661923;
+        const double PI = 3.14159265358979323846;
+
+        const double SINCOF[] = {
+            1.58962301576546568060E-10, -2.50507477628578072866E-8,
+            2.75573136213857245213E-6, -1.98412698295895385996E-4,
+            8.33333333332211858878E-3, -1.66666666666666307295E-1
+        };
+        const double COSCOF[] = {
+            -1.13585365213876817300E-11, 2.08757008419747316778E-9,
+            -2.75573141792967388112E-7, 2.48015872888517045348E-5,
+            -1.38888888888730564116E-3, 4.16666666666665929218E-2
+        };
+
+        template <class V>
+        inline void vsincos(V a, V &s, V &cs) {
+            typedef typename V::Mask M;
+            V x = vabs(a);
+
+            // Nearest multiple of pi/4 with an even index, 2k, so that
+            // z is in [-pi/4, pi/4] and k mod 4 is the quadrant.
+            V k = vfloor((vfloor(x*c<V>(1./PIO4))+c<V>(1.))*c<V>(0.5));
+            V y = k+k;
+            V z = ((x-y*c<V>(7.85398125648498535156E-1))
+                    -y*c<V>(3.77489470793079817668E-8))
+                    -y*c<V>(2.69515142907905952645E-15);
+            V zz = z*z;
+            V ps = z+z*zz*polevl(zz, SINCOF, 6);
+            V pc = c<V>(1.)-c<V>(0.5)*zz+zz*zz*polevl(zz, COSCOF, 6);
+
+            V q = k-c<V>(4.)*vfloor(k*c<V>(0.25));
+            M q1 = q == c<V>(1.), q2 = q == c<V>(2.), q3 = q == c<V>(3.);
+            V sn = select(q1, pc, select(q2, -ps, select(q3, -pc, ps)));
+            cs = select(q1, -ps, select(q2, -pc, select(q3, ps, pc)));
+            s = select(a < c<V>(0.), -sn, sn);
+        }
+
+        const double ATAN_P[] = {
+            -8.750608600031904122785E-1, -1.615753718733365076637E1,
+            -7.500855792314704667340E1, -1.228866684490136173410E2,
+            -6.485021904942025371773E1
+        };
+        const double ATAN_Q[] = {
+            2.485846490142306297962E1, 1.650270098316988542046E2,
+            4.328810604912902668951E2, 4.853903996359136964868E2,
+            1.945506571482613964425E2
+        };
+        const double T3P8 = 2.41421356237309504880;
+        const double MOREBITS = 6.123233995736765886130E-17;
+
+        template <class V>
+        inline V vatan(V a) {
+            typedef typename V::Mask M;
+            V x = vabs(a);
+            M big = x > c<V>(T3P8);
+            M mid = andnot(big, x > c<V>(0.66));
+
+            V xr = select(big, c<V>(-1.)/x, select(mid, (x-c<V>(1.))/(x+c<V>(1.)), x));
+            V y = select(big, c<V>(PIO2), select(mid, c<V>(PIO4), c<V>(0.)));
+            V z = xr*xr;
+            z = z*polevl(z, ATAN_P, 5)/p1evl(z, ATAN_Q, 5);
+            z = xr*z+xr;
+            z = z+select(big, c<V>(MOREBITS), select(mid, c<V>(0.5*MOREBITS), c<V>(0.)));
+            y = y+z;
+            return select(a < c<V>(0.), -y, y);
+        }
+
+        template <class V>
+        inline V vatan2(V y, V x) {
+            V r = vatan(y/x);
+            V zero = c<V>(0.);
+            r = r+select(x < zero, select(y >= zero, c<V>(PI), c<V>(-PI)), zero);
+            return select((x == zero) & (y == zero), zero, r);
+        }
+
+        // The conversions, on the W rotations starting at i.
+
+        struct EulerToMatrix {
+            const EulerArrays &e;
+            const MatrixArrays &m;
+
+            template <class V>
+            void apply(size_t i) const {
+                V sx, cx, sy, cy, sz, cz;
+                vsincos(V::load(e.rx+i), sx, cx);
+                vsincos(V::load(e.ry+i), sy, cy);
+                vsincos(V::load(e.rz+i), sz, cz);
+                (cz*cy).store(m.r[0]+i);
+                (cz*sy*sx-sz*cx).store(m.r[1]+i);
+                (cz*sy*cx+sz*sx).store(m.r[2]+i);
+                (sz*cy).store(m.r[3]+i);
+                (sz*sy*sx+cz*cx).store(m.r[4]+i);
+                (sz*sy*cx-cz*sx).store(m.r[5]+i);
+                (-sy).store(m.r[6]+i);
+                (cy*sx).store(m.r[7]+i);
+                (cy*cx).store(m.r[8]+i);
+            }
+        };
+
+        struct EulerToQuaternion {
+            const EulerArrays &e;
+            const QuaternionArrays &q;
+
+            // q = qz*qy*qx, from the half angles.
+            template <class V>
+            void apply(size_t i) const {
+                V h = c<V>(0.5);
+                V sx, cx, sy, cy, sz, cz;
+                vsincos(V::load(e.rx+i)*h, sx, cx);
+                vsincos(V::load(e.ry+i)*h, sy, cy);
+                vsincos(V::load(e.rz+i)*h, sz, cz);
+                V q0 = cx*cy*cz+sx*sy*sz;
+                V q1 = sx*cy*cz-cx*sy*sz;
+                V q2 = cx*sy*cz+sx*cy*sz;
+                V q3 = cx*cy*sz-sx*sy*cz;
+                // Same hemisphere as fixed_matrix2quaternion.
+                typename V::Mask flip = q0 < c<V>(0.);
+                select(flip, -q0, q0).store(q.q0+i);
+                select(flip, -q1, q1).store(q.q1+i);
+                select(flip, -q2, q2).store(q.q2+i);
+                select(flip, -q3, q3).store(q.q3+i);
+            }
+        };
+
+        template <class V>
+        inline void matrix_to_euler(V r0, V r3, V r6, V r7, V r8, double *rx, double *ry, double *rz) {
+            vatan2(r7, r8).store(rx);
+            vatan2(-r6, vsqrt(r0*r0+r3*r3)).store(ry);
+            vatan2(r3, r0).store(rz);
+        }
+
+        struct MatrixToEuler {
+            const MatrixArrays &m;
+            const EulerArrays &e;
+
+            template <class V>
+            void apply(size_t i) const {
+                matrix_to_euler(V::load(m.r[0]+i), V::load(m.r[3]+i), V::load(m.r[6]+i),
+                        V::load(m.r[7]+i), V::load(m.r[8]+i), e.rx+i, e.ry+i, e.rz+i);
+            }
+        };
+
+        struct MatrixToQuaternion {
+            const MatrixArrays &m;
+            const QuaternionArrays &q;
+
+            // Shepperd's method, all four cases computed and selected.
+            template <class V>
+            void apply(size_t i) const {
+                typedef typename V::Mask M;
+                V r[9];
+                for(int k=0; k<9; ++k)
+                    r[k] = V::load(m.r[k]+i);
+
+                V one = c<V>(1.);
+                V t = r[0]+r[4]+r[8];
+                M c0 = (t >= r[0]) & (t >= r[4]) & (t >= r[8]);
+                M c1 = andnot(c0, (r[0] >= r[4]) & (r[0] >= r[8]));
+                M c2 = andnot(c0, andnot(c1, r[4] >= r[8]));
+
+                V d = select(c0, one+t,
+                        select(c1, one+r[0]-r[4]-r[8],
+                        select(c2, one-r[0]+r[4]-r[8], one-r[0]-r[4]+r[8])));
+                V s = c<V>(2.)*vsqrt(d);
+                V inv = one/s;
+                V h = c<V>(0.25)*s;
+
+                V a = (r[7]-r[5])*inv;
+                V b = (r[2]-r[6])*inv;
+                V cc = (r[3]-r[1])*inv;
+                V dd = (r[1]+r[3])*inv;
+                V ee = (r[2]+r[6])*inv;
+                V ff = (r[5]+r[7])*inv;
+
+                V q0 = select(c0, h, select(c1, a, select(c2, b, cc)));
+                V q1 = select(c0, a, select(c1, h, select(c2, dd, ee)));
+                V q2 = select(c0, b, select(c1, dd, select(c2, h, ff)));
+                V q3 = select(c0, cc, select(c1, ee, select(c2, ff, h)));
+
+                M flip = q0 < c<V>(0.);
+                select(flip, -q0, q0).store(q.q0+i);
+                select(flip, -q1, q1).store(q.q1+i);
+                select(flip, -q2, q2).store(q.q2+i);
+                select(flip, -q3, q3).store(q.q3+i);
+            }
+        };
+
+        struct QuaternionToMatrix {
+            const QuaternionArrays &q;
+            const MatrixArrays &m;
+
+            template <class V>
+            void apply(size_t i) const {
+                V q0 = V::load(q.q0+i), q1 = V::load(q.q1+i);
+                V q2 = V::load(q.q2+i), q3 = V::load(q.q3+i);
+                V one = c<V>(1.), two = c<V>(2.);
+                (one-two*(q2*q2+q3*q3)).store(m.r[0]+i);
+                (two*(q1*q2-q0*q3)).store(m.r[1]+i);
+                (two*(q1*q3+q0*q2)).store(m.r[2]+i);
+                (two*(q1*q2+q0*q3)).store(m.r[3]+i);
+                (one-two*(q1*q1+q3*q3)).store(m.r[4]+i);
+                (two*(q2*q3-q0*q1)).store(m.r[5]+i);
+                (two*(q1*q3-q0*q2)).store(m.r[6]+i);
+                (two*(q2*q3+q0*q1)).store(m.r[7]+i);
+                (one-two*(q1*q1+q2*q2)).store(m.r[8]+i);
+            }
+        };
+
+        struct QuaternionToEuler {
+            const QuaternionArrays &q;
+            const EulerArrays &e;
+
+            // Only the five matrix elements the angles need.
+            template <class V>
+            void apply(size_t i) const {
+                V q0 = V::load(q.q0+i), q1 = V::load(q.q1+i);
+                V q2 = V::load(q.q2+i), q3 = V::load(q.q3+i);
+                V one = c<V>(1.), two = c<V>(2.);
+                V r0 = one-two*(q2*q2+q3*q3);
+                V r3 = two*(q1*q2+q0*q3);
+                V r6 = two*(q1*q3-q0*q2);
+                V r7 = two*(q2*q3+q0*q1);
+                V r8 = one-two*(q1*q1+q2*q2);
+                matrix_to_euler(r0, r3, r6, r7, r8, e.rx+i, e.ry+i, e.rz+i);
+            }
+        };
+
+        template <class K>
+        void run(size_t n, const K &k) {
+            size_t i = 0;
+            for(; i+Wide::W<=n; i+=Wide::W)
+                k.template apply<Wide>(i);
+            for(; i<n; ++i)
+                k.template apply<Scalar>(i);
+        }
+
+    }
+
+    void batch_euler_to_matrix(size_t n, const EulerArrays &e, const MatrixArrays &m)
+    {
+        EulerToMatrix k = { e, m };
+        run(n, k);
+    }
+
+    void batch_euler_to_quaternion(size_t n, const EulerArrays &e, const QuaternionArrays &q)
+    {
+        EulerToQuaternion k = { e, q };
+        run(n, k);
+    }
+
+    void batch_matrix_to_euler(size_t n, const MatrixArrays &m, const EulerArrays &e)
+    {
+        MatrixToEuler k = { m, e };
+        run(n, k);
+    }
+
+    void batch_matrix_to_quaternion(size_t n, const MatrixArrays &m, const QuaternionArrays &q)
+    {
+        MatrixToQuaternion k = { m, q };
+        run(n, k);
+    }
+
+    void batch_quaternion_to_euler(size_t n, const QuaternionArrays &q, const EulerArrays &e)
+    {
+        QuaternionToEuler k = { q, e };
+        run(n, k);
+    }
+
+    void batch_quaternion_to_matrix(size_t n, const QuaternionArrays &q, const MatrixArrays &m)
+    {
+        QuaternionToMatrix k = { q, m };
+        run(n, k);
+    }
+
+    const char *batch_kernel_isa()
+    {
+        return ISA;
+    }
+
+}
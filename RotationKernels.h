@@ -0,0 +1,58 @@
+#ifndef _ROTATIONKERNELS_H_
+#define _ROTATIONKERNELS_H_
+
+/**
+ *@file RotationKernels.h
+ *@brief Rotation conversions over whole trajectories at once.
+ *
+ * The batch counterparts of RotationRep's A_to_B conversions, using the
+ * conventions spelled out in FixedPose.h.  Data are structure-of-arrays:
+ * element i of every array belongs to rotation i, so the kernels can work
+ * on 4 (AVX2) or 2 (SSE2) rotations per instruction.  Which one is used is
+ * decided at compile time (/arch:AVX2 or -mavx2 for AVX2); without either
+ * the kernels are plain scalar code.
+ *
+ * Results agree with fixed_euler2matrix() and friends to within 1e-12
+ * (matrix elements, quaternion components, radians) for angles of
+ * reasonable size (|angle| < 1e6).  Near gimbal lock the Euler angles,
+ * as with the scalar code, are only determined up to the usual ambiguity.
+ *
+ * In and out arrays must not overlap.
+ */
+#include <stddef.h>
+
+namespace BVL {
+
+    struct EulerArrays {
+        double *rx, *ry, *rz;
+    };
+
+    /**
+     * q0 is the scalar part.
+     */
+    struct QuaternionArrays {
+        double *q0, *q1, *q2, *q3;
+    };
+
+    /**
+     * r[k][i] is element k (row-major) of rotation i.
+     */
+    struct MatrixArrays {
+        double *r[9];
+    };
+
+    void batch_euler_to_matrix(size_t n, const EulerArrays &e, const MatrixArrays &m);
+    void batch_euler_to_quaternion(size_t n, const EulerArrays &e, const QuaternionArrays &q);
+    void batch_matrix_to_euler(size_t n, const MatrixArrays &m, const EulerArrays &e);
+    void batch_matrix_to_quaternion(size_t n, const MatrixArrays &m, const QuaternionArrays &q);
+    void batch_quaternion_to_euler(size_t n, const QuaternionArrays &q, const EulerArrays &e);
+    void batch_quaternion_to_matrix(size_t n, const QuaternionArrays &q, const MatrixArrays &m);
+
+    /**
+     * "AVX2", "SSE2" or "scalar".
+     */
+    const char *batch_kernel_isa();
+
+}
+
+#endif/*_ROTATIONKERNELS_H_*/
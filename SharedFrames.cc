@@ -0,0 +1,368 @@
+/**
+ *@file SharedFrames.cc
+ *@brief
+ */
+#include <limits.h>
+#include <string.h>
+#include <stdexcept>
+#include "SharedFrames.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+#endif
+
+namespace VML {
+
+    namespace {
+
+        size_t round_up(size_t n, size_t a)
+        {
+            return (n+a-1)/a*a;
+        }
+
+        size_t slot_bytes(int num_markers)
+        {
+            // Whole cache lines, so slots don't share one.
+            return round_up(sizeof(SharedSlot)+num_markers*sizeof(Position3d), 64);
+        }
+
+#ifdef _WIN32
+        std::string windows_name(const std::string &name)
+        {
+            return name.size() && name[0] == '/' ? name.substr(1) : name;
+        }
+#endif
+
+    }
+
+    SharedFrames::SharedFrames()
+        :base(0),
+        length(0),
+        owner(false),
+        header_size(0),
+        slot_size(0),
+        num_slots(0),
+        num_markers(0)
+    {
+#ifdef _WIN32
+        mapping = 0;
+        for(int k=0; k<SharedFramesHeader::NUM_WAITER_COUNTS; ++k) {
+            events[k] = 0;
+            signalled[k] = false;
+        }
+#endif
+    }
+
+    SharedFrames::~SharedFrames()
+    {
+        close();
+    }
+
+    void SharedFrames::create(const std::string &n, int nm, int ns, float frame_frequency)
+    {
+        close();
+
+        uint32_t slots = 1;
+        while(slots < (uint32_t)ns)
+            slots <<= 1;
+        size_t hs = round_up(sizeof(SharedFramesHeader), 64);
+        size_t ss = slot_bytes(nm);
+        map(n, hs+slots*ss, true);
+
+        header_size = (uint32_t)hs;
+        slot_size = (uint32_t)ss;
+        num_slots = slots;
+        num_markers = nm;
+
+        SharedFramesHeader *h = header();
+        h->closed.store(1, std::memory_order_seq_cst); // while we change it
+        memcpy(h->magic, SHARED_FRAMES_MAGIC, sizeof(h->magic));
+        h->version = SharedFramesHeader::VERSION;
+        h->header_size = header_size;
+        h->slot_size = slot_size;
+        h->num_slots = num_slots;
+        h->num_markers = num_markers;
+        h->frame_frequency = frame_frequency;
+        h->head.store(0, std::memory_order_relaxed);
+        h->wake.store(0, std::memory_order_relaxed);
+        for(uint32_t i=0; i<slots; ++i)
+            slot(i)->sequence.store(0, std::memory_order_relaxed);
+        h->closed.store(0, std::memory_order_release);
+    }
+
+    void SharedFrames::open(const std::string &n)
+    {
+        close();
+        map(n, 0, false);
+
+        const SharedFramesHeader *h = header();
+        if(length < sizeof(SharedFramesHeader)
+                || memcmp(h->magic, SHARED_FRAMES_MAGIC, sizeof(h->magic))
+                || h->version != SharedFramesHeader::VERSION
+                || h->num_slots == 0 || (h->num_slots & (h->num_slots-1))
+                || h->slot_size < slot_bytes(h->num_markers)
+                || length < h->header_size+(size_t)h->num_slots*h->slot_size) {
+            close();
+            throw std::runtime_error(n+" doesn't hold published frames.");
+        }
+        header_size = h->header_size;
+        slot_size = h->slot_size;
+        num_slots = h->num_slots;
+        num_markers = h->num_markers;
+    }
+
+    bool SharedFrames::is_closed() const
+    {
+        const SharedFramesHeader *h = header();
+        return h->closed.load(std::memory_order_acquire) != 0
+            || h->num_markers != num_markers || h->slot_size != slot_size || h->num_slots != num_slots;
+    }
+
+    void SharedFrames::publish(const FrameInfo &info, const Position3d *markers)
+    {
+        SharedFramesHeader *h = header();
+        uint64_t i = h->head.load(std::memory_order_relaxed);
+        SharedSlot *s = slot(i);
+
+        // odd: being written
+        s->sequence.store(2*i+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s->frame_number = info.frame_number;
+        s->flags = info.flags;
+        s->host_time = info.host_time;
+        s->num_markers = info.num_markers;
+        memcpy((char *)(s+1), markers, sizeof(Position3d)*num_markers);
+
+        s->sequence.store(2*i+2, std::memory_order_release);
+        h->head.store(i+1, std::memory_order_seq_cst);
+
+#ifdef _WIN32
+        // Paired with the reader's waiters increment: either we see it,
+        // or it sees the new head and doesn't sleep.  The event frame i+1
+        // sets was last set by frame i+1-n: readers still counted on it
+        // looked at the head before then and haven't slept yet, so it's
+        // left set for them.  Four events make that rare; with two, a
+        // reader a frame behind would keep the next frame's readers
+        // spinning.
+        const int n = SharedFramesHeader::NUM_WAITER_COUNTS;
+        const int p = (int)(i%n), q = (int)((i+1)%n);
+        if(signalled[q] && !h->waiters[q].load(std::memory_order_seq_cst)) {
+            ResetEvent(events[q]);
+            signalled[q] = false;
+        }
+        if(!signalled[p] && h->waiters[p].load(std::memory_order_seq_cst)) {
+            SetEvent(events[p]);
+            signalled[p] = true;
+        }
+#else
+        // Paired with the reader's waiters increment: either we see it,
+        // or it sees the new wake value and doesn't sleep.
+        h->wake.store((uint32_t)(i+1), std::memory_order_seq_cst);
+#ifdef __linux__
+        if(h->waiters[i%SharedFramesHeader::NUM_WAITER_COUNTS].load(std::memory_order_seq_cst))
+            syscall(SYS_futex, &h->wake, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+#endif
+#endif
+    }
+
+    bool SharedFrames::read(uint64_t i, FrameInfo &info, Position3d *markers) const
+    {
+        const SharedSlot *s = slot(i);
+        uint64_t seq = s->sequence.load(std::memory_order_acquire);
+        if(seq != 2*i+2)
+            return false;
+
+        info.frame_number = s->frame_number;
+        info.flags = s->flags;
+        info.host_time = s->host_time;
+        info.num_markers = s->num_markers;
+        if(markers)
+            memcpy(markers, (const char *)(s+1), sizeof(Position3d)*num_markers);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return s->sequence.load(std::memory_order_relaxed) == seq;
+    }
+
+#ifdef _WIN32
+
+    void SharedFrames::map(const std::string &n, size_t size, bool create)
+    {
+        std::string w = windows_name(n);
+        if(create) {
+            mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE,
+                    (DWORD)((unsigned long long)size >> 32), (DWORD)size, w.c_str());
+        }else {
+            mapping = OpenFileMappingA(FILE_MAP_WRITE, FALSE, w.c_str());
+        }
+        if(!mapping)
+            throw std::runtime_error("Can't open shared memory "+n);
+
+        base = (char *)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+        if(!base) {
+            close();
+            throw std::runtime_error("MapViewOfFile failed.");
+        }
+        MEMORY_BASIC_INFORMATION mi;
+        VirtualQuery(base, &mi, sizeof(mi));
+        length = mi.RegionSize;
+        // Readers still holding the old segment keep it alive under its
+        // name, and we get it back instead of a new one.
+        if(create && length < size) {
+            close();
+            throw std::runtime_error("Shared memory "+n+" is still open with a smaller layout.");
+        }
+
+        for(int k=0; k<SharedFramesHeader::NUM_WAITER_COUNTS; ++k) {
+            std::string e = w+"_frame"+(char)('0'+k);
+            events[k] = create ? CreateEventA(0, TRUE, FALSE, e.c_str()) : OpenEventA(SYNCHRONIZE, FALSE, e.c_str());
+            if(!events[k]) {
+                close();
+                throw std::runtime_error("Can't open event "+e);
+            }
+            // A reader may still hold it, set by our last close().
+            if(create)
+                ResetEvent(events[k]);
+            signalled[k] = false;
+        }
+        owner = create;
+        name = n;
+    }
+
+    void SharedFrames::wait(uint64_t seen, long long timeout_ns) const
+    {
+        // Frame seen (counting from 0) sets events[seen%n], and it's not
+        // reset while we're counted on it.
+        SharedFramesHeader *h = header();
+        const int k = (int)(seen%SharedFramesHeader::NUM_WAITER_COUNTS);
+        h->waiters[k].fetch_add(1, std::memory_order_seq_cst);
+        if(h->head.load(std::memory_order_seq_cst) <= seen && !is_closed())
+            WaitForSingleObject(events[k], timeout_ns < 0 ? INFINITE : (DWORD)((timeout_ns+999999)/1000000));
+        h->waiters[k].fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void SharedFrames::close()
+    {
+        if(base && owner) {
+            header()->closed.store(1, std::memory_order_release);
+            for(int k=0; k<SharedFramesHeader::NUM_WAITER_COUNTS; ++k)
+                SetEvent(events[k]);
+        }
+        if(base)
+            UnmapViewOfFile(base);
+        for(int k=0; k<SharedFramesHeader::NUM_WAITER_COUNTS; ++k) {
+            if(events[k])
+                CloseHandle(events[k]);
+            events[k] = 0;
+        }
+        if(mapping)
+            CloseHandle(mapping);
+        mapping = 0;
+        base = 0;
+        length = 0;
+        owner = false;
+        num_markers = 0;
+    }
+
+#else
+
+    void SharedFrames::map(const std::string &n, size_t size, bool create)
+    {
+        int fd;
+        if(create) {
+            // A fresh segment, so readers of an old one see it closed
+            // rather than their layout changing under them.
+            shm_unlink(n.c_str());
+            fd = shm_open(n.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+            if(fd >= 0 && ftruncate(fd, size)) {
+                ::close(fd);
+                shm_unlink(n.c_str());
+                fd = -1;
+            }
+        }else {
+            fd = shm_open(n.c_str(), O_RDWR, 0);
+            struct stat st;
+            if(fd >= 0 && fstat(fd, &st) == 0)
+                size = (size_t)st.st_size;
+        }
+        if(fd < 0)
+            throw std::runtime_error("Can't open shared memory "+n);
+
+        void *p = size ? mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if(p == MAP_FAILED) {
+            if(create)
+                shm_unlink(n.c_str());
+            throw std::runtime_error("Can't map shared memory "+n);
+        }
+        base = (char *)p;
+        length = size;
+        owner = create;
+        name = n;
+    }
+
+    void SharedFrames::wait(uint64_t seen, long long timeout_ns) const
+    {
+        SharedFramesHeader *h = header();
+#ifdef __linux__
+        const int k = (int)(seen%SharedFramesHeader::NUM_WAITER_COUNTS);
+        h->waiters[k].fetch_add(1, std::memory_order_seq_cst);
+        uint32_t expected = (uint32_t)seen;
+        if(h->wake.load(std::memory_order_seq_cst) == expected && !is_closed()) {
+            struct timespec ts, *t = 0;
+            if(timeout_ns >= 0) {
+                ts.tv_sec = (time_t)(timeout_ns/1000000000);
+                ts.tv_nsec = (long)(timeout_ns%1000000000);
+                t = &ts;
+            }
+            syscall(SYS_futex, &h->wake, FUTEX_WAIT, expected, t, 0, 0);
+        }
+        h->waiters[k].fetch_sub(1, std::memory_order_relaxed);
+#else
+        // No futex: nap for a fraction of a frame.
+        if(get_head() > seen || is_closed())
+            return;
+        long long nap = (long long)(0.1e9/(h->frame_frequency > 0.f ? h->frame_frequency : 1000.f));
+        if(timeout_ns >= 0 && timeout_ns < nap)
+            nap = timeout_ns;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(nap));
+#endif
+    }
+
+    void SharedFrames::close()
+    {
+        if(!base)
+            return;
+        if(owner) {
+            SharedFramesHeader *h = header();
+            h->closed.store(1, std::memory_order_seq_cst);
+            // Move the wake word so no reader goes back to sleep on it.
+            h->wake.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+            syscall(SYS_futex, &h->wake, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+#endif
+            shm_unlink(name.c_str());
+        }
+        munmap(base, length);
+        base = 0;
+        length = 0;
+        owner = false;
+        num_markers = 0;
+    }
+
+#endif
+
+} // end of namespace
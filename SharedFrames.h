@@ -0,0 +1,149 @@
+#ifndef _SHAREDFRAMES_H_
+#define _SHAREDFRAMES_H_
+
+/**
+ *@file SharedFrames.h
+ *@brief Layout of the shared-memory segment frames are published in, and
+ * the segment itself.
+ *
+ * The segment is a SharedFramesHeader followed by num_slots slots:
+ *
+ *   SharedSlot, Position3d[num_markers], padding to slot_size
+ *
+ * used as a ring with a seqlock per slot, like FrameRing: one process
+ * writes, any number read, and the writer never waits for them.
+ *
+ * Native only: <atomic> can't be included in /clr translation units.
+ * FramePublisher and FrameSubscriber are the /clr-safe front ends.
+ */
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "OptoFrame.h"
+
+namespace VML {
+
+    struct SharedFramesHeader {
+        enum {
+            VERSION=2,
+            NUM_WAITER_COUNTS=4 //< Readers of frame i are counted in waiters[i%NUM_WAITER_COUNTS].
+        };
+
+        char magic[8];              //< "OPTOSHM"
+        uint32_t version;
+        uint32_t header_size;       //< Offset of the first slot.
+        uint32_t slot_size;         //< Bytes per slot, a multiple of 64.
+        uint32_t num_slots;         //< A power of 2.
+        int32_t num_markers;
+        float frame_frequency;
+        std::atomic<uint64_t> head; //< Frames published so far.
+        std::atomic<uint32_t> wake; //< Low half of head, what blocked readers wait on.
+        std::atomic<uint32_t> waiters[NUM_WAITER_COUNTS]; //< Readers blocked, by the frame they wait for, so the writer can skip waking nobody.
+        std::atomic<uint32_t> closed;  //< Set when the writer's gone or the layout changed.
+    };
+
+    struct SharedSlot {
+        std::atomic<uint64_t> sequence; //< 2i+1 while frame i is written, 2i+2 after.
+        uint32_t frame_number;
+        uint32_t flags;
+        int64_t host_time;
+        uint32_t num_markers;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(std::atomic<uint64_t>) == 8 && sizeof(std::atomic<uint32_t>) == 4,
+            "The atomics in shared memory must be plain words.");
+
+    static const char SHARED_FRAMES_MAGIC[8] = { 'O','P','T','O','S','H','M','\0' };
+
+    /**
+     * A named shared-memory segment holding the ring, plus what blocked
+     * readers sleep on: a futex on the header's wake word on Linux, a
+     * ring of named events on Windows.  Errors throw std::runtime_error.
+     *
+     * Names follow POSIX shm_open() ("/optotrak"); on Windows the leading
+     * slash is dropped and "Local\" may be prefixed.
+     */
+    class SharedFrames {
+        public:
+            SharedFrames();
+            ~SharedFrames();
+
+            /**
+             * Writer: create the segment (replacing any of that name)
+             * for num_markers markers in num_slots slots.
+             */
+            void create(const std::string &name, int num_markers, int num_slots, float frame_frequency);
+
+            /**
+             * Reader: map an existing segment.
+             */
+            void open(const std::string &name);
+
+            /**
+             * Unmap.  The writer also marks the segment closed, wakes the
+             * readers and removes the name.
+             */
+            void close();
+
+            bool is_open() const { return base != 0; }
+
+            /**
+             * Writer: publish a frame and wake whoever is waiting.
+             */
+            void publish(const FrameInfo &info, const Position3d *markers);
+
+            /**
+             * Copy frame i (counting from 0 since creation).
+             * @return false if it's been overwritten, or not written yet.
+             */
+            bool read(uint64_t i, FrameInfo &info, Position3d *markers) const;
+
+            /**
+             * Sleep until more than seen frames have been published, the
+             * segment is closed, or timeout_ns has passed (forever if
+             * negative).  May return early; check get_head().
+             */
+            void wait(uint64_t seen, long long timeout_ns) const;
+
+            uint64_t get_head() const { return header()->head.load(std::memory_order_acquire); }
+
+            /**
+             * The writer has gone, or has set the segment up again with
+             * another layout.  Open it again to carry on.
+             */
+            bool is_closed() const;
+
+            int get_num_markers() const { return num_markers; }
+            int get_num_slots() const { return (int)num_slots; }
+            float get_frame_frequency() const { return header()->frame_frequency; }
+
+        private:
+            SharedFramesHeader *header() const { return (SharedFramesHeader *)base; }
+            // The layout is read once, when mapped, so a writer changing
+            // it can't make us read out of bounds.
+            SharedSlot *slot(uint64_t i) const {
+                return (SharedSlot *)(base+header_size+(i & (num_slots-1))*slot_size);
+            }
+
+            void map(const std::string &name, size_t size, bool create);
+
+            char *base;
+            size_t length;
+            bool owner;
+            std::string name;
+            uint32_t header_size, slot_size, num_slots;
+            int num_markers;
+#ifdef _WIN32
+            void *mapping;
+            void *events[SharedFramesHeader::NUM_WAITER_COUNTS];  //< Frame i sets events[i%n] if it's waited for.
+            bool signalled[SharedFramesHeader::NUM_WAITER_COUNTS]; //< Writer's view of the events, so it only calls when one changes.
+#endif
+
+            SharedFrames(const SharedFrames &);
+            SharedFrames &operator=(const SharedFrames &);
+    };
+
+} // end of namespace
+
+#endif/*_SHAREDFRAMES_H_*/
@@ -0,0 +1,222 @@
+/**
+ *@file SimDevice.cc
+ *@brief
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include "OptoFrame.h"
+#include "SimDevice.h"
+
+namespace VML {
+
+    static void sleep_until_ns(long long t)
+    {
+        long long d = t-host_time_ns();
+        if(d > 0)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(d));
+    }
+
+    // splitmix64, for what has to be the same whenever it's asked.
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    SimDevice::SimDevice(const Params &p)
+        :params(p),
+        start_time(host_time_ns()),
+        last_frame(0),
+        requested(false),
+        requested_frame(0),
+        ready_time(0),
+        buffering(false),
+        buffer_total(0),
+        buffer_count(0),
+        buffer_start_time(0),
+        rng(p.seed*2654435761ULL+1)
+    {
+        calls.requests = calls.ready_checks = calls.receives = 0;
+        ports[0] = ports[1] = ports[2] = ports[3] = 0;
+    }
+
+    int SimDevice::setup_collection(const CollectionParams &p)
+    {
+        if(p.num_markers <= 0 || p.frame_frequency <= 0.f)
+            return 1;
+
+        params.num_markers = p.num_markers;
+        params.frame_frequency = p.frame_frequency;
+        params.next_frame = (p.flags & OPTOTRAK_GET_NEXT_FRAME_FLAG) != 0;
+
+        start_time = host_time_ns();
+        last_frame = 0;
+        requested = false;
+        return 0;
+    }
+
+    unsigned int SimDevice::frame_at(long long t) const
+    {
+        return (unsigned int)((t-start_time)*1e-9*params.frame_frequency)+1;
+    }
+
+    long long SimDevice::time_of(unsigned int fn) const
+    {
+        return start_time+(long long)((fn-1)*1e9/params.frame_frequency);
+    }
+
+    double SimDevice::random()
+    {
+        // xorshift64*
+        rng ^= rng >> 12;
+        rng ^= rng << 25;
+        rng ^= rng >> 27;
+        return ((rng*2685821657736338717ULL) >> 11)*(1./9007199254740992.);
+    }
+
+    bool SimDevice::is_missing(int i, unsigned int fn) const
+    {
+        if(!(params.missing_rate > 0.))
+            return false;
+        // Missing if it went missing in any of the last missing_frames frames.
+        const uint64_t key = (uint64_t)params.seed << 48 ^ (uint64_t)i << 32;
+        for(int k=0; k<params.missing_frames && (unsigned int)k<fn; ++k) {
+            if((mix(key ^ (fn-k)) >> 11)*(1./9007199254740992.) < params.missing_rate)
+                return true;
+        }
+        return false;
+    }
+
+    Position3d SimDevice::position(int i, unsigned int fn) const
+    {
+        Position3d p;
+        if(is_missing(i, fn)) {
+            p.x = p.y = p.z = BAD_FLOAT;
+            return p;
+        }
+
+        double x[3];
+        place(i, fn, x);
+        p.x = (float)x[0];
+        p.y = (float)x[1];
+        p.z = (float)x[2];
+        return p;
+    }
+
+    void SimDevice::path(int i, long long t, double *x) const
+    {
+        place(i, 1.+(t-start_time)*1e-9*params.frame_frequency, x);
+    }
+
+    void SimDevice::place(int i, double fn, double *x) const
+    {
+        double t = fn/params.frame_frequency;
+        double phase = 2.*M_PI*(t*0.5+i/(double)params.num_markers);
+        double r = 100.+10.*i;
+
+        x[0] = r*cos(phase);
+        x[1] = r*sin(phase);
+        x[2] = -2000.+i;
+    }
+
+    int SimDevice::get_latest_3d(unsigned int *fn, unsigned int *ne, unsigned int *f, Position3d *p)
+    {
+        request_latest_3d();
+        return receive_latest_3d(fn, ne, f, p);
+    }
+
+    int SimDevice::request_latest_3d()
+    {
+        ++calls.requests;
+        if(requested)
+            return 0;
+
+        long long now = host_time_ns();
+        unsigned int n = frame_at(now);
+        if(params.next_frame && n <= last_frame)
+            n = last_frame+1;
+        while(params.drop_rate > 0. && random() < params.drop_rate)
+            ++n;
+
+        long long t = time_of(n);
+        if(t < now)
+            t = now;
+
+        double delay = params.transfer_time;
+        if(params.jitter > 0.)
+            delay += params.jitter*random();
+
+        requested = true;
+        requested_frame = n;
+        ready_time = t+(long long)(delay*1e9);
+        return 0;
+    }
+
+    bool SimDevice::data_is_ready()
+    {
+        ++calls.ready_checks;
+        return requested && host_time_ns() >= ready_time;
+    }
+
+    int SimDevice::receive_latest_3d(unsigned int *fn, unsigned int *ne, unsigned int *f, Position3d *p)
+    {
+        ++calls.receives;
+        if(!requested)
+            return 1;
+        sleep_until_ns(ready_time);
+        requested = false;
+
+        unsigned int n = requested_frame;
+        last_frame = n;
+        for(int i=0; i<params.num_markers; ++i)
+            p[i] = position(i, n);
+
+        *fn = n;
+        *ne = params.num_markers;
+        *f = 0;
+        return 0;
+    }
+
+    int SimDevice::buffer_start(int num_frames)
+    {
+        if(num_frames <= 0)
+            return 1;
+        buffering = true;
+        buffer_total = num_frames;
+        buffer_count = 0;
+        buffer_start_time = host_time_ns();
+        return 0;
+    }
+
+    int SimDevice::buffer_read(Position3d *p, int max_frames, int *num_frames, bool *complete)
+    {
+        if(!buffering)
+            return 1;
+
+        long long spooled = (long long)((host_time_ns()-buffer_start_time)*1e-9*params.frame_frequency);
+        if(spooled > buffer_total)
+            spooled = buffer_total;
+
+        int n = 0;
+        for(; buffer_count < spooled && n < max_frames; ++buffer_count, ++n) {
+            for(int i=0; i<params.num_markers; ++i)
+                p[n*params.num_markers+i] = position(i, buffer_count+1);
+        }
+
+        *num_frames = n;
+        *complete = buffer_count == buffer_total;
+        return 0;
+    }
+
+    int SimDevice::buffer_stop()
+    {
+        buffering = false;
+        return 0;
+    }
+
+} // end of namespace
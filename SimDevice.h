@@ -0,0 +1,179 @@
+#ifndef _SIMDEVICE_H_
+#define _SIMDEVICE_H_
+
+/**
+ *@file SimDevice.h
+ *@brief A stand-in for the Optotrak, for running the native code without
+ * hardware (or Windows).
+ */
+#include "OptoDevice.h"
+
+namespace VML {
+
+    /**
+     * Frames are produced by the host clock at frame_frequency, starting
+     * when the collection is set up.  Marker i moves on its own circle, so
+     * the data are smooth and every marker is distinguishable.
+     *
+     * setup_collection() takes the marker count, the frame frequency and
+     * OPTOTRAK_GET_NEXT_FRAME_FLAG from its argument; the constructor's
+     * values only matter if it's never called.
+     *
+     * A request made while another is outstanding is folded into it, so
+     * polling with request/data_is_ready works as it does on the real
+     * system.  Transfers can be given random extra delay and frames can
+     * be dropped (the next one is delivered instead), to exercise the
+     * collector the way a busy host or link would.  Markers can go
+     * missing for a few frames at a time, reported with BAD_FLOAT like
+     * an occluded marker.
+     */
+    class SimDevice : public OptoDevice {
+        public:
+            struct Params {
+                Params()
+                    :num_markers(1),
+                    frame_frequency(120.f),
+                    next_frame(true),
+                    transfer_time(0.0002),
+                    jitter(0.),
+                    drop_rate(0.),
+                    missing_rate(0.),
+                    missing_frames(1),
+                    seed(1)
+                {}
+
+                int num_markers;
+                float frame_frequency;
+                bool next_frame; //< Behave as if OPTOTRAK_GET_NEXT_FRAME_FLAG was set.
+                double transfer_time; //< Seconds from a request until the data are ready.
+                double jitter; //< Extra delay on each transfer, up to this many seconds.
+                double drop_rate; //< Chance that a frame never reaches the host.
+                double missing_rate; //< Chance that a marker goes missing in a given frame,
+                int missing_frames;  //< for this many frames from then.
+                unsigned int seed; //< For the jitter, drops and missing markers, so runs repeat.
+            };
+
+            SimDevice(const Params &p);
+
+            int initialize() { return 0; }
+            int shutdown() { return 0; }
+
+            /**
+             * Kept for get_port_count(), and otherwise ignored: every
+             * position of the collection gets a marker.
+             */
+            int set_strober_table(int port1, int port2, int port3, int port4) {
+                ports[0] = port1;
+                ports[1] = port2;
+                ports[2] = port3;
+                ports[3] = port4;
+                return 0;
+            }
+            int setup_collection(const CollectionParams &p);
+            int activate_markers() { return 0; }
+            int deactivate_markers() { return 0; }
+
+            int get_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers);
+
+            int request_latest_3d();
+            bool data_is_ready();
+            int receive_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers);
+
+            /**
+             * Spooled frames become readable as the clock reaches them,
+             * and are numbered from 1 like in real time.
+             */
+            int buffer_start(int num_frames);
+            int buffer_read(Position3d *markers, int max_frames, int *num_frames, bool *complete);
+            int buffer_stop();
+
+            /**
+             * The position of marker i in frame fn.  What the device
+             * reports, so callers can check what they received: BAD_FLOAT
+             * if it's missing.
+             */
+            Position3d position(int i, unsigned int fn) const;
+
+            /**
+             * Where marker i is at host time t (ns), between frames as
+             * well, missing or not: the true path, for checking anything
+             * that estimates it.  Frame fn is taken when it becomes
+             * available, less the transfer.
+             */
+            void path(int i, long long t, double *x) const;
+
+            /**
+             * Marker i is missing from frame fn.  The same for every
+             * call, however the frame is read.
+             */
+            bool is_missing(int i, unsigned int fn) const;
+
+            const Params &get_params() const { return params; }
+
+            /**
+             * Markers on port (1 to 4) in the last set_strober_table(),
+             * 0 if there's been none.
+             */
+            int get_port_count(int port) const { return ports[port-1]; }
+
+            /**
+             * Host time (ns) frame fn was taken, from which its age when
+             * delivered can be measured.
+             */
+            long long get_frame_time(unsigned int fn) const { return time_of(fn); }
+
+            /**
+             * The newest frame taken by host time t, e.g. for a simulated
+             * ODAU on the same clock.
+             */
+            unsigned int get_frame_at(long long t) const { return frame_at(t); }
+
+            /**
+             * A request_latest_3d() hasn't been received yet.  OAPI
+             * allows no other call meanwhile.
+             */
+            bool is_request_pending() const { return requested; }
+
+            /**
+             * Calls made to the real-time data functions so far.
+             */
+            struct Calls {
+                unsigned long long requests;
+                unsigned long long ready_checks;
+                unsigned long long receives;
+            };
+            const Calls &get_calls() const { return calls; }
+
+        private:
+            // The newest frame available at host time t.
+            unsigned int frame_at(long long t) const;
+            // Host time frame fn becomes available.
+            long long time_of(unsigned int fn) const;
+            // Marker i at frame fn, which needn't be whole.
+            void place(int i, double fn, double *x) const;
+            // Uniform in [0,1).
+            double random();
+
+            Params params;
+            int ports[4];
+            long long start_time;
+            unsigned int last_frame;
+
+            bool requested;
+            unsigned int requested_frame;
+            long long ready_time;
+
+            bool buffering;
+            int buffer_total;
+            int buffer_count;
+            long long buffer_start_time;
+
+            unsigned long long rng;
+            Calls calls;
+    };
+
+} // end of namespace
+
+#endif/*_SIMDEVICE_H_*/
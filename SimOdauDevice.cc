@@ -0,0 +1,75 @@
+/**
+ *@file SimOdauDevice.cc
+ *@brief
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include "OptoFrame.h"
+#include "SimOdauDevice.h"
+
+namespace VML {
+
+    SimOdauDevice::SimOdauDevice(const SimDevice &o, double d, unsigned int seed)
+        :optical(o),
+        frame_frequency(o.get_params().frame_frequency),
+        drop_rate(d),
+        rng(seed*2654435761ULL+7),
+        num_calls(0),
+        num_refused(0)
+    {
+    }
+
+    int SimOdauDevice::setup_collection(const OdauParams &p, const CollectionParams &o)
+    {
+        if(p.num_channels < 1 || p.num_channels > 16 || p.samples_per_frame < 1 || p.gain < 1 || o.frame_frequency <= 0.f)
+            return 1;
+        params = p;
+        frame_frequency = o.frame_frequency;
+        return 0;
+    }
+
+    int SimOdauDevice::value(int c, unsigned int fn, int s) const
+    {
+        double t = (fn+s/(double)params.samples_per_frame)/frame_frequency;
+        double v = (1.+c/4.)*sin(2.*M_PI*(c+1)*t);
+        long q = lrint(v*params.gain/params.volts_per_count);
+        if(q > 32767)
+            q = 32767;
+        if(q < -32768)
+            q = -32768;
+        return (int)(q & 0xffff);
+    }
+
+    double SimOdauDevice::volts(int raw) const
+    {
+        return (short)(raw & 0xffff)*params.volts_per_count/params.gain;
+    }
+
+    int SimOdauDevice::get_latest(unsigned int *fn, unsigned int *ne, unsigned int *f, int *data)
+    {
+        ++num_calls;
+        if(optical.is_request_pending()) {
+            ++num_refused;
+            return 1;
+        }
+        if(drop_rate > 0.) {
+            // xorshift64*
+            rng ^= rng >> 12;
+            rng ^= rng << 25;
+            rng ^= rng >> 27;
+            if(((rng*2685821657736338717ULL) >> 11)*(1./9007199254740992.) < drop_rate)
+                return 1;
+        }
+
+        unsigned int n = optical.get_frame_at(host_time_ns());
+        const int nc = params.num_channels, spf = params.samples_per_frame;
+        for(int s=0; s<spf; ++s)
+            for(int c=0; c<nc; ++c)
+                data[s*nc+c] = value(c, n, s);
+        *fn = n;
+        *ne = (unsigned int)(nc*spf);
+        *f = 0;
+        return 0;
+    }
+
+} // end of namespace
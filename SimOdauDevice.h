@@ -0,0 +1,61 @@
+#ifndef _SIMODAUDEVICE_H_
+#define _SIMODAUDEVICE_H_
+
+/**
+ *@file SimOdauDevice.h
+ *@brief A stand-in for the ODAU, on a SimDevice's frame clock.
+ */
+#include "OdauDevice.h"
+#include "SimDevice.h"
+
+namespace VML {
+
+    /**
+     * Channel c is a sine of c+1 Hz and amplitude 1+c/4 V, sampled
+     * samples_per_frame times a frame starting at the frame's time, and
+     * quantized as the ODAU would.  Frames are numbered by the optical
+     * device's clock, so the two line up as on a real system.
+     *
+     * Frames can be lost (the request fails), to exercise the merging.
+     * Like OAPI, it refuses to be read while a request of the optical
+     * device is out; those calls are counted.
+     */
+    class SimOdauDevice : public OdauDevice {
+        public:
+            /**
+             * @param optical Its clock is used.  Must outlive this.
+             * @param drop_rate Chance a get_latest() fails.
+             */
+            SimOdauDevice(const SimDevice &optical, double drop_rate=0., unsigned int seed=1);
+
+            int setup_collection(const OdauParams &p, const CollectionParams &optical);
+            int get_latest(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, int *data);
+
+            /**
+             * Raw value of channel c in scan s of frame fn.  What the
+             * device reports, so callers can check what they received.
+             */
+            int value(int c, unsigned int fn, int s) const;
+
+            /**
+             * Volts that value() stands for.
+             */
+            double volts(int raw) const;
+
+            unsigned long long get_num_calls() const { return num_calls; }
+            unsigned long long get_num_refused() const { return num_refused; }
+
+        private:
+            const SimDevice &optical;
+            OdauParams params;
+            float frame_frequency;
+            double drop_rate;
+            unsigned long long rng;
+            unsigned long long num_calls;
+            unsigned long long num_refused; //< With an optical request out.
+    };
+
+} // end of namespace
+
+#endif/*_SIMODAUDEVICE_H_*/
@@ -0,0 +1,62 @@
+#ifndef _STAGESTATE_H_
+#define _STAGESTATE_H_
+
+/**
+ *@file StageState.h
+ *@brief What a FrameStage shares with the threads reading from it,
+ * replaced by setup() without being freed under them.
+ *
+ * Native only: <atomic> can't be included in /clr translation units.
+ * Stage headers hold a StageState<State> * and forward-declare the
+ * template.
+ */
+#include <atomic>
+#include <vector>
+
+namespace VML {
+
+    /**
+     * The current T, published for readers on any thread.  replace()
+     * puts a new one in; the one it replaces is kept until the
+     * StageState is destroyed, since a reader may still be copying from
+     * it.  Setups are rare (setup_collection(), reconfigure(), a
+     * DerivedGraph growing), so little is kept.
+     */
+    template <class T>
+    class StageState {
+        public:
+            StageState():current(0) {}
+
+            ~StageState() {
+                delete current.load(std::memory_order_relaxed);
+                for(size_t i=0; i<retired.size(); ++i)
+                    delete retired[i];
+            }
+
+            /**
+             * The current state, 0 before the first replace().
+             */
+            T *get() const {
+                return current.load(std::memory_order_acquire);
+            }
+
+            /**
+             * From setup() only, with s ready to be read.
+             */
+            void replace(T *s) {
+                T *old = current.exchange(s, std::memory_order_acq_rel);
+                if(old)
+                    retired.push_back(old);
+            }
+
+        private:
+            std::atomic<T *> current;
+            std::vector<T *> retired;
+
+            StageState(const StageState &);
+            StageState &operator=(const StageState &);
+    };
+
+} // end of namespace
+
+#endif/*_STAGESTATE_H_*/
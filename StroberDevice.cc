@@ -0,0 +1,73 @@
+/**
+ *@file StroberDevice.cc
+ *@brief
+ */
+#include <stddef.h>
+#include "StroberDevice.h"
+
+namespace VML {
+
+    StroberDevice::StroberDevice(OptoDevice *d, const StroberTable &t)
+        :device(d),
+        table(t)
+    {
+    }
+
+    int StroberDevice::setup_collection(const CollectionParams &p)
+    {
+        int err;
+        if( (err = device->set_strober_table(table.get_port_count(1), table.get_port_count(2),
+                        table.get_port_count(3), table.get_port_count(4))) )
+            return err;
+
+        CollectionParams q = p;
+        q.num_markers = table.get_collection_size();
+        scratch.resize((size_t)BLOCK*q.num_markers);
+        return device->setup_collection(q);
+    }
+
+    void StroberDevice::unpack(unsigned int *ne, Position3d *markers)
+    {
+        // The collector checks the count against its own frame size.
+        if(*ne == (unsigned int)table.get_collection_size()) {
+            table.pack(&scratch[0], markers);
+            *ne = table.get_num_markers();
+        }
+    }
+
+    int StroberDevice::get_latest_3d(unsigned int *fn, unsigned int *ne, unsigned int *f, Position3d *markers)
+    {
+        int err = device->get_latest_3d(fn, ne, f, &scratch[0]);
+        if(!err)
+            unpack(ne, markers);
+        return err;
+    }
+
+    int StroberDevice::receive_latest_3d(unsigned int *fn, unsigned int *ne, unsigned int *f, Position3d *markers)
+    {
+        int err = device->receive_latest_3d(fn, ne, f, &scratch[0]);
+        if(!err)
+            unpack(ne, markers);
+        return err;
+    }
+
+    int StroberDevice::buffer_read(Position3d *markers, int max_frames, int *num_frames, bool *complete)
+    {
+        // A block at a time through the scratch frames.
+        int total = 0;
+        *complete = false;
+        while(total < max_frames && !*complete) {
+            int n, want = max_frames-total < BLOCK ? max_frames-total : BLOCK;
+            int err = device->buffer_read(&scratch[0], want, &n, complete);
+            if(err)
+                return err;
+            table.pack(&scratch[0], markers+(size_t)total*table.get_num_markers(), n);
+            total += n;
+            if(n < want)
+                break;
+        }
+        *num_frames = total;
+        return 0;
+    }
+
+} // end of namespace
@@ -0,0 +1,71 @@
+#ifndef _STROBERDEVICE_H_
+#define _STROBERDEVICE_H_
+
+/**
+ *@file StroberDevice.h
+ *@brief An OptoDevice that serves frames in a StroberTable's dense
+ * layout.
+ */
+#include <vector>
+#include "OptoDevice.h"
+#include "StroberTable.h"
+
+namespace VML {
+
+    /**
+     * Wraps the real device: setup_collection() sets the strober port
+     * table and the collection size from the table, whatever num_markers
+     * says, and every read is gathered from the system's layout into the
+     * dense one, so the caller never sees an empty socket.  Everything
+     * else is passed through.
+     *
+     * The scratch frames are allocated in setup_collection().
+     */
+    class StroberDevice : public OptoDevice {
+        public:
+            /**
+             * @param device Not owned.
+             * @param table Copied.
+             */
+            StroberDevice(OptoDevice *device, const StroberTable &table);
+
+            int initialize() { return device->initialize(); }
+            int shutdown() { return device->shutdown(); }
+
+            int set_strober_table(int port1, int port2, int port3, int port4) {
+                return device->set_strober_table(port1, port2, port3, port4);
+            }
+            int setup_collection(const CollectionParams &p);
+            int activate_markers() { return device->activate_markers(); }
+            int deactivate_markers() { return device->deactivate_markers(); }
+
+            int get_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers);
+
+            int request_latest_3d() { return device->request_latest_3d(); }
+            bool data_is_ready() { return device->data_is_ready(); }
+            int receive_latest_3d(unsigned int *frame_number, unsigned int *num_elements,
+                    unsigned int *flags, Position3d *markers);
+
+            int buffer_start(int num_frames) { return device->buffer_start(num_frames); }
+            int buffer_read(Position3d *markers, int max_frames, int *num_frames, bool *complete);
+            int buffer_stop() { return device->buffer_stop(); }
+
+            const StroberTable &get_table() const { return table; }
+
+            enum {
+                BLOCK=64 //< Frames per buffered read.
+            };
+
+        private:
+            // Check and pack a frame read into scratch.
+            void unpack(unsigned int *num_elements, Position3d *markers);
+
+            OptoDevice *device;
+            StroberTable table;
+            std::vector<Position3d> scratch; //< BLOCK frames as sent.
+    };
+
+} // end of namespace
+
+#endif/*_STROBERDEVICE_H_*/
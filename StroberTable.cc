@@ -0,0 +1,95 @@
+/**
+ *@file StroberTable.cc
+ *@brief
+ */
+#include <stdexcept>
+#include "StroberTable.h"
+
+namespace VML {
+
+    StroberTable::StroberTable()
+    {
+        clear();
+    }
+
+    void StroberTable::clear()
+    {
+        for(int p=0; p<NUM_PORTS; ++p) {
+            port_count[p] = 0;
+            last_strober[p] = -1;
+        }
+        strobers.clear();
+        to_device.clear();
+    }
+
+    int StroberTable::add(int port, int n, int sockets)
+    {
+        if(port < 1 || port > NUM_PORTS) {
+            throw std::invalid_argument("Strober ports are numbered 1 to 4.");
+        }
+        if(n <= 0 || sockets < 0) {
+            throw std::invalid_argument("A strober needs at least one marker.");
+        }
+        if(sockets == 0)
+            sockets = DEFAULT_SOCKETS;
+
+        // Whatever was last on the chain now sends all its sockets.
+        int p = port-1;
+        int prev = last_strober[p];
+        if(prev >= 0) {
+            const Strober &s = strobers[prev];
+            int used = s.num_markers;
+            int padded = (used+s.sockets-1)/s.sockets*s.sockets;
+            port_count[p] = s.first+padded;
+        }
+
+        Strober s;
+        s.port = port;
+        s.first = port_count[p];
+        s.sockets = sockets;
+        s.num_markers = n;
+        strobers.push_back(s);
+        last_strober[p] = (int)strobers.size()-1;
+        port_count[p] += n;
+
+        // Dense indices follow the order of addition; device ones are
+        // recomputed since a port's offset moves as earlier ports grow.
+        int dense = (int)to_device.size();
+        to_device.resize(dense+n);
+        int offset[NUM_PORTS];
+        int sum = 0;
+        for(int k=0; k<NUM_PORTS; ++k) {
+            offset[k] = sum;
+            sum += port_count[k];
+        }
+        int i = 0;
+        for(size_t k=0; k<strobers.size(); ++k) {
+            const Strober &t = strobers[k];
+            for(int m=0; m<t.num_markers; ++m)
+                to_device[i++] = offset[t.port-1]+t.first+m;
+        }
+        return dense;
+    }
+
+    int StroberTable::get_collection_size() const
+    {
+        int n = 0;
+        for(int p=0; p<NUM_PORTS; ++p)
+            n += port_count[p];
+        return n;
+    }
+
+    void StroberTable::pack(const Position3d *src, Position3d *dest, int num_frames) const
+    {
+        int n = (int)to_device.size();
+        int size = get_collection_size();
+        const int *map = to_device.empty() ? 0 : &to_device[0];
+        for(int f=0; f<num_frames; ++f) {
+            for(int i=0; i<n; ++i)
+                dest[i] = src[map[i]];
+            src += size;
+            dest += n;
+        }
+    }
+
+} // end of namespace
@@ -0,0 +1,99 @@
+#ifndef _STROBERTABLE_H_
+#define _STROBERTABLE_H_
+
+/**
+ *@file StroberTable.h
+ *@brief Where each marker lands in the frames the system sends, given
+ * which strobers are on which ports.
+ */
+#include <vector>
+#include "OptoFrame.h"
+
+namespace VML {
+
+    /**
+     * The markers as the collector wants them (dense: in the order the
+     * strobers were added, nothing in between) and as the system sends
+     * them.
+     *
+     * The system sends port 1's markers, then port 2's, and so on.  On
+     * one port, strobers are daisy-chained and each reports all of its
+     * sockets, used or not, except the last strober on the chain, whose
+     * trailing empty sockets aren't sent.  So a 1-marker strober followed
+     * by a 6-marker one on the same port takes 1+5+6 = 12 positions, and
+     * the same two on different ports only 7 (cases 2 and 3 in
+     * OptoCollector's notes).
+     *
+     * Pure bookkeeping, no device: the per-port counts go to
+     * OptotrakSetStroberPortTable, their sum is the collection size, and
+     * pack() gathers a received frame into the dense layout.
+     */
+    class StroberTable {
+        public:
+            enum {
+                NUM_PORTS=4,
+                DEFAULT_SOCKETS=6 //< Sockets on a strober, unless told otherwise.
+            };
+
+            StroberTable();
+
+            /**
+             * A strober (or chain of identical ones, if num_markers is
+             * more than sockets) with num_markers markers, chained after
+             * whatever is on port already.
+             * @param port 1 to NUM_PORTS.
+             * @param sockets Markers each strober could carry; 0 for
+             * DEFAULT_SOCKETS.
+             * @return Dense index of its first marker.
+             * Throws std::invalid_argument on a bad port or count.
+             */
+            int add(int port, int num_markers, int sockets=0);
+
+            bool empty() const { return to_device.empty(); }
+            void clear();
+
+            /**
+             * Markers in the dense layout.
+             */
+            int get_num_markers() const { return (int)to_device.size(); }
+
+            /**
+             * Markers the system sends per frame: the smallest collection
+             * that reaches every marker.
+             */
+            int get_collection_size() const;
+
+            /**
+             * Markers sent for port (1 to NUM_PORTS).
+             */
+            int get_port_count(int port) const { return port_count[port-1]; }
+
+            /**
+             * Where dense marker i is in the system's frame.
+             */
+            int device_index(int i) const { return to_device[i]; }
+
+            /**
+             * Copy the markers of num_frames frames from the system's
+             * layout (get_collection_size() each) to the dense one
+             * (get_num_markers() each).  src and dest mustn't overlap.
+             */
+            void pack(const Position3d *src, Position3d *dest, int num_frames=1) const;
+
+        private:
+            struct Strober {
+                int port;
+                int first;   //< Device position of its first socket, counted on its port.
+                int sockets;
+                int num_markers;
+            };
+
+            int port_count[NUM_PORTS];
+            int last_strober[NUM_PORTS]; //< Index in strobers, -1 if none.
+            std::vector<Strober> strobers;
+            std::vector<int> to_device;
+    };
+
+} // end of namespace
+
+#endif/*_STROBERTABLE_H_*/
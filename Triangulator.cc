@@ -0,0 +1,258 @@
+/**
+ *@file Triangulator.cc
+ *@brief
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <thread>
+#include "Triangulator.h"
+
+namespace VML {
+
+    namespace {
+
+        enum {
+            BLOCK=32 //< Markers per pass; the loops always run the whole block.
+        };
+
+        const char MODEL_MAGIC[] = "optotrak-sensors";
+
+        double dot(const double *a, const double *b)
+        {
+            return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
+        }
+
+    }
+
+    Triangulator::Triangulator()
+    {
+    }
+
+    int Triangulator::add_sensor(const SensorModel &s)
+    {
+        sensors.push_back(s);
+        ux.push_back(s.focal*s.axis[0]);
+        uy.push_back(s.focal*s.axis[1]);
+        uz.push_back(s.focal*s.axis[2]);
+        vx.push_back(s.optical[0]);
+        vy.push_back(s.optical[1]);
+        vz.push_back(s.optical[2]);
+        uo.push_back(s.focal*dot(s.axis, s.lens));
+        vo.push_back(dot(s.optical, s.lens));
+        return (int)sensors.size()-1;
+    }
+
+    void Triangulator::load(const std::string &path)
+    {
+        FILE *f = fopen(path.c_str(), "r");
+        if(!f)
+            throw std::runtime_error("Can't open "+path);
+
+        // Blank lines and lines starting with # are skipped.
+        char line[1024], magic[32];
+        int version = 0, n = 0, i = -1;
+        bool ok = true;
+        Triangulator t;
+        while(ok && i < n && fgets(line, sizeof(line), f)) {
+            const char *p = line;
+            while(*p == ' ' || *p == '\t')
+                ++p;
+            if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+                continue;
+            if(i < 0) {
+                ok = sscanf(p, "%31s %d %d", magic, &version, &n) == 3
+                    && std::string(magic) == MODEL_MAGIC && version == 1 && n > 0;
+                i = 0;
+                continue;
+            }
+            SensorModel s;
+            ok = sscanf(p, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                    &s.lens[0], &s.lens[1], &s.lens[2],
+                    &s.axis[0], &s.axis[1], &s.axis[2],
+                    &s.optical[0], &s.optical[1], &s.optical[2],
+                    &s.focal, &s.center, &s.pitch, &s.distortion) == 13
+                && s.focal > 0. && s.pitch > 0.;
+            if(ok) {
+                t.add_sensor(s);
+                ++i;
+            }
+        }
+        ok = ok && i == n;
+        fclose(f);
+        if(!ok)
+            throw std::runtime_error(path+" isn't a sensor model.");
+
+        t.params = params;
+        *this = t;
+    }
+
+    void Triangulator::save(const std::string &path) const
+    {
+        FILE *f = fopen(path.c_str(), "w");
+        if(!f)
+            throw std::runtime_error("Can't create "+path);
+
+        fprintf(f, "%s 1 %d\n", MODEL_MAGIC, get_num_sensors());
+        fprintf(f, "# lens xyz, axis xyz, optical xyz, focal, center, pitch, distortion\n");
+        for(size_t i=0; i<sensors.size(); ++i) {
+            const SensorModel &s = sensors[i];
+            fprintf(f, "%.17g %.17g %.17g  %.17g %.17g %.17g  %.17g %.17g %.17g  %.17g %.17g %.17g %.17g\n",
+                    s.lens[0], s.lens[1], s.lens[2],
+                    s.axis[0], s.axis[1], s.axis[2],
+                    s.optical[0], s.optical[1], s.optical[2],
+                    s.focal, s.center, s.pitch, s.distortion);
+        }
+        if(fclose(f))
+            throw std::runtime_error("Can't write "+path);
+    }
+
+    float Triangulator::project(int i, const double *p) const
+    {
+        const SensorModel &s = sensors[i];
+        double r[3] = { p[0]-s.lens[0], p[1]-s.lens[1], p[2]-s.lens[2] };
+        double depth = dot(s.optical, r);
+        if(depth <= 0.)
+            return BAD_FLOAT;
+        double x = -s.focal*dot(s.axis, r)/depth;
+
+        // Newton on pitch*d*(1+distortion*d^2) = x.
+        double d = x/s.pitch;
+        for(int k=0; k<4; ++k) {
+            double g = s.pitch*d*(1.+s.distortion*d*d)-x;
+            d -= g/(s.pitch*(1.+3.*s.distortion*d*d));
+        }
+        return (float)(s.center+d);
+    }
+
+    /*
+     * Normal equations per marker, summed sensor by sensor over the block:
+     * A = sum w n n', b = sum w d n, with w = 1/|n|^2 so the residuals
+     * n.X-d are distances.  Then X = A^-1 b by cofactors, and the squared
+     * residuals, X'AX-2X'b+sum w d^2, with no second pass over the
+     * sensors.  Lanes past the end of the frame run with every sensor
+     * missing.
+     */
+    void Triangulator::triangulate_block(const float *centroids, int num_markers, Position3d *markers, int &found) const
+    {
+        const int ns = get_num_sensors();
+        double a00[BLOCK], a01[BLOCK], a02[BLOCK], a11[BLOCK], a12[BLOCK], a22[BLOCK];
+        double b0[BLOCK], b1[BLOCK], b2[BLOCK], dd[BLOCK], count[BLOCK];
+        double c[BLOCK], ok[BLOCK];
+        for(int j=0; j<BLOCK; ++j) {
+            a00[j] = a01[j] = a02[j] = a11[j] = a12[j] = a22[j] = 0.;
+            b0[j] = b1[j] = b2[j] = dd[j] = count[j] = 0.;
+        }
+
+        for(int s=0; s<ns; ++s) {
+            const SensorModel &m = sensors[s];
+            for(int j=0; j<BLOCK; ++j) {
+                float v = j < num_markers ? centroids[j*ns+s] : BAD_FLOAT;
+                bool seen = v > MAX_NEGATIVE;
+                c[j] = seen ? v-m.center : 0.;
+                ok[j] = seen ? 1. : 0.;
+            }
+
+            const double sux = ux[s], suy = uy[s], suz = uz[s];
+            const double svx = vx[s], svy = vy[s], svz = vz[s];
+            const double suo = uo[s], svo = vo[s];
+            const double uu = sux*sux+suy*suy+suz*suz, uv = sux*svx+suy*svy+suz*svz, vv = svx*svx+svy*svy+svz*svz;
+            const double pitch = m.pitch, k = m.distortion;
+            for(int j=0; j<BLOCK; ++j) {
+                double d = c[j];
+                double x = pitch*d*(1.+k*d*d);
+                double nx = sux+x*svx, ny = suy+x*svy, nz = suz+x*svz;
+                double r = suo+x*svo;
+                double w = ok[j]/(uu+x*(2.*uv+x*vv));
+                a00[j] += w*nx*nx; a01[j] += w*nx*ny; a02[j] += w*nx*nz;
+                a11[j] += w*ny*ny; a12[j] += w*ny*nz; a22[j] += w*nz*nz;
+                b0[j] += w*nx*r; b1[j] += w*ny*r; b2[j] += w*nz*r;
+                dd[j] += w*r*r;
+                count[j] += ok[j];
+            }
+        }
+
+        // Degenerate lanes come out inf or NaN here and are dropped below.
+        double px[BLOCK], py[BLOCK], pz[BLOCK], det[BLOCK], sq[BLOCK];
+        for(int j=0; j<BLOCK; ++j) {
+            double c00 = a11[j]*a22[j]-a12[j]*a12[j];
+            double c01 = a02[j]*a12[j]-a01[j]*a22[j];
+            double c02 = a01[j]*a12[j]-a02[j]*a11[j];
+            double c11 = a00[j]*a22[j]-a02[j]*a02[j];
+            double c12 = a01[j]*a02[j]-a00[j]*a12[j];
+            double c22 = a00[j]*a11[j]-a01[j]*a01[j];
+            double d = a00[j]*c00+a01[j]*c01+a02[j]*c02;
+            double inv = 1./d;
+            double x = (c00*b0[j]+c01*b1[j]+c02*b2[j])*inv;
+            double y = (c01*b0[j]+c11*b1[j]+c12*b2[j])*inv;
+            double z = (c02*b0[j]+c12*b1[j]+c22*b2[j])*inv;
+            double ax = a00[j]*x+a01[j]*y+a02[j]*z;
+            double ay = a01[j]*x+a11[j]*y+a12[j]*z;
+            double az = a02[j]*x+a12[j]*y+a22[j]*z;
+            px[j] = x;
+            py[j] = y;
+            pz[j] = z;
+            // Relative to the scale of A, so it's a measure of how far
+            // the planes are from sharing a line.
+            double tr = a00[j]+a11[j]+a22[j];
+            det[j] = d/(tr*tr*tr);
+            sq[j] = x*(ax-2.*b0[j])+y*(ay-2.*b1[j])+z*(az-2.*b2[j])+dd[j];
+        }
+
+        const double min_sensors = params.min_sensors < 3 ? 3. : (double)params.min_sensors;
+        const double max_sq = params.max_residual*params.max_residual;
+        for(int j=0; j<num_markers; ++j) {
+            Position3d &p = markers[j];
+            if(count[j] >= min_sensors && det[j] > 1e-9 && sq[j] <= max_sq*count[j]) {
+                p.x = (float)px[j];
+                p.y = (float)py[j];
+                p.z = (float)pz[j];
+                ++found;
+            }else
+                p.x = p.y = p.z = BAD_FLOAT;
+        }
+    }
+
+    int Triangulator::triangulate(const float *centroids, int num_markers, Position3d *markers) const
+    {
+        const int ns = get_num_sensors();
+        int found = 0;
+        for(int i=0; i<num_markers; i+=BLOCK) {
+            int n = num_markers-i < BLOCK ? num_markers-i : BLOCK;
+            triangulate_block(centroids+(size_t)i*ns, n, markers+i, found);
+        }
+        return found;
+    }
+
+    long long Triangulator::triangulate_frames(const float *centroids, int num_frames, int num_markers,
+            Position3d *markers, int num_threads) const
+    {
+        if(num_threads <= 0)
+            num_threads = (int)std::thread::hardware_concurrency();
+        if(num_threads > num_frames)
+            num_threads = num_frames;
+        if(num_threads < 1)
+            num_threads = 1;
+
+        const size_t frame_size = (size_t)num_markers*get_num_sensors();
+        std::vector<long long> found(num_threads, 0);
+        auto work = [&](int t) {
+            int first = (int)((long long)num_frames*t/num_threads);
+            int last = (int)((long long)num_frames*(t+1)/num_threads);
+            for(int f=first; f<last; ++f)
+                found[t] += triangulate(centroids+f*frame_size, num_markers, markers+(size_t)f*num_markers);
+        };
+
+        std::vector<std::thread> threads;
+        for(int t=1; t<num_threads; ++t)
+            threads.push_back(std::thread(work, t));
+        work(0);
+        long long total = found[0];
+        for(int t=1; t<num_threads; ++t) {
+            threads[t-1].join();
+            total += found[t];
+        }
+        return total;
+    }
+
+} // end of namespace
@@ -0,0 +1,117 @@
+#ifndef _TRIANGULATOR_H_
+#define _TRIANGULATOR_H_
+
+/**
+ *@file Triangulator.h
+ *@brief Raw sensor centroids to 3-D on the host, a block of markers at a
+ * time.
+ */
+#include <string>
+#include <vector>
+#include "OptoTypes.h"
+
+namespace VML {
+
+    /**
+     * One linear sensor of a position sensor: a CCD behind a cylindrical
+     * lens.  A marker is imaged at x = pitch*d*(1+distortion*d^2) mm along
+     * the CCD, d = centroid-center pixels, and all it tells is that the
+     * marker is in the plane
+     *
+     *     (focal*axis+x*optical).(X-lens) = 0
+     *
+     * through the lens's axis.  Three or more such planes, from different
+     * sensors, meet at the marker.
+     */
+    struct SensorModel {
+        double lens[3];    //< Centre of the lens, mm.
+        double axis[3];    //< Unit vector along the CCD.
+        double optical[3]; //< Unit vector along the optical axis, towards the markers.
+        double focal;      //< mm
+        double center;     //< Centroid on the optical axis, pixels.
+        double pitch;      //< mm per pixel.
+        double distortion; //< Per pixel^2.
+    };
+
+    /**
+     * Triangulates every marker of a frame from its raw centroids: the
+     * least-squares point of the sensors' planes, each plane weighted to
+     * measure distance in mm.  Centroids come as OPTOTRAK_BUFFER_RAW_FLAG
+     * spools them, num_sensors per marker, in the model's sensor order;
+     * missing ones are below MAX_NEGATIVE.
+     *
+     * NDI's camera parameter files can't be read here, so the model is
+     * our own: built with add_sensor() from a calibration, or load()ed
+     * from a file save() wrote.
+     *
+     * Markers go through in blocks, each a handful of branch-free loops
+     * over structure-of-arrays scratch that the compiler vectorizes (2 or
+     * 4 markers per instruction), and frames can be split over threads.
+     * triangulate() doesn't allocate.  Both are const, so one model can
+     * serve any number of threads.
+     */
+    class Triangulator {
+        public:
+            struct Params {
+                Params()
+                    :max_residual(0.5),
+                    min_sensors(3)
+                {}
+
+                double max_residual; //< RMS distance to the planes, mm, above which a marker is dropped.
+                int min_sensors; //< Sensors that must see a marker.
+            };
+
+            Triangulator();
+
+            /**
+             * @return The sensor's index.
+             */
+            int add_sensor(const SensorModel &s);
+
+            int get_num_sensors() const { return (int)sensors.size(); }
+            const SensorModel &get_sensor(int i) const { return sensors[i]; }
+
+            /**
+             * Read or write the model as text.  Throw std::runtime_error.
+             */
+            void load(const std::string &path);
+            void save(const std::string &path) const;
+
+            /**
+             * Centroid at which sensor i sees the point p, e.g. to make
+             * synthetic raw data.  BAD_FLOAT if it's behind the sensor.
+             */
+            float project(int i, const double *p) const;
+
+            /**
+             * One frame.
+             * @param centroids num_markers*get_num_sensors().
+             * @param markers Room for num_markers.  Markers not seen by
+             * enough sensors, or fitting them badly, get BAD_FLOAT.
+             * @return Markers triangulated.
+             */
+            int triangulate(const float *centroids, int num_markers, Position3d *markers) const;
+
+            /**
+             * num_frames frames back to back, split over num_threads
+             * threads (one per core if 0).
+             * @return Markers triangulated, over all frames.
+             */
+            long long triangulate_frames(const float *centroids, int num_frames, int num_markers,
+                    Position3d *markers, int num_threads=1) const;
+
+            Params params;
+
+        private:
+            void triangulate_block(const float *centroids, int num_markers, Position3d *markers, int &found) const;
+
+            std::vector<SensorModel> sensors;
+            // The plane for image coordinate x is n.X = d with n = u+x*v,
+            // d = uo+x*vo; one array per component, indexed by sensor.
+            std::vector<double> ux, uy, uz, vx, vy, vz, uo, vo;
+    };
+
+} // end of namespace
+
+#endif/*_TRIANGULATOR_H_*/
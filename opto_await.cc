@@ -0,0 +1,224 @@
+/**
+ *@file opto_await.cc
+ *@brief Coroutines awaiting frames with FrameAwaiter.h's next_frame().
+ *
+ * A CollectorCore on a SimDevice that doesn't block (no
+ * OPTOTRAK_GET_NEXT_FRAME_FLAG, so the acquisition thread polls), and
+ * --awaiters coroutines each looping on co_await next_frame().  A stage
+ * logs the frames the thread acquires.  Checks that every coroutine is
+ * resumed for every frame from its first on, in order, with the frame
+ * latest_frame() then gives, and gets -1 from stop_acquisition().
+ * Prints the wake latency, from the frame's host_time to the coroutine
+ * running, by the order the coroutines are resumed in.
+ *
+ * Needs C++20 (-std=c++20, /std:c++20).
+ *
+ * opto_await [--rate Hz] [--markers n] [--awaiters n] [--seconds s]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "FrameAwaiter.h"
+#include "FrameStage.h"
+#include "SimDevice.h"
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "opto_await needs C++20 coroutines."
+#endif
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :rate(500.),
+            markers(20),
+            awaiters(8),
+            seconds(2.)
+        {}
+
+        double rate;
+        int markers;
+        int awaiters;
+        double seconds;
+    };
+
+    // Starts at once, and stays around after finishing for done().
+    struct Task {
+        struct promise_type {
+            Task get_return_object() {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_never initial_suspend() { return std::suspend_never(); }
+            std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        explicit Task(std::coroutine_handle<promise_type> h):handle(h) {}
+        Task(Task &&t):handle(t.handle) { t.handle = 0; }
+        ~Task() {
+            if(handle)
+                handle.destroy();
+        }
+
+        bool done() const { return handle.done(); }
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // The frames the acquisition thread pushed, in order.
+    class FrameLog : public FrameStage {
+        public:
+            void setup(const CollectionParams &) {}
+            void process(const FrameInfo &info, const Position3d *) {
+                frames.push_back(info.frame_number);
+            }
+
+            std::vector<unsigned int> frames;
+    };
+
+    struct Awaiter {
+        Awaiter() :last(0), wrong(0) {}
+
+        std::vector<unsigned int> frames;
+        int last;                       //< What the last co_await gave.
+        long long wrong;                //< Frames latest_frame() disagreed on.
+    };
+
+    // All on the acquisition thread.
+    int resumed = 0;             //< Coroutines resumed for the current frame.
+    unsigned int current = 0;    //< That frame.
+
+    /**
+     * @param latency Wake latencies in ns, by the order the coroutines
+     * were resumed in for a frame.
+     */
+    Task await_frames(CollectorCore &core, int markers, Awaiter &a, std::vector<std::vector<long long> > &latency)
+    {
+        std::vector<Position3d> m(markers);
+        FrameInfo info;
+        for(;;) {
+            int fn = co_await next_frame(core);
+            a.last = fn;
+            if(fn < 0)
+                break;
+            long long now = host_time_ns();
+            // On the acquisition thread, so this is the newest frame.
+            if(!core.latest_frame(info, &m[0]) || info.frame_number != (unsigned int)fn)
+                ++a.wrong;
+            if((unsigned int)fn != current) {
+                current = (unsigned int)fn;
+                resumed = 0;
+            }
+            latency[resumed++].push_back(now-info.host_time);
+            a.frames.push_back((unsigned int)fn);
+        }
+    }
+
+    double percentile(std::vector<long long> v, double p)
+    {
+        if(v.empty())
+            return 0.;
+        size_t k = (size_t)(p*(v.size()-1));
+        std::nth_element(v.begin(), v.begin()+k, v.end());
+        return (double)v[k];
+    }
+
+    bool run(const Options &o)
+    {
+        SimDevice::Params dp;
+        dp.num_markers = o.markers;
+        dp.frame_frequency = (float)o.rate;
+        dp.next_frame = false;
+        SimDevice device(dp);
+
+        FrameLog log;
+        log.frames.reserve((size_t)(o.rate*(o.seconds+1.)));
+        CollectorCore c(&device);
+        c.add_markers(o.markers);
+        c.params.frame_frequency = (float)o.rate;
+        c.add_stage(&log);
+        c.startup();
+        c.start_acquisition();
+
+        // Started here: each runs to its first co_await and is resumed
+        // on the acquisition thread from then on.
+        std::vector<Awaiter> awaiters(o.awaiters);
+        std::vector<std::vector<long long> > latency(o.awaiters);
+        std::vector<Task> tasks;
+        for(int k=0; k<o.awaiters; ++k) {
+            awaiters[k].frames.reserve(log.frames.capacity());
+            latency[k].reserve(log.frames.capacity());
+            tasks.push_back(await_frames(c, o.markers, awaiters[k], latency));
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+        c.stop_acquisition();
+        c.deactivate();
+
+        bool ok = !log.frames.empty();
+        for(int k=0; k<o.awaiters; ++k) {
+            const Awaiter &a = awaiters[k];
+            // Every frame from its first one on, as the thread acquired them.
+            std::vector<unsigned int>::const_iterator first =
+                a.frames.empty() ? log.frames.end() : std::find(log.frames.begin(), log.frames.end(), a.frames[0]);
+            bool all = !a.frames.empty() && first != log.frames.end()
+                && (size_t)(log.frames.end()-first) == a.frames.size()
+                && std::equal(a.frames.begin(), a.frames.end(), first);
+            bool stopped = tasks[k].done() && a.last == -1;
+            printf("awaiter %d: %zu frames from frame %u, %s, %lld wrong, %s\n", k, a.frames.size(),
+                    a.frames.empty() ? 0 : a.frames[0], all ? "all of them" : "SOME MISSED", a.wrong,
+                    stopped ? "-1 on stop" : "NOT STOPPED");
+            ok = ok && all && stopped && !a.wrong;
+        }
+
+        printf("%zu frames at %g Hz, polled; wake latency from the frame's arrival:\n", log.frames.size(), o.rate);
+        for(int k=0; k<o.awaiters; ++k) {
+            if(latency[k].empty())
+                continue;
+            printf("  resumed %d of %d: p50 %.1f us, p99 %.1f us\n", k+1, o.awaiters,
+                    percentile(latency[k], 0.5)*1e-3, percentile(latency[k], 0.99)*1e-3);
+        }
+        return ok;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--rate Hz] [--markers n] [--awaiters n] [--seconds s]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--rate") o.rate = atof(v);
+        else if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--awaiters") o.awaiters = atoi(v);
+        else if(a == "--seconds") o.seconds = atof(v);
+        else usage(argv[0]);
+    }
+    if(!(o.rate > 0.) || o.markers <= 0 || o.awaiters <= 0 || !(o.seconds > 0.))
+        usage(argv[0]);
+
+    try {
+        return run(o) ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,335 @@
+/**
+ *@file opto_bench.cc
+ *@brief Acquisition benchmark against SimDevice.
+ *
+ * Drives a CollectorCore in each mode for a fixed time and reports, per
+ * mode, the time to the first frame, the sustained frame rate,
+ * update_frame() latency percentiles, the age of the frames delivered,
+ * driver calls and heap allocations per frame and CPU use, as JSON so
+ * runs can be compared between versions.  nonblocking_unscheduled is
+ * nonblocking without the RequestScheduler, for comparison.
+ *
+ * opto_bench [--mode all|blocking|nonblocking|nonblocking_unscheduled|acquisition|buffered]
+ *            [--rate Hz] [--markers n] [--seconds s] [--jitter s]
+ *            [--drop p] [--transfer s] [--seed n] [--output file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "CollectorStartup.h"
+#include "FrameStats.h"
+#include "SimDevice.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace VML;
+
+// Every heap allocation in the process goes through here.
+static std::atomic<unsigned long long> num_allocations(0);
+
+void *operator new(size_t n)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(n ? n : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+    struct Options {
+        Options()
+            :mode("all"),
+            rate(500.),
+            markers(24),
+            seconds(5.),
+            jitter(0.0001),
+            drop(0.001),
+            transfer(0.0002),
+            seed(1),
+            output("-")
+        {}
+
+        std::string mode;
+        double rate;
+        int markers;
+        double seconds;
+        double jitter;
+        double drop;
+        double transfer;
+        unsigned int seed;
+        std::string output;
+    };
+
+    struct Result {
+        std::string mode;
+        double wall;                 //< s
+        double cpu;                  //< s, whole process
+        unsigned long long frames;   //< New frames received.
+        unsigned long long calls;    //< update_frame() calls.
+        unsigned long long failures; //< update_frame() returning -1.
+        unsigned long long dropped;  //< Frame numbers skipped.
+        unsigned long long allocations;
+        unsigned long long driver_calls; //< Requests, ready checks and receives.
+        LatencyHistogram update;     //< update_frame(), successful calls.
+        LatencyHistogram age;        //< From a frame being taken to update_frame() returning it.
+        FrameStatsSnapshot stats;
+        StartupTimes startup;
+    };
+
+    double cpu_seconds()
+    {
+#ifdef _WIN32
+        FILETIME c, e, k, u;
+        GetProcessTimes(GetCurrentProcess(), &c, &e, &k, &u);
+        ULARGE_INTEGER kt, ut;
+        kt.LowPart = k.dwLowDateTime; kt.HighPart = k.dwHighDateTime;
+        ut.LowPart = u.dwLowDateTime; ut.HighPart = u.dwHighDateTime;
+        return (kt.QuadPart+ut.QuadPart)*1e-7;
+#else
+        struct rusage r;
+        getrusage(RUSAGE_SELF, &r);
+        return r.ru_utime.tv_sec+r.ru_stime.tv_sec+(r.ru_utime.tv_usec+r.ru_stime.tv_usec)*1e-6;
+#endif
+    }
+
+    SimDevice::Params device_params(const Options &o)
+    {
+        SimDevice::Params p;
+        p.num_markers = o.markers;
+        p.frame_frequency = (float)o.rate;
+        p.transfer_time = o.transfer;
+        p.jitter = o.jitter;
+        p.drop_rate = o.drop;
+        p.seed = o.seed;
+        return p;
+    }
+
+    void setup(CollectorCore &c, const Options &o)
+    {
+        c.add_markers(o.markers);
+        c.params.frame_frequency = (float)o.rate;
+        c.params.collect_time = (float)o.seconds;
+        c.enforce_blocking();
+        start_async(c).get();
+    }
+
+    void add(LatencyHistogram &h, long long ns)
+    {
+        h.counts[LatencyHistogram::bucket_of(ns < 0 ? 0 : ns)]++;
+    }
+
+    // Call update_frame() until the time's up; sleep between calls if
+    // asked, as a reader of the acquisition ring would.
+    void run_updates(CollectorCore &c, const SimDevice &device, const Options &o, Result &r, long long sleep_ns)
+    {
+        long long end = host_time_ns()+(long long)(o.seconds*1e9);
+        int last = -1;
+        for(long long now=host_time_ns(); now<end; ) {
+            long long before = host_time_ns();
+            int fn = c.update_frame();
+            now = host_time_ns();
+            ++r.calls;
+            if(fn < 0) {
+                ++r.failures;
+            }else {
+                add(r.update, now-before);
+                if(fn != last) {
+                    ++r.frames;
+                    add(r.age, now-device.get_frame_time(fn));
+                }
+                last = fn;
+            }
+            if(sleep_ns > 0)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_ns));
+        }
+    }
+
+    class CountingSink : public BufferSink {
+        public:
+            CountingSink():frames(0) {}
+            void consume(int, const Position3d *, int n) { frames += n; }
+            unsigned long long frames;
+    };
+
+    Result run(const std::string &mode, const Options &o)
+    {
+        SimDevice device(device_params(o));
+        CollectorCore c(&device);
+        setup(c, o);
+
+        Result r;
+        r.mode = mode;
+        r.frames = r.calls = r.failures = 0;
+        memset(&r.update, 0, sizeof(r.update));
+        memset(&r.age, 0, sizeof(r.age));
+
+        // Warm up, so first-time costs don't count.
+        for(int i=0; i<10; ++i)
+            c.update_frame_blocking();
+        r.startup = c.get_startup_times();
+        c.reset_stats();
+        // Starting the thread allocates; that's setup, not per frame.
+        if(mode == "acquisition")
+            c.start_acquisition();
+
+        SimDevice::Calls calls0 = device.get_calls();
+        unsigned long long alloc0 = num_allocations.load();
+        double cpu0 = cpu_seconds();
+        long long t0 = host_time_ns();
+
+        if(mode == "blocking") {
+            run_updates(c, device, o, r, 0);
+        }else if(mode == "nonblocking" || mode == "nonblocking_unscheduled") {
+            c.set_nonblocking();
+            c.set_request_scheduling(mode == "nonblocking");
+            run_updates(c, device, o, r, 0);
+        }else if(mode == "acquisition") {
+            // A reader polling at twice the frame rate.
+            run_updates(c, device, o, r, (long long)(0.5e9/o.rate));
+            c.stop_acquisition();
+        }else if(mode == "buffered") {
+            CountingSink sink;
+            c.collect_buffered(sink);
+            r.frames = sink.frames;
+        }
+
+        r.wall = (host_time_ns()-t0)*1e-9;
+        r.cpu = cpu_seconds()-cpu0;
+        r.allocations = num_allocations.load()-alloc0;
+        const SimDevice::Calls &calls = device.get_calls();
+        r.driver_calls = calls.requests+calls.ready_checks+calls.receives
+            -calls0.requests-calls0.ready_checks-calls0.receives;
+        c.get_stats().snapshot(r.stats);
+        r.dropped = r.stats.num_dropped;
+        if(mode == "acquisition")
+            r.frames = r.stats.num_frames;
+        c.deactivate();
+        return r;
+    }
+
+    void write_histogram(FILE *f, const char *name, const LatencyHistogram &h)
+    {
+        fprintf(f, "\"%s\": {\"count\": %llu, \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f}",
+                name, h.total(), h.quantile(0.5)*1e-3, h.quantile(0.99)*1e-3, h.quantile(0.999)*1e-3);
+    }
+
+    void write_json(FILE *f, const Options &o, const std::vector<Result> &results)
+    {
+        fprintf(f, "{\n  \"config\": {\"rate\": %g, \"markers\": %d, \"seconds\": %g, "
+                "\"jitter\": %g, \"drop\": %g, \"transfer\": %g, \"seed\": %u},\n",
+                o.rate, o.markers, o.seconds, o.jitter, o.drop, o.transfer, o.seed);
+        fprintf(f, "  \"results\": [\n");
+        for(size_t i=0; i<results.size(); ++i) {
+            const Result &r = results[i];
+            double per_frame = r.frames ? (double)r.allocations/r.frames : 0.;
+            double calls_per_frame = r.frames ? (double)r.driver_calls/r.frames : 0.;
+            fprintf(f, "    {\"mode\": \"%s\", \"wall_s\": %.4f, \"frames\": %llu, \"frames_per_s\": %.2f, "
+                    "\"calls\": %llu, \"failures\": %llu, \"dropped\": %llu, "
+                    "\"allocations\": %llu, \"allocations_per_frame\": %.4f, \"cpu_fraction\": %.4f, "
+                    "\"driver_calls_per_frame\": %.2f, \"time_to_first_frame_ms\": %.3f,\n      ",
+                    r.mode.c_str(), r.wall, r.frames, r.frames/r.wall,
+                    r.calls, r.failures, r.dropped,
+                    r.allocations, per_frame, r.cpu/r.wall, calls_per_frame, r.startup.first_frame*1e-6);
+            write_histogram(f, "update_frame", r.update);
+            fprintf(f, ",\n      ");
+            write_histogram(f, "frame_age", r.age);
+            fprintf(f, ",\n      ");
+            write_histogram(f, "device_call", r.stats.call);
+            fprintf(f, ",\n      ");
+            write_histogram(f, "frame_interval", r.stats.interval);
+            fprintf(f, "}%s\n", i+1 < results.size() ? "," : "");
+        }
+        fprintf(f, "  ]\n}\n");
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--mode all|blocking|nonblocking|nonblocking_unscheduled|acquisition|buffered]\n"
+                "    [--rate Hz] [--markers n] [--seconds s] [--jitter s] [--drop p]\n"
+                "    [--transfer s] [--seed n] [--output file]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--mode") o.mode = v;
+        else if(a == "--rate") o.rate = atof(v);
+        else if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--seconds") o.seconds = atof(v);
+        else if(a == "--jitter") o.jitter = atof(v);
+        else if(a == "--drop") o.drop = atof(v);
+        else if(a == "--transfer") o.transfer = atof(v);
+        else if(a == "--seed") o.seed = (unsigned int)atoi(v);
+        else if(a == "--output") o.output = v;
+        else usage(argv[0]);
+    }
+    if(o.rate <= 0. || o.markers <= 0 || o.seconds <= 0.)
+        usage(argv[0]);
+
+    const char *modes[] = { "blocking", "nonblocking", "nonblocking_unscheduled", "acquisition", "buffered" };
+    std::vector<Result> results;
+    for(int i=0; i<5; ++i) {
+        if(o.mode == "all" || o.mode == modes[i]) {
+            fprintf(stderr, "%s...\n", modes[i]);
+            results.push_back(run(modes[i], o));
+        }
+    }
+    if(results.empty())
+        usage(argv[0]);
+
+    FILE *f = o.output == "-" ? stdout : fopen(o.output.c_str(), "w");
+    if(!f) {
+        perror(o.output.c_str());
+        return 1;
+    }
+    write_json(f, o, results);
+    if(f != stdout)
+        fclose(f);
+    return 0;
+}
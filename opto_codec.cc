@@ -0,0 +1,335 @@
+/**
+ *@file opto_codec.cc
+ *@brief Compresses and decompresses recordings, and benchmarks the codec.
+ *
+ * compress turns a recording FrameRecorder wrote into a compressed one,
+ * decompress turns it back (positions rounded to the resolution).
+ * bench makes synthetic 500 Hz frames (markers on circles, with noise
+ * and dropouts), compresses them to file and reads them back, checking
+ * that every frame survives to within half a step; it reports the
+ * ratio, encoding speed and decoding speed on 1 to --threads threads.
+ *
+ * opto_codec compress in out [--resolution mm]
+ * opto_codec decompress in out [--threads n]
+ * opto_codec bench [--markers n] [--frames n] [--resolution mm] [--noise mm]
+ *                  [--occlusion p] [--threads n] [--output file]
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CompressedReader.h"
+#include "FrameCodec.h"
+#include "RecordingReader.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :markers(24),
+            frames(200000),
+            resolution(0.01),
+            noise(0.01),
+            occlusion(0.002),
+            threads(4),
+            output("opto_codec.tmp")
+        {}
+
+        int markers;
+        int frames;
+        double resolution;
+        double noise;
+        double occlusion;
+        int threads;
+        std::string output;
+    };
+
+    /*
+     * Writes a compressed recording with stdio, as the blocks come: the
+     * header goes first with no frames, and again at the end.
+     */
+    class CompressedWriter {
+        public:
+            CompressedWriter(const std::string &path, const RecordingHeader &h, double resolution)
+                :encoder(h.num_markers, resolution),
+                header(h),
+                path(path)
+            {
+                memcpy(header.magic, COMPRESSED_MAGIC, sizeof(header.magic));
+                header.header_size = sizeof(RecordingHeader);
+                header.record_size = 0;
+                header.num_records = 0;
+                header.data_size = 0;
+                f = fopen(path.c_str(), "wb");
+                if(!f || fwrite(&header, sizeof(header), 1, f) != 1)
+                    throw std::runtime_error("Can't create "+path);
+            }
+
+            ~CompressedWriter() {
+                if(f)
+                    fclose(f);
+            }
+
+            void add(const FrameInfo &info, const Position3d *markers) {
+                if(encoder.add(info, markers))
+                    write();
+            }
+
+            void close() {
+                if(encoder.flush())
+                    write();
+                bool ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+                ok = fclose(f) == 0 && ok;
+                f = 0;
+                if(!ok)
+                    throw std::runtime_error("Can't write "+path);
+            }
+
+            unsigned long long get_size() const { return sizeof(header)+header.data_size; }
+
+        private:
+            void write() {
+                CodecBlockHeader b;
+                memcpy(&b, encoder.get_block(), sizeof(b));
+                if(fwrite(encoder.get_block(), encoder.get_block_size(), 1, f) != 1)
+                    throw std::runtime_error("Can't write "+path);
+                header.data_size += encoder.get_block_size();
+                header.num_records += b.num_frames;
+            }
+
+            FrameEncoder encoder;
+            RecordingHeader header;
+            std::string path;
+            FILE *f;
+    };
+
+    double seconds_since(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+    }
+
+    void compress(const std::string &in, const std::string &out, double resolution)
+    {
+        RecordingReader r(in);
+        const int nm = r.get_num_markers();
+        CompressedWriter w(out, r.get_header(), resolution);
+        RecordView v = r.records(0, r.get_num_records());
+        for(size_t i=0; i<v.size(); ++i) {
+            FrameInfo info;
+            info.frame_number = v.header(i).frame_number;
+            info.num_markers = (unsigned int)nm;
+            info.flags = v.header(i).flags;
+            info.host_time = v.header(i).host_time;
+            w.add(info, v.markers(i));
+        }
+        w.close();
+        unsigned long long before = sizeof(RecordingHeader)+(unsigned long long)v.size()*r.get_header().record_size;
+        printf("%zu frames, %llu to %llu bytes (%.1fx)\n", v.size(), before, w.get_size(), (double)before/w.get_size());
+    }
+
+    void decompress(const std::string &in, const std::string &out, int threads)
+    {
+        CompressedReader r(in);
+        const int nm = r.get_num_markers();
+        const size_t n = r.get_num_frames();
+        std::vector<FrameInfo> infos(n);
+        std::vector<Position3d> markers(n*nm+1);
+        r.read_all(n ? &infos[0] : 0, &markers[0], threads);
+
+        RecordingHeader h = r.get_header();
+        memcpy(h.magic, RECORDING_MAGIC, sizeof(h.magic));
+        h.header_size = sizeof(RecordingHeader);
+        h.record_size = record_size(nm);
+        h.num_records = n;
+        h.data_size = 0;
+
+        FILE *f = fopen(out.c_str(), "wb");
+        if(!f)
+            throw std::runtime_error("Can't create "+out);
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+        std::vector<char> record(h.record_size, 0);
+        for(size_t i=0; ok && i<n; ++i) {
+            RecordHeader *rh = (RecordHeader *)&record[0];
+            rh->frame_number = infos[i].frame_number;
+            rh->flags = infos[i].flags;
+            rh->host_time = infos[i].host_time;
+            memcpy(&record[sizeof(RecordHeader)], &markers[i*nm], nm*sizeof(Position3d));
+            ok = fwrite(&record[0], record.size(), 1, f) == 1;
+        }
+        ok = fclose(f) == 0 && ok;
+        if(!ok)
+            throw std::runtime_error("Can't write "+out);
+        printf("%zu frames\n", n);
+    }
+
+    int bench(const Options &o)
+    {
+        const int nm = o.markers;
+        RecordingHeader h;
+        memset(&h, 0, sizeof(h));
+        h.version = RecordingHeader::VERSION;
+        h.num_markers = nm;
+        h.frame_frequency = 500.f;
+
+        // Frames are made as they're encoded, so the source isn't timed
+        // with a frame already in cache; the same seed makes them again
+        // for checking.
+        std::vector<Position3d> frame(nm);
+        auto make = [&](int f, std::mt19937 &gen, FrameInfo &info) {
+            std::normal_distribution<double> noise(0., o.noise);
+            std::uniform_real_distribution<double> uniform(0., 1.);
+            info.frame_number = (unsigned int)f+1;
+            info.num_markers = (unsigned int)nm;
+            info.flags = 0;
+            info.host_time = 1000000000LL+f*2000000LL+(long long)(uniform(gen)*20000.);
+            for(int i=0; i<nm; ++i) {
+                double phase = 2.*M_PI*(f/500.*0.5+i/(double)nm);
+                double r = 100.+10.*i;
+                Position3d &p = frame[i];
+                p.x = (float)(r*cos(phase)+noise(gen));
+                p.y = (float)(r*sin(phase)+noise(gen));
+                p.z = (float)(-2250.+200.*sin(phase*0.3)+noise(gen));
+                if(uniform(gen) < o.occlusion)
+                    p.x = p.y = p.z = BAD_FLOAT;
+            }
+        };
+
+        double make_s = 0.;
+        {
+            std::mt19937 gen(1);
+            FrameInfo info;
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            for(int f=0; f<o.frames; ++f)
+                make(f, gen, info);
+            make_s = seconds_since(t0);
+        }
+
+        std::mt19937 gen(1);
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        CompressedWriter w(o.output, h, o.resolution);
+        for(int f=0; f<o.frames; ++f) {
+            FrameInfo info;
+            make(f, gen, info);
+            w.add(info, &frame[0]);
+        }
+        w.close();
+        double encode_s = seconds_since(t0)-make_s;
+        if(encode_s < 1e-9)
+            encode_s = 1e-9;
+
+        const double raw = (double)o.frames*record_size(nm);
+        const double out_bytes = (double)o.frames*(sizeof(FrameInfo)+nm*sizeof(Position3d));
+        printf("%d frames of %d markers at %g mm: %.0f to %llu bytes (%.1fx, %.2f bits per coordinate)\n",
+                o.frames, nm, o.resolution, raw, w.get_size(), raw/w.get_size(),
+                8.*w.get_size()/((double)o.frames*nm*3));
+        printf("%-16s %12.0f frames/s %8.0f MB/s\n", "encode", o.frames/encode_s, raw/encode_s/1e6);
+
+        CompressedReader r(o.output);
+        std::vector<FrameInfo> infos(o.frames);
+        std::vector<Position3d> markers((size_t)o.frames*nm);
+        for(int n=1; n<=o.threads; n*=2) {
+            // Best of a few, the first run pays for faulting the output in.
+            double best = 1e30;
+            for(int k=0; k<3; ++k) {
+                t0 = std::chrono::steady_clock::now();
+                r.read_all(&infos[0], &markers[0], n);
+                best = std::min(best, seconds_since(t0));
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "decode, %d thread%s", n, n > 1 ? "s" : "");
+            printf("%-16s %12.0f frames/s %8.2f GB/s\n", name, o.frames/best, out_bytes/best/1e9);
+        }
+
+        gen.seed(1);
+        double worst = 0.;
+        long long wrong = 0;
+        for(int f=0; f<o.frames; ++f) {
+            FrameInfo info;
+            make(f, gen, info);
+            const FrameInfo &d = infos[f];
+            if(d.frame_number != info.frame_number || d.flags != info.flags || d.host_time != info.host_time)
+                ++wrong;
+            for(int i=0; i<nm; ++i) {
+                const Position3d &a = frame[i], &b = markers[(size_t)f*nm+i];
+                if(is_valid(a) != is_valid(b)) {
+                    ++wrong;
+                    continue;
+                }
+                if(!is_valid(a))
+                    continue;
+                worst = std::max(worst, (double)fabs(a.x-b.x));
+                worst = std::max(worst, (double)fabs(a.y-b.y));
+                worst = std::max(worst, (double)fabs(a.z-b.z));
+            }
+        }
+        remove(o.output.c_str());
+
+        // Half a step, and the float rounding of a coordinate near 2 m.
+        double allowed = o.resolution/2.+1e-3;
+        printf("largest error %.4f mm, %lld frames or markers wrong\n", worst, wrong);
+        return wrong || worst > allowed ? 1 : 0;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s compress in out [--resolution mm]\n"
+                "       %s decompress in out [--threads n]\n"
+                "       %s bench [--markers n] [--frames n] [--resolution mm] [--noise mm]\n"
+                "                [--occlusion p] [--threads n] [--output file]\n", name, name, name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+        usage(argv[0]);
+    std::string mode = argv[1];
+    std::vector<std::string> files;
+    Options o;
+    for(int i=2; i<argc; ++i) {
+        std::string a = argv[i];
+        if(a.compare(0, 2, "--")) {
+            files.push_back(a);
+            continue;
+        }
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--frames") o.frames = atoi(v);
+        else if(a == "--resolution") o.resolution = atof(v);
+        else if(a == "--noise") o.noise = atof(v);
+        else if(a == "--occlusion") o.occlusion = atof(v);
+        else if(a == "--threads") o.threads = atoi(v);
+        else if(a == "--output") o.output = v;
+        else usage(argv[0]);
+    }
+    if(o.markers <= 0 || o.frames <= 0 || !(o.resolution > 0.) || o.threads <= 0)
+        usage(argv[0]);
+
+    try {
+        if(mode == "compress" && files.size() == 2)
+            compress(files[0], files[1], o.resolution);
+        else if(mode == "decompress" && files.size() == 2)
+            decompress(files[0], files[1], o.threads);
+        else if(mode == "bench" && files.empty())
+            return bench(o);
+        else
+            usage(argv[0]);
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,326 @@
+/**
+ *@file opto_derived.cc
+ *@brief Evaluates a DerivedGraph on synthetic frames: accuracy and speed.
+ *
+ * A chain of rigid bodies (4 markers each) moves and turns; the graph has
+ * every body, landmarks on each, the markers, midpoints, segment lengths,
+ * angles, joint angles between neighbouring bodies and velocities, a few
+ * hundred nodes in all.  Each node is checked against a direct
+ * computation from the known poses, then the time per frame is reported
+ * with everything moving, with half the bodies standing still (their
+ * nodes are skipped), and with markers dropping out, next to the time
+ * the rigid body fits alone take.  Fails if a node is wrong.
+ *
+ * opto_derived [--bodies n] [--landmarks n] [--frames n] [--rate Hz]
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "DerivedGraph.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :bodies(10),
+            landmarks(6),
+            frames(20000),
+            rate(500.)
+        {}
+
+        int bodies;
+        int landmarks;  //< Per body.
+        int frames;
+        double rate;
+    };
+
+    const double MODEL[12] = {
+        0., 0., 0.,
+        60., 0., 0.,
+        0., 40., 0.,
+        20., 20., 30.
+    };
+
+    struct Pose {
+        double r[9];
+        double t[3];
+
+        void apply(const double *x, double *y) const {
+            for(int i=0; i<3; ++i)
+                y[i] = r[3*i]*x[0]+r[3*i+1]*x[1]+r[3*i+2]*x[2]+t[i];
+        }
+    };
+
+    // R = Rx(a)*Ry(b)*Rz(c).
+    void cardan(double a, double b, double c, double *r)
+    {
+        double ca = cos(a), sa = sin(a), cb = cos(b), sb = sin(b), cc = cos(c), sc = sin(c);
+        r[0] = cb*cc;            r[1] = -cb*sc;           r[2] = sb;
+        r[3] = sa*sb*cc+ca*sc;   r[4] = -sa*sb*sc+ca*cc;  r[5] = -sa*cb;
+        r[6] = -ca*sb*cc+sa*sc;  r[7] = ca*sb*sc+sa*cc;   r[8] = ca*cb;
+    }
+
+    // Body j in frame f; bodies still >= moving stand still.
+    Pose pose_of(int j, int f, double rate, int moving)
+    {
+        double t = (j < moving ? f : 0)/rate;
+        Pose p;
+        cardan(0.3*sin(t+j), 0.2*sin(1.3*t+0.5*j), 0.5*sin(0.7*t-j), p.r);
+        p.t[0] = 200.*j+50.*sin(t);
+        p.t[1] = 30.*cos(2.*t+j);
+        p.t[2] = -2000.+10.*j;
+        return p;
+    }
+
+    void make_frame(const Options &o, int f, int moving, double occlusion, std::vector<Position3d> &frame)
+    {
+        for(int j=0; j<o.bodies; ++j) {
+            Pose p = pose_of(j, f, o.rate, moving);
+            for(int m=0; m<4; ++m) {
+                double y[3];
+                p.apply(MODEL+3*m, y);
+                Position3d &q = frame[4*j+m];
+                q.x = (float)y[0];
+                q.y = (float)y[1];
+                q.z = (float)y[2];
+                // Deterministic dropouts.
+                unsigned int h = (unsigned int)(f*2654435761u+(4*j+m)*40503u);
+                if(occlusion > 0. && (h >> 8)%10000 < occlusion*10000.)
+                    q.x = q.y = q.z = BAD_FLOAT;
+            }
+        }
+    }
+
+    std::string name(const char *prefix, int j, int k=-1)
+    {
+        char s[64];
+        if(k < 0)
+            snprintf(s, sizeof(s), "%s%d", prefix, j);
+        else
+            snprintf(s, sizeof(s), "%s%d_%d", prefix, j, k);
+        return s;
+    }
+
+    double landmark_x(int j, int k, int a)
+    {
+        return 10.*(k+1)*(a == 0 ? 1. : a == 1 ? -0.5 : 0.25)+j;
+    }
+
+    /*
+     * Declared children before their inputs, on purpose: setup() sorts
+     * them.
+     */
+    void build(DerivedGraph &g, const Options &o)
+    {
+        for(int j=0; j<o.bodies; ++j) {
+            for(int k=0; k<o.landmarks; ++k) {
+                g.velocity(name("v", j, k), name("l", j, k));
+                if(k > 0)
+                    g.distance(name("d", j, k), name("l", j, k-1), name("l", j, k));
+                if(k > 1)
+                    g.angle(name("a", j, k), name("l", j, k-2), name("l", j, k-1), name("l", j, k));
+            }
+            if(j > 0) {
+                g.joint(name("joint", j), name("body", j-1), name("body", j));
+                g.distance(name("segment", j), name("mid", j-1), name("mid", j));
+            }
+            g.midpoint(name("mid", j), name("m", 4*j), name("m", 4*j+1));
+            g.velocity(name("vmid", j), name("mid", j));
+            for(int k=0; k<o.landmarks; ++k) {
+                double x[3] = { landmark_x(j, k, 0), landmark_x(j, k, 1), landmark_x(j, k, 2) };
+                g.landmark(name("l", j, k), name("body", j), x);
+            }
+            g.body(name("body", j), j);
+            for(int m=0; m<4; ++m)
+                g.marker(name("m", 4*j+m), 4*j+m);
+        }
+    }
+
+    double dist(const double *a, const double *b)
+    {
+        return sqrt((a[0]-b[0])*(a[0]-b[0])+(a[1]-b[1])*(a[1]-b[1])+(a[2]-b[2])*(a[2]-b[2]));
+    }
+
+    // Largest difference between the graph and the poses in frame f.
+    double check(const DerivedGraph &g, const Options &o, int f, long long &wrong)
+    {
+        double worst = 0., v[12];
+        std::vector<Pose> poses(o.bodies);
+        for(int j=0; j<o.bodies; ++j)
+            poses[j] = pose_of(j, f, o.rate, o.bodies);
+        // Velocities are compared per frame, so float positions count the
+        // same whatever the rate.
+        auto diff = [&](const std::string &n, const double *expected, int size, double scale=1.) {
+            if(g.get(g.find(n), v) != f+1) {
+                ++wrong;
+                return;
+            }
+            for(int i=0; i<size; ++i)
+                worst = std::max(worst, fabs(v[i]-expected[i])*scale);
+        };
+        for(int j=0; j<o.bodies; ++j) {
+            double l[64][3];
+            for(int k=0; k<o.landmarks && k<64; ++k) {
+                double x[3] = { landmark_x(j, k, 0), landmark_x(j, k, 1), landmark_x(j, k, 2) };
+                poses[j].apply(x, l[k]);
+                diff(name("l", j, k), l[k], 3);
+                double before[3], vel[3];
+                pose_of(j, f-1, o.rate, o.bodies).apply(x, before);
+                for(int i=0; i<3; ++i)
+                    vel[i] = (l[k][i]-before[i])*o.rate;
+                diff(name("v", j, k), vel, 3, 1./o.rate);
+                if(k > 0) {
+                    double d = dist(l[k-1], l[k]);
+                    diff(name("d", j, k), &d, 1);
+                }
+                if(k > 1) {
+                    double u[3], w[3];
+                    for(int i=0; i<3; ++i) {
+                        u[i] = l[k-2][i]-l[k-1][i];
+                        w[i] = l[k][i]-l[k-1][i];
+                    }
+                    double c = (u[0]*w[0]+u[1]*w[1]+u[2]*w[2])/(dist(l[k-2], l[k-1])*dist(l[k], l[k-1]));
+                    double a = acos(std::max(-1., std::min(1., c)));
+                    diff(name("a", j, k), &a, 1);
+                }
+            }
+            if(j > 0) {
+                // Both bodies turn about their own origins, so the joint
+                // angles are those of R_{j-1}^T R_j.
+                const Pose &p = poses[j-1], &c = poses[j];
+                double r[9];
+                for(int a=0; a<3; ++a)
+                    for(int b=0; b<3; ++b)
+                        r[3*a+b] = p.r[a]*c.r[b]+p.r[3+a]*c.r[3+b]+p.r[6+a]*c.r[6+b];
+                double angles[3] = { atan2(-r[5], r[8]), asin(r[2]), atan2(-r[1], r[0]) };
+                diff(name("joint", j), angles, 3);
+            }
+        }
+        return worst;
+    }
+
+    double run(DerivedGraph &g, const Options &o, int moving, double occlusion, double &evaluations)
+    {
+        CollectionParams p;
+        p.num_markers = 4*o.bodies;
+        p.frame_frequency = (float)o.rate;
+        g.setup(p);
+        std::vector<Position3d> frame(p.num_markers);
+        for(int f=0; f<o.frames; ++f) {
+            make_frame(o, f, moving, occlusion, frame);
+            FrameInfo info;
+            info.frame_number = (unsigned int)f+1;
+            info.num_markers = (unsigned int)p.num_markers;
+            info.flags = 0;
+            info.host_time = 0;
+            g.process(info, &frame[0]);
+        }
+        evaluations = g.get_evaluations_per_frame();
+        return g.get_ns_per_frame();
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--bodies n] [--landmarks n] [--frames n] [--rate Hz]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--bodies") o.bodies = atoi(v);
+        else if(a == "--landmarks") o.landmarks = atoi(v);
+        else if(a == "--frames") o.frames = atoi(v);
+        else if(a == "--rate") o.rate = atof(v);
+        else usage(argv[0]);
+    }
+    if(o.bodies <= 0 || o.landmarks < 0 || o.landmarks > 64 || o.frames <= 0 || !(o.rate > 0.))
+        usage(argv[0]);
+
+    try {
+        RigidBodySolver bodies;
+        for(int j=0; j<o.bodies; ++j)
+            bodies.add_body(MODEL, 4, 4*j);
+        DerivedGraph g;
+        g.set_rigid_bodies(bodies);
+        build(g, o);
+
+        // Accuracy: a frame evaluated after a run of others, so the
+        // incremental path is what's checked.
+        CollectionParams p;
+        p.num_markers = 4*o.bodies;
+        p.frame_frequency = (float)o.rate;
+        g.setup(p);
+        std::vector<Position3d> frame(p.num_markers);
+        long long wrong = 0;
+        double worst = 0.;
+        for(int f=0; f<200; ++f) {
+            make_frame(o, f, o.bodies, 0., frame);
+            FrameInfo info = { (unsigned int)f+1, (unsigned int)p.num_markers, 0, 0 };
+            g.process(info, &frame[0]);
+            if(f%50 == 49)
+                worst = std::max(worst, check(g, o, f, wrong));
+        }
+
+        // A still marker's velocity is exactly 0.
+        double v[3];
+        int still = g.find(name("vmid", o.bodies-1));
+        make_frame(o, 200, o.bodies-1, 0., frame);
+        FrameInfo info = { 201, (unsigned int)p.num_markers, 0, 0 };
+        g.process(info, &frame[0]);
+        g.process(info, &frame[0]);
+        if(o.bodies > 1 && (g.get(still, v) < 0 || v[0] != 0. || v[1] != 0. || v[2] != 0.))
+            ++wrong;
+
+        printf("%d nodes, %d markers, %d bodies\n", g.get_num_nodes(), 4*o.bodies, o.bodies);
+        const struct {
+            const char *label;
+            int moving;
+            double occlusion;
+        } runs[] = {
+            { "all moving", o.bodies, 0. },
+            { "half still", o.bodies/2, 0. },
+            { "all still", 0, 0. },
+            { "1% dropouts", o.bodies, 0.01 },
+        };
+        for(size_t i=0; i<sizeof(runs)/sizeof(runs[0]); ++i) {
+            double evaluations;
+            double ns = run(g, o, runs[i].moving, runs[i].occlusion, evaluations);
+            printf("%-12s %8.2f us/frame %8.1f nodes evaluated/frame\n", runs[i].label, ns*1e-3, evaluations);
+        }
+        // For scale: fitting every body, which the moving runs include.
+        {
+            RigidBodySolver fit = bodies;
+            fit.setup(p.num_markers);
+            make_frame(o, 1, o.bodies, 0., frame);
+            const int n = 2000;
+            long long t0 = host_time_ns();
+            for(int f=0; f<n; ++f) {
+                frame[0].x += 1e-3f;
+                fit.solve(&frame[0]);
+            }
+            printf("%-12s %8.2f us/frame\n", "bodies alone", (host_time_ns()-t0)*1e-3/n);
+        }
+
+        // Floats in the frames: the solver sees positions to ~1e-4 mm.
+        printf("largest error %.2e (mm or rad), %lld wrong\n", worst, wrong);
+        return wrong || worst > 1e-2 ? 1 : 0;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
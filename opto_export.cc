@@ -0,0 +1,112 @@
+/**
+ *@file opto_export.cc
+ *@brief Converts a recording to C3D or CSV with FrameExporter.
+ *
+ * Reads a recording (plain or compressed) and feeds its frames to a
+ * FrameExporter as the collector would, except that it waits for the
+ * writer rather than dropping frames.  Reports the frames per second the
+ * writer managed.
+ *
+ * opto_export in out.c3d|out.csv [--decimals n] [--batch n]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "CompressedReader.h"
+#include "FrameExporter.h"
+#include "RecordingReader.h"
+
+using namespace VML;
+
+namespace {
+
+    bool is_compressed(const std::string &path)
+    {
+        char magic[8] = { 0 };
+        FILE *f = fopen(path.c_str(), "rb");
+        if(!f)
+            return false;
+        bool yes = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, COMPRESSED_MAGIC, sizeof(magic));
+        fclose(f);
+        return yes;
+    }
+
+    CollectionParams params_of(const RecordingHeader &h)
+    {
+        CollectionParams p;
+        p.num_markers = h.num_markers;
+        p.frame_frequency = h.frame_frequency;
+        return p;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s in out.c3d|out.csv [--decimals n] [--batch n]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> files;
+    FrameExporter::Params p;
+    p.wait = true;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(a.compare(0, 2, "--")) {
+            files.push_back(a);
+            continue;
+        }
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--decimals") p.decimals = atoi(v);
+        else if(a == "--batch") p.batch_frames = atoi(v);
+        else usage(argv[0]);
+    }
+    if(files.size() != 2)
+        usage(argv[0]);
+
+    try {
+        FrameExporter e(files[1], FrameExporter::format_of(files[1]), p);
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if(is_compressed(files[0])) {
+            CompressedReader r(files[0]);
+            const int nm = r.get_num_markers();
+            e.setup(params_of(r.get_header()));
+            std::vector<FrameInfo> infos(1024);
+            std::vector<Position3d> markers(1024*nm+1);
+            for(size_t i=0; i<r.get_num_frames(); ) {
+                size_t n = r.read(i, infos.size(), &infos[0], &markers[0]);
+                for(size_t k=0; k<n; ++k)
+                    e.process(infos[k], &markers[k*nm]);
+                i += n;
+            }
+        }else{
+            RecordingReader r(files[0]);
+            const int nm = r.get_num_markers();
+            e.setup(params_of(r.get_header()));
+            RecordView v = r.records(0, r.get_num_records());
+            for(size_t i=0; i<v.size(); ++i) {
+                FrameInfo info;
+                info.frame_number = v.header(i).frame_number;
+                info.num_markers = (unsigned int)nm;
+                info.flags = v.header(i).flags;
+                info.host_time = v.header(i).host_time;
+                e.process(info, v.markers(i));
+            }
+        }
+        e.close();
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        printf("%llu frames to %s: writer %.0f frames/s, overall %.0f frames/s\n",
+                e.get_num_written(), files[1].c_str(), e.get_frames_per_second(), e.get_num_written()/s);
+    }catch(const std::exception &x) {
+        fprintf(stderr, "%s\n", x.what());
+        return 1;
+    }
+    return 0;
+}
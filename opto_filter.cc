@@ -0,0 +1,414 @@
+/**
+ *@file opto_filter.cc
+ *@brief MarkerFilter against a plain scalar filter, per filter type.
+ *
+ * Feeds each filter type frames of a few markers: marker 0 steps in x
+ * and moves at constant speed in y, the others wobble, and two go
+ * missing for a while.  Every output is compared with a textbook
+ * implementation of the same filter, one coordinate at a time in double,
+ * which restarts where MarkerFilter says it does.  Then:
+ *
+ * - the step settles on the new position, with the Butterworth's
+ *   overshoot of 4.3%;
+ * - the lag behind the ramp is what the filter's equations give: L =
+ *   v/2πf for One Euro, at f = min_cutoff+beta*(v+L/dt) since its speed
+ *   is taken from the last output; none for the constant-velocity
+ *   Kalman; the biquad's group delay at DC for the Butterworth;
+ * - a marker that went missing comes back exactly where it is seen, and
+ *   is filtered from then on like a new filter's marker, not across the
+ *   gap; while missing it is reported missing;
+ * - once set up, process() doesn't allocate (operator new counted).
+ *
+ * opto_filter [--rate Hz] [--frames n]
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "MarkerFilter.h"
+
+using namespace VML;
+
+// Every allocation in the program, so process() can be seen not to make any.
+static std::atomic<long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    void *p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+    struct Options {
+        Options()
+            :rate(500.),
+            frames(4000)
+        {}
+
+        double rate;
+        int frames;
+    };
+
+    const int MARKERS = 5;        //< Not a multiple of any vector width.
+    const int STEP_FRAME = 100;   //< Marker 0's x steps here...
+    const double STEP = 100.;     //< ...by this, mm.
+    const double SPEED = 100.;    //< Marker 0's y, mm/s.
+    const int GAP_MARKER = 1, GAP_START = 600, GAP_FRAMES = 50;
+    const int BLINK_MARKER = 3, BLINK_FRAME = 900;
+    const double TOLERANCE = 1e-3; //< mm; outputs are floats.
+
+    const char *TYPE_NAMES[] = { "One Euro", "Kalman", "Butterworth" };
+
+    // Marker i's coordinate a at frame k, or false if it's missing then.
+    bool input(const Options &o, int i, int k, double *x)
+    {
+        if(i == GAP_MARKER && k >= GAP_START && k < GAP_START+GAP_FRAMES)
+            return false;
+        if(i == BLINK_MARKER && k == BLINK_FRAME)
+            return false;
+        const double t = k/o.rate;
+        if(i == 0) {
+            x[0] = k >= STEP_FRAME ? STEP : 0.;
+            x[1] = SPEED*t;
+            x[2] = -2000.;
+        }else {
+            for(int a=0; a<3; ++a)
+                x[a] = 100.*i+20.*a+30.*sin(2.*M_PI*(0.7*i+0.3*a)*t)+0.2*sin(977.*k+i+a);
+        }
+        return true;
+    }
+
+    /*
+     * The references, one coordinate, written from the papers rather
+     * than from MarkerFilter.cc.  reset() is where MarkerFilter restarts,
+     * the first frame and a marker's first frame back: the output is the
+     * input, and the state what it would be after that frame.
+     */
+    struct OneEuro {
+        OneEuro(const MarkerFilter::Params &p, double dt) :p(p), dt(dt) {}
+
+        static double alpha(double cutoff, double dt) {
+            double tau = 1./(2.*M_PI*cutoff);
+            return 1./(1.+tau/dt);
+        }
+
+        void reset(double x) {
+            prev = x;
+            dprev = 0.;
+        }
+
+        double step(double x) {
+            double dx = (x-prev)/dt;
+            dprev += alpha(p.d_cutoff, dt)*(dx-dprev);
+            double cutoff = p.min_cutoff+p.beta*fabs(dprev);
+            prev += alpha(cutoff, dt)*(x-prev);
+            return prev;
+        }
+
+        MarkerFilter::Params p;
+        double dt, prev, dprev;
+    };
+
+    struct Kalman {
+        Kalman(const MarkerFilter::Params &p, double dt) :p(p), dt(dt) {}
+
+        // At the measurement, speed unknown.
+        void reset(double x) {
+            s[0] = x;
+            s[1] = 0.;
+            c[0][0] = p.measurement_noise;
+            c[0][1] = c[1][0] = 0.;
+            c[1][1] = 1e6;
+        }
+
+        double step(double x) {
+            // x' = F x, P' = F P F^T + Q, F = [1 dt; 0 1], white-noise acceleration.
+            const double F[2][2] = { { 1., dt }, { 0., 1. } };
+            const double q = p.process_noise;
+            const double Q[2][2] = { { q*dt*dt*dt/3., q*dt*dt/2. }, { q*dt*dt/2., q*dt } };
+            double ps[2], fp[2][2], pp[2][2];
+            for(int r=0; r<2; ++r) {
+                ps[r] = F[r][0]*s[0]+F[r][1]*s[1];
+                for(int k=0; k<2; ++k)
+                    fp[r][k] = F[r][0]*c[0][k]+F[r][1]*c[1][k];
+            }
+            for(int r=0; r<2; ++r) {
+                for(int k=0; k<2; ++k)
+                    pp[r][k] = fp[r][0]*F[k][0]+fp[r][1]*F[k][1]+Q[r][k];
+            }
+            // H = [1 0].
+            double sv = pp[0][0]+p.measurement_noise;
+            double g[2] = { pp[0][0]/sv, pp[1][0]/sv };
+            double e = x-ps[0];
+            for(int r=0; r<2; ++r) {
+                s[r] = ps[r]+g[r]*e;
+                for(int k=0; k<2; ++k)
+                    c[r][k] = pp[r][k]-g[r]*pp[0][k];
+            }
+            return s[0];
+        }
+
+        MarkerFilter::Params p;
+        double dt, s[2], c[2][2];
+    };
+
+    struct Butterworth {
+        // Bilinear transform of w^2/(s^2+sqrt(2)ws+w^2), prewarped.
+        Butterworth(const MarkerFilter::Params &p, double dt) {
+            double K = 2./dt, w = K*tan(M_PI*p.cutoff*dt);
+            double d = K*K+M_SQRT2*K*w+w*w;
+            b[0] = w*w/d;
+            b[1] = 2.*b[0];
+            b[2] = b[0];
+            a[1] = 2.*(w*w-K*K)/d;
+            a[2] = (K*K-M_SQRT2*K*w+w*w)/d;
+        }
+
+        // As if x had always been the input.
+        void reset(double x) {
+            x1 = x2 = y1 = y2 = x;
+        }
+
+        // Direct form I.
+        double step(double x) {
+            double y = b[0]*x+b[1]*x1+b[2]*x2-a[1]*y1-a[2]*y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            return y;
+        }
+
+        double b[3], a[3], x1, x2, y1, y2;
+    };
+
+    // A reference per coordinate, restarting like MarkerFilter.
+    template <class F>
+    struct Reference {
+        Reference(const MarkerFilter::Params &p, double dt)
+            :filters(3*MARKERS, F(p, dt)),
+            seen(MARKERS, false)
+        {}
+
+        // False if marker i is missing.
+        bool step(int i, bool ok, const double *x, double *y) {
+            if(ok) {
+                for(int a=0; a<3; ++a) {
+                    F &f = filters[3*i+a];
+                    if(seen[i]) {
+                        y[a] = f.step(x[a]);
+                    }else {
+                        f.reset(x[a]);
+                        y[a] = x[a];
+                    }
+                }
+            }
+            seen[i] = ok;
+            return ok;
+        }
+
+        std::vector<F> filters;
+        std::vector<bool> seen;
+    };
+
+    struct Result {
+        Result()
+            :worst(0.), wrong(0), allocations(0), settled(0.), overshoot(0.), rise(0), lag(0.),
+            back(true), fresh(0.)
+        {}
+
+        double worst;           //< Largest difference from the reference, mm.
+        long long wrong;        //< Frames with a marker off by more than TOLERANCE.
+        long long allocations;  //< In process().
+        double settled;         //< Marker 0's x at the end, less the step.
+        double overshoot;       //< Of the step, fraction.
+        int rise;               //< Frames from 10% to 90% of the step.
+        double lag;             //< Behind the ramp at the end, mm.
+        bool back;              //< The gap marker: missing while gone, exactly its input when back.
+        double fresh;           //< Largest difference from a new filter after the gap, mm.
+    };
+
+    Position3d position(const double *x)
+    {
+        Position3d p;
+        p.x = (float)x[0];
+        p.y = (float)x[1];
+        p.z = (float)x[2];
+        return p;
+    }
+
+    template <class F>
+    Result run(const Options &o, MarkerFilter::Type type)
+    {
+        MarkerFilter::Params fp;
+        fp.type = type;
+        MarkerFilter filter(fp);
+        // The gap marker on its own, from its first frame back.
+        MarkerFilter after(fp);
+        CollectionParams cp;
+        cp.num_markers = MARKERS;
+        cp.frame_frequency = (float)o.rate;
+        filter.setup(cp);
+        cp.num_markers = 1;
+        after.setup(cp);
+
+        const double dt = 1./o.rate;
+        Reference<F> reference(fp, dt);
+        Result r;
+        std::vector<Position3d> in(MARKERS), out(MARKERS);
+        Position3d one;
+        FrameInfo info, got;
+        info.num_markers = MARKERS;
+        info.flags = 0;
+        info.host_time = 0;
+        double x[MARKERS][3], y[3], peak = -1e300;
+        int t10 = -1, t90 = -1;
+        for(int k=0; k<o.frames; ++k) {
+            bool ok[MARKERS];
+            for(int i=0; i<MARKERS; ++i) {
+                ok[i] = input(o, i, k, x[i]);
+                if(ok[i])
+                    in[i] = position(x[i]);
+                else
+                    in[i].x = in[i].y = in[i].z = BAD_FLOAT;
+            }
+            info.frame_number = k+1;
+            long long before = allocations;
+            filter.process(info, &in[0]);
+            r.allocations += allocations-before;
+            filter.latest_frame(got, &out[0]);
+
+            bool right = got.frame_number == info.frame_number;
+            for(int i=0; i<MARKERS; ++i) {
+                // The reference on what the filter got, floats.
+                double xf[3] = { in[i].x, in[i].y, in[i].z };
+                if(!reference.step(i, ok[i], xf, y)) {
+                    right = right && !is_valid(out[i]);
+                    continue;
+                }
+                const double d[3] = { out[i].x-y[0], out[i].y-y[1], out[i].z-y[2] };
+                for(int a=0; a<3; ++a) {
+                    r.worst = std::max(r.worst, fabs(d[a]));
+                    right = right && fabs(d[a]) <= TOLERANCE;
+                }
+            }
+            r.wrong += !right;
+
+            // The gap.
+            if(k >= GAP_START && k < GAP_START+GAP_FRAMES)
+                r.back = r.back && !is_valid(out[GAP_MARKER]);
+            if(k == GAP_START+GAP_FRAMES) {
+                const Position3d &a = out[GAP_MARKER], &b = in[GAP_MARKER];
+                r.back = r.back && a.x == b.x && a.y == b.y && a.z == b.z;
+            }
+            if(k >= GAP_START+GAP_FRAMES) {
+                after.process(info, &in[GAP_MARKER]);
+                after.latest_frame(got, &one);
+                const Position3d &a = out[GAP_MARKER];
+                const double d[3] = { a.x-one.x, a.y-one.y, a.z-one.z };
+                for(int c=0; c<3; ++c)
+                    r.fresh = std::max(r.fresh, fabs(d[c]));
+            }
+
+            // The step.
+            if(k >= STEP_FRAME) {
+                double v = out[0].x/STEP;
+                peak = std::max(peak, v);
+                if(t10 < 0 && v >= 0.1)
+                    t10 = k;
+                if(t90 < 0 && v >= 0.9)
+                    t90 = k;
+            }
+        }
+        r.settled = out[0].x-STEP;
+        r.overshoot = peak-1.;
+        r.rise = t90-t10;
+        r.lag = SPEED*(o.frames-1)/o.rate-out[0].y;
+        return r;
+    }
+
+    bool check(const Options &o, MarkerFilter::Type type)
+    {
+        Result r;
+        MarkerFilter::Params p;
+        double lag = 0.;
+        if(type == MarkerFilter::ONE_EURO) {
+            r = run<OneEuro>(o, type);
+            // L = v/2πf with f = min_cutoff+beta*s, where the speed s is
+            // taken from the last output, so v+L/dt: a quadratic in L.
+            const double dt = 1./o.rate, a = 2.*M_PI*p.beta/dt, b = 2.*M_PI*(p.min_cutoff+p.beta*SPEED);
+            lag = (sqrt(b*b+4.*a*SPEED)-b)/(2.*a);
+        }else if(type == MarkerFilter::KALMAN) {
+            r = run<Kalman>(o, type);
+        }else {
+            r = run<Butterworth>(o, type);
+            // The biquad's group delay at DC.
+            lag = SPEED*M_SQRT2/(2.*o.rate*tan(M_PI*p.cutoff/o.rate));
+        }
+
+        bool ok = !r.wrong && !r.allocations && fabs(r.settled) < 0.01 && r.back && r.fresh < 1e-4
+            && fabs(r.lag-lag) < 0.01*lag+0.01;
+        if(type == MarkerFilter::BUTTERWORTH)
+            ok = ok && fabs(r.overshoot-0.0432) < 0.005;
+        printf("%s: %lld frames wrong (worst %.2g mm), step rise %.1f ms, overshoot %.2f%%, "
+                "lag %.4f mm (expected %.4f), gap %s (%.2g mm from a new filter), %lld allocations, %s\n",
+                TYPE_NAMES[type], r.wrong, r.worst, 1000.*r.rise/o.rate, 100.*r.overshoot,
+                r.lag, lag, r.back ? "restarted" : "WRONG", r.fresh, r.allocations, ok ? "ok" : "WRONG");
+        return ok;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--rate Hz] [--frames n]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--rate") o.rate = atof(v);
+        else if(a == "--frames") o.frames = atoi(v);
+        else usage(argv[0]);
+    }
+    // Past the gaps, and long enough for the slowest filter to settle.
+    if(!(o.rate > 2.*MarkerFilter::Params().cutoff) || o.frames < BLINK_FRAME+5*(int)o.rate)
+        usage(argv[0]);
+
+    try {
+        bool ok = true;
+        ok = check(o, MarkerFilter::ONE_EURO) && ok;
+        ok = check(o, MarkerFilter::KALMAN) && ok;
+        ok = check(o, MarkerFilter::BUTTERWORTH) && ok;
+        return ok ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
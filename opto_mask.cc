@@ -0,0 +1,263 @@
+/**
+ *@file opto_mask.cc
+ *@brief The validity mask and hold-over, on markers that go missing.
+ *
+ * First scan_valid() against a marker-by-marker is_valid(), on frame
+ * sizes that aren't multiples of 4 (the SSE2 step) or 64 (a word), with
+ * one, two or all three coordinates of a missing marker bad.  Then a
+ * CollectorCore on a SimDevice whose markers go missing for a few frames
+ * at a time, with set_hold_over() off, at 1, at --hold and forever, read
+ * with blocking update_frame() calls and from the acquisition thread:
+ * every frame's mask must say which markers are missing, held ones
+ * included, and a missing marker must read as where it was last seen for
+ * exactly the hold-over's frames (those read, with the thread), then as
+ * missing.
+ *
+ * Built twice: opto_mask with the SSE2 scan where there is one, and
+ * opto_mask_scalar with the scalar scan only.
+ *
+ * opto_mask [--rate Hz] [--markers n] [--frames n] [--hold n]
+ *           [--missing p] [--missing-frames n]
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "MarkerMask.h"
+#include "SimDevice.h"
+
+using namespace VML;
+
+namespace {
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const char *SCAN = "SSE2";
+#else
+    const char *SCAN = "scalar";
+#endif
+
+    struct Options {
+        Options()
+            :rate(2000.),
+            markers(67),
+            frames(2000),
+            hold(5),
+            missing(0.02),
+            missing_frames(8)
+        {}
+
+        double rate;
+        int markers;
+        int frames;
+        int hold;
+        double missing;
+        int missing_frames;
+    };
+
+    // xorshift64*, so runs repeat.
+    unsigned long long rng = 88172645463325252ULL;
+
+    double random()
+    {
+        rng ^= rng >> 12;
+        rng ^= rng << 25;
+        rng ^= rng >> 27;
+        return ((rng*2685821657736338717ULL) >> 11)*(1./9007199254740992.);
+    }
+
+    bool check_scan()
+    {
+        const int sizes[] = { 1, 2, 3, 4, 5, 7, 13, 63, 64, 65, 67, 127, 128, 130, 255 };
+        // Missing coordinates as the Optotrak reports them, and the
+        // boundary is_valid() draws.
+        const float bad[] = { BAD_FLOAT, MAX_NEGATIVE, MAX_NEGATIVE*1.5f };
+        long long frames = 0, wrong = 0;
+        for(size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s) {
+            const int n = sizes[s];
+            std::vector<Position3d> m(n);
+            std::vector<uint64_t> bits(mask_words(n));
+            for(int trial=0; trial<500; ++trial, ++frames) {
+                // Mostly seen, mostly missing, or anything.
+                double p = trial%3 == 0 ? 0.05 : trial%3 == 1 ? 0.95 : random();
+                int expected = 0;
+                for(int i=0; i<n; ++i) {
+                    m[i].x = (float)(1000.*random()-500.);
+                    m[i].y = (float)(1000.*random()-500.);
+                    m[i].z = (float)(-2000.*random());
+                    if(random() < p) {
+                        // One, two or three coordinates bad.
+                        int which = 1+(int)(random()*7.);
+                        float b = bad[(int)(random()*3.)];
+                        if(which & 1) m[i].x = b;
+                        if(which & 2) m[i].y = b;
+                        if(which & 4) m[i].z = b;
+                    }
+                    expected += is_valid(m[i]);
+                }
+                // Garbage in, so unset and unused bits are seen cleared.
+                memset(&bits[0], 0xa5, bits.size()*sizeof(uint64_t));
+                bool ok = scan_valid(&m[0], n, &bits[0]) == expected;
+                for(int i=0; i<n; ++i)
+                    ok = ok && test_bit(&bits[0], i) == is_valid(m[i]);
+                if(n%64)
+                    ok = ok && !(bits.back() >> (n%64));
+                int seen = 0;
+                for_each_valid(&bits[0], n, [&](int i) { ok = ok && is_valid(m[i]); ++seen; });
+                ok = ok && seen == expected;
+                if(!ok)
+                    ++wrong;
+            }
+        }
+        printf("%s scan: %lld frames of 1 to 255 markers, %lld wrong\n", SCAN, frames, wrong);
+        return !wrong;
+    }
+
+    bool same(const Position3d &a, const Position3d &b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    bool check_hold(const Options &o, int hold, bool thread)
+    {
+        SimDevice::Params dp;
+        dp.num_markers = o.markers;
+        dp.frame_frequency = (float)o.rate;
+        dp.missing_rate = o.missing;
+        dp.missing_frames = o.missing_frames;
+        SimDevice device(dp);
+
+        CollectorCore c(&device);
+        c.add_markers(o.markers);
+        c.params.frame_frequency = (float)o.rate;
+        c.enforce_blocking();
+        c.set_hold_over(hold);
+        c.startup();
+        if(thread)
+            c.start_acquisition();
+
+        // Per marker: where it was last seen, and frames received since.
+        std::vector<Position3d> last(o.markers);
+        std::vector<int> age(o.markers, -1);
+        const int limit = hold < 0 ? INT_MAX : hold;
+        long long missing = 0, held = 0, dropped = 0, wrong = 0;
+        int longest = 0, received = 0, previous = -1;
+        while(received < o.frames) {
+            if(thread) {
+                // Most frames, some twice and some not at all.
+                std::this_thread::sleep_for(std::chrono::duration<double>(0.7/o.rate));
+            }
+            int fn = c.update_frame();
+            if(fn < 0) {
+                // No frame in the ring yet.
+                wrong += !thread || received > 0;
+                continue;
+            }
+            // The same frame again doesn't age anything.
+            const bool fresh = fn != previous;
+            previous = fn;
+            received += fresh;
+            const uint64_t *bits = c.get_valid_mask();
+            int seen = 0;
+            bool ok = true;
+            for(int i=0; i<o.markers; ++i) {
+                const bool gone = device.is_missing(i, (unsigned int)fn);
+                ok = ok && test_bit(bits, i) == !gone;
+                const Position3d &p = c.get_position(i);
+                if(!gone) {
+                    ++seen;
+                    last[i] = p;
+                    age[i] = 0;
+                    ok = ok && same(p, device.position(i, (unsigned int)fn));
+                    continue;
+                }
+                if(fresh && age[i] >= 0)
+                    ++age[i];
+                missing += fresh;
+                if(age[i] > 0 && age[i] <= limit) {
+                    held += fresh;
+                    if(age[i] > longest)
+                        longest = age[i];
+                    ok = ok && same(p, last[i]);
+                }else {
+                    dropped += fresh && age[i] > 0;
+                    ok = ok && !is_valid(p);
+                }
+                if(hold && age[i] > 0)
+                    ok = ok && c.get_marker_age(i) == age[i];
+            }
+            if(o.markers%64)
+                ok = ok && !(bits[mask_words(o.markers)-1] >> (o.markers%64));
+            ok = ok && c.get_num_valid() == seen;
+            if(!ok)
+                ++wrong;
+        }
+        c.deactivate();
+
+        char name[32];
+        if(hold < 0)
+            sprintf(name, "forever");
+        else if(hold == 0)
+            sprintf(name, "off");
+        else
+            sprintf(name, "%d frame%s", hold, hold > 1 ? "s" : "");
+        printf("%s, hold-over %s: %d frames, %lld markers missing, %lld held (longest %d frames), %lld dropped, %lld frames wrong\n",
+                thread ? "thread" : "blocking", name, received, missing, held, longest, dropped, wrong);
+
+        // The occlusions have to have tested something.
+        bool ok = !wrong && missing > 0;
+        if(hold > 0)
+            ok = ok && longest == hold && dropped > 0;
+        else if(hold == 0)
+            ok = ok && held == 0;
+        else
+            ok = ok && !dropped;
+        return ok;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--rate Hz] [--markers n] [--frames n] [--hold n]\n"
+                "       [--missing p] [--missing-frames n]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--rate") o.rate = atof(v);
+        else if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--frames") o.frames = atoi(v);
+        else if(a == "--hold") o.hold = atoi(v);
+        else if(a == "--missing") o.missing = atof(v);
+        else if(a == "--missing-frames") o.missing_frames = atoi(v);
+        else usage(argv[0]);
+    }
+    // Longer occlusions than the hold-over, so it's seen to run out.
+    if(!(o.rate > 0.) || o.markers <= 0 || o.frames <= 0 || o.hold < 2
+            || !(o.missing > 0.) || o.missing_frames <= o.hold)
+        usage(argv[0]);
+
+    try {
+        bool ok = check_scan();
+        const int holds[] = { 0, 1, o.hold, -1 };
+        for(int k=0; k<8; ++k)
+            ok = check_hold(o, holds[k%4], k >= 4) && ok;
+        return ok ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,207 @@
+/**
+ *@file opto_odau.cc
+ *@brief Optical and analog frames merged by OdauCore, on simulated devices.
+ *
+ * Runs a CollectorCore on a SimDevice with an OdauCore on a
+ * SimOdauDevice for a while, in each of the ways frames can be read: the
+ * acquisition thread with blocking reads, with requests scheduled with
+ * and without OPTOTRAK_GET_NEXT_FRAME_FLAG, and update_frame() in
+ * nonblocking mode.  Then it reads back every frame still kept and checks
+ * its markers and analog samples against what the devices made.  Reports
+ * the share of frames merged, the frame rate and the time per frame spent
+ * in the collector's stages (the ODAU read included), and fails if any
+ * merged frame is wrong or the ODAU was read with an Optotrak request
+ * out.
+ *
+ * opto_odau [--rate Hz] [--markers n] [--channels n] [--samples n]
+ *           [--seconds s] [--drop p] [--odau-drop p]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "CollectorCore.h"
+#include "CollectorStartup.h"
+#include "OdauCore.h"
+#include "SimDevice.h"
+#include "SimOdauDevice.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :rate(500.),
+            markers(24),
+            channels(8),
+            samples(4),
+            seconds(2.),
+            drop(0.001),
+            odau_drop(0.001)
+        {}
+
+        double rate;
+        int markers;
+        int channels;
+        int samples;
+        double seconds;
+        double drop;
+        double odau_drop;
+    };
+
+    enum Mode {
+        BLOCKING,    //< Acquisition thread, blocking reads.
+        LATEST,      //< Acquisition thread, scheduled requests for the newest frame.
+        NEXT,        //< Acquisition thread, scheduled requests for the next frame.
+        NONBLOCKING  //< update_frame() in nonblocking mode, next frame.
+    };
+
+    const char *MODE_NAMES[] = {
+        "acquisition thread, blocking reads",
+        "acquisition thread, scheduled requests, latest frame",
+        "acquisition thread, scheduled requests, next frame",
+        "nonblocking update_frame(), next frame"
+    };
+
+    void read_nonblocking(CollectorCore &c, double seconds)
+    {
+        long long end = host_time_ns()+(long long)(seconds*1e9);
+        while(host_time_ns() < end) {
+            c.update_frame();
+            long long wait = c.get_scheduler().get_due()-host_time_ns();
+            if(wait > 0)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        }
+    }
+
+    bool run(const Options &o, Mode mode)
+    {
+        SimDevice::Params dp;
+        dp.num_markers = o.markers;
+        dp.frame_frequency = (float)o.rate;
+        dp.drop_rate = o.drop;
+        dp.next_frame = mode != LATEST;
+        SimDevice device(dp);
+        SimOdauDevice odau(device, o.odau_drop);
+
+        // Keep the whole run, so every frame can be checked.
+        const int history = (int)(o.rate*(o.seconds+1.));
+        OdauCore merger(&odau, history);
+        merger.params.num_channels = o.channels;
+        merger.params.samples_per_frame = o.samples;
+
+        CollectorCore c(&device);
+        c.add_markers(o.markers);
+        c.params.frame_frequency = (float)o.rate;
+        c.params.collect_time = (float)o.seconds;
+        if(mode != LATEST)
+            c.enforce_blocking();
+        if(mode != BLOCKING)
+            c.set_nonblocking();
+        c.add_stage(&merger);
+        start_async(c).get();
+
+        c.reset_stats();
+        if(mode == NONBLOCKING) {
+            read_nonblocking(c, o.seconds);
+        }else {
+            c.start_acquisition();
+            std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+            c.stop_acquisition();
+        }
+        c.deactivate();
+        c.remove_stage(&merger);
+
+        FrameStatsSnapshot stats;
+        c.get_stats().snapshot(stats);
+
+        // Every frame kept, newest first.
+        MergedFrame f;
+        long long checked = 0, wrong = 0;
+        double worst_mm = 0., worst_v = 0.;
+        const double step = merger.params.volts_per_count/merger.params.gain;
+        for(long long fn=merger.get_latest_frame(); fn>0; --fn) {
+            if(!merger.read((unsigned int)fn, f))
+                continue;
+            ++checked;
+            if(f.info.frame_number != fn || f.num_scans != o.samples) {
+                ++wrong;
+                continue;
+            }
+            for(int i=0; i<o.markers; ++i) {
+                Position3d a = device.position(i, (unsigned int)fn), b = f.markers[i];
+                if(is_valid(a) != is_valid(b)) {
+                    ++wrong;
+                    continue;
+                }
+                if(!is_valid(a))
+                    continue;
+                worst_mm = std::max(worst_mm, (double)fabs(a.x-b.x)+fabs(a.y-b.y)+fabs(a.z-b.z));
+            }
+            for(int ch=0; ch<o.channels; ++ch) {
+                const float *v = f.channel(ch);
+                for(int s=0; s<o.samples; ++s)
+                    worst_v = std::max(worst_v, fabs(v[s]-odau.volts(odau.value(ch, (unsigned int)fn, s))));
+            }
+        }
+
+        const double frames = (double)stats.num_frames;
+        printf("%s\n", MODE_NAMES[mode]);
+        printf("%llu optical frames (%.0f/s), %llu ODAU frames, %llu merged (%.1f%%), %llu ODAU failures\n",
+                stats.num_frames, frames/o.seconds, merger.get_num_analog(), merger.get_num_merged(),
+                frames > 0. ? 100.*merger.get_num_merged()/frames : 0., merger.get_num_failures());
+        printf("%d channels at %g Hz; stages per frame p50 %.2f us, p99 %.2f us\n",
+                o.channels, merger.get_scan_frequency(),
+                stats.process.quantile(0.5)*1e-3, stats.process.quantile(0.99)*1e-3);
+        printf("%lld frames checked, %lld wrong, largest errors %.4f mm, %.6f V\n",
+                checked, wrong, worst_mm, worst_v);
+        printf("%llu ODAU reads with an Optotrak request out\n\n", odau.get_num_refused());
+
+        // Volts are stored as floats: allow their rounding, well under a step.
+        return checked > 0 && !wrong && worst_mm == 0. && worst_v < step/2. && !odau.get_num_refused();
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--rate Hz] [--markers n] [--channels n] [--samples n]\n"
+                "       [--seconds s] [--drop p] [--odau-drop p]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--rate") o.rate = atof(v);
+        else if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--channels") o.channels = atoi(v);
+        else if(a == "--samples") o.samples = atoi(v);
+        else if(a == "--seconds") o.seconds = atof(v);
+        else if(a == "--drop") o.drop = atof(v);
+        else if(a == "--odau-drop") o.odau_drop = atof(v);
+        else usage(argv[0]);
+    }
+    if(!(o.rate > 0.) || o.markers <= 0 || !(o.seconds > 0.))
+        usage(argv[0]);
+
+    try {
+        bool ok = true;
+        for(int m=BLOCKING; m<=NONBLOCKING; ++m)
+            ok = run(o, (Mode)m) && ok;
+        return ok ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,320 @@
+/**
+ *@file opto_reconfigure.cc
+ *@brief Switching profiles live, with outputs and readers attached.
+ *
+ * Runs a CollectorCore on a SimDevice, with a FrameRecorder, a C3D
+ * FrameExporter, a MarkerFilter, a FrameResampler, an OdauCore and a
+ * DerivedGraph attached, and switches back and forth between two
+ * profiles (--rate-a Hz with --markers-a, --rate-b Hz with --markers-b)
+ * with reconfigure() while the acquisition thread runs.  Meanwhile one
+ * thread per stage reads its frames the way a display would.  Checks
+ * that:
+ *
+ * - the frame buffer is reused, since the smaller frame fits;
+ * - each reader keeps getting frames of one profile's size or the
+ *   other's, with the markers where the device put them, after every
+ *   switch;
+ * - the recording and the export go on in trial.1.rec, trial.2.rec, ...
+ *   and trial.1.c3d, ..., each with the frame size and rate of its
+ *   profile and some frames in it.
+ *
+ * The files are written at --path (trial.rec and trial.c3d from it) and
+ * removed if everything checks out.
+ *
+ * opto_reconfigure [--path trial] [--switches n] [--seconds s]
+ *                  [--rate-a Hz] [--markers-a n] [--rate-b Hz] [--markers-b n]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "DerivedGraph.h"
+#include "FrameExporter.h"
+#include "FrameRecorder.h"
+#include "FrameResampler.h"
+#include "MarkerFilter.h"
+#include "OdauCore.h"
+#include "RecordingReader.h"
+#include "SimDevice.h"
+#include "SimOdauDevice.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :path("trial"),
+            switches(6),
+            seconds(0.3),
+            rate_a(500.),
+            markers_a(24),
+            rate_b(100.),
+            markers_b(8)
+        {}
+
+        std::string path;
+        int switches;
+        double seconds; //< Spent in each profile.
+        double rate_a;
+        int markers_a;  //< Also the markers added, so the larger frame.
+        double rate_b;
+        int markers_b;
+    };
+
+    enum Reader {
+        FILTER,
+        RESAMPLER,
+        ODAU,
+        DERIVED,
+        NUM_READERS
+    };
+
+    const char *READER_NAMES[NUM_READERS] = { "filter", "resampler", "ODAU", "derived" };
+
+    struct Readers {
+        Readers()
+            :stop(false)
+        {
+            for(int k=0; k<NUM_READERS; ++k) {
+                reads[k] = 0;
+                wrong[k] = 0;
+            }
+            filter_markers = 0;
+        }
+
+        std::atomic<bool> stop;
+        std::atomic<long long> reads[NUM_READERS]; //< Frames read.
+        std::atomic<long long> wrong[NUM_READERS];
+        std::atomic<int> filter_markers;           //< Size of the newest filtered frame.
+    };
+
+    // Marker i of the SimDevice, filtered or not: z doesn't move.
+    bool in_place(const Position3d &p, int i)
+    {
+        return !is_valid(p) || fabs(p.z-(-2000.+i)) < 1e-2;
+    }
+
+    void read_frames(Reader r, const Options &o, Readers &readers, const MarkerFilter &filter,
+            const FrameResampler &resampler, const OdauCore &odau, const DerivedGraph &graph, int node)
+    {
+        // Room for the larger frame, whichever is current.
+        std::vector<Position3d> m(o.markers_a);
+        MergedFrame f;
+        FrameInfo info;
+        double values[3];
+        while(!readers.stop) {
+            bool got = false, ok = true;
+            if(r == FILTER) {
+                got = filter.latest_frame(info, &m[0]);
+                if(got) {
+                    const int n = (int)info.num_markers;
+                    ok = n == o.markers_a || n == o.markers_b;
+                    for(int i=0; ok && i<n; ++i)
+                        ok = in_place(m[i], i);
+                    readers.filter_markers = n;
+                }
+            }else if(r == RESAMPLER) {
+                // Both profiles have the smaller frame's markers.
+                got = resampler.sample(host_time_ns(), &m[0]) != FrameResampler::NO_FRAMES;
+                for(int i=0; got && ok && i<o.markers_b; ++i)
+                    ok = in_place(m[i], i);
+            }else if(r == ODAU) {
+                long long fn = odau.get_latest_frame();
+                got = fn >= 0 && odau.read((unsigned int)fn, f);
+                if(got) {
+                    const int n = (int)f.info.num_markers;
+                    ok = (n == o.markers_a || n == o.markers_b) && (int)f.markers.size() >= n;
+                    for(int i=0; ok && i<n; ++i)
+                        ok = in_place(f.markers[i], i);
+                }
+            }else {
+                got = graph.get(node, values) >= 0;
+                ok = !got || fabs(values[2]-(-2000.+o.markers_b-1)) < 1e-2;
+            }
+            if(got)
+                ++readers.reads[r];
+            if(!ok)
+                ++readers.wrong[r];
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    bool check_recording(const std::string &path, const CollectionParams &p)
+    {
+        RecordingReader r(path);
+        const RecordingHeader &h = r.get_header();
+        bool ok = h.num_markers == p.num_markers && h.frame_frequency == p.frame_frequency
+            && r.get_num_records() > 0;
+        printf("  %s: %d markers at %g Hz, %zu frames, %s\n", path.c_str(), h.num_markers,
+                h.frame_frequency, r.get_num_records(), ok ? "ok" : "WRONG");
+        return ok;
+    }
+
+    // The C3D header: points, frames and rate, and room for the frames.
+    bool check_export(const std::string &path, const CollectionParams &p)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if(!file) {
+            printf("  %s: missing\n", path.c_str());
+            return false;
+        }
+        unsigned short w[256];
+        bool ok = fread(w, sizeof(w), 1, file) == 1;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+
+        float rate = 0.f;
+        memcpy(&rate, &w[10], 4);
+        const long frames = w[4], data = (long)(w[8]-1)*512;
+        ok = ok && w[0] == 0x5002 && w[1] == p.num_markers && w[3] == 1 && frames > 0
+            && rate == p.frame_frequency && size >= data+frames*p.num_markers*16;
+        printf("  %s: %d markers at %g Hz, %ld frames, %s\n", path.c_str(), w[1], rate, frames,
+                ok ? "ok" : "WRONG");
+        return ok;
+    }
+
+    bool run(const Options &o)
+    {
+        SimDevice::Params dp;
+        dp.num_markers = o.markers_a;
+        dp.frame_frequency = (float)o.rate_a;
+        SimDevice device(dp);
+        SimOdauDevice odau_device(device);
+
+        const std::string rec = o.path+".rec", c3d = o.path+".c3d";
+        FrameRecorder recorder(rec);
+        FrameExporter exporter(c3d, FrameExporter::C3D);
+        MarkerFilter filter((MarkerFilter::Params()));
+        FrameResampler resampler((FrameResampler::Params()));
+        OdauCore odau(&odau_device);
+        odau.params.num_channels = 2;
+        odau.params.samples_per_frame = 1;
+        DerivedGraph graph;
+        const int node = graph.marker("last", o.markers_b-1);
+
+        CollectorCore c(&device);
+        c.add_markers(o.markers_a);
+        c.params.frame_frequency = (float)o.rate_a;
+        c.params.marker_frequency = 15000.f;
+        c.enforce_blocking();
+
+        CollectionParams profile[2];
+        profile[0] = profile[1] = c.params;
+        profile[0].num_markers = o.markers_a;
+        profile[1].frame_frequency = (float)o.rate_b;
+        profile[1].num_markers = o.markers_b;
+        const int id[2] = { c.add_profile(profile[0]), c.add_profile(profile[1]) };
+
+        c.startup();
+        FrameStage *stages[] = { &recorder, &exporter, &filter, &resampler, &odau, &graph };
+        for(size_t k=0; k<sizeof(stages)/sizeof(stages[0]); ++k)
+            c.add_stage(stages[k]);
+        const Position3d *buffer = c.get_frame_view().markers;
+        c.start_acquisition();
+
+        Readers readers;
+        std::vector<std::thread> threads;
+        for(int k=0; k<NUM_READERS; ++k)
+            threads.push_back(std::thread(read_frames, (Reader)k, std::cref(o), std::ref(readers),
+                        std::cref(filter), std::cref(resampler), std::cref(odau), std::cref(graph), node));
+
+        bool ok = true;
+        int stalled = 0;
+        for(int s=0; s<=o.switches; ++s) {
+            const int now = s%2;
+            if(s) {
+                c.reconfigure(id[now]);
+                ok = ok && c.get_frame_view().markers == buffer && c.get_total_num_markers() == profile[now].num_markers;
+            }
+            long long before[NUM_READERS];
+            for(int k=0; k<NUM_READERS; ++k)
+                before[k] = readers.reads[k];
+            std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+            // Every reader got on, and the filter's frames are the new size.
+            bool going = readers.filter_markers == profile[now].num_markers;
+            for(int k=0; k<NUM_READERS; ++k)
+                going = going && readers.reads[k] > before[k];
+            stalled += !going;
+        }
+        readers.stop = true;
+        for(size_t k=0; k<threads.size(); ++k)
+            threads[k].join();
+        c.deactivate();
+        for(size_t k=0; k<sizeof(stages)/sizeof(stages[0]); ++k)
+            c.remove_stage(stages[k]);
+        recorder.close();
+        exporter.close();
+
+        long long wrong = 0;
+        printf("%d switches between %g Hz with %d markers and %g Hz with %d, frame buffer %s, %d profiles stalled\n",
+                o.switches, o.rate_a, o.markers_a, o.rate_b, o.markers_b, ok ? "reused" : "NOT REUSED", stalled);
+        for(int k=0; k<NUM_READERS; ++k) {
+            printf("  %s reader: %lld frames, %lld wrong\n", READER_NAMES[k],
+                    (long long)readers.reads[k], (long long)readers.wrong[k]);
+            wrong += readers.wrong[k];
+        }
+        ok = ok && !stalled && !wrong;
+
+        // One file of each per profile used, the first with no number.
+        for(int s=0; s<=o.switches; ++s) {
+            const std::string r = s ? segment_path(rec, s) : rec;
+            const std::string e = s ? segment_path(c3d, s) : c3d;
+            ok = check_recording(r, profile[s%2]) && ok;
+            ok = check_export(e, profile[s%2]) && ok;
+        }
+        if(ok) {
+            for(int s=0; s<=o.switches; ++s) {
+                remove((s ? segment_path(rec, s) : rec).c_str());
+                remove((s ? segment_path(c3d, s) : c3d).c_str());
+            }
+        }
+        return ok;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--path trial] [--switches n] [--seconds s]\n"
+                "       [--rate-a Hz] [--markers-a n] [--rate-b Hz] [--markers-b n]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--path") o.path = v;
+        else if(a == "--switches") o.switches = atoi(v);
+        else if(a == "--seconds") o.seconds = atof(v);
+        else if(a == "--rate-a") o.rate_a = atof(v);
+        else if(a == "--markers-a") o.markers_a = atoi(v);
+        else if(a == "--rate-b") o.rate_b = atof(v);
+        else if(a == "--markers-b") o.markers_b = atoi(v);
+        else usage(argv[0]);
+    }
+    // The smaller frame has to fit in the larger one's buffer.
+    if(o.switches < 1 || !(o.seconds > 0.) || !(o.rate_a > 0.) || !(o.rate_b > 0.)
+            || o.markers_b <= 0 || o.markers_a < o.markers_b)
+        usage(argv[0]);
+
+    try {
+        return run(o) ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,425 @@
+/**
+ *@file opto_resample.cc
+ *@brief FrameResampler on trajectories whose answers are known.
+ *
+ * First frames at exact times, of a marker moving in a line, one on a
+ * parabola, one on a fast circle and a rigid body turning at constant
+ * speed about a fixed axis, into a linear and a cubic FrameResampler.
+ * After every frame, at the midpoints between the newest 4:
+ *
+ * - linear gives the line exactly, and the circle's chord midpoint: the
+ *   sagitta r(1-cos(θ/2)) inside it, θ the angle per frame;
+ * - cubic gives the parabola exactly between the middle two, and the
+ *   circle where its Hermite weights put it, far closer;
+ * - past the newest frame both follow the line up to max_extrapolation
+ *   and then stay put;
+ * - the body's pose is the closed-form rotation, SLERP being exact about
+ *   a fixed axis, interpolated and extrapolated, with q0 >= 0.
+ *
+ * Then a live CollectorCore on a SimDevice with transfer jitter, sampled
+ * from another thread at --past ms ago, --ahead ms ahead and as the
+ * newest frame alone, against the device's true path.  When the stage
+ * was added it was quoted at 0.05 mm, 0.07 mm and about 0.5 mm (p50) for
+ * 3 ms, 5 ms and the newest frame, at 500 Hz with 0.3 ms jitter.
+ * That holds with the latency set to the device's transfer time, as
+ * here; left at 0, the 0.2 ms transfer alone puts both at about 0.13 mm.
+ *
+ * opto_resample [--rate Hz] [--markers n] [--jitter s] [--seconds s]
+ *               [--past ms] [--ahead ms]
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "FrameResampler.h"
+#include "RigidBodySolver.h"
+#include "SimDevice.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :rate(500.),
+            markers(8),
+            jitter(0.0003),
+            seconds(3.),
+            past(3.),
+            ahead(5.)
+        {}
+
+        double rate;
+        int markers;
+        double jitter;
+        double seconds;
+        double past;  //< ms
+        double ahead; //< ms
+    };
+
+    /*
+     * The known trajectories, s seconds from the timeline's start.
+     */
+    const double RATE = 100.;               //< Frames a second.
+    const int FRAMES = 300;
+    const long long START = 1000000000LL;   //< Host time of frame 0, ns.
+    const double RADIUS = 100., TURNS = 5.; //< The circle, turns a second.
+    const double SPIN = 0.7;                //< The body, turns a second.
+    const int LINE = 0, PARABOLA = 1, CIRCLE = 2, BODY = 3, BODY_MARKERS = 4;
+    const int MARKERS = BODY+BODY_MARKERS;
+    const double MODEL[BODY_MARKERS][3] = { { 0., 0., 0. }, { 60., 0., 0. }, { 0., 40., 0. }, { 10., 10., 30. } };
+    const double TOLERANCE = 1e-3;          //< mm; frames are floats.
+    const double ANGLE_TOLERANCE = 1e-4;    //< rad
+
+    double seconds_at(long long t)
+    {
+        return (t-START)*1e-9;
+    }
+
+    void line(double s, double *x)
+    {
+        x[0] = 10.+50.*s;
+        x[1] = -20.+30.*s;
+        x[2] = -2000.-40.*s;
+    }
+
+    void parabola(double s, double *x)
+    {
+        x[0] = 100.*s*s;
+        x[1] = -50.*s+80.*s*s;
+        x[2] = -1900.+20.*s*s;
+    }
+
+    void circle(double s, double *x)
+    {
+        x[0] = RADIUS*cos(2.*M_PI*TURNS*s);
+        x[1] = RADIUS*sin(2.*M_PI*TURNS*s);
+        x[2] = -2000.;
+    }
+
+    // About a fixed axis, q0 >= 0.
+    void body_rotation(double s, double *q)
+    {
+        const double n[3] = { 1./sqrt(14.), 2./sqrt(14.), 3./sqrt(14.) };
+        double half = M_PI*SPIN*s;
+        double sign = cos(half) < 0. ? -1. : 1.;
+        q[0] = sign*cos(half);
+        for(int k=0; k<3; ++k)
+            q[k+1] = sign*sin(half)*n[k];
+    }
+
+    void body_translation(double s, double *x)
+    {
+        x[0] = 200.+40.*s;
+        x[1] = -100.+10.*s;
+        x[2] = -1800.-20.*s;
+    }
+
+    Position3d position(const double *x)
+    {
+        Position3d p;
+        p.x = (float)x[0];
+        p.y = (float)x[1];
+        p.z = (float)x[2];
+        return p;
+    }
+
+    void frame(double s, Position3d *m)
+    {
+        double x[3], q[4], t[3];
+        line(s, x);
+        m[LINE] = position(x);
+        parabola(s, x);
+        m[PARABOLA] = position(x);
+        circle(s, x);
+        m[CIRCLE] = position(x);
+        body_rotation(s, q);
+        body_translation(s, t);
+        const double r[9] = {
+            1.-2.*(q[2]*q[2]+q[3]*q[3]), 2.*(q[1]*q[2]-q[0]*q[3]), 2.*(q[1]*q[3]+q[0]*q[2]),
+            2.*(q[1]*q[2]+q[0]*q[3]), 1.-2.*(q[1]*q[1]+q[3]*q[3]), 2.*(q[2]*q[3]-q[0]*q[1]),
+            2.*(q[1]*q[3]-q[0]*q[2]), 2.*(q[2]*q[3]+q[0]*q[1]), 1.-2.*(q[1]*q[1]+q[2]*q[2]) };
+        for(int k=0; k<BODY_MARKERS; ++k) {
+            const double *b = MODEL[k];
+            for(int a=0; a<3; ++a)
+                x[a] = r[3*a]*b[0]+r[3*a+1]*b[1]+r[3*a+2]*b[2]+t[a];
+            m[BODY+k] = position(x);
+        }
+    }
+
+    double distance(const Position3d &p, const double *x)
+    {
+        double dx = p.x-x[0], dy = p.y-x[1], dz = p.z-x[2];
+        return sqrt(dx*dx+dy*dy+dz*dz);
+    }
+
+    struct Tally {
+        Tally() :checks(0), wrong(0), worst(0.) {}
+
+        void add(bool ok, double error=0.) {
+            ++checks;
+            wrong += !ok;
+            worst = std::max(worst, error);
+        }
+
+        long long checks, wrong;
+        double worst;
+    };
+
+    // The pose at s: rotation within ANGLE_TOLERANCE, q0 >= 0, translation within TOLERANCE.
+    void check_pose(const FrameResampler &r, long long t, double s, int expected, Tally &tally)
+    {
+        BodyPose p;
+        double q[4], x[3];
+        int result = r.sample_pose(t, 0, p);
+        body_rotation(s, q);
+        body_translation(s, x);
+        double dot = 0., dt = 0.;
+        for(int k=0; k<4; ++k)
+            dot += p.quaternion[k]*q[k];
+        for(int k=0; k<3; ++k)
+            dt += (p.translation[k]-x[k])*(p.translation[k]-x[k]);
+        double angle = 2.*acos(std::min(1., fabs(dot)));
+        // The sign is only defined away from q0 = 0.
+        bool sign = p.quaternion[0] >= 0. && (q[0] < 1e-3 || dot > 0.);
+        tally.add(result == expected && p.valid && sign && angle < ANGLE_TOLERANCE
+                && sqrt(dt) < TOLERANCE, angle);
+    }
+
+    bool check_known()
+    {
+        FrameResampler::Params lp, cp;
+        lp.method = FrameResampler::LINEAR;
+        cp.method = FrameResampler::CUBIC;
+        FrameResampler linear(lp), cubic(cp);
+        RigidBodySolver bodies;
+        bodies.add_body(&MODEL[0][0], BODY_MARKERS, BODY);
+        linear.set_rigid_bodies(bodies);
+        cubic.set_rigid_bodies(bodies);
+        CollectionParams p;
+        p.num_markers = MARKERS;
+        p.frame_frequency = (float)RATE;
+        linear.setup(p);
+        cubic.setup(p);
+
+        // Closed forms for the circle, from frame a at angle 0 to a+1 at θ.
+        typedef std::complex<double> Point;
+        const double theta = 2.*M_PI*TURNS/RATE;
+        const Point e1 = std::polar(1., theta), em = std::polar(1., -theta), e2 = std::polar(1., 2.*theta);
+        const Point chord = 0.5*(1.+e1);
+        const Point hermite = chord+(e1-em-e2+1.)/16.;
+        const double sagitta = RADIUS*(1.-cos(theta/2.));
+        const double bend = RADIUS*std::abs(hermite-std::polar(1., theta/2.));
+
+        Tally lines, chords, parabolas, hermites, caps, rotations;
+        double lin_circle = 0., cub_circle = 0.;
+        const long long period = (long long)(1e9/RATE);
+        const long long max_dt = (long long)(lp.max_extrapolation*1e9);
+        std::vector<Position3d> m(MARKERS), out(MARKERS), capped(MARKERS);
+        FrameInfo info;
+        info.num_markers = MARKERS;
+        info.flags = 0;
+        for(int fn=1; fn<=FRAMES; ++fn) {
+            info.frame_number = fn;
+            info.host_time = START+fn*period;
+            frame(fn/RATE, &m[0]);
+            linear.process(info, &m[0]);
+            cubic.process(info, &m[0]);
+            if(fn < 4)
+                continue;
+
+            double x[3];
+            for(int k=0; k<3; ++k) {
+                // Midway from frame a to a+1, a from 3 before the newest.
+                const int a = fn-3+k;
+                const long long t = START+a*period+period/2;
+                const double s = seconds_at(t);
+                const Point at = std::polar(RADIUS, 2.*M_PI*TURNS*a/RATE);
+
+                lines.add(linear.sample(t, &out[0]) == FrameResampler::INTERPOLATED);
+                line(s, x);
+                lines.add(distance(out[LINE], x) < TOLERANCE, distance(out[LINE], x));
+                const Point c = at*chord;
+                const double cx[3] = { c.real(), c.imag(), -2000. };
+                chords.add(distance(out[CIRCLE], cx) < TOLERANCE, distance(out[CIRCLE], cx));
+                circle(s, x);
+                lin_circle = std::max(lin_circle, distance(out[CIRCLE], x));
+                check_pose(linear, t, s, FrameResampler::INTERPOLATED, rotations);
+                check_pose(cubic, t, s, FrameResampler::INTERPOLATED, rotations);
+
+                cubic.sample(t, &out[0]);
+                line(s, x);
+                lines.add(distance(out[LINE], x) < TOLERANCE, distance(out[LINE], x));
+                if(k != 1)
+                    continue;
+                // Central differences on both sides only between the middle two.
+                parabola(s, x);
+                parabolas.add(distance(out[PARABOLA], x) < TOLERANCE, distance(out[PARABOLA], x));
+                const Point h = at*hermite;
+                const double hx[3] = { h.real(), h.imag(), -2000. };
+                hermites.add(distance(out[CIRCLE], hx) < TOLERANCE, distance(out[CIRCLE], hx));
+                circle(s, x);
+                cub_circle = std::max(cub_circle, distance(out[CIRCLE], x));
+            }
+
+            // Past the newest frame, then past the limit.
+            const long long newest = START+fn*period;
+            const double ahead[] = { 0.25, 0.5, 1., 2., 10. };
+            for(int k=0; k<5; ++k) {
+                const long long dt = (long long)(ahead[k]*max_dt);
+                const long long t = newest+dt;
+                const double s = seconds_at(newest+std::min(dt, max_dt));
+                for(int j=0; j<2; ++j) {
+                    const FrameResampler &r = j ? cubic : linear;
+                    bool ok = r.sample(t, &out[0]) == FrameResampler::EXTRAPOLATED;
+                    // Weights up to 1+max_extrapolation/period scale the frames' rounding.
+                    line(s, x);
+                    ok = ok && distance(out[LINE], x) < TOLERANCE*(1.+2.*std::min(dt, max_dt)/period);
+                    if(dt > max_dt) {
+                        // Nothing moves past the limit.
+                        r.sample(newest+max_dt, &capped[0]);
+                        for(int i=0; i<MARKERS; ++i)
+                            ok = ok && out[i].x == capped[i].x && out[i].y == capped[i].y && out[i].z == capped[i].z;
+                    }
+                    caps.add(ok, distance(out[LINE], x));
+                    check_pose(r, t, s, FrameResampler::EXTRAPOLATED, rotations);
+                }
+            }
+        }
+
+        printf("known paths, %d frames at %g Hz:\n", FRAMES, RATE);
+        printf("  line: %lld samples, worst %.2g mm, %lld wrong\n", lines.checks, lines.worst, lines.wrong);
+        printf("  circle, linear: %.4f mm off (sagitta %.4f), %lld from the chord's midpoint (worst %.2g mm)\n",
+                lin_circle, sagitta, chords.wrong, chords.worst);
+        printf("  parabola, cubic: %lld samples, worst %.2g mm, %lld wrong\n", parabolas.checks, parabolas.worst, parabolas.wrong);
+        printf("  circle, cubic: %.4f mm off (closed form %.4f), %lld from Hermite's point (worst %.2g mm)\n",
+                cub_circle, bend, hermites.wrong, hermites.worst);
+        printf("  extrapolation to %g ms and capped there: %lld samples, worst %.2g mm, %lld wrong\n",
+                lp.max_extrapolation*1e3, caps.checks, caps.worst, caps.wrong);
+        printf("  body poses by SLERP: %lld samples, worst %.2g rad, %lld wrong\n",
+                rotations.checks, rotations.worst, rotations.wrong);
+
+        return !lines.wrong && !chords.wrong && !parabolas.wrong && !hermites.wrong && !caps.wrong
+            && !rotations.wrong && fabs(lin_circle-sagitta) < TOLERANCE && fabs(cub_circle-bend) < TOLERANCE
+            && cub_circle < sagitta/10.;
+    }
+
+    double percentile(std::vector<double> &v, double p)
+    {
+        if(v.empty())
+            return 0.;
+        size_t k = (size_t)(p*(v.size()-1));
+        std::nth_element(v.begin(), v.begin()+k, v.end());
+        return v[k];
+    }
+
+    bool check_live(const Options &o)
+    {
+        SimDevice::Params dp;
+        dp.num_markers = o.markers;
+        dp.frame_frequency = (float)o.rate;
+        dp.jitter = o.jitter;
+        SimDevice device(dp);
+
+        // The transfer is the latency from taking a frame to having it.
+        FrameResampler::Params rp;
+        rp.latency = dp.transfer_time;
+        FrameResampler resampler(rp);
+
+        CollectorCore c(&device);
+        c.add_markers(o.markers);
+        c.params.frame_frequency = (float)o.rate;
+        c.enforce_blocking();
+        c.add_stage(&resampler);
+        c.startup();
+        c.start_acquisition();
+
+        std::vector<double> past, ahead, newest;
+        std::vector<Position3d> m(o.markers);
+        const long long past_ns = (long long)(o.past*1e6), ahead_ns = (long long)(o.ahead*1e6);
+        double x[3];
+        const long long end = host_time_ns()+(long long)(o.seconds*1e9);
+        // Settle the timeline first.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for(long long now=host_time_ns(); now<end; now=host_time_ns()) {
+            if(resampler.sample(now-past_ns, &m[0]) != FrameResampler::NO_FRAMES) {
+                for(int i=0; i<o.markers; ++i) {
+                    device.path(i, now-past_ns, x);
+                    past.push_back(distance(m[i], x));
+                }
+            }
+            if(resampler.sample(now+ahead_ns, &m[0]) != FrameResampler::NO_FRAMES) {
+                for(int i=0; i<o.markers; ++i) {
+                    device.path(i, now+ahead_ns, x);
+                    ahead.push_back(distance(m[i], x));
+                }
+            }
+            long long t = resampler.get_latest_time();
+            if(t >= 0 && resampler.sample(t, &m[0]) != FrameResampler::NO_FRAMES) {
+                for(int i=0; i<o.markers; ++i) {
+                    device.path(i, now, x);
+                    newest.push_back(distance(m[i], x));
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(300));
+        }
+        c.deactivate();
+        c.remove_stage(&resampler);
+
+        double p50[3] = { percentile(past, 0.5), percentile(ahead, 0.5), percentile(newest, 0.5) };
+        double p95[3] = { percentile(past, 0.95), percentile(ahead, 0.95), percentile(newest, 0.95) };
+        printf("live at %g Hz with %g ms jitter, %d markers, %zu samples each:\n", o.rate, o.jitter*1e3, o.markers, past.size());
+        printf("  %g ms ago:     p50 %.3f mm, p95 %.3f mm (quoted 0.05 p50)\n", o.past, p50[0], p95[0]);
+        printf("  %g ms ahead:   p50 %.3f mm, p95 %.3f mm (quoted 0.07 p50)\n", o.ahead, p50[1], p95[1]);
+        printf("  newest frame: p50 %.3f mm, p95 %.3f mm (quoted about 0.5 p50)\n", p50[2], p95[2]);
+
+        // Resampling has to beat showing the newest frame.
+        return !past.empty() && p50[0] < p50[2]/4. && p50[1] < p50[2]/4.;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--rate Hz] [--markers n] [--jitter s] [--seconds s]\n"
+                "       [--past ms] [--ahead ms]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--rate") o.rate = atof(v);
+        else if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--jitter") o.jitter = atof(v);
+        else if(a == "--seconds") o.seconds = atof(v);
+        else if(a == "--past") o.past = atof(v);
+        else if(a == "--ahead") o.ahead = atof(v);
+        else usage(argv[0]);
+    }
+    if(!(o.rate > 0.) || o.markers <= 0 || !(o.jitter >= 0.) || !(o.seconds > 0.)
+            || !(o.past >= 0.) || !(o.ahead >= 0.))
+        usage(argv[0]);
+
+    try {
+        bool ok = check_known();
+        ok = check_live(o) && ok;
+        return ok ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,146 @@
+/**
+ *@file opto_shm.cc
+ *@brief Try out shared-memory publishing without the hardware.
+ *
+ * opto_shm publish [--name /optotrak] [--rate Hz] [--markers n] [--seconds s]
+ *     Collects from a SimDevice on the acquisition thread and publishes
+ *     every frame.
+ *
+ * opto_shm read [--name /optotrak] [--seconds s]
+ *     Follows the frames with FrameSubscriber::next() and reports how many
+ *     arrived, how many were skipped and the latency from the frame's
+ *     arrival in the publisher to the read here.
+ *
+ * Run one publisher and as many readers as wanted, in separate processes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "FramePublisher.h"
+#include "FrameStats.h"
+#include "FrameSubscriber.h"
+#include "SimDevice.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :name("/optotrak"),
+            rate(500.),
+            markers(24),
+            seconds(10.)
+        {}
+
+        std::string name;
+        double rate;
+        int markers;
+        double seconds;
+    };
+
+    int publish(const Options &o)
+    {
+        SimDevice::Params sp;
+        sp.num_markers = o.markers;
+        sp.frame_frequency = (float)o.rate;
+        SimDevice device(sp);
+
+        CollectorCore c(&device);
+        FramePublisher publisher(o.name);
+        c.add_markers(o.markers);
+        c.params.frame_frequency = (float)o.rate;
+        c.enforce_blocking();
+        c.add_stage(&publisher);
+        c.startup(false);
+        c.start_acquisition();
+
+        fprintf(stderr, "publishing %d markers at %g Hz as %s\n", o.markers, o.rate, o.name.c_str());
+        std::this_thread::sleep_for(std::chrono::nanoseconds((long long)(o.seconds*1e9)));
+
+        c.deactivate();
+        c.remove_stage(&publisher);
+        publisher.close();
+        return 0;
+    }
+
+    int read(const Options &o)
+    {
+        FrameSubscriber s;
+        long long end = host_time_ns()+(long long)(o.seconds*1e9);
+        while(!s.is_open()) {
+            try {
+                s.open(o.name);
+            }catch(const std::exception &) {
+                if(host_time_ns() > end) {
+                    fprintf(stderr, "nothing published as %s\n", o.name.c_str());
+                    return 1;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+
+        std::vector<Position3d> markers(s.get_num_markers());
+        LatencyHistogram latency;
+        memset(&latency, 0, sizeof(latency));
+        unsigned long long frames = 0;
+        while(host_time_ns() < end) {
+            FrameInfo info;
+            if(!s.next(info, &markers[0], 1.)) {
+                if(s.is_closed())
+                    break;
+                continue;
+            }
+            long long d = host_time_ns()-info.host_time;
+            latency.counts[LatencyHistogram::bucket_of(d < 0 ? 0 : d)]++;
+            ++frames;
+        }
+
+        printf("frames %llu skipped %llu latency p50 %.1f p99 %.1f p99.9 %.1f us%s\n",
+                frames, s.get_num_skipped(),
+                latency.quantile(0.5)*1e-3, latency.quantile(0.99)*1e-3, latency.quantile(0.999)*1e-3,
+                s.is_closed() ? " (publisher closed)" : "");
+        return 0;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s publish|read [--name shm] [--rate Hz] [--markers n] [--seconds s]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+        usage(argv[0]);
+    std::string mode = argv[1];
+
+    Options o;
+    for(int i=2; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--name") o.name = v;
+        else if(a == "--rate") o.rate = atof(v);
+        else if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--seconds") o.seconds = atof(v);
+        else usage(argv[0]);
+    }
+    if(o.rate <= 0. || o.markers <= 0 || o.seconds <= 0.)
+        usage(argv[0]);
+
+    if(mode == "publish")
+        return publish(o);
+    if(mode == "read")
+        return read(o);
+    usage(argv[0]);
+    return 1;
+}
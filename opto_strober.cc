@@ -0,0 +1,257 @@
+/**
+ *@file opto_strober.cc
+ *@brief Strober layouts, and frames packed by StroberDevice.
+ *
+ * For each of the four cases in OptoCollector's notes (and both orders of
+ * case 3), plus a chain of three strobers, checks the StroberTable's port
+ * counts, collection size and dense index map against what the notes
+ * work out by hand.  Then it reads live frames (get_latest_3d() and
+ * request/receive) and a buffered trial through a StroberDevice over a
+ * SimDevice, whose markers go missing now and then, and compares every
+ * marker with the device's own position at the expected index.  Case 2
+ * is also run through CollectorCore::add_markers(n, port), live and
+ * buffered.
+ *
+ * opto_strober [--rate Hz] [--frames n]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CollectorCore.h"
+#include "SimDevice.h"
+#include "StroberDevice.h"
+#include "StroberTable.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :rate(1000.),
+            frames(200)
+        {}
+
+        double rate;
+        int frames; //< In the buffered trial; more than StroberDevice::BLOCK.
+    };
+
+    struct Layout {
+        const char *name;
+        int num_strobers;
+        int port[3], markers[3]; //< In the order added.
+        int ports[StroberTable::NUM_PORTS];
+        int collection_size;
+        int num_markers;
+        int map[18];             //< Device index of each dense marker.
+    };
+
+    const Layout LAYOUTS[] = {
+        { "case 1: laser1 (6), then a marker chained on port 1",
+            2, { 1, 1 }, { 6, 1 }, { 7, 0, 0, 0 }, 7, 7,
+            { 0, 1, 2, 3, 4, 5, 6 } },
+        { "case 2: a marker, then laser1 (6) chained on port 1",
+            2, { 1, 1 }, { 1, 6 }, { 12, 0, 0, 0 }, 12, 7,
+            { 0, 6, 7, 8, 9, 10, 11 } },
+        { "case 3: laser1 (6) on port 1, a marker on port 2",
+            2, { 1, 2 }, { 6, 1 }, { 6, 1, 0, 0 }, 7, 7,
+            { 0, 1, 2, 3, 4, 5, 6 } },
+        { "case 3: a marker on port 1, laser1 (6) on port 2",
+            2, { 1, 2 }, { 1, 6 }, { 1, 6, 0, 0 }, 7, 7,
+            { 0, 1, 2, 3, 4, 5, 6 } },
+        { "case 3: laser1 (6) on port 2 added first, a marker on port 1",
+            2, { 2, 1 }, { 6, 1 }, { 1, 6, 0, 0 }, 7, 7,
+            { 1, 2, 3, 4, 5, 6, 0 } },
+        { "case 4: cuby1 (3), then laser1 (6) chained on port 1",
+            2, { 1, 1 }, { 3, 6 }, { 12, 0, 0, 0 }, 12, 9,
+            { 0, 1, 2, 6, 7, 8, 9, 10, 11 } },
+        { "case 4 as in sample11.c: two of 6 chained on port 1",
+            2, { 1, 1 }, { 6, 6 }, { 12, 0, 0, 0 }, 12, 12,
+            { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 } },
+        { "1, 2 and 6 chained on port 4",
+            3, { 4, 4, 4 }, { 1, 2, 6 }, { 0, 0, 0, 18 }, 18, 9,
+            { 0, 6, 7, 12, 13, 14, 15, 16, 17 } }
+    };
+
+    bool same(const Position3d &a, const Position3d &b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    // Dense frame markers against the device's frame fn.
+    bool check_frame(const SimDevice &d, const Layout &l, unsigned int fn, const Position3d *markers)
+    {
+        bool ok = true;
+        for(int i=0; i<l.num_markers; ++i)
+            ok = ok && same(markers[i], d.position(l.map[i], fn));
+        return ok;
+    }
+
+    SimDevice::Params device_params(const Options &o)
+    {
+        SimDevice::Params dp;
+        dp.frame_frequency = (float)o.rate;
+        dp.missing_rate = 0.02;
+        dp.missing_frames = 3;
+        return dp;
+    }
+
+    bool check_table(const Layout &l, StroberTable &t)
+    {
+        bool ok = true;
+        int first = 0;
+        for(int k=0; k<l.num_strobers; ++k) {
+            ok = ok && t.add(l.port[k], l.markers[k]) == first;
+            first += l.markers[k];
+        }
+        ok = ok && t.get_num_markers() == l.num_markers && t.get_collection_size() == l.collection_size;
+        for(int p=1; p<=StroberTable::NUM_PORTS; ++p)
+            ok = ok && t.get_port_count(p) == l.ports[p-1];
+        for(int i=0; i<l.num_markers; ++i)
+            ok = ok && t.device_index(i) == l.map[i];
+
+        // Two frames as sent, each marker tagged with its index and frame.
+        std::vector<Position3d> sent(2*l.collection_size), dense(2*l.num_markers);
+        for(size_t j=0; j<sent.size(); ++j) {
+            sent[j].x = (float)j;
+            sent[j].y = sent[j].z = 0.f;
+        }
+        t.pack(&sent[0], &dense[0], 2);
+        for(int f=0; f<2; ++f) {
+            for(int i=0; i<l.num_markers; ++i)
+                ok = ok && dense[f*l.num_markers+i].x == (float)(f*l.collection_size+l.map[i]);
+        }
+        return ok;
+    }
+
+    bool check_device(const Options &o, const Layout &l, const StroberTable &t, int &frames)
+    {
+        SimDevice sim(device_params(o));
+        StroberDevice d(&sim, t);
+        CollectionParams p;
+        p.num_markers = 1; // ignored: the table decides
+        p.frame_frequency = (float)o.rate;
+        p.flags |= OPTOTRAK_GET_NEXT_FRAME_FLAG;
+        bool ok = d.setup_collection(p) == 0 && sim.get_params().num_markers == l.collection_size;
+        for(int k=1; k<=StroberTable::NUM_PORTS; ++k)
+            ok = ok && sim.get_port_count(k) == l.ports[k-1];
+        if(!ok)
+            return false;
+
+        std::vector<Position3d> m((size_t)o.frames*l.num_markers);
+        unsigned int fn, ne, f;
+        for(int k=0; k<20; ++k, ++frames) {
+            ok = ok && !d.get_latest_3d(&fn, &ne, &f, &m[0]) && ne == (unsigned int)l.num_markers
+                && check_frame(sim, l, fn, &m[0]);
+        }
+        for(int k=0; k<20; ++k, ++frames) {
+            d.request_latest_3d();
+            while(!d.data_is_ready())
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ok = ok && !d.receive_latest_3d(&fn, &ne, &f, &m[0]) && ne == (unsigned int)l.num_markers
+                && check_frame(sim, l, fn, &m[0]);
+        }
+
+        // Buffered, in reads that span several of its blocks.
+        ok = ok && !d.buffer_start(o.frames);
+        int total = 0;
+        bool complete = false;
+        while(ok && !complete) {
+            int n;
+            ok = !d.buffer_read(&m[(size_t)total*l.num_markers], o.frames-total, &n, &complete);
+            total += n;
+            if(!complete)
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        d.buffer_stop();
+        ok = ok && total == o.frames;
+        for(int k=0; k<total; ++k)
+            ok = ok && check_frame(sim, l, k+1, &m[(size_t)k*l.num_markers]);
+        frames += total;
+        return ok;
+    }
+
+    // Case 2 the way a script sets it up.
+    bool check_collector(const Options &o, const Layout &l)
+    {
+        SimDevice sim(device_params(o));
+        CollectorCore c(&sim);
+        bool ok = c.add_markers(1, 1) == 1 && c.add_markers(6, 1) == 2;
+        c.params.frame_frequency = (float)o.rate;
+        c.params.collect_time = (float)(o.frames/o.rate);
+        c.enforce_blocking();
+        c.startup();
+        ok = ok && c.get_total_num_markers() == l.num_markers && c.get_num_elements() == l.num_markers
+            && sim.get_params().num_markers == l.collection_size && sim.get_port_count(1) == l.ports[0];
+
+        int live = 0;
+        std::vector<Position3d> m(l.num_markers);
+        for(int k=0; k<50; ++k) {
+            int fn = c.update_frame();
+            for(int i=0; i<l.num_markers; ++i)
+                m[i] = c.get_position(i);
+            ok = ok && fn > 0 && check_frame(sim, l, fn, &m[0]);
+            ++live;
+        }
+
+        const int n = c.get_num_buffered_frames();
+        std::vector<Position3d> b((size_t)n*l.num_markers);
+        int got = c.collect_buffered(&b[0], n);
+        ok = ok && n > 0 && got == n;
+        for(int k=0; k<got; ++k)
+            ok = ok && check_frame(sim, l, k+1, &b[(size_t)k*l.num_markers]);
+        c.deactivate();
+
+        printf("CollectorCore, %s: %d live and %d buffered frames of %d markers, %s\n",
+                l.name, live, got, c.get_total_num_markers(), ok ? "ok" : "WRONG");
+        return ok;
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--rate Hz] [--frames n]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--rate") o.rate = atof(v);
+        else if(a == "--frames") o.frames = atoi(v);
+        else usage(argv[0]);
+    }
+    if(!(o.rate > 0.) || o.frames <= StroberDevice::BLOCK)
+        usage(argv[0]);
+
+    try {
+        bool ok = true;
+        for(size_t k=0; k<sizeof(LAYOUTS)/sizeof(LAYOUTS[0]); ++k) {
+            const Layout &l = LAYOUTS[k];
+            StroberTable t;
+            bool table = check_table(l, t);
+            int frames = 0;
+            bool device = table && check_device(o, l, t, frames);
+            printf("%s: ports (%d,%d,%d,%d), %d collected, %d markers; table %s, %d frames %s\n",
+                    l.name, t.get_port_count(1), t.get_port_count(2), t.get_port_count(3), t.get_port_count(4),
+                    t.get_collection_size(), t.get_num_markers(), table ? "ok" : "WRONG",
+                    frames, device ? "ok" : "WRONG");
+            ok = ok && table && device;
+        }
+        ok = check_collector(o, LAYOUTS[1]) && ok;
+        return ok ? 0 : 1;
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,295 @@
+/**
+ *@file opto_triangulate.cc
+ *@brief Checks and times Triangulator on synthetic raw data.
+ *
+ * Places position sensors (3 linear sensors each, like a 3020) around a
+ * volume 2.25 m away, projects markers moving on circles into centroids
+ * with Gaussian noise, and triangulates them: one marker at a time with
+ * plain scalar code, then with triangulate_frames() on 1 to --threads
+ * threads.  Reports the error against the true positions, the largest
+ * difference between the two, and frames per second.
+ *
+ * opto_triangulate [--markers n] [--frames n] [--cameras n] [--noise px]
+ *                  [--occlusion p] [--threads n] [--save model] [--model model]
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "OptoFrame.h"
+#include "Triangulator.h"
+
+using namespace VML;
+
+namespace {
+
+    struct Options {
+        Options()
+            :markers(24),
+            frames(20000),
+            cameras(1),
+            noise(0.02),
+            occlusion(0.01),
+            threads(4)
+        {}
+
+        int markers;
+        int frames;
+        int cameras;
+        double noise;
+        double occlusion;
+        int threads;
+        std::string save;
+        std::string model;
+    };
+
+    void normalize(double *v)
+    {
+        double n = sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+        v[0] /= n; v[1] /= n; v[2] /= n;
+    }
+
+    /*
+     * A 1.1 m bar per camera: the outer sensors measure horizontally,
+     * the middle one vertically, all toed in towards the volume.
+     * Cameras are spread 30 degrees apart around it.
+     */
+    void synthetic_model(Triangulator &t, int cameras)
+    {
+        const double target[3] = { 0., 0., -2250. };
+        for(int c=0; c<cameras; ++c) {
+            double yaw = (c-(cameras-1)/2.)*M_PI/6.;
+            double right[3] = { cos(yaw), 0., -sin(yaw) };
+            for(int k=0; k<3; ++k) {
+                double off = (k-1)*550.;
+                SensorModel s;
+                for(int a=0; a<3; ++a)
+                    s.lens[a] = target[a]-2250.*(a == 2 ? cos(yaw) : a == 0 ? -sin(yaw) : 0.)+off*right[a];
+                for(int a=0; a<3; ++a)
+                    s.optical[a] = target[a]-s.lens[a];
+                normalize(s.optical);
+                double up[3] = { 0., 1., 0. };
+                const double *along = k == 1 ? up : right;
+                double d = along[0]*s.optical[0]+along[1]*s.optical[1]+along[2]*s.optical[2];
+                for(int a=0; a<3; ++a)
+                    s.axis[a] = along[a]-d*s.optical[a];
+                normalize(s.axis);
+                s.focal = 45.;
+                s.center = 1024.;
+                s.pitch = 0.013;
+                s.distortion = 2e-9;
+                t.add_sensor(s);
+            }
+        }
+    }
+
+    void position(int i, int f, int num_markers, double *p)
+    {
+        double phase = 2.*M_PI*(f/500.*0.5+i/(double)num_markers);
+        double r = 100.+10.*i;
+        p[0] = r*cos(phase);
+        p[1] = r*sin(phase);
+        p[2] = -2250.+200.*sin(phase*0.3);
+    }
+
+    // The same least squares, one marker at a time, straight from the model.
+    bool reference(const Triangulator &t, const float *c, Position3d &out)
+    {
+        double a[3][3] = { { 0. } }, b[3] = { 0. }, dd = 0.;
+        int count = 0;
+        for(int s=0; s<t.get_num_sensors(); ++s) {
+            if(!(c[s] > MAX_NEGATIVE))
+                continue;
+            const SensorModel &m = t.get_sensor(s);
+            double d = c[s]-m.center;
+            double x = m.pitch*d*(1.+m.distortion*d*d);
+            double n[3], r = 0.;
+            for(int k=0; k<3; ++k) {
+                n[k] = m.focal*m.axis[k]+x*m.optical[k];
+                r += n[k]*m.lens[k];
+            }
+            double w = 1./(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+            for(int i=0; i<3; ++i) {
+                for(int j=0; j<3; ++j)
+                    a[i][j] += w*n[i]*n[j];
+                b[i] += w*n[i]*r;
+            }
+            dd += w*r*r;
+            ++count;
+        }
+        if(count < t.params.min_sensors)
+            return false;
+
+        // Gaussian elimination with partial pivoting.
+        double m[3][4];
+        for(int i=0; i<3; ++i) {
+            for(int j=0; j<3; ++j)
+                m[i][j] = a[i][j];
+            m[i][3] = b[i];
+        }
+        for(int col=0; col<3; ++col) {
+            int p = col;
+            for(int i=col+1; i<3; ++i)
+                if(fabs(m[i][col]) > fabs(m[p][col]))
+                    p = i;
+            for(int j=0; j<4; ++j)
+                std::swap(m[col][j], m[p][j]);
+            if(fabs(m[col][col]) < 1e-12)
+                return false;
+            for(int i=col+1; i<3; ++i) {
+                double f = m[i][col]/m[col][col];
+                for(int j=col; j<4; ++j)
+                    m[i][j] -= f*m[col][j];
+            }
+        }
+        double x[3];
+        for(int i=2; i>=0; --i) {
+            x[i] = m[i][3];
+            for(int j=i+1; j<3; ++j)
+                x[i] -= m[i][j]*x[j];
+            x[i] /= m[i][i];
+        }
+
+        double sq = dd;
+        for(int i=0; i<3; ++i) {
+            sq -= 2.*x[i]*b[i];
+            for(int j=0; j<3; ++j)
+                sq += x[i]*a[i][j]*x[j];
+        }
+        if(sq > t.params.max_residual*t.params.max_residual*count)
+            return false;
+        out.x = (float)x[0];
+        out.y = (float)x[1];
+        out.z = (float)x[2];
+        return true;
+    }
+
+    double seconds_since(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+    }
+
+    void usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--markers n] [--frames n] [--cameras n] [--noise px]\n"
+                "    [--occlusion p] [--threads n] [--save model] [--model model]\n", name);
+        exit(1);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    for(int i=1; i<argc; ++i) {
+        std::string a = argv[i];
+        if(i+1 >= argc)
+            usage(argv[0]);
+        const char *v = argv[++i];
+        if(a == "--markers") o.markers = atoi(v);
+        else if(a == "--frames") o.frames = atoi(v);
+        else if(a == "--cameras") o.cameras = atoi(v);
+        else if(a == "--noise") o.noise = atof(v);
+        else if(a == "--occlusion") o.occlusion = atof(v);
+        else if(a == "--threads") o.threads = atoi(v);
+        else if(a == "--save") o.save = v;
+        else if(a == "--model") o.model = v;
+        else usage(argv[0]);
+    }
+    if(o.markers <= 0 || o.frames <= 0 || o.cameras <= 0 || o.threads <= 0)
+        usage(argv[0]);
+
+    Triangulator t;
+    try {
+        if(o.model.empty())
+            synthetic_model(t, o.cameras);
+        else
+            t.load(o.model);
+        if(!o.save.empty())
+            t.save(o.save);
+    }catch(const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    const int ns = t.get_num_sensors(), nm = o.markers;
+    std::vector<float> raw((size_t)o.frames*nm*ns);
+    std::vector<Position3d> truth((size_t)o.frames*nm);
+    std::mt19937 gen(1);
+    std::normal_distribution<double> noise(0., o.noise);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    for(int f=0; f<o.frames; ++f) {
+        for(int i=0; i<nm; ++i) {
+            double p[3];
+            position(i, f, nm, p);
+            Position3d &q = truth[(size_t)f*nm+i];
+            q.x = (float)p[0]; q.y = (float)p[1]; q.z = (float)p[2];
+            float *c = &raw[((size_t)f*nm+i)*ns];
+            for(int s=0; s<ns; ++s) {
+                c[s] = t.project(s, p);
+                if(c[s] > MAX_NEGATIVE)
+                    c[s] += (float)noise(gen);
+                if(uniform(gen) < o.occlusion)
+                    c[s] = BAD_FLOAT;
+            }
+        }
+    }
+
+    printf("%d frames of %d markers, %d sensors\n", o.frames, nm, ns);
+
+    std::vector<Position3d> ref(truth.size()), out(truth.size());
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    long long ref_found = 0;
+    for(size_t j=0; j<ref.size(); ++j) {
+        if(reference(t, &raw[j*ns], ref[j]))
+            ++ref_found;
+        else
+            ref[j].x = ref[j].y = ref[j].z = BAD_FLOAT;
+    }
+    double ref_s = seconds_since(t0);
+    printf("%-16s %12.0f frames/s\n", "per marker", o.frames/ref_s);
+
+    long long found = 0;
+    for(int n=1; n<=o.threads; n*=2) {
+        t0 = std::chrono::steady_clock::now();
+        found = t.triangulate_frames(&raw[0], o.frames, nm, &out[0], n);
+        double s = seconds_since(t0);
+        char name[32];
+        snprintf(name, sizeof(name), "%d thread%s", n, n > 1 ? "s" : "");
+        printf("%-16s %12.0f frames/s %8.1fx\n", name, o.frames/s, ref_s/s);
+    }
+
+    std::vector<double> err;
+    double diff = 0.;
+    long long disagree = 0;
+    for(size_t j=0; j<out.size(); ++j) {
+        bool a = is_valid(out[j]), b = is_valid(ref[j]);
+        if(a != b) {
+            ++disagree;
+            continue;
+        }
+        if(!a)
+            continue;
+        double dx = out[j].x-truth[j].x, dy = out[j].y-truth[j].y, dz = out[j].z-truth[j].z;
+        err.push_back(sqrt(dx*dx+dy*dy+dz*dz));
+        diff = std::max(diff, (double)fabs(out[j].x-ref[j].x));
+        diff = std::max(diff, (double)fabs(out[j].y-ref[j].y));
+        diff = std::max(diff, (double)fabs(out[j].z-ref[j].z));
+    }
+    std::sort(err.begin(), err.end());
+    if(err.empty()) {
+        printf("no markers triangulated\n");
+        return 1;
+    }
+    // Markers right at max_residual may be kept by one and dropped by
+    // the other, rounding differently.
+    printf("found %lld of %zu (per marker %lld), error p50 %.4f p99 %.4f mm, "
+            "largest difference %.2e mm, %lld kept by only one\n",
+            found, out.size(), ref_found, err[err.size()/2], err[err.size()*99/100], diff, disagree);
+    return diff > 1e-3 || disagree*1000 > (long long)out.size() ? 1 : 0;
+}
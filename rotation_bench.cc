@@ -0,0 +1,340 @@
+/**
+ *@file rotation_bench.cc
+ *@brief Times the batch rotation kernels against converting one
+ * RotationRep at a time, and checks that the two agree.
+ *
+ * Then checks FixedRotationRep and FixedPose against RotationRep and Pose
+ * the same way, and against the conventions FixedPose.h states: Euler
+ * angles give R = Rz*Ry*Rx, multiplied out from the rotations about each
+ * axis; quaternions come out with q0 >= 0, and q and -q give the same
+ * rotation.  Returns 1 if anything disagrees by more than 1e-12.
+ *
+ * rotation_bench [num_rotations [repeats]]
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "FixedPose.h"
+#include "Pose.h"
+#include "RotationKernels.h"
+
+using namespace BVL;
+
+namespace {
+
+    const double TOLERANCE = 1e-12;
+
+    struct Trajectory {
+        Trajectory(size_t n)
+            :e(3*n), q(4*n), m(9*n)
+        {
+            euler.rx = &e[0]; euler.ry = &e[n]; euler.rz = &e[2*n];
+            for(int k=0; k<4; ++k)
+                qk[k] = &q[k*n];
+            quaternion.q0 = qk[0]; quaternion.q1 = qk[1];
+            quaternion.q2 = qk[2]; quaternion.q3 = qk[3];
+            for(int k=0; k<9; ++k)
+                matrix.r[k] = &m[k*n];
+        }
+
+        std::vector<double> e, q, m;
+        double *qk[4];
+        EulerArrays euler;
+        QuaternionArrays quaternion;
+        MatrixArrays matrix;
+    };
+
+    double seconds_since(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+    }
+
+    template <class F>
+    double best_of(int repeats, F f)
+    {
+        double best = 1e30;
+        for(int r=0; r<repeats; ++r) {
+            std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+            f();
+            double s = seconds_since(t);
+            if(s < best)
+                best = s;
+        }
+        return best;
+    }
+
+    bool report(const char *name, size_t n, double per_pose, double batch, double err)
+    {
+        printf("%-22s %10.1f %10.1f %8.1fx   %.2e%s\n", name,
+                per_pose*1e9/n, batch*1e9/n, per_pose/batch, err,
+                err > TOLERANCE ? "  FAIL" : "");
+        return err <= TOLERANCE;
+    }
+
+    // negative: quaternions that came out with q0 < 0.
+    bool agree(const char *name, double err, size_t negative)
+    {
+        bool ok = err <= TOLERANCE && !negative;
+        printf("%-22s %.2e, %zu with q0 < 0%s\n", name, err, negative, ok ? "" : "  FAIL");
+        return ok;
+    }
+
+    // c = a*b, all 3x3 row-major.
+    void multiply(const double a[9], const double b[9], double c[9])
+    {
+        for(int i=0; i<3; ++i) {
+            for(int j=0; j<3; ++j)
+                c[3*i+j] = a[3*i]*b[j]+a[3*i+1]*b[3+j]+a[3*i+2]*b[6+j];
+        }
+    }
+
+    // Rz*Ry*Rx, from the rotations about each fixed axis.
+    void euler_product(double rx, double ry, double rz, double r[9])
+    {
+        const double x[9] = { 1., 0., 0.,  0., cos(rx), -sin(rx),  0., sin(rx), cos(rx) };
+        const double y[9] = { cos(ry), 0., sin(ry),  0., 1., 0.,  -sin(ry), 0., cos(ry) };
+        const double z[9] = { cos(rz), -sin(rz), 0.,  sin(rz), cos(rz), 0.,  0., 0., 1. };
+        double zy[9];
+        multiply(z, y, zy);
+        multiply(zy, x, r);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], 0, 10) : 100000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    if(n == 0 || repeats <= 0) {
+        fprintf(stderr, "usage: %s [num_rotations [repeats]]\n", argv[0]);
+        return 1;
+    }
+
+    // Away from gimbal lock, where the Euler angles are unique.
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI), pitch(-1.5, 1.5);
+    Trajectory in(n), ref(n), out(n);
+    for(size_t i=0; i<n; ++i) {
+        in.euler.rx[i] = angle(gen);
+        in.euler.ry[i] = pitch(gen);
+        in.euler.rz[i] = angle(gen);
+    }
+    batch_euler_to_matrix(n, in.euler, in.matrix);
+    batch_euler_to_quaternion(n, in.euler, in.quaternion);
+
+    printf("%zu rotations, %s kernels\n", n, batch_kernel_isa());
+    printf("%-22s %10s %10s %9s   %s\n", "", "ns/pose", "ns/batch", "speedup", "max error");
+
+    RotationRep rep;
+    double per_pose, batch, err;
+    bool ok = true;
+
+    // euler -> matrix
+    per_pose = best_of(repeats, [&] {
+        for(size_t i=0; i<n; ++i) {
+            rep.set_euler(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i]);
+            rep.get_matrix();
+            for(int k=0; k<9; ++k)
+                ref.matrix.r[k][i] = rep.matrix(k/3+1, k%3+1);
+        }
+    });
+    batch = best_of(repeats, [&] { batch_euler_to_matrix(n, in.euler, out.matrix); });
+    err = 0.;
+    for(size_t j=0; j<9*n; ++j)
+        err = fmax(err, fabs(ref.m[j]-out.m[j]));
+    ok = report("euler -> matrix", n, per_pose, batch, err) && ok;
+
+    // euler -> quaternion
+    per_pose = best_of(repeats, [&] {
+        for(size_t i=0; i<n; ++i) {
+            rep.set_euler(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i]);
+            rep.get_quaternion();
+            for(int k=0; k<4; ++k)
+                ref.qk[k][i] = rep.quaternion[k];
+        }
+    });
+    batch = best_of(repeats, [&] { batch_euler_to_quaternion(n, in.euler, out.quaternion); });
+    err = 0.;
+    for(size_t j=0; j<4*n; ++j)
+        err = fmax(err, fabs(ref.q[j]-out.q[j]));
+    ok = report("euler -> quaternion", n, per_pose, batch, err) && ok;
+
+    // matrix -> euler
+    per_pose = best_of(repeats, [&] {
+        Matrix<double> r(3, 3);
+        for(size_t i=0; i<n; ++i) {
+            for(int k=0; k<9; ++k)
+                r(k/3+1, k%3+1) = in.matrix.r[k][i];
+            rep.set_matrix(r);
+            rep.get_euler();
+            ref.euler.rx[i] = rep.euler[0];
+            ref.euler.ry[i] = rep.euler[1];
+            ref.euler.rz[i] = rep.euler[2];
+        }
+    });
+    batch = best_of(repeats, [&] { batch_matrix_to_euler(n, in.matrix, out.euler); });
+    err = 0.;
+    for(size_t j=0; j<3*n; ++j)
+        err = fmax(err, fabs(ref.e[j]-out.e[j]));
+    ok = report("matrix -> euler", n, per_pose, batch, err) && ok;
+
+    // matrix -> quaternion
+    per_pose = best_of(repeats, [&] {
+        Matrix<double> r(3, 3);
+        for(size_t i=0; i<n; ++i) {
+            for(int k=0; k<9; ++k)
+                r(k/3+1, k%3+1) = in.matrix.r[k][i];
+            rep.set_matrix(r);
+            rep.get_quaternion();
+            for(int k=0; k<4; ++k)
+                ref.qk[k][i] = rep.quaternion[k];
+        }
+    });
+    batch = best_of(repeats, [&] { batch_matrix_to_quaternion(n, in.matrix, out.quaternion); });
+    err = 0.;
+    for(size_t j=0; j<4*n; ++j)
+        err = fmax(err, fabs(ref.q[j]-out.q[j]));
+    ok = report("matrix -> quaternion", n, per_pose, batch, err) && ok;
+
+    // quaternion -> euler
+    per_pose = best_of(repeats, [&] {
+        for(size_t i=0; i<n; ++i) {
+            rep.set_quaternion(in.quaternion.q0[i], in.quaternion.q1[i],
+                    in.quaternion.q2[i], in.quaternion.q3[i]);
+            rep.get_euler();
+            ref.euler.rx[i] = rep.euler[0];
+            ref.euler.ry[i] = rep.euler[1];
+            ref.euler.rz[i] = rep.euler[2];
+        }
+    });
+    batch = best_of(repeats, [&] { batch_quaternion_to_euler(n, in.quaternion, out.euler); });
+    err = 0.;
+    for(size_t j=0; j<3*n; ++j)
+        err = fmax(err, fabs(ref.e[j]-out.e[j]));
+    ok = report("quaternion -> euler", n, per_pose, batch, err) && ok;
+
+    // quaternion -> matrix
+    per_pose = best_of(repeats, [&] {
+        for(size_t i=0; i<n; ++i) {
+            rep.set_quaternion(in.quaternion.q0[i], in.quaternion.q1[i],
+                    in.quaternion.q2[i], in.quaternion.q3[i]);
+            rep.get_matrix();
+            for(int k=0; k<9; ++k)
+                ref.matrix.r[k][i] = rep.matrix(k/3+1, k%3+1);
+        }
+    });
+    batch = best_of(repeats, [&] { batch_quaternion_to_matrix(n, in.quaternion, out.matrix); });
+    err = 0.;
+    for(size_t j=0; j<9*n; ++j)
+        err = fmax(err, fabs(ref.m[j]-out.m[j]));
+    ok = report("quaternion -> matrix", n, per_pose, batch, err) && ok;
+
+    printf("\nFixedRotationRep and FixedPose against RotationRep and Pose\n");
+    FixedRotationRep fixed;
+    double r[9], product[9];
+    size_t negative;
+
+    // euler -> matrix, and R = Rz*Ry*Rx
+    err = 0.;
+    for(size_t i=0; i<n; ++i) {
+        rep.set_euler(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i]);
+        rep.get_matrix();
+        fixed.set_euler(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i]);
+        fixed.get_matrix();
+        euler_product(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i], product);
+        for(int k=0; k<9; ++k) {
+            err = fmax(err, fabs(fixed.matrix[k]-rep.matrix(k/3+1, k%3+1)));
+            err = fmax(err, fabs(fixed.matrix[k]-product[k]));
+        }
+    }
+    ok = agree("euler -> matrix", err, 0) && ok;
+
+    // euler -> quaternion, with RotationRep's sign
+    err = 0.;
+    negative = 0;
+    for(size_t i=0; i<n; ++i) {
+        rep.set_euler(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i]);
+        rep.get_quaternion();
+        fixed.set_euler(in.euler.rx[i], in.euler.ry[i], in.euler.rz[i]);
+        fixed.get_quaternion();
+        for(int k=0; k<4; ++k)
+            err = fmax(err, fabs(fixed.quaternion[k]-rep.quaternion[k]));
+        negative += fixed.quaternion[0] < 0. || rep.quaternion[0] < 0.;
+    }
+    ok = agree("euler -> quaternion", err, negative) && ok;
+
+    // matrix -> euler and quaternion
+    err = 0.;
+    negative = 0;
+    {
+        Matrix<double> m(3, 3);
+        for(size_t i=0; i<n; ++i) {
+            for(int k=0; k<9; ++k)
+                m(k/3+1, k%3+1) = r[k] = in.matrix.r[k][i];
+            rep.set_matrix(m);
+            rep.get_euler();
+            rep.get_quaternion();
+            fixed.set_matrix(r);
+            fixed.get_euler();
+            fixed.get_quaternion();
+            for(int k=0; k<3; ++k)
+                err = fmax(err, fabs(fixed.euler[k]-rep.euler[k]));
+            for(int k=0; k<4; ++k)
+                err = fmax(err, fabs(fixed.quaternion[k]-rep.quaternion[k]));
+            negative += fixed.quaternion[0] < 0. || rep.quaternion[0] < 0.;
+        }
+    }
+    ok = agree("matrix -> euler, quat", err, negative) && ok;
+
+    // -q -> matrix and euler, against RotationRep from q
+    err = 0.;
+    for(size_t i=0; i<n; ++i) {
+        const double q[4] = { in.quaternion.q0[i], in.quaternion.q1[i], in.quaternion.q2[i], in.quaternion.q3[i] };
+        rep.set_quaternion(q[0], q[1], q[2], q[3]);
+        rep.get_matrix();
+        rep.get_euler();
+        fixed.set_quaternion(-q[0], -q[1], -q[2], -q[3]);
+        fixed.get_matrix();
+        fixed.get_euler();
+        for(int k=0; k<9; ++k)
+            err = fmax(err, fabs(fixed.matrix[k]-rep.matrix(k/3+1, k%3+1)));
+        for(int k=0; k<3; ++k)
+            err = fmax(err, fabs(fixed.euler[k]-rep.euler[k]));
+    }
+    ok = agree("-quat -> matrix, euler", err, 0) && ok;
+
+    // Pose -> FixedPose -> Pose
+    err = 0.;
+    negative = 0;
+    {
+        Matrix<double> m(3, 3);
+        Vector<double> t(3);
+        for(size_t i=0; i<n; ++i) {
+            for(int k=0; k<9; ++k)
+                m(k/3+1, k%3+1) = in.matrix.r[k][i];
+            t[0] = (double)i; t[1] = 2.*i; t[2] = -3.*i;
+            Pose p(m, t);
+            FixedPose f(p);
+            Pose back = f.to_pose();
+            double a[4], b[4], c[3], d[3], x, y, z;
+            p.get_quaternion(a[0], a[1], a[2], a[3]);
+            f.get_quaternion(b[0], b[1], b[2], b[3]);
+            for(int k=0; k<4; ++k)
+                err = fmax(err, fabs(a[k]-b[k]));
+            negative += a[0] < 0. || b[0] < 0.;
+            p.get_euler_angles(c[0], c[1], c[2]);
+            back.get_euler_angles(d[0], d[1], d[2]);
+            for(int k=0; k<3; ++k)
+                err = fmax(err, fabs(c[k]-d[k]));
+            back.get_translation(x, y, z);
+            err = fmax(err, fmax(fabs(x-t[0]), fmax(fabs(y-t[1]), fabs(z-t[2]))));
+        }
+    }
+    ok = agree("Pose <-> FixedPose", err, negative) && ok;
+
+    return ok ? 0 : 1;
+}